@@ -1,6 +1,14 @@
 #ifdef GEOS_BENCH
 #include <geos_c.h>
 #endif
+#include <pthread.h>
+#include <unistd.h>
+#include <dirent.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
 #include "tests.h"
 
 size_t bmalloc_heap_size();
@@ -33,6 +41,338 @@ void print_end_bold() {
     printf("\n");
 }
 
+// Hardware performance counters, which are enabled with PERF=1 on Linux.
+// The counters are measured around the timed part of each run, and the
+// counts of the fastest run are reported per operation under each row.
+
+enum {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_BRANCH_MISSES,
+    PERF_L1D_MISSES,
+    PERF_LLC_MISSES,
+    PERF_NCOUNTERS,
+};
+
+struct perf_counts {
+    bool valid;
+    double secs;                  // duration of the run
+    double vals[PERF_NCOUNTERS];  // per operation, negative if unavailable
+};
+
+static bool perf_enabled = false;
+static int perf_fds[PERF_NCOUNTERS];
+static struct perf_counts perf_row = { 0 };
+
+#ifdef __linux__
+static int perf_open(uint32_t type, uint64_t config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | 
+        PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+void perf_init(void) {
+    for (int i = 0; i < PERF_NCOUNTERS; i++) {
+        perf_fds[i] = -1;
+    }
+    const char *env = getenv("PERF");
+    if (!env || strcmp(env, "1") != 0) {
+        return;
+    }
+#ifdef __linux__
+    uint64_t l1d_miss = PERF_COUNT_HW_CACHE_L1D |
+        (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    perf_fds[PERF_CYCLES] = 
+        perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    perf_fds[PERF_INSTRUCTIONS] = 
+        perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    perf_fds[PERF_BRANCH_MISSES] = 
+        perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+    perf_fds[PERF_L1D_MISSES] = perf_open(PERF_TYPE_HW_CACHE, l1d_miss);
+    perf_fds[PERF_LLC_MISSES] = 
+        perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    for (int i = 0; i < PERF_NCOUNTERS; i++) {
+        if (perf_fds[i] != -1) {
+            perf_enabled = true;
+        }
+    }
+    if (perf_enabled) {
+        printf("PERF=1\n");
+    } else {
+        printf("PERF: counters not available (%s)\n", strerror(errno));
+    }
+#else
+    printf("PERF: counters are only available on Linux\n");
+#endif
+}
+
+void perf_start(void) {
+#ifdef __linux__
+    for (int i = 0; i < PERF_NCOUNTERS; i++) {
+        if (perf_fds[i] != -1) {
+            ioctl(perf_fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(perf_fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#endif
+}
+
+// Stop the counters for a run that took secs for nops operations. The
+// counts are kept when the run is the fastest of the current row.
+void perf_stop(double secs, double nops) {
+    if (!perf_enabled) {
+        return;
+    }
+    struct perf_counts counts = { .valid = true, .secs = secs };
+    for (int i = 0; i < PERF_NCOUNTERS; i++) {
+        counts.vals[i] = -1;
+#ifdef __linux__
+        if (perf_fds[i] == -1) {
+            continue;
+        }
+        ioctl(perf_fds[i], PERF_EVENT_IOC_DISABLE, 0);
+        uint64_t vals[3];
+        if (read(perf_fds[i], vals, sizeof(vals)) != sizeof(vals) || 
+            vals[2] == 0)
+        {
+            continue;
+        }
+        // scale for multiplexing when there are too few hardware counters
+        double count = (double)vals[0] * ((double)vals[1]/(double)vals[2]);
+        counts.vals[i] = count/nops;
+#endif
+    }
+    if (!perf_row.valid || secs < perf_row.secs) {
+        perf_row = counts;
+    }
+}
+
+static void perf_print_val(const char *name, double val, int prec) {
+    if (val >= 0) {
+        printf("  %s %.*f", name, prec, val);
+    } else {
+        printf("  %s n/a", name);
+    }
+}
+
+void perf_print(void) {
+    if (!perf_row.valid) {
+        return;
+    }
+    double *vals = perf_row.vals;
+    printf("%15s", "");
+    perf_print_val("cycles/op", vals[PERF_CYCLES], 1);
+    if (vals[PERF_CYCLES] > 0 && vals[PERF_INSTRUCTIONS] >= 0) {
+        printf("  ipc %.2f", vals[PERF_INSTRUCTIONS]/vals[PERF_CYCLES]);
+    } else {
+        printf("  ipc n/a");
+    }
+    perf_print_val("br-miss/op", vals[PERF_BRANCH_MISSES], 2);
+    perf_print_val("L1d-miss/op", vals[PERF_L1D_MISSES], 2);
+    perf_print_val("LLC-miss/op", vals[PERF_LLC_MISSES], 2);
+    printf("\n");
+}
+
+// Machine readable results, which are written to the OUTPUT file as JSON or
+// CSV, depending on the file extension. Each row also has the ns/op of every
+// run, which is used by benchcmp.c for noise-aware comparisons.
+
+struct bench_row {
+    char section[32];
+    char group[32];
+    char name[64];
+    double ops_sec;
+    double ns_op;
+    double build_us;
+    int64_t bytes;
+    int64_t allocs;
+    int points;
+    int hits;
+    int nsamples;
+    double *samples;
+    struct perf_counts perf;
+};
+
+static struct bench_row *rows = NULL;
+static int nrows = 0;
+static int rows_cap = 0;
+static char cur_section[32] = "";
+static char cur_group[32] = "";
+static uint64_t bench_seed = 0;
+
+void set_section(const char *section) {
+    assert(strlen(section) < sizeof(cur_section));
+    snprintf(cur_section, sizeof(cur_section), "%s", section);
+}
+
+void set_group(const char *group) {
+    assert(strlen(group) < sizeof(cur_group));
+    snprintf(cur_group, sizeof(cur_group), "%s", group);
+}
+
+void record_row(const char *name, double ops_sec, double ns_op, 
+    double build_us, int64_t bytes, int64_t allocs, int points, int hits,
+    const double *samples, int nsamples)
+{
+    if (nrows == rows_cap) {
+        rows_cap = rows_cap == 0 ? 64 : rows_cap*2;
+        rows = realloc(rows, rows_cap*sizeof(struct bench_row));
+        assert(rows);
+    }
+    struct bench_row *row = &rows[nrows++];
+    memset(row, 0, sizeof(struct bench_row));
+    assert(strlen(name) < sizeof(row->name));
+    snprintf(row->section, sizeof(row->section), "%s", cur_section);
+    snprintf(row->group, sizeof(row->group), "%s", cur_group);
+    snprintf(row->name, sizeof(row->name), "%s", name);
+    row->ops_sec = ops_sec;
+    row->ns_op = ns_op;
+    row->build_us = build_us;
+    row->bytes = bytes;
+    row->allocs = allocs;
+    row->points = points;
+    row->hits = hits;
+    row->nsamples = nsamples;
+    row->samples = malloc((nsamples+1)*sizeof(double));
+    assert(row->samples);
+    memcpy(row->samples, samples, nsamples*sizeof(double));
+    // the counters belong to this row, which is printed before recording
+    perf_print();
+    row->perf = perf_row;
+    memset(&perf_row, 0, sizeof(struct perf_counts));
+}
+
+static const char *perf_names[] = {
+    "cycles", "instructions", "branch_misses", "l1d_misses", "llc_misses",
+};
+
+static void write_perf_val(FILE *f, struct bench_row *row, int i) {
+    if (row->perf.valid && row->perf.vals[i] >= 0) {
+        fprintf(f, "%.3f", row->perf.vals[i]);
+    } else {
+        fprintf(f, "%s", "null");
+    }
+}
+
+static bool has_suffix(const char *str, const char *suffix) {
+    size_t n = strlen(str);
+    size_t m = strlen(suffix);
+    return n >= m && strcmp(str+n-m, suffix) == 0;
+}
+
+// Writes a CSV field, which is quoted when it has a comma, quote, or newline.
+static void write_csv_field(FILE *f, const char *str) {
+    if (!strpbrk(str, ",\"\r\n")) {
+        fprintf(f, "%s,", str);
+        return;
+    }
+    fputc('"', f);
+    for (; *str; str++) {
+        if (*str == '"') {
+            fputc('"', f);
+        }
+        fputc(*str, f);
+    }
+    fprintf(f, "\",");
+}
+
+// Writes a JSON string, escaping quotes, backslashes, and control characters.
+static void write_json_string(FILE *f, const char *str) {
+    fputc('"', f);
+    for (; *str; str++) {
+        unsigned char c = *str;
+        if (c == '"' || c == '\\') {
+            fprintf(f, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(f, "\\u%04x", c);
+        } else {
+            fputc(c, f);
+        }
+    }
+    fputc('"', f);
+}
+
+void write_results(const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        exit(1);
+    }
+    const char *commit = getenv("COMMIT")?getenv("COMMIT"):"";
+    bool csv = has_suffix(path, ".csv");
+    if (csv) {
+        fprintf(f, "section,group,name,ops_sec,ns_op,build_us,bytes,allocs,"
+            "points,hits,seed,commit,samples_ns");
+        for (int i = 0; i < PERF_NCOUNTERS; i++) {
+            fprintf(f, ",%s_op", perf_names[i]);
+        }
+        fprintf(f, "\n");
+    } else {
+        fprintf(f, "[\n");
+    }
+    for (int i = 0; i < nrows; i++) {
+        struct bench_row *row = &rows[i];
+        if (csv) {
+            write_csv_field(f, row->section);
+            write_csv_field(f, row->group);
+            write_csv_field(f, row->name);
+            fprintf(f, "%.2f,%.2f,%.2f,%lld,%lld,%d,%d,%llu,", row->ops_sec, 
+                row->ns_op, row->build_us, (long long)row->bytes, 
+                (long long)row->allocs, row->points, row->hits,
+                (unsigned long long)bench_seed);
+            write_csv_field(f, commit);
+            for (int j = 0; j < row->nsamples; j++) {
+                fprintf(f, "%s%.2f", j == 0 ? "" : ";", row->samples[j]);
+            }
+            for (int j = 0; j < PERF_NCOUNTERS; j++) {
+                fprintf(f, ",");
+                if (row->perf.valid && row->perf.vals[j] >= 0) {
+                    fprintf(f, "%.3f", row->perf.vals[j]);
+                }
+            }
+            fprintf(f, "\n");
+        } else {
+            fprintf(f, "  {\"section\":");
+            write_json_string(f, row->section);
+            fprintf(f, ",\"group\":");
+            write_json_string(f, row->group);
+            fprintf(f, ",\"name\":");
+            write_json_string(f, row->name);
+            fprintf(f, ",\"ops_sec\":%.2f,\"ns_op\":%.2f,"
+                "\"build_us\":%.2f,\"bytes\":%lld,\"allocs\":%lld,"
+                "\"points\":%d,\"hits\":%d,\"seed\":%llu,\"commit\":",
+                row->ops_sec, row->ns_op, row->build_us, 
+                (long long)row->bytes, (long long)row->allocs, row->points, 
+                row->hits, (unsigned long long)bench_seed);
+            write_json_string(f, commit);
+            fprintf(f, ",\"samples_ns\":[");
+            for (int j = 0; j < row->nsamples; j++) {
+                fprintf(f, "%s%.2f", j == 0 ? "" : ",", row->samples[j]);
+            }
+            fprintf(f, "]");
+            for (int j = 0; j < PERF_NCOUNTERS; j++) {
+                fprintf(f, ",\"%s_op\":", perf_names[j]);
+                write_perf_val(f, row, j);
+            }
+            fprintf(f, "}%s\n", i == nrows-1 ? "" : ",");
+        }
+    }
+    if (!csv) {
+        fprintf(f, "]\n");
+    }
+    fclose(f);
+}
+
 static int64_t *cinv = NULL;
 static int64_t xval = 0;
 static void invalidate_cache() {
@@ -62,6 +402,7 @@ static void bench_step_tg(
     int N,
     double *create_secs_out,
     int *memsize_out,
+    int *allocs_out,
     double *bench_secs_out,
     int *hits_out
 ) {
@@ -77,6 +418,7 @@ static void bench_step_tg(
 
     double start = clock_now();
     size_t heap_start = bmalloc_heap_size();
+    size_t allocs_start = bmalloc_num_allocs();
     struct tg_ring *ring = tg_ring_new_ix(points, npoints, opts);
     assert(ring);
     struct tg_poly *poly = tg_poly_new(ring, NULL, 0);
@@ -84,9 +426,11 @@ static void bench_step_tg(
     size_t heap_end = bmalloc_heap_size();
     *create_secs_out = clock_now()-start;
     *memsize_out = heap_end-heap_start; 
+    *allocs_out = bmalloc_num_allocs()-allocs_start;
     // *memsize_out = tg_poly_memsize(poly);
     char label[64];
     int hits = 0;
+    perf_start();
     start = clock_now();
     for (int i = 0; i < N; i++) {
         if (rpoints) {
@@ -100,6 +444,7 @@ static void bench_step_tg(
         }
     }
     *bench_secs_out = clock_now()-start;
+    perf_stop(*bench_secs_out, N);
     *hits_out = hits;
     tg_poly_free(poly);
     tg_ring_free(ring);
@@ -121,6 +466,7 @@ static void bench_step_geos(
     int N,
     double *create_secs_out,
     int *memsize_out,
+    int *allocs_out,
     double *bench_secs_out,
     int *hits_out
 ) {
@@ -152,6 +498,7 @@ static void bench_step_geos(
     
     double start = clock_now();
     size_t heap_start = bmalloc_heap_size();
+    size_t allocs_start = bmalloc_num_allocs();
     GEOSCoordSequence *seq = GEOSCoordSeq_copyFromBuffer_r(handle, 
         (double*)points, npoints, 0, 0);
     assert(seq);
@@ -195,8 +542,10 @@ static void bench_step_geos(
 
     *create_secs_out = clock_now()-start;
     *memsize_out = heap_end-heap_start;
+    *allocs_out = bmalloc_num_allocs()-allocs_start;
     // do benchmarking
     int hits = 0;
+    perf_start();
     start = clock_now();
     if (prepared) {
         for (int i = 0; i < N; i++) {
@@ -213,6 +562,7 @@ static void bench_step_geos(
     }
 
     *bench_secs_out = clock_now()-start;
+    perf_stop(*bench_secs_out, N);
     *hits_out = hits;
 
     // cleanup
@@ -235,12 +585,14 @@ static void bench_step_geos(
 #define ROW_FIELDS_ENCDEC    "%11s %8.0f %7.0f"
 
 void print_header(const char *name) {
+    set_group(name);
     print_start_bold();
     printf("%-15s " HEADER_FIELDS, name, "ops/sec", "ns/op", "points", "hits", "built", "bytes");
     print_end_bold();
 }
 
 void print_header_io(const char *name) {
+    set_group(name);
     print_start_bold();
     printf("%-15s " HEADER_FIELDS_ENCDEC, name, "ops/sec", "ns/op", "MB/sec");
     print_end_bold();
@@ -266,7 +618,10 @@ void bench_run(int runs, const char *name, char *libname, char *ixname,
     double create_secs = 0;
     double bench_secs = 0;
     int memsize = 0;
+    int allocs = 0;
     int hits = 0;
+    double *samples = malloc(runs*sizeof(double));
+    assert(samples);
 
     char label[64];
     // snprintf(label, sizeof(label), "%s/%s/%s", name, libname, ixname);
@@ -280,23 +635,26 @@ void bench_run(int runs, const char *name, char *libname, char *ixname,
         double create_secs0 = 0;
         double bench_secs0 = 0;
         int memsize0 = 0;
+        int allocs0 = 0;
         int hits0 = 0;
     #ifdef GEOS_BENCH
         if (strcmp(libname, "geos") == 0) {
             bool prepared = strcmp(ixname, "prepared") == 0;
             bench_step_geos(prepared, points, npoints, rpoints, rsegs, N, 
-                &create_secs0, &memsize0, &bench_secs0, &hits0);
+                &create_secs0, &memsize0, &allocs0, &bench_secs0, &hits0);
         } else
     #endif
         {
             bench_step_tg(opts, points, npoints, rpoints, rsegs, N, 
-                &create_secs0, &memsize0, &bench_secs0, &hits0);
+                &create_secs0, &memsize0, &allocs0, &bench_secs0, &hits0);
         }
         create_secs_sum += create_secs0;
+        samples[i] = bench_secs0/N*1e9;
         if (i == 0) {
             create_secs = create_secs0;
             bench_secs = bench_secs0;
             memsize = memsize0;
+            allocs = allocs0;
             hits = hits0;
         } else {
             if (create_secs0 < create_secs && create_secs0 > 0.0) {
@@ -320,6 +678,9 @@ void bench_run(int runs, const char *name, char *libname, char *ixname,
         commaize(N/bench_secs), bench_secs/N*1e9, 
         npoints, hits, create_secs*1e6, commaize(memsize));
     printf("\n");
+    record_row(label, N/bench_secs, bench_secs/N*1e9, create_secs*1e6, 
+        memsize, allocs, npoints, hits, samples, runs);
+    free(samples);
 }
 
 struct tg_rect rect_from_points(const struct tg_point points[], int npoints) {
@@ -509,6 +870,7 @@ void test_intersects_bench_rand_polygon(int runs, int npoints) {
 }
 
 void main_pip_bench(uint64_t seed, int runs, bool simple) {
+    set_section("pip");
     srand(seed);
     print_start_bold();
     printf("== Point-in-polygon ==");
@@ -554,6 +916,7 @@ void main_pip_bench(uint64_t seed, int runs, bool simple) {
 }
 
 void main_intersects_bench(uint64_t seed, int runs) {
+    set_section("intersects");
     srand(seed); 
     print_start_bold();
     printf("== Line intersect ==");
@@ -602,6 +965,8 @@ void read_bench_run(int runs, char *name, char *libname, char *kind, char *data,
     double start;
 
     int subruns = 10;
+    double *samples = malloc(runs*sizeof(double));
+    assert(samples);
     for (int i = 0; i < runs; i++) {
         invalidate_cache();
         if (!markdown) {
@@ -609,6 +974,7 @@ void read_bench_run(int runs, char *name, char *libname, char *kind, char *data,
         }
         // printf("\r%-18s %2d ", label, i+1); 
         fflush(stdout);
+        perf_start();
         double nsecs;
         if (strcmp(libname, "tg") == 0) {
             if (strcmp(kind, "wkb") == 0) { 
@@ -702,6 +1068,8 @@ void read_bench_run(int runs, char *name, char *libname, char *kind, char *data,
             abort();
         }
 
+        perf_stop(nsecs, subruns);
+        samples[i] = nsecs*1e9;
         if (i == 0 || (nsecs < bench_secs && nsecs > 0)) {
             bench_secs = nsecs;
         }
@@ -713,6 +1081,9 @@ void read_bench_run(int runs, char *name, char *libname, char *kind, char *data,
     printf(ROW_FIELDS_ENCDEC, commaize(1/bench_secs), bench_secs/1*1e9, 
         ((double)len)/bench_secs/1024.0/1024.0);
     printf("\n");
+    record_row(label, 1/bench_secs, bench_secs*1e9, 0, len, 0, 0, 0, 
+        samples, runs);
+    free(samples);
 }
 
 
@@ -725,6 +1096,8 @@ void write_bench_run(int runs, char *name, char *libname, char *kind, char *data
     double start;
 
     int subruns = 10;
+    double *samples = malloc(runs*sizeof(double));
+    assert(samples);
     for (int i = 0; i < runs; i++) {
         invalidate_cache();
         if (!markdown) {
@@ -732,6 +1105,7 @@ void write_bench_run(int runs, char *name, char *libname, char *kind, char *data
         }
         // printf("\r%-18s %2d ", label, i+1); 
         fflush(stdout);
+        perf_start();
         double nsecs;
         if (strcmp(libname, "tg") == 0) {
             struct tg_geom *geom = tg_parse_wkb_ix((uint8_t*)data, len, TG_NONE);
@@ -829,6 +1203,8 @@ void write_bench_run(int runs, char *name, char *libname, char *kind, char *data
             abort();
         }
 
+        perf_stop(nsecs, subruns);
+        samples[i] = nsecs*1e9;
         if (i == 0 || (nsecs < bench_secs && nsecs > 0)) {
             bench_secs = nsecs;
         }
@@ -840,6 +1216,9 @@ void write_bench_run(int runs, char *name, char *libname, char *kind, char *data
     printf(ROW_FIELDS_ENCDEC, commaize(1/bench_secs), bench_secs/1*1e9, 
         ((double)len)/bench_secs/1024.0/1024.0);
     printf("\n");
+    record_row(label, 1/bench_secs, bench_secs*1e9, 0, len, 0, 0, 0, 
+        samples, runs);
+    free(samples);
 }
 
 
@@ -898,6 +1277,7 @@ void test_io_bench(int runs, char *name) {
 
 
 void main_io_bench(uint64_t seed, int runs) {
+    set_section("io");
     print_start_bold();
     printf("== I/O ==");
     print_end_bold();
@@ -920,40 +1300,2391 @@ void main_io_bench(uint64_t seed, int runs) {
     test_io_bench(runs, "ri");
 }
 
-int main(int argc, char **argv) {
-    tg_env_set_allocator(bmalloc, brealloc, bfree);
-    markdown = atoi(getenv("MARKDOWN")?getenv("MARKDOWN"):"0");
-    uint64_t seed = strtoull(getenv("SEED")?getenv("SEED"):"0", NULL, 10);
-    if (!seed) seed = mkrandseed();
+// Predicates benchmark
 
-    int runs = atoi(getenv("RUNS")?getenv("RUNS"):"0");
-    if (runs <= 0) runs = 10;
+#define NUM_RAND_GEOMS     1000  // number of random geometries, Predicates
+#define NUM_PARTS          100   // number of parts in multi geometries
+#define NUM_EQUAL_GEOMS    20    // number of equal copies, Predicates
+#define NUM_MULTIPOINTS    10    // number of multipoints, Predicates
+#define MULTIPOINT_SIZE    50000 // points per multipoint, Predicates
+#define NUM_LONG_LINES     10    // number of long lines, Predicates
+#define LONG_LINE_SIZE     200000 // points per long line, Predicates
+#define MAX_ROW_SECS       2.0   // stop repeating runs of a slow row
 
-    printf("SEED=%llu\n", (unsigned long long)seed);
-    printf("RUNS=%llu\n", (unsigned long long)runs);
+#define HEADER_FIELDS_PRED "%11s %8s %7s %5s %11s %10s"
+#define ROW_FIELDS_PRED    "%11s %8.0f %7d %5d %8.2f µs %10s"
 
-    if (argc == 2) {
-        // run all tests
-        main_pip_bench(seed, runs, false);
-        main_intersects_bench(seed, runs);
-        main_io_bench(seed, runs);
+void print_header_pred(const char *name) {
+    set_group(name);
+    print_start_bold();
+    printf("%-36s " HEADER_FIELDS_PRED, name, "ops/sec", "ns/op", "points", 
+        "hits", "built", "bytes");
+    print_end_bold();
+}
+
+// A random affine copy of a shape that is rotated, scaled to the size of
+// the provided rect times size, and moved to a random location in rect.
+struct tg_point *make_affine_points(const struct tg_point points[], 
+    int npoints, struct tg_rect rect, double size)
+{
+    struct tg_rect mbr = rect_from_points(points, npoints);
+    struct tg_point center = { 
+        (mbr.min.x+mbr.max.x)/2, (mbr.min.y+mbr.max.y)/2 
+    };
+    double scale = fmax(rect.max.x-rect.min.x, rect.max.y-rect.min.y) /
+        fmax(mbr.max.x-mbr.min.x, mbr.max.y-mbr.min.y) * size;
+    struct tg_point to = rand_point(rect);
+    double angle = rand_double()*M_PI*2;
+    double c = cos(angle)*scale;
+    double s = sin(angle)*scale;
+    struct tg_point *apoints = malloc(npoints*sizeof(struct tg_point));
+    assert(apoints);
+    for (int i = 0; i < npoints; i++) {
+        double dx = points[i].x-center.x;
+        double dy = points[i].y-center.y;
+        apoints[i].x = to.x + dx*c - dy*s;
+        apoints[i].y = to.y + dx*s + dy*c;
+    }
+    return apoints;
+}
+
+enum pred_kind { KIND_POLY, KIND_LINE, KIND_MULTIPOLY, KIND_COLLECTION };
+
+// The parts of a geometry that is built from scratch on every run, so that
+// the build time and memory can be measured per index.
+struct pred_target {
+    enum pred_kind kind;
+    int nparts;
+    struct tg_point **parts;
+    int *nparts_points;
+};
+
+struct tg_geom *make_part_geom(const struct tg_point points[], int npoints, 
+    bool line, enum tg_index ix)
+{
+    struct tg_geom *geom;
+    if (line) {
+        struct tg_line *line = tg_line_new_ix(points, npoints, ix);
+        assert(line);
+        geom = tg_geom_new_linestring(line);
+        tg_line_free(line);
     } else {
-        // run specific tests
-        for (int i = 2; i < argc; i++) {
-            if (strcmp(argv[i], "io") == 0 || strcmp(argv[i], "i/o") == 0) {
-                main_io_bench(seed, runs);
+        struct tg_ring *ring = tg_ring_new_ix(points, npoints, ix);
+        assert(ring);
+        geom = tg_geom_new_polygon((struct tg_poly*)ring);
+        tg_ring_free(ring);
+    }
+    assert(geom);
+    return geom;
+}
+
+struct tg_geom *make_pred_geom(struct pred_target *target, enum tg_index ix) {
+    if (target->kind == KIND_POLY || target->kind == KIND_LINE) {
+        return make_part_geom(target->parts[0], target->nparts_points[0], 
+            target->kind == KIND_LINE, ix);
+    }
+    struct tg_geom **geoms = malloc(target->nparts*sizeof(struct tg_geom*));
+    assert(geoms);
+    for (int i = 0; i < target->nparts; i++) {
+        bool line = target->kind == KIND_COLLECTION && i%2 == 1;
+        geoms[i] = make_part_geom(target->parts[i], target->nparts_points[i],
+            line, ix);
+    }
+    struct tg_geom *geom;
+    if (target->kind == KIND_MULTIPOLY) {
+        const struct tg_poly **polys = malloc(target->nparts*sizeof(void*));
+        assert(polys);
+        for (int i = 0; i < target->nparts; i++) {
+            polys[i] = tg_geom_poly(geoms[i]);
+        }
+        geom = tg_geom_new_multipolygon(polys, target->nparts);
+        free(polys);
+    } else {
+        geom = tg_geom_new_geometrycollection(
+            (const struct tg_geom**)geoms, target->nparts);
+    }
+    assert(geom);
+    for (int i = 0; i < target->nparts; i++) {
+        tg_geom_free(geoms[i]);
+    }
+    free(geoms);
+    return geom;
+}
+
+void free_pred_target(struct pred_target *target) {
+    for (int i = 0; i < target->nparts; i++) {
+        free(target->parts[i]);
+    }
+    free(target->parts);
+    free(target->nparts_points);
+}
+
+// A single part target, or a multi part target of affine copies that are
+// spread over the shape's MBR.
+struct pred_target make_pred_target(enum pred_kind kind, 
+    const struct tg_point points[], int npoints)
+{
+    struct pred_target target = { .kind = kind };
+    target.nparts = kind == KIND_POLY || kind == KIND_LINE ? 1 : NUM_PARTS;
+    target.parts = malloc(target.nparts*sizeof(struct tg_point*));
+    target.nparts_points = malloc(target.nparts*sizeof(int));
+    assert(target.parts && target.nparts_points);
+    struct tg_rect rect = rect_from_points(points, npoints);
+    for (int i = 0; i < target.nparts; i++) {
+        if (target.nparts == 1) {
+            target.parts[i] = malloc(npoints*sizeof(struct tg_point));
+            assert(target.parts[i]);
+            memcpy(target.parts[i], points, npoints*sizeof(struct tg_point));
+        } else {
+            target.parts[i] = make_affine_points(points, npoints, rect, 0.1);
+        }
+        target.nparts_points[i] = npoints;
+    }
+    return target;
+}
+
+bool pred_intersects(const struct tg_geom *a, const struct tg_geom *b) {
+    return tg_geom_intersects(a, b);
+}
+
+bool pred_covers(const struct tg_geom *a, const struct tg_geom *b) {
+    return tg_geom_covers(a, b);
+}
+
+bool pred_touches(const struct tg_geom *a, const struct tg_geom *b) {
+    return tg_geom_touches(a, b);
+}
+
+bool pred_equals(const struct tg_geom *a, const struct tg_geom *b) {
+    return tg_geom_equals(a, b);
+}
+
+bool pred_crosses(const struct tg_geom *a, const struct tg_geom *b) {
+    return tg_geom_crosses(a, b);
+}
+
+bool pred_overlaps(const struct tg_geom *a, const struct tg_geom *b) {
+    return tg_geom_overlaps(a, b);
+}
+
+bool pred_intersects_xy(const struct tg_geom *a, const struct tg_geom *b) {
+    struct tg_point point = tg_geom_point(b);
+    return tg_geom_intersects_xy(a, point.x, point.y);
+}
+
+// The tracker is created again when the target geometry changes. It holds a
+// clone of its geometry, so a new target cannot have the same address.
+static struct tg_pip_tracker *pred_tracker = NULL;
+static const struct tg_geom *pred_tracker_geom = NULL;
+
+bool pred_tracker_xy(const struct tg_geom *a, const struct tg_geom *b) {
+    if (a != pred_tracker_geom) {
+        tg_pip_tracker_free(pred_tracker);
+        pred_tracker = tg_pip_tracker_new(a);
+        assert(pred_tracker);
+        pred_tracker_geom = a;
+    }
+    struct tg_point point = tg_geom_point(b);
+    return tg_pip_tracker_intersects_xy(pred_tracker, point.x, point.y);
+}
+
+void free_pred_tracker(void) {
+    tg_pip_tracker_free(pred_tracker);
+    pred_tracker = NULL;
+    pred_tracker_geom = NULL;
+}
+
+// The locator is created again when the target geometry changes, the same
+// as the tracker.
+static struct tg_locator *pred_locator = NULL;
+static const struct tg_geom *pred_locator_geom = NULL;
+
+bool pred_locator_xy(const struct tg_geom *a, const struct tg_geom *b) {
+    if (a != pred_locator_geom) {
+        tg_locator_free(pred_locator);
+        pred_locator = tg_locator_new(a);
+        assert(pred_locator);
+        pred_locator_geom = a;
+    }
+    struct tg_point point = tg_geom_point(b);
+    int index;
+    return tg_locator_find_xy(pred_locator, point.x, point.y, &index, 1) > 0;
+}
+
+void free_pred_locator(void) {
+    tg_locator_free(pred_locator);
+    pred_locator = NULL;
+    pred_locator_geom = NULL;
+}
+
+void pred_bench_run(int runs, const char *workload, char *ixname,
+    struct pred_target *target, 
+    bool(*pred)(const struct tg_geom *a, const struct tg_geom *b),
+    struct tg_geom **geoms, int N)
+{
+    enum tg_index ix = strcmp(ixname, "none") == 0 ? TG_NONE :
+        strcmp(ixname, "natural") == 0 ? TG_NATURAL : TG_YSTRIPES;
+    char label[64];
+    snprintf(label, sizeof(label), "%s/%s", workload, ixname);
+    double create_secs = 0;
+    double bench_secs = 0;
+    int memsize = 0;
+    int hits = 0;
+    int npoints = 0;
+    int allocs = 0;
+    int nsamples = 0;
+    double *samples = malloc(runs*sizeof(double));
+    assert(samples);
+    double row_start = clock_now();
+    for (int i = 0; i < runs; i++) {
+        if (i > 0 && clock_now()-row_start > MAX_ROW_SECS) {
+            break;
+        }
+        invalidate_cache();
+        if (!markdown) {
+            printf("\r%-42s %2d/%d ", label, i+1, runs); 
+        }
+        fflush(stdout);
+        double start = clock_now();
+        size_t heap_start = bmalloc_heap_size();
+        size_t allocs_start = bmalloc_num_allocs();
+        struct tg_geom *geom = make_pred_geom(target, ix);
+        size_t heap_end = bmalloc_heap_size();
+        int allocs0 = bmalloc_num_allocs()-allocs_start;
+        double create_secs0 = clock_now()-start;
+        int hits0 = 0;
+        perf_start();
+        start = clock_now();
+        for (int j = 0; j < N; j++) {
+            if (pred(geom, geoms[j])) {
+                hits0++;
             }
-            if (strcmp(argv[i], "pip") == 0) {
-                main_pip_bench(seed, runs, false);
+        }
+        double bench_secs0 = clock_now()-start;
+        perf_stop(bench_secs0, N);
+        samples[nsamples++] = bench_secs0/N*1e9;
+        npoints = tg_geom_num_points(geom);
+        if (npoints == 0) {
+            for (int j = 0; j < target->nparts; j++) {
+                npoints += target->nparts_points[j];
             }
-            if (strcmp(argv[i], "pip_simple") == 0) {
-                main_pip_bench(seed, runs, true);
+        }
+        tg_geom_free(geom);
+        if (i == 0) {
+            create_secs = create_secs0;
+            bench_secs = bench_secs0;
+            memsize = heap_end-heap_start;
+            allocs = allocs0;
+            hits = hits0;
+        } else {
+            if (create_secs0 < create_secs && create_secs0 > 0.0) {
+                create_secs = create_secs0;
             }
-            if (strcmp(argv[i], "intersects") == 0) {
-                main_intersects_bench(seed, runs);
+            if (bench_secs0 < bench_secs) {
+                bench_secs = bench_secs0;
+            }
+            assert(hits0 == hits);
+        }
+    }
+    if (!markdown) {
+        printf("\r");
+    }
+    printf("%-36s ", label); 
+    printf(ROW_FIELDS_PRED,
+        commaize(N/bench_secs), bench_secs/N*1e9, 
+        npoints, hits, create_secs*1e6, commaize(memsize));
+    printf("\n");
+    record_row(label, N/bench_secs, bench_secs/N*1e9, create_secs*1e6,
+        memsize, allocs, npoints, hits, samples, nsamples);
+    free(samples);
+}
+
+// Creates random affine copies of the query shape as polygons or lines, or
+// random points, that are within the target's MBR with the extra padding.
+struct tg_geom **make_pred_geoms(const struct tg_point points[], int npoints,
+    const struct tg_point qpoints[], int nqpoints, enum pred_kind kind, int N)
+{
+    struct tg_rect rect = rect_from_points(points, npoints);
+    double w = rect.max.x - rect.min.x;
+    double h = rect.max.y - rect.min.y;
+    rect.min.x -= w * MBR_PAD;
+    rect.min.y -= h * MBR_PAD;
+    rect.max.x += w * MBR_PAD;
+    rect.max.y += h * MBR_PAD;
+    struct tg_geom **geoms = malloc(N*sizeof(struct tg_geom*));
+    assert(geoms);
+    for (int i = 0; i < N; i++) {
+        if (kind == KIND_POLY || kind == KIND_LINE) {
+            double size = 0.01 + rand_double()*0.1;
+            struct tg_point *apoints = make_affine_points(qpoints, nqpoints, 
+                rect, size);
+            geoms[i] = make_part_geom(apoints, nqpoints, kind == KIND_LINE, 
+                TG_DEFAULT);
+            free(apoints);
+        } else {
+            geoms[i] = tg_geom_new_point(rand_point(rect));
+            assert(geoms[i]);
+        }
+    }
+    return geoms;
+}
+
+// Creates polygons that are equal to the ring points. Each starts at a
+// random point, and they are in turn exact, rotated, reversed, or with one
+// point repeated.
+struct tg_geom **make_equal_geoms(const struct tg_point points[], int npoints,
+    int N)
+{
+    int n = npoints-1;
+    struct tg_point *points2 = malloc((npoints+1)*sizeof(struct tg_point));
+    struct tg_geom **geoms = malloc(N*sizeof(struct tg_geom*));
+    assert(points2 && geoms);
+    for (int i = 0; i < N; i++) {
+        int start = i%4 == 0 ? 0 : rand()%n;
+        int npoints2 = 0;
+        for (int j = 0; j < n; j++) {
+            int k = i%4 == 2 ? (start-j+n)%n : (start+j)%n;
+            points2[npoints2++] = points[k];
+            if (i%4 == 3 && j == 0) {
+                points2[npoints2++] = points[k];
             }
         }
+        points2[npoints2++] = points2[0];
+        geoms[i] = make_part_geom(points2, npoints2, false, TG_DEFAULT);
+    }
+    free(points2);
+    return geoms;
+}
+
+// Multipoints of random points that are inside of the shape, where every
+// other one also has a single point outside of the shape.
+struct tg_geom **make_multipoint_geoms(const struct tg_point points[], 
+    int npoints, int N)
+{
+    struct tg_ring *ring = tg_ring_new_ix(points, npoints, TG_NATURAL);
+    struct tg_point *mpoints = malloc(MULTIPOINT_SIZE*sizeof(struct tg_point));
+    struct tg_geom **geoms = malloc(N*sizeof(struct tg_geom*));
+    assert(ring && mpoints && geoms);
+    struct tg_rect rect = tg_ring_rect(ring);
+    for (int i = 0; i < N; i++) {
+        for (int j = 0; j < MULTIPOINT_SIZE; j++) {
+            bool inside = !(i%2 == 1 && j == MULTIPOINT_SIZE/2);
+            struct tg_point point;
+            do {
+                point.x = rect.min.x + (rect.max.x-rect.min.x)*rand_double();
+                point.y = rect.min.y + (rect.max.y-rect.min.y)*rand_double();
+            } while (tg_ring_contains_point(ring, point, true).hit != inside);
+            mpoints[j] = point;
+        }
+        geoms[i] = tg_geom_new_multipoint(mpoints, MULTIPOINT_SIZE);
+        assert(geoms[i]);
+    }
+    free(mpoints);
+    tg_ring_free(ring);
+    return geoms;
+}
+
+// Long random walk lines that start outside of the shape, but inside of its
+// MBR.
+struct tg_geom **make_long_line_geoms(const struct tg_point points[], 
+    int npoints, int N)
+{
+    struct tg_ring *ring = tg_ring_new_ix(points, npoints, TG_NATURAL);
+    struct tg_point *lpoints = malloc(LONG_LINE_SIZE*sizeof(struct tg_point));
+    struct tg_geom **geoms = malloc(N*sizeof(struct tg_geom*));
+    assert(ring && lpoints && geoms);
+    struct tg_rect rect = tg_ring_rect(ring);
+    double step = (rect.max.x-rect.min.x)/2000;
+    for (int i = 0; i < N; i++) {
+        do {
+            lpoints[0].x = rect.min.x + (rect.max.x-rect.min.x)*rand_double();
+            lpoints[0].y = rect.min.y + (rect.max.y-rect.min.y)*rand_double();
+        } while (tg_ring_contains_point(ring, lpoints[0], true).hit);
+        double angle = rand_double()*M_PI*2;
+        for (int j = 1; j < LONG_LINE_SIZE; j++) {
+            angle += (rand_double()-0.5)*0.5;
+            lpoints[j].x = lpoints[j-1].x + cos(angle)*step;
+            lpoints[j].y = lpoints[j-1].y + sin(angle)*step;
+        }
+        struct tg_line *line = tg_line_new(lpoints, LONG_LINE_SIZE);
+        assert(line);
+        geoms[i] = tg_geom_new_linestring(line);
+        assert(geoms[i]);
+        tg_line_free(line);
+    }
+    free(lpoints);
+    tg_ring_free(ring);
+    return geoms;
+}
+
+// Points along a random walk in the MBR of the shape, like the positions of
+// a moving vehicle.
+struct tg_geom **make_track_geoms(const struct tg_point points[], int npoints,
+    int N)
+{
+    struct tg_rect rect = rect_from_points(points, npoints);
+    struct tg_geom **geoms = malloc(N*sizeof(struct tg_geom*));
+    assert(geoms);
+    double step = (rect.max.x-rect.min.x)/5000;
+    struct tg_point point = rand_point(rect);
+    double angle = rand_double()*M_PI*2;
+    for (int i = 0; i < N; i++) {
+        geoms[i] = tg_geom_new_point(point);
+        assert(geoms[i]);
+        angle += (rand_double()-0.5)*0.5;
+        point.x += cos(angle)*step;
+        point.y += sin(angle)*step;
+        if (!tg_rect_intersects_point(rect, point)) {
+            angle += M_PI;
+        }
+    }
+    return geoms;
+}
+
+void free_pred_geoms(struct tg_geom **geoms, int N) {
+    for (int i = 0; i < N; i++) {
+        tg_geom_free(geoms[i]);
+    }
+    free(geoms);
+}
+
+void pred_bench_ixs(int runs, const char *workload, struct pred_target *target,
+    bool(*pred)(const struct tg_geom *a, const struct tg_geom *b),
+    struct tg_geom **geoms, int N)
+{
+    pred_bench_run(runs, workload, "none", target, pred, geoms, N);
+    pred_bench_run(runs, workload, "natural", target, pred, geoms, N);
+    pred_bench_run(runs, workload, "ystripes", target, pred, geoms, N);
+}
+
+void test_pred_bench(int runs, const char *name) {
+    struct tg_geom *shape = load_geom(name, TG_NONE);
+    const struct tg_ring *ring = tg_poly_exterior(tg_geom_poly(shape));
+    const struct tg_point *points = tg_ring_points(ring);
+    int npoints = tg_ring_num_points(ring);
+    int N = NUM_RAND_GEOMS;
+
+    // Rhode Island is the query shape
+    struct tg_geom *qshape = load_geom("ri", TG_NONE);
+    const struct tg_ring *qring = tg_poly_exterior(tg_geom_poly(qshape));
+    const struct tg_point *qpoints = tg_ring_points(qring);
+    int nqpoints = tg_ring_num_points(qring);
+
+    struct pred_target poly = make_pred_target(KIND_POLY, points, npoints);
+    struct tg_geom **polys = make_pred_geoms(points, npoints, qpoints, 
+        nqpoints, KIND_POLY, N);
+    pred_bench_ixs(runs, "poly/poly/intersects", &poly, pred_intersects, 
+        polys, N);
+    pred_bench_ixs(runs, "poly/poly/covers", &poly, pred_covers, polys, N);
+    pred_bench_ixs(runs, "poly/poly/touches", &poly, pred_touches, polys, N);
+    pred_bench_ixs(runs, "poly/poly/overlaps", &poly, pred_overlaps, polys, N);
+    struct tg_geom **equals = make_equal_geoms(points, npoints, 
+        NUM_EQUAL_GEOMS);
+    pred_bench_ixs(runs, "poly/poly/equals", &poly, pred_equals, equals, 
+        NUM_EQUAL_GEOMS);
+
+    struct tg_geom **lines = make_pred_geoms(points, npoints, qpoints, 
+        nqpoints, KIND_LINE, N);
+    pred_bench_ixs(runs, "poly/line/intersects", &poly, pred_intersects, 
+        lines, N);
+    pred_bench_ixs(runs, "poly/line/crosses", &poly, pred_crosses, lines, N);
+    struct tg_geom **llines = make_long_line_geoms(points, npoints, 
+        NUM_LONG_LINES);
+    pred_bench_ixs(runs, "poly/longline/intersects", &poly, pred_intersects, 
+        llines, NUM_LONG_LINES);
+
+    struct tg_geom **mpts = make_multipoint_geoms(points, npoints, 
+        NUM_MULTIPOINTS);
+    pred_bench_ixs(runs, "poly/multipoint/covers", &poly, pred_covers, mpts, 
+        NUM_MULTIPOINTS);
+
+    struct tg_geom **track = make_track_geoms(points, npoints, 
+        NUM_RAND_POINTS);
+    pred_bench_ixs(runs, "poly/track/intersects", &poly, pred_intersects_xy, 
+        track, NUM_RAND_POINTS);
+    pred_bench_ixs(runs, "poly/track/tracker", &poly, pred_tracker_xy, 
+        track, NUM_RAND_POINTS);
+    free_pred_tracker();
+
+    struct tg_geom **pts = make_pred_geoms(points, npoints, qpoints, 
+        nqpoints, KIND_MULTIPOLY, NUM_RAND_POINTS);
+    struct pred_target multi = make_pred_target(KIND_MULTIPOLY, points, 
+        npoints);
+    pred_bench_ixs(runs, "multipoly/point/intersects", &multi, 
+        pred_intersects_xy, pts, NUM_RAND_POINTS);
+    pred_bench_ixs(runs, "multipoly/poly/intersects", &multi, 
+        pred_intersects, polys, N);
+
+    struct pred_target coll = make_pred_target(KIND_COLLECTION, points, 
+        npoints);
+    pred_bench_ixs(runs, "collection/point/intersects", &coll, 
+        pred_intersects_xy, pts, NUM_RAND_POINTS);
+    pred_bench_ixs(runs, "collection/point/locator", &coll, 
+        pred_locator_xy, pts, NUM_RAND_POINTS);
+    free_pred_locator();
+    pred_bench_ixs(runs, "collection/poly/intersects", &coll, 
+        pred_intersects, polys, N);
+
+    free_pred_geoms(polys, N);
+    free_pred_geoms(equals, NUM_EQUAL_GEOMS);
+    free_pred_geoms(lines, N);
+    free_pred_geoms(mpts, NUM_MULTIPOINTS);
+    free_pred_geoms(llines, NUM_LONG_LINES);
+    free_pred_geoms(pts, NUM_RAND_POINTS);
+    free_pred_geoms(track, NUM_RAND_POINTS);
+    free_pred_target(&poly);
+    free_pred_target(&multi);
+    free_pred_target(&coll);
+    tg_geom_free(qshape);
+    tg_geom_free(shape);
+}
+
+void main_predicates_bench(uint64_t seed, int runs) {
+    set_section("predicates");
+    srand(seed);
+    print_start_bold();
+    printf("== Predicates ==");
+    print_end_bold();
+    printf("Benchmark geometry predicates of polygons, multipolygons, and\n"
+           "collections against %dK random affine copies of Rhode Island,\n"
+           "which are rotated, scaled to between 1%% and 11%% the size of\n"
+           "the polygon, and moved to within the polygon's MBR plus an extra\n"
+           "%.0f%% padding. Multi part geometries contain %d copies of the\n"
+           "polygon that are scaled to 10%%.\n",
+           NUM_RAND_GEOMS/1000, MBR_PAD*100.0, NUM_PARTS);
+    printf("Performs %d run%s and chooses the best results. Rows that take\n"
+           "longer than %.0f seconds stop after fewer runs.\n", runs, 
+           runs!=0?"s":"", MAX_ROW_SECS);
+    print_header_pred("Brazil");
+    test_pred_bench(runs, "br");
+    print_header_pred("Texas");
+    test_pred_bench(runs, "tx");
+    print_header_pred("Arizona");
+    test_pred_bench(runs, "az");
+    print_header_pred("Br Columbia");
+    test_pred_bench(runs, "bc");
+    print_header_pred("Rhode Island");
+    test_pred_bench(runs, "ri");
+}
+
+// Search benchmarks
+
+#define NUM_KNN_QUERIES      1000     // number of kNN queries per run
+#define NUM_SEARCH_QUERIES   10000    // number of rect search queries per run
+#define NUM_SCAN_QUERIES     100      // number of queries for sequential scans
+
+#define HEADER_FIELDS_SEARCH "%11s %8s %8s %8s %8s"
+#define ROW_FIELDS_SEARCH    "%11s %8.0f %8.1f %8s %8s"
+
+void print_header_search(const char *name) {
+    set_group(name);
+    print_start_bold();
+    printf("%-24s " HEADER_FIELDS_SEARCH, name, "ops/sec", "ns/op", 
+        "hits", "nodes", "segs");
+    print_end_bold();
+}
+
+// Runs a search row, where query is called once per query and returns the
+// number of hits. The nodes and segs are the average number of index nodes
+// and segments visited per query, or negative when they are unknown, in 
+// which case they are shown as '-' unless TG was compiled with TG_STATS.
+void search_bench_run(int runs, const char *label, int N,
+    int (*query)(void *ctx, int i), void *ctx, double *nodes, double *segs)
+{
+    double bench_secs = 0;
+    int hits = 0;
+    int nsamples = 0;
+    if (*nodes < 0 || *segs < 0) {
+        // Use the counters of a TG_STATS build (STATS=1) when available.
+        struct tg_stats stats;
+        tg_stats_reset();
+        for (int j = 0; j < N; j++) {
+            query(ctx, j);
+        }
+        tg_stats_get(&stats);
+        uint64_t segs0 = stats.segments+stats.segment_intersects;
+        if (stats.index_nodes+segs0 > 0) {
+            *nodes = *nodes < 0 ? (double)stats.index_nodes/N : *nodes;
+            *segs = *segs < 0 ? (double)segs0/N : *segs;
+        }
+    }
+    double *samples = malloc(runs*sizeof(double));
+    assert(samples);
+    double row_start = clock_now();
+    for (int i = 0; i < runs; i++) {
+        if (i > 0 && clock_now()-row_start > MAX_ROW_SECS) {
+            break;
+        }
+        invalidate_cache();
+        if (!markdown) {
+            printf("\r%-30s %2d/%d ", label, i+1, runs); 
+        }
+        fflush(stdout);
+        int hits0 = 0;
+        perf_start();
+        double start = clock_now();
+        for (int j = 0; j < N; j++) {
+            hits0 += query(ctx, j);
+        }
+        double bench_secs0 = clock_now()-start;
+        perf_stop(bench_secs0, N);
+        samples[nsamples++] = bench_secs0/N*1e9;
+        if (i == 0 || bench_secs0 < bench_secs) {
+            bench_secs = bench_secs0;
+        }
+        assert(i == 0 || hits0 == hits);
+        hits = hits0;
+    }
+    if (!markdown) {
+        printf("\r");
+    }
+    char snodes[32] = "-";
+    char ssegs[32] = "-";
+    if (*nodes >= 0) {
+        snprintf(snodes, sizeof(snodes), "%.1f", *nodes);
+    }
+    if (*segs >= 0) {
+        snprintf(ssegs, sizeof(ssegs), "%.1f", *segs);
+    }
+    printf("%-24s ", label); 
+    printf(ROW_FIELDS_SEARCH, commaize(N/bench_secs), bench_secs/N*1e9,
+        (double)hits/N, snodes, ssegs);
+    printf("\n");
+    record_row(label, N/bench_secs, bench_secs/N*1e9, 0, 0, 0, 0, hits, 
+        samples, nsamples);
+    free(samples);
+}
+
+struct knn_ctx {
+    const struct tg_ring *ring;
+    bool line;
+    const struct tg_point *points;
+    struct tg_point point;
+    int k;
+    int count;
+    int64_t nodes;
+    int64_t segs;
+};
+
+static double knn_rect_dist(struct tg_rect rect, int *more, void *udata) {
+    (void)more;
+    struct knn_ctx *ctx = udata;
+    ctx->nodes++;
+    return tg_point_distance_rect(ctx->point, rect);
+}
+
+static double knn_seg_dist(struct tg_segment seg, int *more, void *udata) {
+    (void)more;
+    struct knn_ctx *ctx = udata;
+    ctx->segs++;
+    return tg_point_distance_segment(ctx->point, seg);
+}
+
+static bool knn_iter(struct tg_segment seg, double dist, int index, 
+    void *udata)
+{
+    (void)seg; (void)dist; (void)index;
+    struct knn_ctx *ctx = udata;
+    ctx->count++;
+    return ctx->count < ctx->k;
+}
+
+static int knn_query(void *udata, int i) {
+    struct knn_ctx *ctx = udata;
+    ctx->point = ctx->points[i];
+    ctx->count = 0;
+    if (ctx->line) {
+        tg_line_nearest_segment((struct tg_line*)ctx->ring, knn_rect_dist,
+            knn_seg_dist, knn_iter, ctx);
+    } else {
+        tg_ring_nearest_segment(ctx->ring, knn_rect_dist, knn_seg_dist, 
+            knn_iter, ctx);
+    }
+    return ctx->count;
+}
+
+void knn_bench_run(int runs, const char *ixname, bool line, int k,
+    const struct tg_point *points, int npoints, 
+    const struct tg_point *qpoints, int N)
+{
+    enum tg_index ix = strcmp(ixname, "none") == 0 ? TG_NONE :
+                       strcmp(ixname, "natural") == 0 ? TG_NATURAL : 
+                       TG_YSTRIPES;
+    struct tg_ring *ring = tg_ring_new_ix(points, npoints, ix);
+    assert(ring);
+    struct knn_ctx ctx = { .ring = ring, .line = line, .points = qpoints, 
+        .k = k };
+    // count the visits in a warmup pass
+    for (int i = 0; i < N; i++) {
+        knn_query(&ctx, i);
+    }
+    double nodes = (double)ctx.nodes/N;
+    double segs = (double)ctx.segs/N;
+    char label[64];
+    snprintf(label, sizeof(label), "k%d/%s/%s", k, line?"line":"ring", 
+        ixname);
+    search_bench_run(runs, label, N, knn_query, &ctx, &nodes, &segs);
+    tg_ring_free(ring);
+}
+
+struct sdist_bench_ctx {
+    const struct tg_geom *geom;
+    const struct tg_point *points;
+    struct knn_ctx knn;
+};
+
+// The inside test and the nearest segment as two separate operations.
+static int sdist_covers_nearest_query(void *udata, int i) {
+    struct sdist_bench_ctx *ctx = udata;
+    bool covers = tg_geom_covers_xy(ctx->geom, ctx->points[i].x, 
+        ctx->points[i].y);
+    knn_query(&ctx->knn, i);
+    return covers;
+}
+
+static int sdist_signed_query(void *udata, int i) {
+    struct sdist_bench_ctx *ctx = udata;
+    return tg_geom_signed_distance(ctx->geom, ctx->points[i].x, 
+        ctx->points[i].y) <= 0;
+}
+
+void sdist_bench_run(int runs, const char *name, const char *ixname,
+    const struct tg_point *qpoints, int N)
+{
+    enum tg_index ix = strcmp(ixname, "none") == 0 ? TG_NONE :
+                       strcmp(ixname, "natural") == 0 ? TG_NATURAL : 
+                       TG_YSTRIPES;
+    struct tg_geom *geom = load_geom(name, ix);
+    assert(geom);
+    struct sdist_bench_ctx ctx = { 
+        .geom = geom, 
+        .points = qpoints,
+        .knn = { 
+            .ring = tg_poly_exterior(tg_geom_poly(geom)), 
+            .points = qpoints, 
+            .k = 1,
+        },
+    };
+    double nodes = -1, segs = -1;
+    char label[64];
+    snprintf(label, sizeof(label), "covers+k1/%s", ixname);
+    search_bench_run(runs, label, N, sdist_covers_nearest_query, &ctx, 
+        &nodes, &segs);
+    snprintf(label, sizeof(label), "signed/%s", ixname);
+    search_bench_run(runs, label, N, sdist_signed_query, &ctx, &nodes, 
+        &segs);
+    tg_geom_free(geom);
+}
+
+void test_knn_bench(int runs, const char *name) {
+    struct tg_geom *shape = load_geom(name, TG_NONE);
+    const struct tg_ring *ring = tg_poly_exterior(tg_geom_poly(shape));
+    const struct tg_point *points = tg_ring_points(ring);
+    int npoints = tg_ring_num_points(ring);
+    int N = NUM_KNN_QUERIES;
+    struct tg_rect rect = rect_from_points(points, npoints);
+    struct tg_point *qpoints = make_random_points(rect, N);
+    int ks[] = { 1, 10, 100 };
+    for (int i = 0; i < 3; i++) {
+        knn_bench_run(runs, "none", false, ks[i], points, npoints, qpoints, N);
+        knn_bench_run(runs, "natural", false, ks[i], points, npoints, 
+            qpoints, N);
+        knn_bench_run(runs, "ystripes", false, ks[i], points, npoints, 
+            qpoints, N);
+        knn_bench_run(runs, "natural", true, ks[i], points, npoints, 
+            qpoints, N);
+    }
+    sdist_bench_run(runs, name, "none", qpoints, N);
+    sdist_bench_run(runs, name, "natural", qpoints, N);
+    sdist_bench_run(runs, name, "ystripes", qpoints, N);
+    free(qpoints);
+    tg_geom_free(shape);
+}
+
+void main_knn_bench(uint64_t seed, int runs) {
+    set_section("knn");
+    srand(seed);
+    print_start_bold();
+    printf("== Nearest segments ==");
+    print_end_bold();
+    printf("Benchmark finding the k nearest segments of a polygon's exterior\n"
+           "ring, and the same points as a line, using\n"
+           "tg_ring_nearest_segment and tg_line_nearest_segment for %d\n"
+           "random points within the polygon's MBR plus an extra %.0f%%\n"
+           "padding. The hits are the segments returned per query, and the\n"
+           "nodes and segs are the index rectangles and segments measured\n"
+           "per query. The covers+k1 rows test the point with\n"
+           "tg_geom_covers_xy and then find the nearest segment, which is\n"
+           "the same answer as tg_geom_signed_distance in the signed rows.\n",
+           NUM_KNN_QUERIES, MBR_PAD*100.0);
+    printf("Performs %d run%s and chooses the best results. Rows that take\n"
+           "longer than %.0f seconds stop after fewer runs.\n", runs, 
+           runs!=0?"s":"", MAX_ROW_SECS);
+    print_header_search("Brazil");
+    test_knn_bench(runs, "br");
+    print_header_search("Texas");
+    test_knn_bench(runs, "tx");
+    print_header_search("Arizona");
+    test_knn_bench(runs, "az");
+    print_header_search("Br Columbia");
+    test_knn_bench(runs, "bc");
+    print_header_search("Rhode Island");
+    test_knn_bench(runs, "ri");
+}
+
+// Counts the index nodes and segments that tg_ring_search visits for rect,
+// by walking the same levels using the public index accessors.
+static void ring_search_visits(const struct tg_ring *ring, struct tg_rect rect,
+    int level, int start, int64_t *nodes, int64_t *segs)
+{
+    int spread = tg_ring_index_spread(ring);
+    int nlevels = tg_ring_index_num_levels(ring);
+    if (nlevels == 0) {
+        *segs += tg_ring_num_segments(ring);
+        return;
+    }
+    if (level == nlevels) {
+        int e = start+spread;
+        if (e > tg_ring_num_segments(ring)) {
+            e = tg_ring_num_segments(ring);
+        }
+        *segs += e-start;
+        return;
+    }
+    int e = start+spread;
+    if (e > tg_ring_index_level_num_rects(ring, level)) {
+        e = tg_ring_index_level_num_rects(ring, level);
+    }
+    for (int i = start; i < e; i++) {
+        (*nodes)++;
+        struct tg_rect irect = tg_ring_index_level_rect(ring, level, i);
+        if (tg_rect_intersects_rect(irect, rect)) {
+            ring_search_visits(ring, rect, level+1, i*spread, nodes, segs);
+        }
+    }
+}
+
+struct rsearch_ctx {
+    const struct tg_ring *ring;
+    const struct tg_rect *rects;
+    const struct tg_ring **rings;
+    int count;
+};
+
+static bool rsearch_iter(struct tg_segment seg, int index, void *udata) {
+    (void)seg; (void)index;
+    ((struct rsearch_ctx*)udata)->count++;
+    return true;
+}
+
+static int rsearch_query(void *udata, int i) {
+    struct rsearch_ctx *ctx = udata;
+    ctx->count = 0;
+    tg_ring_search(ctx->ring, ctx->rects[i], rsearch_iter, ctx);
+    return ctx->count;
+}
+
+static bool rrsearch_iter(struct tg_segment aseg, int aidx, 
+    struct tg_segment bseg, int bidx, void *udata)
+{
+    (void)aseg; (void)aidx; (void)bseg; (void)bidx;
+    ((struct rsearch_ctx*)udata)->count++;
+    return true;
+}
+
+static int rrsearch_query(void *udata, int i) {
+    struct rsearch_ctx *ctx = udata;
+    ctx->count = 0;
+    tg_ring_ring_search(ctx->ring, ctx->rings[i], rrsearch_iter, ctx);
+    return ctx->count;
+}
+
+// Random rects that each cover the provided fraction of the area of rect.
+struct tg_rect *make_random_rects(struct tg_rect rect, double frac, int N) {
+    struct tg_rect *rects = malloc(N*sizeof(struct tg_rect));
+    assert(rects);
+    double w = (rect.max.x-rect.min.x)*sqrt(frac);
+    double h = (rect.max.y-rect.min.y)*sqrt(frac);
+    for (int i = 0; i < N; i++) {
+        struct tg_point min = rand_point(
+            (struct tg_rect){ rect.min, { rect.max.x-w, rect.max.y-h } });
+        rects[i] = (struct tg_rect){ min, { min.x+w, min.y+h } };
+    }
+    return rects;
+}
+
+static const char *ixnames[] = { "none", "natural", "ystripes" };
+static const enum tg_index ixkinds[] = { TG_NONE, TG_NATURAL, TG_YSTRIPES };
+static const double selectivities[] = { 0.0001, 0.001, 0.01, 0.1 };
+
+void test_search_bench(int runs, const char *name) {
+    struct tg_geom *shape = load_geom(name, TG_NONE);
+    const struct tg_ring *ring = tg_poly_exterior(tg_geom_poly(shape));
+    const struct tg_point *points = tg_ring_points(ring);
+    int npoints = tg_ring_num_points(ring);
+    struct tg_rect rect = rect_from_points(points, npoints);
+    int N = NUM_SEARCH_QUERIES;
+    char label[64];
+
+    for (int i = 0; i < 4; i++) {
+        struct tg_rect *rects = make_random_rects(rect, selectivities[i], N);
+        for (int j = 0; j < 3; j++) {
+            struct tg_ring *ring = tg_ring_new_ix(points, npoints, 
+                ixkinds[j]);
+            assert(ring);
+            int64_t nodes = 0, segs = 0;
+            for (int k = 0; k < N; k++) {
+                ring_search_visits(ring, rects[k], 0, 0, &nodes, &segs);
+            }
+            double dnodes = (double)nodes/N;
+            double dsegs = (double)segs/N;
+            struct rsearch_ctx ctx = { .ring = ring, .rects = rects };
+            snprintf(label, sizeof(label), "rect/%g%%/%s", 
+                selectivities[i]*100, ixnames[j]);
+            search_bench_run(runs, label, N, rsearch_query, &ctx, &dnodes, 
+                &dsegs);
+            tg_ring_free(ring);
+        }
+        free(rects);
+    }
+
+    // Rhode Island copies are the query rings
+    struct tg_geom *qshape = load_geom("ri", TG_NONE);
+    const struct tg_ring *qring = tg_poly_exterior(tg_geom_poly(qshape));
+    const struct tg_point *qpoints = tg_ring_points(qring);
+    int nqpoints = tg_ring_num_points(qring);
+    int NR = NUM_KNN_QUERIES;
+    struct tg_point **apoints = malloc(NR*sizeof(struct tg_point*));
+    assert(apoints);
+    for (int k = 0; k < NR; k++) {
+        apoints[k] = make_affine_points(qpoints, nqpoints, rect, 
+            0.01+rand_double()*0.1);
+    }
+    for (int j = 0; j < 3; j++) {
+        // without an index every pair of segments is compared
+        int N = ixkinds[j] == TG_NONE ? NUM_SCAN_QUERIES : NR;
+        struct tg_ring *ring = tg_ring_new_ix(points, npoints, ixkinds[j]);
+        assert(ring);
+        struct tg_ring **rings = malloc(N*sizeof(struct tg_ring*));
+        assert(rings);
+        for (int k = 0; k < N; k++) {
+            rings[k] = tg_ring_new_ix(apoints[k], nqpoints, ixkinds[j]);
+            assert(rings[k]);
+        }
+        struct rsearch_ctx ctx = { .ring = ring, 
+            .rings = (const struct tg_ring**)rings };
+        double nodes = -1, segs = -1;
+        snprintf(label, sizeof(label), "ring-ring/%s", ixnames[j]);
+        search_bench_run(runs, label, N, rrsearch_query, &ctx, &nodes, 
+            &segs);
+        for (int k = 0; k < N; k++) {
+            tg_ring_free(rings[k]);
+        }
+        free(rings);
+        tg_ring_free(ring);
+    }
+    for (int k = 0; k < NR; k++) {
+        free(apoints[k]);
+    }
+    free(apoints);
+    tg_geom_free(qshape);
+    tg_geom_free(shape);
+}
+
+void main_search_bench(uint64_t seed, int runs) {
+    set_section("search");
+    srand(seed);
+    print_start_bold();
+    printf("== Segment search ==");
+    print_end_bold();
+    printf("Benchmark tg_ring_search for %dK random rectangles that each\n"
+           "cover between %g%% and %g%% of the polygon's MBR, and\n"
+           "tg_ring_ring_search for %d random affine copies of Rhode\n"
+           "Island (%d without an index). The hits are the segments (or segment pairs) found per\n"
+           "query, and the nodes and segs are the index rectangles and\n"
+           "segments that are tested per query.\n",
+           NUM_SEARCH_QUERIES/1000, selectivities[0]*100, 
+           selectivities[3]*100, NUM_KNN_QUERIES, NUM_SCAN_QUERIES);
+    printf("Performs %d run%s and chooses the best results. Rows that take\n"
+           "longer than %.0f seconds stop after fewer runs.\n", runs, 
+           runs!=0?"s":"", MAX_ROW_SECS);
+    print_header_search("Brazil");
+    test_search_bench(runs, "br");
+    print_header_search("Texas");
+    test_search_bench(runs, "tx");
+    print_header_search("Arizona");
+    test_search_bench(runs, "az");
+    print_header_search("Br Columbia");
+    test_search_bench(runs, "bc");
+    print_header_search("Rhode Island");
+    test_search_bench(runs, "ri");
+}
+
+struct msearch_ctx {
+    const struct tg_geom *geom;
+    const struct tg_rect *rects;
+    int count;
+};
+
+static bool msearch_iter(const struct tg_geom *geom, int index, void *udata) {
+    (void)geom; (void)index;
+    ((struct msearch_ctx*)udata)->count++;
+    return true;
+}
+
+static int msearch_query(void *udata, int i) {
+    struct msearch_ctx *ctx = udata;
+    ctx->count = 0;
+    tg_geom_search(ctx->geom, ctx->rects[i], msearch_iter, ctx);
+    return ctx->count;
+}
+
+static int mscan_query(void *udata, int i) {
+    struct msearch_ctx *ctx = udata;
+    int n = tg_geom_num_geometries(ctx->geom);
+    int count = 0;
+    for (int j = 0; j < n; j++) {
+        struct tg_rect rect = tg_geom_rect(tg_geom_geometry_at(ctx->geom, j));
+        if (tg_rect_intersects_rect(rect, ctx->rects[i])) {
+            count++;
+        }
+    }
+    return count;
+}
+
+// A collection of random features, which are 90% points and 10% small
+// squares, spread over the world.
+struct tg_geom *make_features(struct tg_rect world, int nfeats) {
+    struct tg_geom **feats = calloc(nfeats, sizeof(struct tg_geom*));
+    assert(feats);
+    for (int i = 0; i < nfeats; i++) {
+        struct tg_point p = rand_point(world);
+        if (i%10 == 0) {
+            double size = rand_double()*0.1;
+            struct tg_point points[] = {
+                p, { p.x+size, p.y }, { p.x+size, p.y+size }, 
+                { p.x, p.y+size }, p,
+            };
+            struct tg_ring *ring = tg_ring_new(points, 5);
+            struct tg_poly *poly = tg_poly_new(ring, NULL, 0);
+            feats[i] = tg_geom_new_polygon(poly);
+            tg_poly_free(poly);
+            tg_ring_free(ring);
+        } else {
+            feats[i] = tg_geom_new_point(p);
+        }
+        assert(feats[i]);
+    }
+    struct tg_geom *geom = tg_geom_new_geometrycollection(
+        (const struct tg_geom *const*)feats, nfeats);
+    assert(geom);
+    for (int i = 0; i < nfeats; i++) {
+        tg_geom_free(feats[i]);
+    }
+    free(feats);
+    return geom;
+}
+
+void test_multi_bench(int runs, int nfeats) {
+    struct tg_rect world = R(-180, -90, 180, 90);
+    char name[32];
+    if (nfeats >= 1000000) {
+        snprintf(name, sizeof(name), "%dM features", nfeats/1000000);
+    } else {
+        snprintf(name, sizeof(name), "%dK features", nfeats/1000);
+    }
+    double start = clock_now();
+    size_t heap_start = bmalloc_heap_size();
+    struct tg_geom *geom = make_features(world, nfeats);
+    double build_secs = clock_now()-start;
+    size_t heap_end = bmalloc_heap_size();
+    print_header_search(name);
+    printf("built in %.0f ms, %s bytes, index spread %d\n", build_secs*1e3,
+        commaize(heap_end-heap_start), tg_geom_multi_index_spread(geom));
+    int N = NUM_SEARCH_QUERIES;
+    char label[64];
+    for (int i = 0; i < 3; i++) {
+        struct tg_rect *rects = make_random_rects(world, 
+            selectivities[i]/10, N);
+        struct msearch_ctx ctx = { .geom = geom, .rects = rects };
+        snprintf(label, sizeof(label), "rect/%g%%/index", 
+            selectivities[i]*10);
+        double nodes = -1, segs = -1;
+        search_bench_run(runs, label, N, msearch_query, &ctx, &nodes, &segs);
+        snprintf(label, sizeof(label), "rect/%g%%/scan", 
+            selectivities[i]*10);
+        nodes = 0;
+        segs = nfeats;
+        search_bench_run(runs, label, NUM_SCAN_QUERIES, mscan_query, &ctx, 
+            &nodes, &segs);
+        free(rects);
+    }
+    tg_geom_free(geom);
+}
+
+void main_multi_bench(uint64_t seed, int runs) {
+    set_section("multi");
+    srand(seed);
+    print_start_bold();
+    printf("== Collection search ==");
+    print_end_bold();
+    printf("Benchmark tg_geom_search on collections of 100K, 1M, and 10M\n"
+           "random world features, which are 90%% points and 10%% small\n"
+           "polygons, for %dK random rectangles that each cover between\n"
+           "%g%% and %g%% of the world. The indexed search is compared to\n"
+           "a sequential scan of %d rectangles over the feature MBRs, where\n"
+           "segs are the features tested per query.\n", 
+           NUM_SEARCH_QUERIES/1000, selectivities[0]*10, 
+           selectivities[2]*10, NUM_SCAN_QUERIES);
+    printf("Performs %d run%s and chooses the best results. Rows that take\n"
+           "longer than %.0f seconds stop after fewer runs.\n", runs, 
+           runs!=0?"s":"", MAX_ROW_SECS);
+    test_multi_bench(runs, 100000);
+    test_multi_bench(runs, 1000000);
+    test_multi_bench(runs, 10000000);
+}
+
+// Join benchmark
+
+#define JOIN_PARCELS 200000 // number of small squares
+#define JOIN_ZONES   2000   // number of large circles
+
+struct join_bench_ctx {
+    const struct tg_geom *parcels;
+    const struct tg_geom *zones;
+    const struct tg_geom *parcel;
+    int nthreads;
+    int count;
+};
+
+static bool join_bench_iter(int aindex, int bindex, void *udata) {
+    (void)aindex; (void)bindex;
+    ((struct join_bench_ctx*)udata)->count++;
+    return true;
+}
+
+static int join_bench_query(void *udata, int i) {
+    (void)i;
+    struct join_bench_ctx *ctx = udata;
+    ctx->count = 0;
+    tg_env_set_batch_threads(ctx->nthreads);
+    bool ok = tg_join(ctx->parcels, ctx->zones, tg_geom_intersects, 
+        join_bench_iter, ctx);
+    assert(ok);
+    tg_env_set_batch_threads(0);
+    return ctx->count;
+}
+
+static bool join_loop_iter(const struct tg_geom *geom, int index, 
+    void *udata)
+{
+    (void)index;
+    struct join_bench_ctx *ctx = udata;
+    ctx->count += tg_geom_intersects(ctx->parcel, geom);
+    return true;
+}
+
+// The parcels one at a time, searching the zones with tg_geom_search.
+static int join_loop_query(void *udata, int i) {
+    (void)i;
+    struct join_bench_ctx *ctx = udata;
+    ctx->count = 0;
+    int n = tg_geom_num_geometries(ctx->parcels);
+    for (int j = 0; j < n; j++) {
+        ctx->parcel = tg_geom_geometry_at(ctx->parcels, j);
+        tg_geom_search(ctx->zones, tg_geom_rect(ctx->parcel), join_loop_iter,
+            ctx);
+    }
+    return ctx->count;
+}
+
+// A collection of random circles, each with 64 points.
+struct tg_geom *make_zones(struct tg_rect world, int nzones) {
+    struct tg_geom **zones = calloc(nzones, sizeof(struct tg_geom*));
+    assert(zones);
+    double w = world.max.x-world.min.x;
+    for (int i = 0; i < nzones; i++) {
+        struct tg_ring *ring = tg_circle_new(rand_point(world), 
+            w/100+w/50*rand_double(), 64);
+        assert(ring);
+        zones[i] = tg_geom_new_polygon((struct tg_poly*)ring);
+        assert(zones[i]);
+        tg_ring_free(ring);
+    }
+    struct tg_geom *geom = tg_geom_new_geometrycollection(
+        (const struct tg_geom *const*)zones, nzones);
+    assert(geom);
+    for (int i = 0; i < nzones; i++) {
+        tg_geom_free(zones[i]);
+    }
+    free(zones);
+    return geom;
+}
+
+void main_join_bench(uint64_t seed, int runs) {
+    set_section("join");
+    srand(seed);
+    print_start_bold();
+    printf("== Spatial join ==");
+    print_end_bold();
+    printf("Benchmark tg_join with tg_geom_intersects of %dK random world\n"
+           "features, which are 90%% points and 10%% small polygons, against\n"
+           "%dK random circles. The join is compared to a loop over the\n"
+           "features that finds the circles of each one with tg_geom_search\n"
+           "and tests them with tg_geom_intersects. One op is the whole\n"
+           "join, and the hits are the pairs found.\n", 
+           JOIN_PARCELS/1000, JOIN_ZONES/1000);
+    printf("Performs %d run%s and chooses the best results. Rows that take\n"
+           "longer than %.0f seconds stop after fewer runs.\n", runs, 
+           runs!=0?"s":"", MAX_ROW_SECS);
+    struct tg_rect world = R(-180, -90, 180, 90);
+    struct tg_geom *parcels = make_features(world, JOIN_PARCELS);
+    struct tg_geom *zones = make_zones(world, JOIN_ZONES);
+    print_header_search("Features");
+    struct join_bench_ctx ctx = { .parcels = parcels, .zones = zones };
+    double nodes = -1, segs = -1;
+    search_bench_run(runs, "loop/search", 1, join_loop_query, &ctx, &nodes,
+        &segs);
+    int nthreads[] = { 1, 2, 4, 0 };
+    for (int i = 0; i < 4; i++) {
+        char label[64];
+        if (nthreads[i] == 0) {
+            snprintf(label, sizeof(label), "join/default");
+        } else {
+            snprintf(label, sizeof(label), "join/%d-thread%s", nthreads[i],
+                nthreads[i] == 1 ? "" : "s");
+        }
+        ctx.nthreads = nthreads[i];
+        nodes = -1, segs = -1;
+        search_bench_run(runs, label, 1, join_bench_query, &ctx, &nodes, 
+            &segs);
+    }
+    tg_geom_free(zones);
+    tg_geom_free(parcels);
+}
+
+// Spread benchmark
+
+#define SPREAD_NQUERIES     10000   // number of pip and rect queries per run,
+                                    // which is reduced for rings over 10K
+#define SPREAD_MAXPOINTS    10000000 // default largest ring size
+#define SPREAD_TOLERANCE    0.05    // query times within 5% are a tie
+
+#define HEADER_FIELDS_SPREAD "%7s %11s %12s %10s %10s"
+#define ROW_FIELDS_SPREAD    "%6d%c %8.0f µs %12s %10.1f %10.1f"
+
+static const int spreads[] = { 4, 8, 16, 32, 64, 128, 256 };
+#define NSPREADS ((int)(sizeof(spreads)/sizeof(spreads[0])))
+
+struct spread_result {
+    double build_us;
+    size_t bytes;
+    double pip_ns;
+    double rect_ns;
+};
+
+void print_header_spread(const char *name) {
+    set_group(name);
+    print_start_bold();
+    printf("%-20s " HEADER_FIELDS_SPREAD, name, "spread", "built", "bytes",
+        "pip ns/op", "rect ns/op");
+    print_end_bold();
+}
+
+// Runs the queries against the ring and returns the best ns/op.
+static double spread_queries(int runs, const struct tg_ring *ring, 
+    const struct tg_point *points, const struct tg_rect *rects, int N, 
+    bool rect, int *hits_out)
+{
+    const struct tg_geom *geom = (const struct tg_geom*)ring;
+    double best = 0;
+    double row_start = clock_now();
+    for (int i = 0; i < runs; i++) {
+        if (i > 0 && clock_now()-row_start > MAX_ROW_SECS) {
+            break;
+        }
+        int hits = 0;
+        double start = clock_now();
+        for (int j = 0; j < N; j++) {
+            if (rect) {
+                hits += tg_geom_intersects_rect(geom, rects[j]);
+            } else {
+                hits += tg_geom_intersects_xy(geom, points[j].x, points[j].y);
+            }
+        }
+        double secs = clock_now()-start;
+        if (i == 0 || secs < best) {
+            best = secs;
+        }
+        *hits_out = hits;
+    }
+    return best/N*1e9;
+}
+
+static struct spread_result spread_run(int runs, const char *label,
+    const struct tg_point *ringpts, int npoints, enum tg_index ix, int spread,
+    bool isdefault, const struct tg_point *points, const struct tg_rect *rects,
+    int N)
+{
+    struct tg_options opts = { .index = ix, .spread = spread };
+    struct spread_result res = { 0 };
+    struct tg_ring *ring = NULL;
+    double row_start = clock_now();
+    for (int i = 0; i < runs; i++) {
+        if (i > 0 && clock_now()-row_start > MAX_ROW_SECS) {
+            break;
+        }
+        if (!markdown) {
+            printf("\r%-20s %2d/%d ", label, i+1, runs); 
+            fflush(stdout);
+        }
+        tg_ring_free(ring);
+        invalidate_cache();
+        double start = clock_now();
+        ring = tg_ring_new_opts(ringpts, npoints, &opts);
+        double us = (clock_now()-start)*1e6;
+        assert(ring);
+        if (i == 0 || us < res.build_us) {
+            res.build_us = us;
+        }
+    }
+    res.bytes = tg_ring_memsize(ring);
+    int pip_hits = 0, rect_hits = 0;
+    res.pip_ns = spread_queries(runs, ring, points, rects, N, false, 
+        &pip_hits);
+    res.rect_ns = spread_queries(runs, ring, points, rects, N, true, 
+        &rect_hits);
+    tg_ring_free(ring);
+    if (!markdown) {
+        printf("\r");
+    }
+    printf("%-20s ", label);
+    printf(ROW_FIELDS_SPREAD, spread, isdefault ? '*' : ' ', res.build_us, 
+        commaize(res.bytes), res.pip_ns, res.rect_ns);
+    printf("\n");
+    char name[64];
+    snprintf(name, sizeof(name), "%s/pip", label);
+    record_row(name, 1e9/res.pip_ns, res.pip_ns, res.build_us, res.bytes, 0,
+        npoints, pip_hits, NULL, 0);
+    snprintf(name, sizeof(name), "%s/rect", label);
+    record_row(name, 1e9/res.rect_ns, res.rect_ns, res.build_us, res.bytes, 0,
+        npoints, rect_hits, NULL, 0);
+    return res;
+}
+
+// Picks the spread with the fastest pip and rect queries combined. Spreads
+// that are within SPREAD_TOLERANCE of the fastest are a tie, which goes to
+// the smallest index.
+static int spread_recommend(const struct spread_result *res) {
+    int best = 0;
+    for (int i = 1; i < NSPREADS; i++) {
+        if (res[i].pip_ns+res[i].rect_ns < res[best].pip_ns+res[best].rect_ns) {
+            best = i;
+        }
+    }
+    double limit = (res[best].pip_ns+res[best].rect_ns)*(1+SPREAD_TOLERANCE);
+    int pick = best;
+    for (int i = 0; i < NSPREADS; i++) {
+        if (res[i].pip_ns+res[i].rect_ns <= limit && 
+            res[i].bytes < res[pick].bytes)
+        {
+            pick = i;
+        }
+    }
+    return spreads[pick];
+}
+
+void main_spread_bench(uint64_t seed, int runs) {
+    set_section("spread");
+    srand(seed);
+    int maxpoints = atoi(getenv("SPREAD_MAXPOINTS") ? 
+        getenv("SPREAD_MAXPOINTS") : "0");
+    if (maxpoints <= 0) maxpoints = SPREAD_MAXPOINTS;
+    print_start_bold();
+    printf("== Index spread ==");
+    print_end_bold();
+    printf("Benchmark building random rings of 10 to %d points with the\n"
+           "natural and ystripes indexes over spreads of %d to %d, and\n"
+           "querying them with %dK random points (pip) and rects of 1%% of\n"
+           "the MBR (rect), which are fewer for rings over 10K points. The\n"
+           "default spread is marked with '*'. The recommended spread has\n"
+           "the fastest queries, where a tie goes to the smallest index.\n"
+           "Use SPREAD_MAXPOINTS=N to change the largest ring.\n", maxpoints,
+           spreads[0], spreads[NSPREADS-1], SPREAD_NQUERIES/1000);
+    printf("Performs %d run%s and chooses the best results. Rows that take\n"
+           "longer than %.0f seconds stop after fewer runs.\n", runs, 
+           runs!=0?"s":"", MAX_ROW_SECS);
+    int nsizes = 0;
+    int sizes[16];
+    int recs[16][2];
+    for (int npoints = 10; npoints <= maxpoints && nsizes < 16; 
+        npoints *= 10) 
+    {
+        struct tg_point *ringpts = make_rand_polygon(npoints);
+        struct tg_ring *ring = tg_ring_new_ix(ringpts, npoints, TG_NONE);
+        assert(ring);
+        struct tg_rect rect = tg_ring_rect(ring);
+        tg_ring_free(ring);
+        int N = npoints <= 10000 ? SPREAD_NQUERIES : 
+            (int)((double)SPREAD_NQUERIES*10000/npoints);
+        N = N < 100 ? 100 : N;
+        struct tg_point *points = malloc(SPREAD_NQUERIES*
+            sizeof(struct tg_point));
+        assert(points);
+        for (int i = 0; i < SPREAD_NQUERIES; i++) {
+            points[i] = rand_point(rect);
+        }
+        struct tg_rect *rects = make_random_rects(rect, 0.01, 
+            SPREAD_NQUERIES);
+        char name[32];
+        if (npoints >= 1000000) {
+            snprintf(name, sizeof(name), "%dM points", npoints/1000000);
+        } else if (npoints >= 1000) {
+            snprintf(name, sizeof(name), "%dK points", npoints/1000);
+        } else {
+            snprintf(name, sizeof(name), "%d points", npoints);
+        }
+        print_header_spread(name);
+        for (int k = 0; k < 2; k++) {
+            enum tg_index ix = ixkinds[k+1];
+            struct tg_ring *dring = tg_ring_new_ix(ringpts, npoints, ix);
+            assert(dring);
+            int dspread = tg_ring_index_spread(dring);
+            tg_ring_free(dring);
+            struct spread_result res[NSPREADS];
+            for (int i = 0; i < NSPREADS; i++) {
+                char label[32];
+                snprintf(label, sizeof(label), "%s/%d", ixnames[k+1], 
+                    spreads[i]);
+                res[i] = spread_run(runs, label, ringpts, npoints, ix, 
+                    spreads[i], spreads[i] == dspread, points, rects, N);
+            }
+            recs[nsizes][k] = spread_recommend(res);
+        }
+        sizes[nsizes++] = npoints;
+        free(rects);
+        free(points);
+        free(ringpts);
+    }
+    print_start_bold();
+    printf("%-20s %12s %12s", "recommended spread", "natural", "ystripes");
+    print_end_bold();
+    for (int i = 0; i < nsizes; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "%d points", sizes[i]);
+        printf("%-20s %12d %12d\n", name, recs[i][0], recs[i][1]);
+    }
+}
+
+// Dataset benchmark
+
+#define DATA_NQUERIES    10000  // default number of queries per run
+#define DATA_NCLUSTERS   10     // number of clusters for clustered queries
+#define DATA_ROW_SECS    0.05   // target duration of a parse or write run
+
+struct data_ctx {
+    const char *data;        // file contents
+    size_t len;
+    enum tg_index ix;
+    const struct tg_geom *geom;
+    const struct tg_point *points;
+    struct tg_rect *rects;
+    char *buf;
+    size_t bufsz;
+    int format;
+};
+
+static char *data_read_file(const char *path, size_t *len) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long n = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *data = malloc(n+1);
+    assert(data);
+    if (n < 0 || fread(data, 1, n, f) != (size_t)n) {
+        free(data);
+        fclose(f);
+        return NULL;
+    }
+    data[n] = '\0';
+    fclose(f);
+    *len = n;
+    return data;
+}
+
+static int data_parse_query(void *udata, int i) {
+    (void)i;
+    struct data_ctx *ctx = udata;
+    struct tg_geom *geom = tg_parse_ix(ctx->data, ctx->len, ctx->ix);
+    assert(geom);
+    tg_geom_free(geom);
+    return 0;
+}
+
+static size_t data_write(struct data_ctx *ctx, char *dst, size_t n) {
+    switch (ctx->format) {
+    case 0: return tg_geom_geojson(ctx->geom, dst, n);
+    case 1: return tg_geom_wkt(ctx->geom, dst, n);
+    case 2: return tg_geom_wkb(ctx->geom, (uint8_t*)dst, n);
+    default: return tg_geom_geobin(ctx->geom, (uint8_t*)dst, n);
+    }
+}
+
+static int data_write_query(void *udata, int i) {
+    (void)i;
+    struct data_ctx *ctx = udata;
+    data_write(ctx, ctx->buf, ctx->bufsz);
+    return 0;
+}
+
+static int data_pip_query(void *udata, int i) {
+    struct data_ctx *ctx = udata;
+    return tg_geom_intersects_xy(ctx->geom, ctx->points[i].x, 
+        ctx->points[i].y);
+}
+
+static int data_rect_query(void *udata, int i) {
+    struct data_ctx *ctx = udata;
+    return tg_geom_intersects_rect(ctx->geom, ctx->rects[i]);
+}
+
+// Returns the number of times that an operation can run in about 
+// DATA_ROW_SECS, between 1 and 1000.
+static int data_row_ops(int (*query)(void *ctx, int i), void *ctx) {
+    double start = clock_now();
+    query(ctx, 0);
+    double secs = clock_now()-start;
+    int n = secs > 0 ? (int)(DATA_ROW_SECS/secs) : 1000;
+    return n < 1 ? 1 : n > 1000 ? 1000 : n;
+}
+
+static double rand_normal(void) {
+    double u = rand_double();
+    double v = rand_double();
+    return sqrt(-2*log(u > 0 ? u : 1e-300))*cos(2*M_PI*v);
+}
+
+// Loads the points of a text file with one "x y" or "x,y" pair per line.
+static struct tg_point *data_load_points(const char *path, int *npoints) {
+    size_t len;
+    char *data = data_read_file(path, &len);
+    if (!data) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        exit(1);
+    }
+    int cap = 1024;
+    int n = 0;
+    struct tg_point *points = malloc(cap*sizeof(struct tg_point));
+    assert(points);
+    char *line = strtok(data, "\n");
+    while (line) {
+        double x, y;
+        if (sscanf(line, " %lf%*[ ,\t]%lf", &x, &y) == 2) {
+            if (n == cap) {
+                cap *= 2;
+                points = realloc(points, cap*sizeof(struct tg_point));
+                assert(points);
+            }
+            points[n++] = (struct tg_point){ x, y };
+        }
+        line = strtok(NULL, "\n");
+    }
+    free(data);
+    if (n == 0) {
+        fprintf(stderr, "%s: no points\n", path);
+        exit(1);
+    }
+    *npoints = n;
+    return points;
+}
+
+// Generates the query points, which are either uniform in the MBR of the
+// geometry, in clusters centered on points that intersect the geometry, or
+// the points of a file, which are repeated as needed.
+static struct tg_point *data_make_queries(const struct tg_geom *geom, 
+    const char *dist, int n)
+{
+    struct tg_point *points = malloc(n*sizeof(struct tg_point));
+    assert(points);
+    struct tg_rect rect = tg_geom_rect(geom);
+    if (strcmp(dist, "uniform") == 0) {
+        for (int i = 0; i < n; i++) {
+            points[i] = rand_point(rect);
+        }
+    } else if (strcmp(dist, "clustered") == 0) {
+        struct tg_point centers[DATA_NCLUSTERS];
+        for (int i = 0; i < DATA_NCLUSTERS; i++) {
+            centers[i] = rand_point(rect);
+            for (int j = 0; j < 1000; j++) {
+                if (tg_geom_intersects_xy(geom, centers[i].x, centers[i].y)) {
+                    break;
+                }
+                centers[i] = rand_point(rect);
+            }
+        }
+        double sx = (rect.max.x-rect.min.x)*0.01;
+        double sy = (rect.max.y-rect.min.y)*0.01;
+        for (int i = 0; i < n; i++) {
+            struct tg_point c = centers[rand()%DATA_NCLUSTERS];
+            points[i] = (struct tg_point){ 
+                c.x+rand_normal()*sx, c.y+rand_normal()*sy 
+            };
+        }
+    } else {
+        int nfile;
+        struct tg_point *file = data_load_points(dist, &nfile);
+        for (int i = 0; i < n; i++) {
+            points[i] = file[i%nfile];
+        }
+        free(file);
+    }
+    return points;
+}
+
+static void test_data_bench(int runs, const char *path, const char *dist,
+    int nqueries)
+{
+    const char *name = strrchr(path, '/');
+    name = name ? name+1 : path;
+    struct data_ctx ctx = { 0 };
+    char *data = data_read_file(path, &ctx.len);
+    if (!data) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return;
+    }
+    ctx.data = data;
+    struct tg_geom *geoms[3];
+    for (int i = 0; i < 3; i++) {
+        geoms[i] = tg_parse_ix(data, ctx.len, ixkinds[i]);
+        assert(geoms[i]);
+        if (tg_geom_error(geoms[i])) {
+            fprintf(stderr, "%s: %s\n", path, tg_geom_error(geoms[i]));
+            for (int j = 0; j <= i; j++) {
+                tg_geom_free(geoms[j]);
+            }
+            free(data);
+            return;
+        }
+    }
+    print_header_search(name);
+    printf("%s bytes, %s", commaize(ctx.len), 
+        tg_geom_type_string(tg_geom_typeof(geoms[0])));
+    if (tg_geom_num_geometries(geoms[0]) > 0) {
+        printf(" of %d", tg_geom_num_geometries(geoms[0]));
+    }
+    printf(", %s bytes with natural index\n", 
+        commaize(tg_geom_memsize(geoms[1])));
+    char label[64];
+    double nodes, segs;
+    for (int i = 0; i < 3; i++) {
+        ctx.ix = ixkinds[i];
+        snprintf(label, sizeof(label), "parse/%s", ixnames[i]);
+        nodes = -1, segs = -1;
+        search_bench_run(runs, label, data_row_ops(data_parse_query, &ctx), 
+            data_parse_query, &ctx, &nodes, &segs);
+    }
+
+    // Writing
+    static const char *formats[] = { "geojson", "wkt", "wkb", "geobin" };
+    ctx.geom = geoms[1];
+    for (int i = 0; i < 4; i++) {
+        ctx.format = i;
+        ctx.bufsz = data_write(&ctx, NULL, 0)+1;
+        ctx.buf = malloc(ctx.bufsz);
+        assert(ctx.buf);
+        snprintf(label, sizeof(label), "write/%s", formats[i]);
+        nodes = -1, segs = -1;
+        search_bench_run(runs, label, data_row_ops(data_write_query, &ctx),
+            data_write_query, &ctx, &nodes, &segs);
+        free(ctx.buf);
+        ctx.buf = NULL;
+    }
+
+    // Queries, where rects are 0.1% of the MBR area around each point.
+    struct tg_point *points = data_make_queries(geoms[1], dist, nqueries);
+    struct tg_rect rect = tg_geom_rect(geoms[1]);
+    double hw = (rect.max.x-rect.min.x)*sqrt(0.001)/2;
+    double hh = (rect.max.y-rect.min.y)*sqrt(0.001)/2;
+    struct tg_rect *rects = malloc(nqueries*sizeof(struct tg_rect));
+    assert(rects);
+    for (int i = 0; i < nqueries; i++) {
+        rects[i] = R(points[i].x-hw, points[i].y-hh, points[i].x+hw, 
+            points[i].y+hh);
+    }
+    ctx.points = points;
+    ctx.rects = rects;
+    for (int i = 0; i < 3; i++) {
+        ctx.geom = geoms[i];
+        snprintf(label, sizeof(label), "pip/%s", ixnames[i]);
+        nodes = -1, segs = -1;
+        search_bench_run(runs, label, nqueries, data_pip_query, &ctx, 
+            &nodes, &segs);
+    }
+    for (int i = 0; i < 3; i++) {
+        ctx.geom = geoms[i];
+        snprintf(label, sizeof(label), "rect/%s", ixnames[i]);
+        nodes = -1, segs = -1;
+        search_bench_run(runs, label, nqueries, data_rect_query, &ctx, 
+            &nodes, &segs);
+    }
+    free(rects);
+    free(points);
+    for (int i = 0; i < 3; i++) {
+        tg_geom_free(geoms[i]);
+    }
+    free(data);
+}
+
+static int data_cmp_names(const void *a, const void *b) {
+    return strcmp(*(char**)a, *(char**)b);
+}
+
+static bool data_has_ext(const char *name) {
+    static const char *exts[] = { 
+        ".geojson", ".json", ".wkb", ".geobin", ".wkt", ".hex" 
+    };
+    size_t n = strlen(name);
+    for (size_t i = 0; i < sizeof(exts)/sizeof(exts[0]); i++) {
+        size_t m = strlen(exts[i]);
+        if (n > m && strcmp(name+n-m, exts[i]) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void main_data_bench(uint64_t seed, int runs) {
+    set_section("data");
+    srand(seed);
+    const char *path = getenv("DATA");
+    const char *dist = getenv("DATA_QUERIES");
+    if (!dist || !*dist) dist = "uniform";
+    int nqueries = atoi(getenv("DATA_NQUERIES")?getenv("DATA_NQUERIES"):"0");
+    if (nqueries <= 0) nqueries = DATA_NQUERIES;
+    print_start_bold();
+    printf("== Dataset ==");
+    print_end_bold();
+    if (!path || !*path) {
+        printf("Use DATA=path to provide a GeoJSON, WKT, WKB, Hex, or GeoBIN\n"
+               "file, or a directory of them.\n");
+        return;
+    }
+    printf("Benchmark parsing, writing, and querying %s. Each file is\n"
+           "parsed with each index kind, written with the natural index,\n"
+           "and queried by %dK %s points (pip) and by rects of 0.1%% of\n"
+           "the MBR around the same points (rect). Use DATA_QUERIES to\n"
+           "choose uniform, clustered, or a file of 'x y' lines, and\n"
+           "DATA_NQUERIES to change the number of queries.\n", path, 
+           nqueries/1000, dist);
+    printf("Performs %d run%s and chooses the best results. Rows that take\n"
+           "longer than %.0f seconds stop after fewer runs.\n", runs, 
+           runs!=0?"s":"", MAX_ROW_SECS);
+    DIR *dir = opendir(path);
+    if (!dir) {
+        test_data_bench(runs, path, dist, nqueries);
+        return;
+    }
+    char **names = NULL;
+    int nnames = 0;
+    struct dirent *ent;
+    while ((ent = readdir(dir))) {
+        if (data_has_ext(ent->d_name)) {
+            names = realloc(names, (nnames+1)*sizeof(char*));
+            assert(names);
+            size_t n = strlen(path)+strlen(ent->d_name)+2;
+            names[nnames] = malloc(n);
+            assert(names[nnames]);
+            snprintf(names[nnames], n, "%s/%s", path, ent->d_name);
+            nnames++;
+        }
+    }
+    closedir(dir);
+    qsort(names, nnames, sizeof(char*), data_cmp_names);
+    for (int i = 0; i < nnames; i++) {
+        test_data_bench(runs, names[i], dist, nqueries);
+        free(names[i]);
+    }
+    free(names);
+}
+
+// Churn benchmark
+
+#define CHURN_LIVE      10000  // number of live geometries
+#define CHURN_TICKS     12     // number of rows printed over the duration
+#define CHURN_SOURCES   64     // number of small source features
+
+size_t bmalloc_peak_heap_size(void);
+void bmalloc_reset_peak(void);
+int bmalloc_histogram(size_t *counts, int n);
+
+struct churn_source {
+    char *json;
+    size_t jsonsz;
+    uint8_t *wkb;
+    size_t wkbsz;
+};
+
+// Total number of malloc and realloc calls.
+size_t churn_allocs(void) {
+    size_t counts[64];
+    int n = bmalloc_histogram(counts, 64);
+    size_t total = 0;
+    for (int i = 0; i < n; i++) {
+        total += counts[i];
+    }
+    return total;
+}
+
+// Resident set size of the process in bytes, or zero if unknown.
+size_t churn_rss(void) {
+    size_t rss = 0;
+#ifdef __linux__
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f) {
+        unsigned long size, resident;
+        if (fscanf(f, "%lu %lu", &size, &resident) == 2) {
+            rss = resident*sysconf(_SC_PAGESIZE);
+        }
+        fclose(f);
+    }
+#endif
+    return rss;
+}
+
+void churn_source_init(struct churn_source *src, const struct tg_geom *geom) {
+    src->jsonsz = tg_geom_geojson(geom, 0, 0);
+    src->json = malloc(src->jsonsz+1);
+    assert(src->json);
+    tg_geom_geojson(geom, src->json, src->jsonsz+1);
+    src->wkbsz = tg_geom_wkb(geom, 0, 0);
+    src->wkb = malloc(src->wkbsz);
+    assert(src->wkb);
+    tg_geom_wkb(geom, src->wkb, src->wkbsz);
+}
+
+// A small random feature with properties, which is a point or a polygon
+// with 4 to 64 sides.
+struct tg_geom *churn_feature(int i) {
+    struct tg_point c = rand_point(R(-180, -80, 170, 80));
+    struct tg_geom *geom;
+    if (i%2 == 0) {
+        geom = tg_geom_new_point(c);
+    } else {
+        int n = 4+rand()%61;
+        struct tg_point points[65];
+        for (int j = 0; j < n; j++) {
+            double a = 2*M_PI*j/n;
+            double r = 0.5+rand_double()*0.5;
+            points[j] = (struct tg_point){ c.x+cos(a)*r, c.y+sin(a)*r };
+        }
+        points[n] = points[0];
+        struct tg_ring *ring = tg_ring_new(points, n+1);
+        struct tg_poly *poly = tg_poly_new(ring, NULL, 0);
+        geom = tg_geom_new_polygon(poly);
+        tg_poly_free(poly);
+        tg_ring_free(ring);
+    }
+    assert(geom);
+    // Round trip through GeoJSON to attach the id and properties.
+    char head[128];
+    int m = snprintf(head, sizeof(head), "{\"type\":\"Feature\",\"id\":%d,"
+        "\"properties\":{\"name\":\"f%d\"},\"geometry\":", i, i);
+    size_t n = tg_geom_geojson(geom, 0, 0);
+    char *json = malloc(m+n+2);
+    assert(json);
+    memcpy(json, head, m);
+    tg_geom_geojson(geom, json+m, n+1);
+    strcpy(json+m+n, "}");
+    tg_geom_free(geom);
+    geom = tg_parse_geojson(json);
+    assert(geom && !tg_geom_error(geom));
+    free(json);
+    return geom;
+}
+
+void main_churn_bench(uint64_t seed, int runs) {
+    (void)runs;
+    set_section("churn");
+    srand(seed);
+    double secs = atof(getenv("CHURN_SECS")?getenv("CHURN_SECS"):"0");
+    if (secs <= 0) secs = 60;
+    const char *preload = getenv("LD_PRELOAD");
+    print_start_bold();
+    printf("== Parse/free churn ==");
+    print_end_bold();
+    printf("Benchmark memory over time for %.0f seconds of mixed GeoJSON and\n"
+           "WKB parsing, cloning, copying, and reparsing, where each op\n"
+           "replaces one of %d live geometries. Sources are %d small\n"
+           "features and the state polygons, which are picked 1 in 100 ops.\n"
+           "Use CHURN_SECS=N to change the duration and LD_PRELOAD to\n"
+           "change the allocator, which is currently %s.\n",
+           secs, CHURN_LIVE, CHURN_SOURCES, 
+           preload && *preload ? preload : "the system malloc");
+
+    const char *states[] = { "br", "tx", "az", "bc", "ri" };
+    int nstates = sizeof(states)/sizeof(states[0]);
+    int nsources = CHURN_SOURCES+nstates;
+    struct churn_source *sources = calloc(nsources, sizeof(*sources));
+    assert(sources);
+    for (int i = 0; i < CHURN_SOURCES; i++) {
+        struct tg_geom *geom = churn_feature(i);
+        churn_source_init(&sources[i], geom);
+        tg_geom_free(geom);
+    }
+    for (int i = 0; i < nstates; i++) {
+        struct tg_geom *ring = load_geom(states[i], TG_NONE);
+        struct tg_geom *geom = tg_geom_new_polygon(
+            tg_poly_new((struct tg_ring*)ring, NULL, 0));
+        churn_source_init(&sources[CHURN_SOURCES+i], geom);
+        tg_poly_free((struct tg_poly*)tg_geom_poly(geom));
+        tg_geom_free(geom);
+        tg_geom_free(ring);
+    }
+    struct tg_geom **live = calloc(CHURN_LIVE, sizeof(struct tg_geom*));
+    assert(live);
+    size_t bufcap = 1024;
+    char *buf = malloc(bufcap);
+    assert(buf);
+
+    set_group("mixed");
+    print_start_bold();
+    printf("%-8s %10s %8s %10s %12s %12s %12s", "time", "ops", "ns/op",
+        "allocs/op", "live", "peak", "rss");
+    print_end_bold();
+
+    size_t heap_start = bmalloc_heap_size();
+    size_t allocs_start = churn_allocs();
+    size_t hist_start[64], hist_end[64];
+    int nbuckets = bmalloc_histogram(hist_start, 64);
+    bmalloc_reset_peak();
+    double samples[CHURN_TICKS];
+    int nsamples = 0;
+    double start = clock_now();
+    double tick_start = start;
+    size_t tick_allocs = allocs_start;
+    uint64_t ops = 0;
+    uint64_t tick_ops = 0;
+    while (nsamples < CHURN_TICKS) {
+        for (int k = 0; k < 1000; k++) {
+            int i = rand()%CHURN_LIVE;
+            int s = rand()%100 == 0 ? CHURN_SOURCES+rand()%nstates : 
+                rand()%CHURN_SOURCES;
+            struct churn_source *src = &sources[s];
+            const struct tg_geom *other = live[rand()%CHURN_LIVE];
+            struct tg_geom *geom = NULL;
+            switch (rand()%10) {
+            case 0: case 1: case 2: case 3:
+                geom = tg_parse_geojsonn(src->json, src->jsonsz);
+                break;
+            case 4: case 5: case 6:
+                geom = tg_parse_wkb(src->wkb, src->wkbsz);
+                break;
+            case 7:
+                geom = other ? tg_geom_clone(other) : NULL;
+                break;
+            case 8:
+                geom = other ? tg_geom_copy(other) : NULL;
+                break;
+            case 9:
+                if (other) {
+                    size_t n = tg_geom_geojson(other, buf, bufcap);
+                    if (n >= bufcap) {
+                        bufcap = n+1;
+                        buf = realloc(buf, bufcap);
+                        assert(buf);
+                        tg_geom_geojson(other, buf, bufcap);
+                    }
+                    geom = tg_parse_geojsonn(buf, n);
+                }
+                break;
+            }
+            assert(!geom || !tg_geom_error(geom));
+            tg_geom_free(live[i]);
+            live[i] = geom;
+        }
+        ops += 1000;
+        tick_ops += 1000;
+        double now = clock_now();
+        if (now-tick_start < secs/CHURN_TICKS) {
+            continue;
+        }
+        size_t allocs = churn_allocs();
+        double ns_op = (now-tick_start)/tick_ops*1e9;
+        samples[nsamples++] = ns_op;
+        printf("%7.1fs %10llu %8.0f %10.2f %9.0f KB %9.0f KB %9.0f KB\n", 
+            now-start, (unsigned long long)ops, ns_op, 
+            (double)(allocs-tick_allocs)/tick_ops, 
+            (double)(bmalloc_heap_size()-heap_start)/1024,
+            (double)(bmalloc_peak_heap_size()-heap_start)/1024,
+            (double)churn_rss()/1024);
+        tick_start = now;
+        tick_allocs = allocs;
+        tick_ops = 0;
+    }
+    double elapsed = clock_now()-start;
+    size_t allocs = churn_allocs()-allocs_start;
+    size_t peak = bmalloc_peak_heap_size()-heap_start;
+    bmalloc_histogram(hist_end, nbuckets);
+    record_row("churn", ops/elapsed, elapsed/ops*1e9, 0, peak, allocs, 0, 0, 
+        samples, nsamples);
+
+    for (int i = 0; i < CHURN_LIVE; i++) {
+        tg_geom_free(live[i]);
+    }
+    size_t leaked = bmalloc_heap_size()-heap_start;
+    printf("%llu allocations, %.0f KB peak, %llu bytes live after free\n",
+        (unsigned long long)allocs, (double)peak/1024, 
+        (unsigned long long)leaked);
+
+    print_start_bold();
+    printf("%-20s %12s %8s", "allocation size", "count", "share");
+    print_end_bold();
+    for (int i = 0; i < nbuckets; i++) {
+        size_t count = hist_end[i]-hist_start[i];
+        if (count == 0) {
+            continue;
+        }
+        char range[48];
+        if (i == 0) {
+            snprintf(range, sizeof(range), "<= 1");
+        } else {
+            snprintf(range, sizeof(range), "%llu-%llu", 
+                (unsigned long long)((1ULL<<(i-1))+1), 
+                (unsigned long long)(1ULL<<i));
+        }
+        printf("%-20s %12zu %7.2f%%\n", range, count, 
+            (double)count/allocs*100);
+    }
+
+    free(buf);
+    free(live);
+    for (int i = 0; i < nsources; i++) {
+        free(sources[i].json);
+        free(sources[i].wkb);
+    }
+    free(sources);
+}
+
+// Threads benchmark
+
+#define THREAD_OPS         100000  // number of operations per thread
+#define THREAD_PARSE_OPS   1000    // number of parse operations per thread
+
+#define HEADER_FIELDS_THREADS "%7s %11s %8s %8s %10s"
+#define ROW_FIELDS_THREADS    "%7d %11s %8.0f %7.2fx %9.0f%%"
+
+void print_header_threads(const char *name) {
+    set_group(name);
+    print_start_bold();
+    printf("%-20s " HEADER_FIELDS_THREADS, name, "threads", "ops/sec", 
+        "ns/op", "speedup", "efficiency");
+    print_end_bold();
+}
+
+enum threads_kind { 
+    THREADS_PIP, THREADS_INTERSECTS, THREADS_CLONE, THREADS_PARSE 
+};
+
+// Shared by all threads of a run.
+struct threads_ctx {
+    enum threads_kind kind;
+    int nops;
+    struct tg_geom *geom;
+    struct tg_point *points;
+    struct tg_geom **lines;
+    int npoints;
+    uint8_t *wkb;
+    size_t wkbsz;
+    pthread_mutex_t mu;
+    pthread_cond_t cond;
+    bool started;
+};
+
+struct threads_arg {
+    struct threads_ctx *ctx;
+    int id;
+    int hits;
+};
+
+static void *threads_worker(void *varg) {
+    struct threads_arg *arg = varg;
+    struct threads_ctx *ctx = arg->ctx;
+    // wait for all threads to be ready
+    pthread_mutex_lock(&ctx->mu);
+    while (!ctx->started) {
+        pthread_cond_wait(&ctx->cond, &ctx->mu);
+    }
+    pthread_mutex_unlock(&ctx->mu);
+    int hits = 0;
+    int j = (arg->id*7919) % ctx->npoints;
+    for (int i = 0; i < ctx->nops; i++) {
+        switch (ctx->kind) {
+        case THREADS_PIP:
+            hits += tg_geom_intersects_xy(ctx->geom, ctx->points[j].x, 
+                ctx->points[j].y);
+            break;
+        case THREADS_INTERSECTS:
+            hits += tg_geom_intersects(ctx->geom, ctx->lines[j]);
+            break;
+        case THREADS_CLONE: {
+            struct tg_geom *geom = tg_geom_clone(ctx->geom);
+            hits += geom != NULL;
+            tg_geom_free(geom);
+            break;
+        }
+        case THREADS_PARSE: {
+            struct tg_geom *geom = tg_parse_wkb_ix(ctx->wkb, ctx->wkbsz, 
+                TG_NONE);
+            hits += !tg_geom_error(geom);
+            tg_geom_free(geom);
+            break;
+        }}
+        j = j+1 == ctx->npoints ? 0 : j+1;
+    }
+    arg->hits = hits;
+    return NULL;
+}
+
+// Returns the wall time of running the workload on nthreads at once.
+static double threads_step(struct threads_ctx *ctx, int nthreads) {
+    pthread_t *threads = malloc(nthreads*sizeof(pthread_t));
+    struct threads_arg *args = malloc(nthreads*sizeof(struct threads_arg));
+    assert(threads && args);
+    ctx->started = false;
+    for (int i = 0; i < nthreads; i++) {
+        args[i] = (struct threads_arg){ .ctx = ctx, .id = i };
+        assert(pthread_create(&threads[i], NULL, threads_worker, 
+            &args[i]) == 0);
+    }
+    double start = clock_now();
+    pthread_mutex_lock(&ctx->mu);
+    ctx->started = true;
+    pthread_cond_broadcast(&ctx->cond);
+    pthread_mutex_unlock(&ctx->mu);
+    for (int i = 0; i < nthreads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    double secs = clock_now()-start;
+    for (int i = 1; i < nthreads; i++) {
+        // all threads do the same work
+        assert(args[i].hits == args[0].hits || ctx->kind <= 
+            THREADS_INTERSECTS);
+    }
+    free(args);
+    free(threads);
+    return secs;
+}
+
+void threads_bench_run(int runs, const char *label, struct threads_ctx *ctx,
+    int maxthreads)
+{
+    double base_ops = 0;
+    double *samples = malloc(runs*sizeof(double));
+    assert(samples);
+    int nthreads = 1;
+    while (nthreads <= maxthreads) {
+        double secs = 0;
+        for (int i = 0; i < runs; i++) {
+            if (!markdown) {
+                printf("\r%-20s %7d %2d/%d ", label, nthreads, i+1, runs); 
+            }
+            fflush(stdout);
+            double secs0 = threads_step(ctx, nthreads);
+            samples[i] = secs0/ctx->nops*1e9;
+            if (i == 0 || secs0 < secs) {
+                secs = secs0;
+            }
+        }
+        double total = (double)ctx->nops*nthreads;
+        double ops = total/secs;
+        if (nthreads == 1) {
+            base_ops = ops;
+        }
+        if (!markdown) {
+            printf("\r");
+        }
+        printf("%-20s ", label);
+        printf(ROW_FIELDS_THREADS, nthreads, commaize(ops), 
+            secs/ctx->nops*1e9, ops/base_ops, ops/base_ops/nthreads*100.0);
+        printf("\n");
+        char name[64];
+        snprintf(name, sizeof(name), "%s/%dt", label, nthreads);
+        record_row(name, ops, secs/ctx->nops*1e9, 0, 0, 0, 0, 0, samples, 
+            runs);
+        if (nthreads < maxthreads && nthreads*2 > maxthreads) {
+            // always finish with the maximum number of threads
+            nthreads = maxthreads;
+        } else {
+            nthreads *= 2;
+        }
+    }
+    free(samples);
+}
+
+void test_threads_bench(int runs, const char *name, int maxthreads) {
+    struct tg_geom *shape = load_geom(name, TG_NONE);
+    const struct tg_ring *ring = tg_poly_exterior(tg_geom_poly(shape));
+    const struct tg_point *points = tg_ring_points(ring);
+    int npoints = tg_ring_num_points(ring);
+    struct tg_rect rect = rect_from_points(points, npoints);
+
+    struct threads_ctx ctx = { 
+        .npoints = NUM_RAND_POINTS,
+        .mu = PTHREAD_MUTEX_INITIALIZER,
+        .cond = PTHREAD_COND_INITIALIZER,
+    };
+    ctx.points = make_random_points(rect, NUM_RAND_POINTS);
+    struct tg_segment *rsegs = make_random_segments(rect, NUM_RAND_POINTS);
+    ctx.lines = malloc(NUM_RAND_POINTS*sizeof(struct tg_geom*));
+    assert(ctx.lines);
+    for (int i = 0; i < NUM_RAND_POINTS; i++) {
+        struct tg_point lpoints[] = { rsegs[i].a, rsegs[i].b };
+        struct tg_line *line = tg_line_new(lpoints, 2);
+        assert(line);
+        ctx.lines[i] = tg_geom_new_linestring(line);
+        assert(ctx.lines[i]);
+        tg_line_free(line);
+    }
+    ctx.wkbsz = tg_geom_wkb(shape, 0, 0);
+    ctx.wkb = malloc(ctx.wkbsz);
+    assert(ctx.wkb);
+    tg_geom_wkb(shape, ctx.wkb, ctx.wkbsz);
+
+    const char *ixnames[] = { "natural", "ystripes" };
+    enum tg_index ixs[] = { TG_NATURAL, TG_YSTRIPES };
+    char label[64];
+    for (int i = 0; i < 2; i++) {
+        struct tg_ring *ring2 = tg_ring_new_ix(points, npoints, ixs[i]);
+        assert(ring2);
+        ctx.geom = tg_geom_new_polygon((struct tg_poly*)ring2);
+        assert(ctx.geom);
+        tg_ring_free(ring2);
+        ctx.nops = THREAD_OPS;
+        ctx.kind = THREADS_PIP;
+        snprintf(label, sizeof(label), "pip/%s", ixnames[i]);
+        threads_bench_run(runs, label, &ctx, maxthreads);
+        ctx.kind = THREADS_INTERSECTS;
+        snprintf(label, sizeof(label), "intersects/%s", ixnames[i]);
+        threads_bench_run(runs, label, &ctx, maxthreads);
+        tg_geom_free(ctx.geom);
+    }
+    ctx.geom = shape;
+    ctx.kind = THREADS_CLONE;
+    threads_bench_run(runs, "clone/free", &ctx, maxthreads);
+    ctx.kind = THREADS_PARSE;
+    ctx.nops = THREAD_PARSE_OPS;
+    threads_bench_run(runs, "parse/wkb", &ctx, maxthreads);
+
+    for (int i = 0; i < NUM_RAND_POINTS; i++) {
+        tg_geom_free(ctx.lines[i]);
+    }
+    free(ctx.lines);
+    free(ctx.points);
+    free(ctx.wkb);
+    free(rsegs);
+    tg_geom_free(shape);
+}
+
+void main_threads_bench(uint64_t seed, int runs) {
+    set_section("threads");
+    srand(seed);
+    int maxthreads = atoi(getenv("THREADS")?getenv("THREADS"):"0");
+    if (maxthreads <= 0) {
+        maxthreads = sysconf(_SC_NPROCESSORS_ONLN);
+        maxthreads = maxthreads < 1 ? 1 : maxthreads;
+    }
+    print_start_bold();
+    printf("== Threads ==");
+    print_end_bold();
+    printf("Benchmark the scaling of operations on geometries that are shared\n"
+           "by 1 to %d threads. Each thread performs %dK operations of\n"
+           "point-in-polygon, line intersects, or clone and free, or %dK\n"
+           "WKB parse operations.\n"
+           "Efficiency is the speedup divided by the number of threads.\n"
+           "Use THREADS=N to change the maximum number of threads.\n",
+           maxthreads, THREAD_OPS/1000, THREAD_PARSE_OPS/1000);
+    printf("Performs %d run%s and chooses the best results.\n", runs, runs!=0?"s":"");
+    print_header_threads("Texas");
+    test_threads_bench(runs, "tx", maxthreads);
+    print_header_threads("Brazil");
+    test_threads_bench(runs, "br", maxthreads);
+}
+
+int main(int argc, char **argv) {
+    tg_env_set_allocator(bmalloc, brealloc, bfree);
+    markdown = atoi(getenv("MARKDOWN")?getenv("MARKDOWN"):"0");
+    uint64_t seed = strtoull(getenv("SEED")?getenv("SEED"):"0", NULL, 10);
+    if (!seed) seed = mkrandseed();
+
+    int runs = atoi(getenv("RUNS")?getenv("RUNS"):"0");
+    if (runs <= 0) runs = 10;
+
+    bench_seed = seed;
+    printf("SEED=%llu\n", (unsigned long long)seed);
+    printf("RUNS=%llu\n", (unsigned long long)runs);
+    perf_init();
+
+    if (argc == 2) {
+        // run all tests
+        main_pip_bench(seed, runs, false);
+        main_intersects_bench(seed, runs);
+        main_io_bench(seed, runs);
+        main_predicates_bench(seed, runs);
+        main_knn_bench(seed, runs);
+        main_search_bench(seed, runs);
+    } else {
+        // run specific tests
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "io") == 0 || strcmp(argv[i], "i/o") == 0) {
+                main_io_bench(seed, runs);
+            }
+            if (strcmp(argv[i], "pip") == 0) {
+                main_pip_bench(seed, runs, false);
+            }
+            if (strcmp(argv[i], "pip_simple") == 0) {
+                main_pip_bench(seed, runs, true);
+            }
+            if (strcmp(argv[i], "intersects") == 0) {
+                main_intersects_bench(seed, runs);
+            }
+            if (strcmp(argv[i], "predicates") == 0) {
+                main_predicates_bench(seed, runs);
+            }
+            if (strcmp(argv[i], "knn") == 0) {
+                main_knn_bench(seed, runs);
+            }
+            if (strcmp(argv[i], "search") == 0) {
+                main_search_bench(seed, runs);
+            }
+            if (strcmp(argv[i], "multi") == 0) {
+                main_multi_bench(seed, runs);
+            }
+            if (strcmp(argv[i], "join") == 0) {
+                main_join_bench(seed, runs);
+            }
+            if (strcmp(argv[i], "spread") == 0) {
+                main_spread_bench(seed, runs);
+            }
+            if (strcmp(argv[i], "data") == 0) {
+                main_data_bench(seed, runs);
+            }
+            if (strcmp(argv[i], "churn") == 0) {
+                main_churn_bench(seed, runs);
+            }
+            if (strcmp(argv[i], "threads") == 0) {
+                main_threads_bench(seed, runs);
+            }
+        }
+    }
+    const char *output = getenv("OUTPUT");
+    if (output && *output) {
+        write_results(output);
+        printf("Results written to %s\n", output);
     }
     // Do a quick exit to avoid any thread-local and c++ stack unrolling.
+    fflush(stdout);
     _Exit(0);
 }
\ No newline at end of file
@@ -0,0 +1,350 @@
+// Compare two benchmark results files that were written by bench.c using
+// the OUTPUT environment variable.
+//
+//   ./run.sh benchcmp old.json new.json [threshold-percent]
+//
+// Rows are matched by section, group, and name. A row is only reported as a
+// regression (or improvement) when the best ns/op has changed by more than
+// the threshold (default 5%) and the 95% confidence intervals of the two
+// runs do not overlap, which keeps ordinary run-to-run noise from being
+// flagged. Exits with status 1 when any row regressed.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include "../deps/json.h"
+
+// The section, group, and name are the same sizes as those in the
+// bench_row of bench.c.
+struct row {
+    char section[32];
+    char group[32];
+    char name[64];
+    char label[160];
+    int nsamples;
+    double samples[256];
+    double ns_op;
+    bool matched;
+};
+
+struct rows {
+    struct row *rows;
+    int len;
+    int cap;
+};
+
+static struct row *rows_push(struct rows *rows) {
+    if (rows->len == rows->cap) {
+        rows->cap = rows->cap == 0 ? 64 : rows->cap*2;
+        rows->rows = realloc(rows->rows, rows->cap*sizeof(struct row));
+        if (!rows->rows) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+    struct row *row = &rows->rows[rows->len++];
+    memset(row, 0, sizeof(struct row));
+    return row;
+}
+
+static char *read_file(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        exit(1);
+    }
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *data = malloc(len+1);
+    if (!data || fread(data, 1, len, f) != (size_t)len) {
+        fprintf(stderr, "%s: read failed\n", path);
+        exit(1);
+    }
+    data[len] = '\0';
+    fclose(f);
+    return data;
+}
+
+// Copies a field into a row buffer, failing when it does not fit.
+static void copy_field(const char *path, const char *what, char *dst, 
+    size_t size, const char *src, size_t len)
+{
+    if (len >= size) {
+        fprintf(stderr, "%s: %s is too long (%zu bytes, max %zu): %.*s\n",
+            path, what, len, size-1, (int)len, src);
+        exit(1);
+    }
+    memcpy(dst, src, len);
+    dst[len] = '\0';
+}
+
+static void set_label(struct row *row) {
+    snprintf(row->label, sizeof(row->label), "%s %s %s", row->section,
+        row->group, row->name);
+}
+
+static bool same_key(const struct row *a, const struct row *b) {
+    return strcmp(a->section, b->section) == 0 && 
+        strcmp(a->group, b->group) == 0 && strcmp(a->name, b->name) == 0;
+}
+
+static void copy_json_field(const char *path, const char *what, char *dst, 
+    size_t size, struct json json)
+{
+    size_t len = json_string_length(json);
+    char *str = malloc(len+1);
+    if (!str) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    json_string_copy(json, str, len+1);
+    copy_field(path, what, dst, size, str, len);
+    free(str);
+}
+
+static void load_json(const char *path, const char *data, struct rows *rows) {
+    if (!json_valid(data)) {
+        fprintf(stderr, "%s: invalid json\n", path);
+        exit(1);
+    }
+    struct json json = json_first(json_parse(data));
+    while (json_exists(json)) {
+        struct row *row = rows_push(rows);
+        copy_json_field(path, "section", row->section, sizeof(row->section),
+            json_object_get(json, "section"));
+        copy_json_field(path, "group", row->group, sizeof(row->group),
+            json_object_get(json, "group"));
+        copy_json_field(path, "name", row->name, sizeof(row->name),
+            json_object_get(json, "name"));
+        set_label(row);
+        row->ns_op = json_double(json_object_get(json, "ns_op"));
+        struct json sample = json_first(json_object_get(json, "samples_ns"));
+        while (json_exists(sample) && row->nsamples < 256) {
+            row->samples[row->nsamples++] = json_double(sample);
+            sample = json_next(sample);
+        }
+        json = json_next(json);
+    }
+}
+
+// Reads the next CSV field in place, unquoting it when it starts with a
+// quote. Quotes inside of a quoted field are doubled. Returns the end of the
+// field, which is the comma, newline, or terminator that follows it.
+static char *csv_field(char *p, char **field, size_t *len) {
+    char *dst = p;
+    *field = p;
+    if (*p != '"') {
+        while (*p && *p != ',' && *p != '\n' && *p != '\r') {
+            p++;
+        }
+        *len = p-*field;
+        return p;
+    }
+    p++;
+    while (*p) {
+        if (*p == '"') {
+            if (p[1] != '"') {
+                p++;
+                break;
+            }
+            p++;
+        }
+        *dst++ = *p++;
+    }
+    *len = dst-*field;
+    return p;
+}
+
+static void load_csv(const char *path, char *data, struct rows *rows) {
+    // section,group,name,ops_sec,ns_op,build_us,bytes,allocs,points,hits,
+    // seed,commit,samples_ns
+    char *p = data;
+    bool header = true;
+    while (*p) {
+        char *fields[13] = { 0 };
+        size_t lens[13] = { 0 };
+        int nfields = 0;
+        while (1) {
+            char *field;
+            size_t len;
+            p = csv_field(p, &field, &len);
+            if (nfields < 13) {
+                fields[nfields] = field;
+                lens[nfields] = len;
+                nfields++;
+            }
+            if (*p != ',') {
+                break;
+            }
+            p++;
+        }
+        // end of the record
+        char *end = p;
+        while (*p == '\r' || *p == '\n') {
+            p++;
+        }
+        *end = '\0';
+        for (int i = 0; i < nfields; i++) {
+            fields[i][lens[i]] = '\0';
+        }
+        if (header) {
+            header = false;
+            continue;
+        }
+        if (nfields == 13) {
+            struct row *row = rows_push(rows);
+            copy_field(path, "section", row->section, sizeof(row->section),
+                fields[0], lens[0]);
+            copy_field(path, "group", row->group, sizeof(row->group),
+                fields[1], lens[1]);
+            copy_field(path, "name", row->name, sizeof(row->name),
+                fields[2], lens[2]);
+            set_label(row);
+            row->ns_op = atof(fields[4]);
+            char *s = fields[12];
+            while (*s && row->nsamples < 256) {
+                row->samples[row->nsamples++] = strtod(s, &s);
+                if (*s == ';') {
+                    s++;
+                } else {
+                    break;
+                }
+            }
+        }
+    }
+}
+
+static void load(const char *path, struct rows *rows) {
+    char *data = read_file(path);
+    size_t n = strlen(path);
+    if (n >= 4 && strcmp(path+n-4, ".csv") == 0) {
+        load_csv(path, data, rows);
+    } else {
+        load_json(path, data, rows);
+    }
+    free(data);
+}
+
+struct stats {
+    double best;
+    double mean;
+    double ci;  // half width of the 95% confidence interval
+    int n;
+};
+
+// Two-sided 95% critical values of the t-distribution.
+static double tvalue(int df) {
+    static const double t[] = {
+        0, 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262,
+        2.228, 2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093,
+        2.086, 2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045,
+        2.042,
+    };
+    if (df < 1) {
+        return 0;
+    }
+    if (df <= 30) {
+        return t[df];
+    }
+    return 1.960;
+}
+
+static struct stats row_stats(struct row *row) {
+    struct stats stats = { .best = row->ns_op, .mean = row->ns_op };
+    stats.n = row->nsamples;
+    if (stats.n == 0) {
+        return stats;
+    }
+    double sum = 0;
+    stats.best = row->samples[0];
+    for (int i = 0; i < stats.n; i++) {
+        sum += row->samples[i];
+        if (row->samples[i] < stats.best) {
+            stats.best = row->samples[i];
+        }
+    }
+    stats.mean = sum/stats.n;
+    if (stats.n > 1) {
+        double var = 0;
+        for (int i = 0; i < stats.n; i++) {
+            double d = row->samples[i]-stats.mean;
+            var += d*d;
+        }
+        var /= stats.n-1;
+        stats.ci = tvalue(stats.n-1)*sqrt(var/stats.n);
+    }
+    return stats;
+}
+
+static bool overlaps(struct stats a, struct stats b) {
+    return a.mean-a.ci <= b.mean+b.ci && b.mean-b.ci <= a.mean+a.ci;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr,
+            "usage: %s <old-results> <new-results> [threshold-percent]\n",
+            argv[0]);
+        return 1;
+    }
+    double threshold = argc > 3 ? atof(argv[3])/100.0 : 0.05;
+    struct rows old = { 0 };
+    struct rows new = { 0 };
+    load(argv[1], &old);
+    load(argv[2], &new);
+
+    int nregress = 0;
+    int nimprove = 0;
+    int nmissing = 0;
+    printf("%-48s %12s %12s %8s  %s\n", "benchmark", "old ns/op",
+        "new ns/op", "delta", "");
+    for (int i = 0; i < new.len; i++) {
+        struct row *nrow = &new.rows[i];
+        struct row *orow = NULL;
+        for (int j = 0; j < old.len; j++) {
+            if (!old.rows[j].matched && same_key(&old.rows[j], nrow))
+            {
+                orow = &old.rows[j];
+                break;
+            }
+        }
+        if (!orow) {
+            printf("%-48s %12s %12.2f %8s  (new)\n", nrow->label, "-",
+                nrow->ns_op, "");
+            continue;
+        }
+        orow->matched = true;
+        struct stats ostats = row_stats(orow);
+        struct stats nstats = row_stats(nrow);
+        double delta = ostats.best > 0 ? nstats.best/ostats.best-1 : 0;
+        bool noisy = ostats.n > 1 && nstats.n > 1 &&
+            overlaps(ostats, nstats);
+        const char *verdict = "";
+        if (delta > threshold && !noisy) {
+            verdict = "REGRESSION";
+            nregress++;
+        } else if (delta < -threshold && !noisy) {
+            verdict = "improved";
+            nimprove++;
+        } else if (fabs(delta) > threshold) {
+            verdict = "(noise)";
+        }
+        printf("%-48s %12.2f %12.2f %+7.1f%%  %s\n", nrow->label,
+            ostats.best, nstats.best, delta*100, verdict);
+    }
+    for (int i = 0; i < old.len; i++) {
+        if (!old.rows[i].matched) {
+            printf("%-48s %12.2f %12s %8s  (missing)\n", old.rows[i].label,
+                old.rows[i].ns_op, "-", "");
+            nmissing++;
+        }
+    }
+    printf("\n%d regressed, %d improved, %d missing (threshold %.1f%%)\n",
+        nregress, nimprove, nmissing, threshold*100);
+    free(old.rows);
+    free(new.rows);
+    return nregress > 0 ? 1 : 0;
+}
@@ -2,37 +2,130 @@
 // An allocator used by benchmarking tool to track allocations.
 //
 // Notes:
-// - For single threaded programs only.
+// - Safe for multithreaded programs. The stats are spread over striped
+//   counters, on separate cache lines, to avoid contention between threads.
 // - Track memory stats with malloc_heap_size() and malloc_num_allocs();
+// - Track the peak heap size with bmalloc_peak_heap_size(), which is exact
+//   for a single thread and an upper bound when there are many threads.
+// - Track allocation sizes with bmalloc_histogram(), which counts every
+//   malloc and realloc by the power of two that holds the requested size.
 // - Use with bmalloc.cpp for C++
 
 #include <stdint.h>
 #include <stdlib.h>
 
-static uint64_t num_allocs = 0;
-static uint64_t heap_size = 0;
+#define NSTRIPES 64
+#define BMALLOC_NBUCKETS 40 // power of two buckets, up to 512 GB
+
+struct stripe {
+    int64_t num_allocs;
+    int64_t heap_size;
+    int64_t peak_heap_size;
+    char pad[40];
+    int64_t buckets[BMALLOC_NBUCKETS];
+};
+
+static struct stripe stripes[NSTRIPES];
+static _Thread_local int stripe_idx = -1;
+static int next_stripe = 0;
+
+static struct stripe *get_stripe(void) {
+    if (stripe_idx == -1) {
+        stripe_idx = __atomic_fetch_add(&next_stripe, 1, __ATOMIC_RELAXED) %
+            NSTRIPES;
+    }
+    return &stripes[stripe_idx];
+}
+
+static int size_bucket(size_t size) {
+    int bucket = 0;
+    while (bucket < BMALLOC_NBUCKETS-1 && ((size_t)1<<bucket) < size) {
+        bucket++;
+    }
+    return bucket;
+}
+
+static void add_stats(int64_t num_allocs, int64_t heap_size, 
+    int64_t alloc_size)
+{
+    struct stripe *stripe = get_stripe();
+    __atomic_fetch_add(&stripe->num_allocs, num_allocs, __ATOMIC_RELAXED);
+    int64_t size = __atomic_add_fetch(&stripe->heap_size, heap_size, 
+        __ATOMIC_RELAXED);
+    if (size > __atomic_load_n(&stripe->peak_heap_size, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&stripe->peak_heap_size, size, __ATOMIC_RELAXED);
+    }
+    if (alloc_size >= 0) {
+        __atomic_fetch_add(&stripe->buckets[size_bucket(alloc_size)], 1, 
+            __ATOMIC_RELAXED);
+    }
+}
 
 size_t bmalloc_heap_size(void) {
+    int64_t heap_size = 0;
+    for (int i = 0; i < NSTRIPES; i++) {
+        heap_size += __atomic_load_n(&stripes[i].heap_size, __ATOMIC_RELAXED);
+    }
     return heap_size;
 }
 
 size_t bmalloc_num_allocs(void) {
+    int64_t num_allocs = 0;
+    for (int i = 0; i < NSTRIPES; i++) {
+        num_allocs += __atomic_load_n(&stripes[i].num_allocs, 
+            __ATOMIC_RELAXED);
+    }
     return num_allocs;
 }
 
+// Returns the sum of the peak heap sizes of each thread since the last
+// bmalloc_reset_peak().
+size_t bmalloc_peak_heap_size(void) {
+    int64_t peak = 0;
+    for (int i = 0; i < NSTRIPES; i++) {
+        peak += __atomic_load_n(&stripes[i].peak_heap_size, __ATOMIC_RELAXED);
+    }
+    return peak;
+}
+
+// Resets the peak heap size to the current heap size.
+void bmalloc_reset_peak(void) {
+    for (int i = 0; i < NSTRIPES; i++) {
+        __atomic_store_n(&stripes[i].peak_heap_size, 
+            __atomic_load_n(&stripes[i].heap_size, __ATOMIC_RELAXED),
+            __ATOMIC_RELAXED);
+    }
+}
+
+// Copies the number of allocations by size into counts, where counts[i] is
+// the number of sizes from (2^(i-1))+1 to 2^i bytes. Returns the number of 
+// buckets, which is at most n.
+int bmalloc_histogram(size_t *counts, int n) {
+    if (n > BMALLOC_NBUCKETS) {
+        n = BMALLOC_NBUCKETS;
+    }
+    for (int i = 0; i < n; i++) {
+        int64_t count = 0;
+        for (int j = 0; j < NSTRIPES; j++) {
+            count += __atomic_load_n(&stripes[j].buckets[i], 
+                __ATOMIC_RELAXED);
+        }
+        counts[i] = count;
+    }
+    return n;
+}
+
 void *bmalloc(size_t size) {
     void *mem = malloc(sizeof(uint64_t)+size);
     if (!mem) return NULL;
     *(uint64_t*)mem = size;
-    num_allocs++;
-    heap_size += size;
+    add_stats(1, size, size);
     return (char*)mem+sizeof(uint64_t);
 }
 
 void bfree(void *ptr) {
     if (!ptr) return;
-    heap_size -= *(uint64_t*)((char*)ptr-sizeof(uint64_t));
-    num_allocs--;
+    add_stats(-1, -(int64_t)*(uint64_t*)((char*)ptr-sizeof(uint64_t)), -1);
     free((char*)ptr-sizeof(uint64_t));
 }
 
@@ -42,7 +135,6 @@ void *brealloc(void *ptr, size_t size) {
     void *mem = realloc((char*)ptr-sizeof(uint64_t), sizeof(uint64_t)+size);
     if (!mem) return NULL;
     *(uint64_t*)mem = size;
-    heap_size -= psize;
-    heap_size += size;
+    add_stats(0, (int64_t)size-(int64_t)psize, size);
     return (char*)mem+sizeof(uint64_t);
 }
@@ -3,6 +3,16 @@
 # ./run.sh [<test-name>]
 
 set -e
+
+# Results and comparison files are relative to the caller's directory
+abspath() { if [[ "$1" == /* ]]; then echo "$1"; else echo "$PWD/$1"; fi; }
+if [[ "$OUTPUT" != "" ]]; then
+    export OUTPUT="$(abspath "$OUTPUT")"
+fi
+if [[ "$1" == "benchcmp" ]]; then
+    BENCHCMP_ARGS=("$(abspath "$2")" "$(abspath "$3")" "${@:4}")
+fi
+
 cd $(dirname "${BASH_SOURCE[0]}")
 
 OK=0
@@ -43,6 +53,13 @@ fi
 if [[ "$CC" == "" ]]; then
     CC=cc
 fi
+if [[ "$1" == "benchcmp" ]]; then
+    # ./run.sh benchcmp <old-results> <new-results> [threshold-percent]
+    $CC -O2 ../deps/json.c benchcmp.c -lm
+    ./a.out "${BENCHCMP_ARGS[@]}" || { OK=1; exit 1; }
+    OK=1
+    exit 0
+fi
 if [[ "$1" != "bench" ]]; then
     CFLAGS="-O0 -g2 -Wall -Wextra -fstrict-aliasing $CFLAGS"
     CCVERSHEAD="$($CC --version | head -n 1)"
@@ -110,7 +127,8 @@ echo Compiler: $($cc2 --version | head -n 1)
 if [[ "$NOSANS" == "1" ]]; then
     echo "Sanitizers disabled"
 fi
-echo "TG Commit: `git rev-parse --short HEAD 2>&1 || true`"
+export COMMIT="`git rev-parse --short HEAD 2>/dev/null || true`"
+echo "TG Commit: $COMMIT"
 
 ./genrelations.sh
 
@@ -129,6 +147,9 @@ if [[ "$GEOS_BENCH" == "1" ]]; then
 fi
 
 if [[ "$1" == "bench" ]]; then
+    if [[ "$STATS" == "1" ]]; then
+        CFLAGS="$CFLAGS -DTG_STATS"
+    fi
     echo "BENCHMARKING..."
     if [[ "$MARKDOWN" == "1" ]]; then
         echo_wrapped $CC $CFLAGS bmalloc.c ../tg.c bench.c -lm $GEOS_FLAGS
@@ -154,6 +175,21 @@ else
     DEPS_SRCS="../deps/json.c ../deps/ryu.c"
     DEPS_OBJS="json.o ryu.o"
     rm -f tg.o $DEPS_OBJS
+    run_test() {
+        if [[ "$WITHSANS" == "1" ]]; then
+            export MallocNanoZone=0
+        fi
+        if [[ "$WITHCOV" == "1" ]]; then
+            export LLVM_PROFILE_FILE="$1.profraw"
+        fi
+        if [[ "$VALGRIND" == "1" ]]; then
+            valgrind --leak-check=yes ./$1.test "${@:2}"
+        elif [[ "$CC" == "emcc" ]]; then
+            node ./$1.test "${@:2}"
+        else
+            ./$1.test "${@:2}"
+        fi
+    }
     for f in *; do 
         if [[ "$f" != test_*.c ]]; then continue; fi 
         if [[ "$1" == test_* ]]; then 
@@ -185,18 +221,16 @@ else
         else
             $CC $CFLAGS -DTG_NOAMALGA -o $f.test tg.o $DEPS_OBJS -lm $f
         fi
-        if [[ "$WITHSANS" == "1" ]]; then
-            export MallocNanoZone=0
-        fi
-        if [[ "$WITHCOV" == "1" ]]; then
-            export LLVM_PROFILE_FILE="$f.profraw"
-        fi
-        if [[ "$VALGRIND" == "1" ]]; then
-            valgrind --leak-check=yes ./$f.test $@
-        elif [[ "$CC" == "emcc" ]]; then
-            node ./$f.test $@
-        else
-            ./$f.test $@
+        run_test $f $@
+        if [[ "$f" == "test_stats.c" ]]; then
+            # Again with the TG_STATS counters compiled in
+            if [[ "$AMALGA" == "1" ]]; then
+                $CC $CFLAGS -DTG_STATS -o $f.stats.test ../tg.c -lm $f
+            else
+                $CC $CFLAGS -DTG_STATS -DTG_NOAMALGA -o $f.stats.test \
+                    ../tg.c $DEPS_OBJS -lm $f
+            fi
+            run_test $f.stats $@
         fi
     done
     OK=1
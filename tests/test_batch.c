@@ -0,0 +1,323 @@
+#include <unistd.h>
+#include <sys/wait.h>
+#include "tests.h"
+
+static struct tg_point *gen_points(struct tg_rect rect, int npoints,
+    bool clustered)
+{
+    struct tg_point *points = malloc(npoints*sizeof(struct tg_point));
+    assert(points);
+    struct tg_rect cluster = rect;
+    if (clustered) {
+        // most points near the middle of the rectangle
+        double w = (rect.max.x-rect.min.x)/20;
+        double h = (rect.max.y-rect.min.y)/20;
+        double x = (rect.min.x+rect.max.x)/2;
+        double y = (rect.min.y+rect.max.y)/2;
+        cluster = R(x-w, y-h, x+w, y+h);
+    }
+    for (int i = 0; i < npoints; i++) {
+        points[i] = rand_point(clustered && i%10 ? cluster : rect);
+    }
+    return points;
+}
+
+static void check_covers_xy(const struct tg_geom *geom, int npoints,
+    bool clustered)
+{
+    struct tg_point *points = gen_points(tg_geom_rect(geom), npoints,
+        clustered);
+    bool *results = malloc(npoints+1);
+    assert(results);
+    results[npoints] = true;
+    tg_batch_covers_xy(geom, points, npoints, results);
+    for (int i = 0; i < npoints; i++) {
+        assert(results[i] == tg_geom_covers_xy(geom, points[i].x,
+            points[i].y));
+    }
+    assert(results[npoints]);
+    free(results);
+    free(points);
+}
+
+void test_batch_covers_xy(void) {
+    const struct tg_geom *geoms[] = {
+        (struct tg_geom*)RING(az),
+        (struct tg_geom*)RING(tx),
+        (struct tg_geom*)RING_INDEX(TG_YSTRIPES, ri),
+        (struct tg_geom*)gc_ring(RING_INDEX(TG_NONE, bc)),
+    };
+    int nthreads[] = { 1, 2, 3, 8, 0 };
+    for (size_t i = 0; i < sizeof(nthreads)/sizeof(int); i++) {
+        tg_env_set_batch_threads(nthreads[i]);
+        for (size_t j = 0; j < sizeof(geoms)/sizeof(*geoms); j++) {
+            check_covers_xy(geoms[j], 100, false);
+            check_covers_xy(geoms[j], 20000, false);
+            check_covers_xy(geoms[j], 20000, true);
+            check_covers_xy(geoms[j], 12345, true);
+        }
+    }
+    tg_ring_free((struct tg_ring*)geoms[2]);
+    tg_env_set_batch_threads(0);
+
+    // should not fail
+    tg_batch_covers_xy(geoms[0], NULL, 0, NULL);
+    tg_batch_covers_xy(NULL, (struct tg_point[]){ P(0, 0) }, 1,
+        (bool[]){ true });
+}
+
+void test_batch_intersects(void) {
+    struct tg_geom *geom = (struct tg_geom*)RING(az);
+    struct tg_rect rect = tg_geom_rect(geom);
+    int ngeoms = 5000;
+    struct tg_geom **geoms = malloc(ngeoms*sizeof(struct tg_geom*));
+    assert(geoms);
+    for (int i = 0; i < ngeoms; i++) {
+        struct tg_point min = rand_point(rect);
+        double size = rand_double() * 0.5;
+        struct tg_point points[] = {
+            P(min.x, min.y), P(min.x+size, min.y), P(min.x+size, min.y+size),
+            P(min.x, min.y+size), P(min.x, min.y),
+        };
+        if (i%3 == 0) {
+            geoms[i] = tg_geom_new_point(min);
+        } else {
+            geoms[i] = (struct tg_geom*)tg_ring_new(points, 5);
+        }
+        assert(geoms[i]);
+    }
+    bool *results = malloc(ngeoms);
+    assert(results);
+    int nthreads[] = { 1, 4, 0 };
+    for (size_t i = 0; i < sizeof(nthreads)/sizeof(int); i++) {
+        tg_env_set_batch_threads(nthreads[i]);
+        tg_batch_intersects(geom, (const struct tg_geom**)geoms, ngeoms,
+            results);
+        for (int j = 0; j < ngeoms; j++) {
+            assert(results[j] == tg_geom_intersects(geom, geoms[j]));
+        }
+    }
+    tg_env_set_batch_threads(0);
+    for (int i = 0; i < ngeoms; i++) {
+        tg_geom_free(geoms[i]);
+    }
+    free(results);
+    free(geoms);
+}
+
+// Random squares and points in the rect, as a GeometryCollection.
+static struct tg_geom *gen_collection(struct tg_rect rect, int n) {
+    struct tg_geom **geoms = malloc(n*sizeof(struct tg_geom*));
+    assert(geoms);
+    for (int i = 0; i < n; i++) {
+        struct tg_point min = rand_point(rect);
+        double size = rand_double() * 0.5;
+        struct tg_point points[] = {
+            P(min.x, min.y), P(min.x+size, min.y), P(min.x+size, min.y+size),
+            P(min.x, min.y+size), P(min.x, min.y),
+        };
+        if (i%4 == 0) {
+            geoms[i] = tg_geom_new_point(min);
+        } else {
+            struct tg_ring *ring = tg_ring_new(points, 5);
+            assert(ring);
+            geoms[i] = tg_geom_new_polygon((struct tg_poly*)ring);
+            tg_ring_free(ring);
+        }
+        assert(geoms[i]);
+    }
+    struct tg_geom *geom = tg_geom_new_geometrycollection(
+        (const struct tg_geom *const*)geoms, n);
+    assert(geom);
+    for (int i = 0; i < n; i++) {
+        tg_geom_free(geoms[i]);
+    }
+    free(geoms);
+    return geom;
+}
+
+struct join_ctx {
+    int nb;
+    char *found;
+    int count;
+    int max;
+};
+
+static bool join_iter(int aindex, int bindex, void *udata) {
+    struct join_ctx *ctx = udata;
+    assert(!ctx->found[aindex*ctx->nb+bindex]);
+    ctx->found[aindex*ctx->nb+bindex] = 1;
+    ctx->count++;
+    return ctx->count != ctx->max;
+}
+
+static bool rects_intersect(const struct tg_geom *a, const struct tg_geom *b) {
+    return tg_rect_intersects_rect(tg_geom_rect(a), tg_geom_rect(b));
+}
+
+static void check_join(const struct tg_geom *a, const struct tg_geom *b,
+    bool (*pred)(const struct tg_geom *a, const struct tg_geom *b))
+{
+    bool acoll = tg_geom_typeof(a) == TG_GEOMETRYCOLLECTION;
+    bool bcoll = tg_geom_typeof(b) == TG_GEOMETRYCOLLECTION;
+    int na = acoll ? tg_geom_num_geometries(a) : 1;
+    int nb = bcoll ? tg_geom_num_geometries(b) : 1;
+    char *expect = malloc(na*nb+1);
+    char *found = malloc(na*nb+1);
+    assert(expect && found);
+    int nexpect = 0;
+    for (int i = 0; i < na; i++) {
+        const struct tg_geom *achild = acoll ? tg_geom_geometry_at(a, i) : a;
+        for (int j = 0; j < nb; j++) {
+            const struct tg_geom *bchild = bcoll ? 
+                tg_geom_geometry_at(b, j) : b;
+            expect[i*nb+j] = (pred ? pred : rects_intersect)(achild, bchild);
+            nexpect += expect[i*nb+j];
+        }
+    }
+    int nthreads[] = { 1, 4, 0 };
+    for (size_t i = 0; i < sizeof(nthreads)/sizeof(int); i++) {
+        tg_env_set_batch_threads(nthreads[i]);
+        memset(found, 0, na*nb);
+        struct join_ctx ctx = { .nb = nb, .found = found };
+        assert(tg_join(a, b, pred, join_iter, &ctx));
+        assert(ctx.count == nexpect);
+        assert(memcmp(found, expect, na*nb) == 0);
+    }
+    if (nexpect > 10) {
+        // stop early
+        memset(found, 0, na*nb);
+        struct join_ctx ctx = { .nb = nb, .found = found, .max = 10 };
+        assert(tg_join(a, b, pred, join_iter, &ctx));
+        assert(ctx.count == 10);
+    }
+    tg_env_set_batch_threads(0);
+    free(found);
+    free(expect);
+}
+
+void test_batch_join(void) {
+    struct tg_rect rect = tg_geom_rect((struct tg_geom*)RING(az));
+    struct tg_geom *a = gen_collection(rect, 1500);
+    struct tg_geom *b = gen_collection(rect, 1000);
+    struct tg_geom *small = gen_collection(rect, 50);
+    struct tg_geom *single = tg_parse_wkt(
+        "POLYGON((-112 34,-111 34,-111 35,-112 35,-112 34))");
+    assert(single);
+    check_join(a, b, tg_geom_intersects);
+    check_join(b, a, tg_geom_covers);
+    check_join(a, b, NULL);
+    check_join(a, a, tg_geom_intersects);
+    check_join(small, b, tg_geom_intersects);
+    check_join(b, small, tg_geom_within);
+    check_join(small, small, tg_geom_touches);
+    check_join(single, b, tg_geom_covers);
+    check_join(a, single, tg_geom_intersects);
+
+    // should not fail
+    struct join_ctx ctx = { 0 };
+    assert(tg_join(NULL, b, tg_geom_intersects, join_iter, &ctx));
+    assert(tg_join(a, NULL, tg_geom_intersects, join_iter, &ctx));
+    assert(tg_join(a, b, tg_geom_intersects, NULL, &ctx));
+    struct tg_geom *empty = tg_parse_wkt("GEOMETRYCOLLECTION EMPTY");
+    assert(empty);
+    assert(tg_join(a, empty, tg_geom_intersects, join_iter, &ctx));
+    assert(ctx.count == 0);
+    tg_geom_free(empty);
+    tg_geom_free(single);
+    tg_geom_free(small);
+    tg_geom_free(b);
+    tg_geom_free(a);
+}
+
+static struct tg_geom **nested_geoms;
+static int nested_ngeoms;
+
+// Join predicate that starts its own batch from inside the join.
+static bool nested_intersects(const struct tg_geom *a, const struct tg_geom *b)
+{
+    bool results[300];
+    assert(nested_ngeoms <= 300);
+    tg_batch_intersects(a, (const struct tg_geom *const*)nested_geoms,
+        nested_ngeoms, results);
+    for (int i = 0; i < nested_ngeoms; i++) {
+        assert(results[i] == tg_geom_intersects(a, nested_geoms[i]));
+    }
+    return tg_geom_intersects(a, b);
+}
+
+void test_batch_nested(void) {
+    struct tg_rect rect = tg_geom_rect((struct tg_geom*)RING(az));
+    struct tg_geom *a = gen_collection(rect, 600);
+    struct tg_geom *b = tg_geom_clone((struct tg_geom*)RING(az));
+    nested_ngeoms = 300;
+    nested_geoms = malloc(nested_ngeoms*sizeof(struct tg_geom*));
+    assert(nested_geoms);
+    for (int i = 0; i < nested_ngeoms; i++) {
+        nested_geoms[i] = tg_geom_clone(tg_geom_geometry_at(a, i));
+    }
+    tg_env_set_batch_threads(4);
+    // The join batch holds the pool, so the inner batches must run on their
+    // calling threads rather than wait for it.
+    check_join(a, b, nested_intersects);
+    tg_env_set_batch_threads(0);
+    for (int i = 0; i < nested_ngeoms; i++) {
+        tg_geom_free(nested_geoms[i]);
+    }
+    free(nested_geoms);
+    tg_geom_free(b);
+    tg_geom_free(a);
+}
+
+void test_batch_fork(void) {
+    const struct tg_geom *geom = (struct tg_geom*)RING(az);
+    tg_env_set_batch_threads(4);
+    // start the pool in the parent
+    check_covers_xy(geom, 100000, false);
+    fflush(NULL);
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        // The parent's workers do not exist in the child, which must start
+        // its own pool rather than wait for them.
+        alarm(30);
+        check_covers_xy(geom, 100000, false);
+        check_covers_xy(geom, 100000, true);
+        _exit(0);
+    }
+    int status;
+    assert(waitpid(pid, &status, 0) == pid);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    // the parent's pool is unchanged
+    check_covers_xy(geom, 100000, false);
+    tg_env_set_batch_threads(0);
+}
+
+void test_batch_join_chaos(void) {
+    struct tg_geom *a = NULL;
+    while (!a) {
+        a = tg_parse_wkt("GEOMETRYCOLLECTION(POINT(0 0),"
+            "POLYGON((0 0,1 0,1 1,0 1,0 0)),POLYGON((1 0,2 0,2 1,1 1,1 0)))");
+    }
+    char found[9];
+    struct join_ctx ctx = { .nb = 3, .found = found };
+    while (1) {
+        memset(found, 0, sizeof(found));
+        ctx.count = 0;
+        if (tg_join(a, a, tg_geom_intersects, join_iter, &ctx)) {
+            break;
+        }
+    }
+    assert(ctx.count == 7);
+    tg_geom_free(a);
+}
+
+int main(int argc, char **argv) {
+    do_test(test_batch_covers_xy);
+    do_test(test_batch_intersects);
+    do_test(test_batch_join);
+    do_test(test_batch_nested);
+    do_test(test_batch_fork);
+    do_chaos_test(test_batch_join_chaos);
+    return 0;
+}
@@ -489,6 +489,169 @@ void test_geom_multipoint() {
 
 }
 
+// multipoint_poly_ref tests each point of the MultiPoint on its own.
+static void multipoint_poly_ref(const struct tg_poly *poly, 
+    const struct tg_point *points, int npoints, bool *covers, 
+    bool *intersects)
+{
+    *covers = npoints > 0;
+    *intersects = false;
+    for (int i = 0; i < npoints; i++) {
+        if (tg_poly_covers_point(poly, points[i])) {
+            *intersects = true;
+        } else {
+            *covers = false;
+        }
+    }
+}
+
+void test_geom_multipoint_poly(void) {
+    static const enum tg_index ixs[] = { TG_NONE, TG_NATURAL, TG_YSTRIPES };
+    struct tg_point azpoints[] = { az };
+    int nazpoints = sizeof(azpoints)/sizeof(struct tg_point);
+    struct tg_point hpoints[] = { 
+        P(-112, 34), P(-111, 34), P(-111, 35), P(-112, 35), P(-112, 34),
+    };
+    srand(mkrandseed());
+    for (int k = 0; k < 3; k++) {
+        struct tg_ring *exterior = tg_ring_new_ix(azpoints, nazpoints, ixs[k]);
+        struct tg_ring *hole = tg_ring_new_ix(hpoints, 5, ixs[k]);
+        assert(exterior && hole);
+        struct tg_poly *poly = tg_poly_new(exterior, 
+            (const struct tg_ring*[]){ hole }, 1);
+        assert(poly);
+        struct tg_geom *geom = tg_geom_new_polygon(poly);
+        assert(geom);
+        struct tg_rect rect = tg_poly_rect(poly);
+        for (int i = 0; i < 2000; i++) {
+            // points in a random part of the polygon rect, some of them on
+            // the boundary
+            int npoints = rand()%200+1;
+            double w = (rect.max.x-rect.min.x)*rand_double();
+            double h = (rect.max.y-rect.min.y)*rand_double();
+            double x = rect.min.x+(rect.max.x-rect.min.x-w)*rand_double();
+            double y = rect.min.y+(rect.max.y-rect.min.y-h)*rand_double();
+            struct tg_point *points = malloc(npoints*sizeof(struct tg_point));
+            assert(points);
+            for (int j = 0; j < npoints; j++) {
+                switch (rand()%8) {
+                case 0:
+                    points[j] = azpoints[rand()%nazpoints];
+                    break;
+                case 1:
+                    points[j] = hpoints[rand()%5];
+                    break;
+                default:
+                    points[j] = P(x+w*rand_double(), y+h*rand_double());
+                }
+            }
+            bool covers, intersects;
+            multipoint_poly_ref(poly, points, npoints, &covers, &intersects);
+            struct tg_geom *multi = tg_geom_new_multipoint(points, npoints);
+            assert(multi);
+            assert(tg_geom_covers(geom, multi) == covers);
+            assert(tg_geom_coveredby(multi, geom) == covers);
+            assert(tg_geom_intersects(geom, multi) == intersects);
+            assert(tg_geom_intersects(multi, geom) == intersects);
+            assert(tg_geom_covers((struct tg_geom*)poly, multi) == covers);
+            tg_geom_free(multi);
+            free(points);
+        }
+        // a polygon and every one of its vertices
+        struct tg_geom *multi = tg_geom_new_multipoint(azpoints, nazpoints);
+        assert(tg_geom_covers(geom, multi));
+        assert(tg_geom_intersects(multi, geom));
+        tg_geom_free(multi);
+        tg_geom_free(geom);
+        tg_poly_free(poly);
+        tg_ring_free(hole);
+        tg_ring_free(exterior);
+    }
+}
+
+// signed_distance_ref checks every segment of every ring.
+static double signed_distance_ref(const struct tg_geom *geom, 
+    struct tg_point point)
+{
+    double dist = INFINITY;
+    int npolys = tg_geom_typeof(geom) == TG_POLYGON ? 1 : 
+        tg_geom_num_polys(geom);
+    for (int i = 0; i < npolys; i++) {
+        const struct tg_poly *poly = tg_geom_typeof(geom) == TG_POLYGON ? 
+            tg_geom_poly(geom) : tg_geom_poly_at(geom, i);
+        for (int j = -1; j < tg_poly_num_holes(poly); j++) {
+            const struct tg_ring *ring = j == -1 ? tg_poly_exterior(poly) :
+                tg_poly_hole_at(poly, j);
+            for (int k = 0; k < tg_ring_num_segments(ring); k++) {
+                double d = tg_point_distance_segment(point, 
+                    tg_ring_segment_at(ring, k));
+                if (d < dist) {
+                    dist = d;
+                }
+            }
+        }
+    }
+    return tg_geom_covers_xy(geom, point.x, point.y) ? -dist : dist;
+}
+
+void test_geom_signed_distance(void) {
+    static const enum tg_index ixs[] = { TG_NONE, TG_NATURAL, TG_YSTRIPES };
+    struct tg_point azpoints[] = { az };
+    int nazpoints = sizeof(azpoints)/sizeof(struct tg_point);
+    srand(mkrandseed());
+    for (int k = 0; k < 3; k++) {
+        struct tg_geom *geoms[] = {
+            load_geom("az", ixs[k]),
+            tg_parse_wkt_ix("POLYGON((-115 31,-109 31,-109 37,-115 37,-115 31),"
+                "(-112 34,-111 34,-111 35,-112 35,-112 34))", ixs[k]),
+            load_geom("tx", ixs[k]),
+        };
+        for (int g = 0; g < 3; g++) {
+            assert(geoms[g]);
+            struct tg_rect rect = tg_geom_rect(geoms[g]);
+            double w = rect.max.x-rect.min.x;
+            double h = rect.max.y-rect.min.y;
+            for (int i = 0; i < 2000; i++) {
+                struct tg_point point = P(
+                    rect.min.x-w*0.2+w*1.4*rand_double(),
+                    rect.min.y-h*0.2+h*1.4*rand_double());
+                if (g == 0 && i%10 == 0) {
+                    // on the boundary
+                    point = azpoints[rand()%nazpoints];
+                }
+                double expect = signed_distance_ref(geoms[g], point);
+                double dist = tg_geom_signed_distance(geoms[g], point.x, 
+                    point.y);
+                assert(dist == expect);
+            }
+        }
+        for (int g = 0; g < 3; g++) {
+            tg_geom_free(geoms[g]);
+        }
+        // a hole that is filled by a second polygon
+        struct tg_geom *multi = tg_parse_wkt_ix(
+            "MULTIPOLYGON(((0 0,10 0,10 10,0 10,0 0),(2 2,8 2,8 8,2 8,2 2)),"
+            "((4 4,6 4,6 6,4 6,4 4)))", ixs[k]);
+        assert(multi);
+        assert(tg_geom_signed_distance(multi, 1, 5) == -1);
+        assert(tg_geom_signed_distance(multi, 3, 5) == 1);
+        assert(tg_geom_signed_distance(multi, 5, 5) == -1);
+        assert(tg_geom_signed_distance(multi, 2, 5) == 0);
+        assert(tg_geom_signed_distance(multi, 10, 10) == 0);
+        assert(tg_geom_signed_distance(multi, 13, 14) == 5);
+        tg_geom_free(multi);
+    }
+    struct tg_geom *geom = tg_parse_wkt("LINESTRING(0 0,10 10)");
+    assert(geom);
+    assert(tg_geom_signed_distance(geom, 0, 0) == INFINITY);
+    tg_geom_free(geom);
+    geom = tg_parse_wkt("POLYGON EMPTY");
+    assert(geom);
+    assert(tg_geom_signed_distance(geom, 0, 0) == INFINITY);
+    tg_geom_free(geom);
+    assert(tg_geom_signed_distance(NULL, 0, 0) == INFINITY);
+}
+
 void test_geom_multilinestring() {
     struct tg_geom *lil1 = tg_geom_new_polygon(POLY(RR(5, 5, 20, 20)));
     struct tg_line const *lines[] = { 
@@ -1002,6 +1165,8 @@ int main(int argc, char **argv) {
     do_test(test_geom_linestring);
     do_test(test_geom_polygon);
     do_test(test_geom_multipoint);
+    do_test(test_geom_multipoint_poly);
+    do_test(test_geom_signed_distance);
     do_test(test_geom_multilinestring);
     do_test(test_geom_multipolygon);
     do_test(test_geom_geometrycollection);
@@ -490,6 +490,129 @@ void test_index_defaults(void) {
     tg_ring_free(ring);
 }
 
+void test_index_thread_defaults(void) {
+    struct tg_ring *ring;
+    enum tg_index defix = tg_env_get_default_index();
+    int spread = tg_env_get_index_spread();
+
+    tg_env_set_thread_index(99);
+    assert(tg_env_get_default_index() == defix);
+    tg_env_set_thread_index_spread(1);
+    assert(tg_env_get_index_spread() == spread);
+
+    tg_env_set_thread_index(TG_NONE);
+    tg_env_set_thread_index_spread(37);
+    assert(tg_env_get_default_index() == TG_NONE);
+    assert(tg_env_get_index_spread() == 37);
+    ring = RING(az);
+    assert(ring);
+    assert(tg_ring_index_spread(ring) == 0);
+
+    tg_env_set_thread_index(TG_NATURAL);
+    ring = RING(az);
+    assert(ring);
+    assert(tg_ring_index_spread(ring) == 37);
+
+    // clear the overrides
+    tg_env_set_thread_index(TG_DEFAULT);
+    tg_env_set_thread_index_spread(0);
+    assert(tg_env_get_default_index() == defix);
+    assert(tg_env_get_index_spread() == spread);
+}
+
+static int opts_nallocs = 0;
+
+static void *opts_malloc(size_t size) {
+    opts_nallocs++;
+    return xmalloc(size);
+}
+
+static void *opts_realloc(void *ptr, size_t size) {
+    opts_nallocs++;
+    return xrealloc(ptr, size);
+}
+
+void test_index_options(void) {
+    struct tg_ring *ring0 = RING(az);
+    const struct tg_point *points = tg_ring_points(ring0);
+    int npoints = tg_ring_num_points(ring0);
+    struct tg_rect rect = tg_ring_rect(ring0);
+    struct tg_point center = {
+        (rect.min.x+rect.max.x)/2, (rect.min.y+rect.max.y)/2
+    };
+
+    // NULL options are the same as the defaults
+    struct tg_ring *ring = tg_ring_new_opts(points, npoints, NULL);
+    assert(ring);
+    assert(tg_ring_index_spread(ring) == tg_ring_index_spread(ring0));
+    tg_ring_free(ring);
+
+    struct tg_options opts = { .index = TG_NATURAL, .spread = 9 };
+    ring = tg_ring_new_opts(points, npoints, &opts);
+    assert(ring);
+    assert(tg_ring_index_spread(ring) == 9);
+    tg_ring_free(ring);
+
+    struct tg_line *line = tg_line_new_opts(points, npoints, &opts);
+    assert(line);
+    assert(tg_line_index_spread(line) == 9);
+    tg_line_free(line);
+
+    // lazy ystripes are built on first point-in-polygon
+    opts = (struct tg_options){ .index = TG_YSTRIPES, .lazy = true };
+    ring = tg_ring_new_opts(points, npoints, &opts);
+    assert(ring);
+    struct tg_ring *eager = RING_INDEX(TG_YSTRIPES, az);
+    size_t size = tg_ring_memsize(ring);
+    assert(size < tg_ring_memsize(eager));
+    bool hit = tg_geom_intersects_xy((struct tg_geom*)ring, center.x, center.y);
+    assert(hit == tg_geom_intersects_xy((struct tg_geom*)eager, 
+        center.x, center.y));
+    assert(tg_ring_memsize(ring) == tg_ring_memsize(eager));
+    struct tg_point *pts = rand_points(rect, 1000);
+    for (int i = 0; i < 1000; i++) {
+        assert(tg_ring_contains_point(ring, pts[i], true).hit == 
+            tg_ring_contains_point(eager, pts[i], true).hit);
+    }
+    free(pts);
+    // moved and copied rings keep their ystripes
+    struct tg_ring *ring2 = tg_ring_copy(ring);
+    assert(ring2);
+    assert(tg_ring_memsize(ring2) == tg_ring_memsize(eager));
+    tg_ring_free(ring2);
+    tg_ring_free(ring);
+    ring = tg_ring_new_opts(points, npoints, &opts);
+    assert(ring);
+    ring2 = tg_ring_move(ring, 1, 1);
+    assert(ring2);
+    assert(tg_ring_memsize(ring2) == size);
+    assert(tg_geom_intersects_xy((struct tg_geom*)ring2, 
+        center.x+1, center.y+1) == hit);
+    assert(tg_ring_memsize(ring2) == tg_ring_memsize(eager));
+    tg_ring_free(ring2);
+    tg_ring_free(ring);
+    tg_ring_free(eager);
+
+    // thread allocator
+    opts_nallocs = 0;
+    tg_env_set_thread_allocator(opts_malloc, opts_realloc, xfree);
+    ring = tg_ring_new_opts(points, npoints, &opts);
+    tg_env_set_thread_allocator(NULL, NULL, NULL);
+    assert(ring);
+    assert(opts_nallocs > 0);
+    int nallocs = opts_nallocs;
+    ring2 = tg_ring_new(points, npoints);
+    assert(ring2);
+    assert(opts_nallocs == nallocs);
+    tg_ring_free(ring2);
+    tg_ring_free(ring);
+
+    struct tg_geom *geom = tg_parse_opts("POLYGON((0 0,1 0,1 1,0 0))", 26, 
+        &opts);
+    assert(geom && !tg_geom_error(geom));
+    tg_geom_free(geom);
+}
+
 struct icounterctx {
     int count;
 };
@@ -626,6 +749,59 @@ void test_index_chaos(void) {
 
 }
 
+void test_index_stats(void) {
+    struct tg_ring *none = RING_NONE(br);
+    struct tg_ring *natural = RING_NATURAL(br);
+    struct tg_ring *ystripes = RING_YSTRIPES(br);
+    struct tg_index_stats stats;
+    struct tg_index_level_stats lstats;
+
+    assert(tg_ring_index_stats(none, &stats));
+    assert(stats.nlevels == 0 && stats.nstripes == 0);
+    assert(stats.pip_cost == tg_ring_num_segments(none));
+    assert(!tg_ring_index_level_stats(none, 0, &lstats));
+
+    assert(tg_ring_index_stats(natural, &stats));
+    assert(stats.nlevels == tg_ring_index_num_levels(natural));
+    assert(stats.spread == tg_ring_index_spread(natural));
+    assert(stats.nleaves == tg_ring_index_level_num_rects(natural, 
+        stats.nlevels-1));
+    assert(stats.leaf_segments > 1 && stats.leaf_segments <= stats.spread);
+    assert(stats.nstripes == 0);
+    assert(stats.pip_cost > 0);
+    assert(stats.pip_cost < tg_ring_num_segments(natural)/10);
+    double natural_cost = stats.pip_cost;
+    for (int i = 0; i < stats.nlevels; i++) {
+        assert(tg_ring_index_level_stats(natural, i, &lstats));
+        assert(lstats.nrects == tg_ring_index_level_num_rects(natural, i));
+        assert(lstats.area > 0);
+        assert(lstats.overlap >= 0);
+        assert(lstats.dead_space >= 0 && lstats.dead_space <= 1);
+    }
+    assert(!tg_ring_index_level_stats(natural, stats.nlevels, &lstats));
+    assert(!tg_ring_index_level_stats(natural, -1, &lstats));
+    assert(!tg_ring_index_level_stats(natural, 0, NULL));
+
+    assert(tg_ring_index_stats(ystripes, &stats));
+    assert(stats.nstripes > 0);
+    assert(stats.stripe_max >= stats.stripe_avg && stats.stripe_avg > 0);
+    assert(stats.stripe_empty < stats.nstripes);
+    assert(stats.pip_cost < natural_cost);
+
+    // a bigger spread has fewer and fuller leaves
+    struct tg_ring *wide = RING_INDEX(tg_index_with_spread(TG_NATURAL, 64), 
+        br);
+    assert(tg_ring_index_stats(wide, &stats));
+    assert(stats.spread == 64);
+    assert(stats.leaf_segments > 16);
+    tg_ring_free(wide);
+    tg_ring_free(ystripes);
+
+    // should not fail
+    assert(!tg_ring_index_stats(NULL, &stats));
+    assert(!tg_ring_index_stats(natural, NULL));
+}
+
 int main(int argc, char **argv) {
     do_test(test_index_pip_concave);
     do_test(test_index_pip_circle);
@@ -633,8 +809,11 @@ int main(int argc, char **argv) {
     do_test(test_index_ystripes_circle);
     do_test(test_index_svg);
     do_test(test_index_defaults);
+    do_test(test_index_thread_defaults);
+    do_test(test_index_options);
     do_test(test_index_multi);
     do_test(test_index_various);
+    do_test(test_index_stats);
     do_chaos_test(test_index_chaos);
     return 0;
 }
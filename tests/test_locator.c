@@ -0,0 +1,244 @@
+#include "tests.h"
+
+// Returns the features of the collection that cover the point, in order.
+static int locate_ref(struct tg_geom *geom, double x, double y, int *indexes) {
+    int count = 0;
+    int n = tg_geom_num_geometries(geom);
+    for (int i = 0; i < n; i++) {
+        const struct tg_geom *child = tg_geom_geometry_at(geom, i);
+        if ((tg_geom_typeof(child) == TG_POLYGON ||
+            tg_geom_typeof(child) == TG_MULTIPOLYGON) &&
+            tg_geom_covers_xy(child, x, y))
+        {
+            indexes[count++] = i;
+        }
+    }
+    return count;
+}
+
+static int intcmp(const void *a, const void *b) {
+    return *(int*)a - *(int*)b;
+}
+
+// Checks random points, and points on the grid lines, against locate_ref.
+static void check_locator(struct tg_geom *geom, int npoints) {
+    struct tg_locator *locator = tg_locator_new(geom);
+    assert(locator);
+    struct tg_rect rect = tg_geom_rect(geom);
+    double w = rect.max.x - rect.min.x;
+    double h = rect.max.y - rect.min.y;
+    int n = tg_geom_num_geometries(geom);
+    int *expect = malloc((n+1)*sizeof(int));
+    int *got = malloc((n+1)*sizeof(int));
+    struct tg_point *points = malloc(npoints*sizeof(struct tg_point));
+    int *found = malloc(npoints*sizeof(int));
+    assert(expect && got && points && found);
+    int nhits = 0;
+    for (int i = 0; i < npoints; i++) {
+        double x = rect.min.x - w*0.1 + w*1.2*rand_double();
+        double y = rect.min.y - h*0.1 + h*1.2*rand_double();
+        if (i%4 == 0) {
+            // on the boundaries of the squares
+            x = round(x);
+        }
+        points[i] = P(x, y);
+        int nexpect = locate_ref(geom, x, y, expect);
+        int ngot = tg_locator_find_xy(locator, x, y, got, n+1);
+        assert(ngot == nexpect);
+        qsort(got, ngot, sizeof(int), intcmp);
+        for (int j = 0; j < ngot; j++) {
+            assert(got[j] == expect[j]);
+        }
+        if (nexpect > 0) {
+            // stop at the first
+            assert(tg_locator_find_xy(locator, x, y, got, 1) == 1);
+            int j = 0;
+            while (j < nexpect && expect[j] != got[0]) j++;
+            assert(j < nexpect);
+            nhits++;
+        }
+    }
+    assert(nhits > 0);
+    tg_locator_find_points(locator, points, npoints, found);
+    for (int i = 0; i < npoints; i++) {
+        int nexpect = locate_ref(geom, points[i].x, points[i].y, expect);
+        if (nexpect == 0) {
+            assert(found[i] == -1);
+        } else {
+            int j = 0;
+            while (j < nexpect && expect[j] != found[i]) j++;
+            assert(j < nexpect);
+        }
+    }
+    free(found);
+    free(points);
+    free(got);
+    free(expect);
+    tg_locator_free(locator);
+}
+
+// Makes a collection of unit squares, some with holes, some overlapping,
+// some MultiPolygons, and some lines that are never found.
+static struct tg_geom *make_squares(int cols, int rows, enum tg_index ix) {
+    int n = cols*rows;
+    struct tg_geom **geoms = malloc(n*sizeof(struct tg_geom*));
+    assert(geoms);
+    char wkt[256];
+    for (int y = 0; y < rows; y++) {
+        for (int x = 0; x < cols; x++) {
+            switch ((x+y*cols)%5) {
+            case 0:
+                snprintf(wkt, sizeof(wkt),
+                    "POLYGON((%d %d,%d %d,%d %d,%d %d,%d %d),"
+                    "(%g %g,%g %g,%g %g,%g %g))",
+                    x, y, x+1, y, x+1, y+1, x, y+1, x, y,
+                    x+0.25, y+0.25, x+0.75, y+0.25, x+0.5, y+0.75,
+                    x+0.25, y+0.25);
+                break;
+            case 1:
+                snprintf(wkt, sizeof(wkt),
+                    "MULTIPOLYGON(((%d %d,%g %d,%d %d,%d %d)),"
+                    "((%g %d,%d %d,%d %d,%g %d)))",
+                    x, y, x+0.5, y, x, y+1, x, y,
+                    x+0.5, y, x+1, y, x+1, y+1, x+0.5, y);
+                break;
+            case 2:
+                // larger than the cell
+                snprintf(wkt, sizeof(wkt),
+                    "POLYGON((%g %g,%g %g,%g %g,%g %g,%g %g))",
+                    x-0.5, y-0.5, x+1.5, y-0.5, x+1.5, y+1.5, x-0.5, y+1.5,
+                    x-0.5, y-0.5);
+                break;
+            case 3:
+                snprintf(wkt, sizeof(wkt),
+                    "LINESTRING(%d %d,%d %d)", x, y, x+1, y+1);
+                break;
+            default:
+                snprintf(wkt, sizeof(wkt),
+                    "POLYGON((%d %d,%d %d,%d %d,%d %d,%d %d))",
+                    x, y, x+1, y, x+1, y+1, x, y+1, x, y);
+            }
+            struct tg_geom *geom = tg_parse_wkt_ix(wkt, ix);
+            assert(geom && !tg_geom_error(geom));
+            geoms[y*cols+x] = geom;
+        }
+    }
+    struct tg_geom *geom = tg_geom_new_geometrycollection(
+        (const struct tg_geom *const*)geoms, n);
+    assert(geom);
+    for (int i = 0; i < n; i++) {
+        tg_geom_free(geoms[i]);
+    }
+    free(geoms);
+    return geom;
+}
+
+void test_locator_squares(void) {
+    srand(mkrandseed());
+    static const enum tg_index ixs[] = { TG_NONE, TG_NATURAL, TG_YSTRIPES };
+    for (int i = 0; i < 3; i++) {
+        struct tg_geom *geom = make_squares(20, 10, ixs[i]);
+        check_locator(geom, 5000);
+        tg_geom_free(geom);
+        geom = make_squares(1, 30, ixs[i]);
+        check_locator(geom, 1000);
+        tg_geom_free(geom);
+        // large enough to be spread over the batch threads
+        geom = make_squares(40, 40, ixs[i]);
+        check_locator(geom, 10000);
+        tg_geom_free(geom);
+    }
+}
+
+void test_locator_various(void) {
+    int indexes[4];
+
+    // a single polygon is feature zero
+    struct tg_geom *geom = tg_parse_wkt(
+        "POLYGON((0 0,10 0,10 10,0 10,0 0),(4 4,6 4,6 6,4 6,4 4))");
+    assert(geom);
+    struct tg_locator *locator = tg_locator_new(geom);
+    assert(locator);
+    tg_geom_free(geom);
+    assert(tg_locator_find_xy(locator, 1, 1, indexes, 4) == 1);
+    assert(indexes[0] == 0);
+    assert(tg_locator_find_xy(locator, 10, 10, indexes, 4) == 1);
+    assert(tg_locator_find_xy(locator, 4, 5, indexes, 4) == 1);
+    assert(tg_locator_find_xy(locator, 5, 5, indexes, 4) == 0);
+    assert(tg_locator_find_xy(locator, 11, 5, indexes, 4) == 0);
+    assert(tg_locator_find_xy(locator, 1, 1, indexes, 0) == 0);
+    assert(tg_locator_find_xy(locator, 1, 1, NULL, 4) == 0);
+    tg_locator_free(locator);
+
+    // the polygons of a multipolygon are each a feature
+    geom = tg_parse_wkt(
+        "MULTIPOLYGON(((0 0,10 0,10 10,0 10,0 0)),"
+        "((5 5,15 5,15 15,5 15,5 5)))");
+    assert(geom);
+    locator = tg_locator_new(geom);
+    assert(locator);
+    assert(tg_locator_find_xy(locator, 1, 1, indexes, 4) == 1);
+    assert(indexes[0] == 0);
+    assert(tg_locator_find_xy(locator, 14, 14, indexes, 4) == 1);
+    assert(indexes[0] == 1);
+    assert(tg_locator_find_xy(locator, 7, 7, indexes, 4) == 2);
+    assert(indexes[0] != indexes[1]);
+    assert(tg_locator_find_xy(locator, 7, 7, indexes, 1) == 1);
+    tg_locator_free(locator);
+    tg_geom_free(geom);
+
+    // degenerate bounds
+    geom = tg_parse_wkt(
+        "GEOMETRYCOLLECTION(POINT(1 1),POLYGON((0 0,10 0,0 0)),"
+        "POLYGON EMPTY)");
+    assert(geom);
+    locator = tg_locator_new(geom);
+    assert(locator);
+    assert(tg_locator_find_xy(locator, 5, 0, indexes, 4) == 1);
+    assert(indexes[0] == 1);
+    assert(tg_locator_find_xy(locator, 1, 1, indexes, 4) == 0);
+    tg_locator_free(locator);
+    tg_geom_free(geom);
+
+    // empty and null
+    geom = tg_parse_wkt("GEOMETRYCOLLECTION EMPTY");
+    assert(geom);
+    locator = tg_locator_new(geom);
+    assert(locator);
+    assert(tg_locator_find_xy(locator, 0, 0, indexes, 4) == 0);
+    tg_locator_free(locator);
+    tg_geom_free(geom);
+    locator = tg_locator_new(NULL);
+    assert(locator);
+    assert(tg_locator_find_xy(locator, 0, 0, indexes, 4) == 0);
+    struct tg_point point = P(0, 0);
+    tg_locator_find_points(locator, &point, 1, indexes);
+    assert(indexes[0] == -1);
+    tg_locator_free(locator);
+    assert(tg_locator_find_xy(NULL, 0, 0, indexes, 4) == 0);
+    tg_locator_free(NULL);
+}
+
+void test_locator_chaos(void) {
+    struct tg_geom *geom = NULL;
+    while (!geom) {
+        geom = tg_parse_wkt("GEOMETRYCOLLECTION(POINT(0 0),"
+            "POLYGON((0 0,1 0,1 1,0 1,0 0)),POLYGON((1 0,2 0,2 1,1 1,1 0)))");
+    }
+    struct tg_locator *locator = NULL;
+    while (!locator) {
+        locator = tg_locator_new(geom);
+    }
+    int index;
+    assert(tg_locator_find_xy(locator, 1.5, 0.5, &index, 1) == 1);
+    assert(index == 2);
+    tg_locator_free(locator);
+    tg_geom_free(geom);
+}
+
+int main(int argc, char **argv) {
+    do_test(test_locator_squares);
+    do_test(test_locator_various);
+    do_chaos_test(test_locator_chaos);
+    return 0;
+}
@@ -0,0 +1,259 @@
+#include "tests.h"
+
+double poly_area(const struct tg_poly *poly) {
+    double area = tg_ring_area(tg_poly_exterior(poly));
+    for (int i = 0; i < tg_poly_num_holes(poly); i++) {
+        area -= tg_ring_area(tg_poly_hole_at(poly, i));
+    }
+    return area;
+}
+
+double geom_area(const struct tg_geom *geom) {
+    if (tg_geom_typeof(geom) == TG_POLYGON) {
+        return tg_geom_is_empty(geom) ? 0 : poly_area(tg_geom_poly(geom));
+    }
+    double area = 0;
+    for (int i = 0; i < tg_geom_num_polys(geom); i++) {
+        area += poly_area(tg_geom_poly_at(geom, i));
+    }
+    return area;
+}
+
+int geom_npolys(const struct tg_geom *geom) {
+    if (tg_geom_typeof(geom) == TG_POLYGON) {
+        return tg_geom_is_empty(geom) ? 0 : 1;
+    }
+    return tg_geom_num_polys(geom);
+}
+
+struct tg_geom *overlay(const char *op, const char *wkt_a, const char *wkt_b) {
+    struct tg_geom *a = tg_parse_wkt(wkt_a);
+    struct tg_geom *b = tg_parse_wkt(wkt_b);
+    assert(!tg_geom_error(a) && !tg_geom_error(b));
+    struct tg_geom *geom;
+    if (strcmp(op, "intersection") == 0) {
+        geom = tg_geom_intersection(a, b);
+    } else if (strcmp(op, "union") == 0) {
+        geom = tg_geom_union(a, b);
+    } else {
+        geom = tg_geom_difference(a, b);
+    }
+    assert(geom && !tg_geom_error(geom));
+    tg_geom_free(a);
+    tg_geom_free(b);
+    return gc_geom(geom);
+}
+
+#define assert_overlay(op, a, b, npolys, area) { \
+    struct tg_geom *geom = overlay((op), (a), (b)); \
+    if (geom_npolys(geom) != (npolys) || !eqish(geom_area(geom), (area))) { \
+        char wkt[1024]; \
+        tg_geom_wkt(geom, wkt, sizeof(wkt)); \
+        fprintf(stderr, "line %d: %s: expected %d polys with area %f, " \
+            "got %d polys with area %f\n%s\n", __LINE__, (op), (npolys), \
+            (double)(area), geom_npolys(geom), geom_area(geom), wkt); \
+        abort(); \
+    } \
+}
+
+#define SQUARE0  "POLYGON((0 0,10 0,10 10,0 10,0 0))"
+#define SQUARE5  "POLYGON((5 5,15 5,15 15,5 15,5 5))"
+#define SQUAREX  "POLYGON((10 0,20 0,20 10,10 10,10 0))"
+#define SQUAREC  "POLYGON((10 10,20 10,20 20,10 20,10 10))"
+#define SQUAREF  "POLYGON((30 30,40 30,40 40,30 40,30 30))"
+#define SQUAREI  "POLYGON((2 2,4 2,4 4,2 4,2 2))"
+#define HOLED    "POLYGON((0 0,10 0,10 10,0 10,0 0),(2 2,8 2,8 8,2 8,2 2))"
+#define SQUARECW "POLYGON((0 0,0 10,10 10,10 0,0 0))"
+
+void test_overlay_basic(void) {
+    // overlapping
+    assert_overlay("intersection", SQUARE0, SQUARE5, 1, 25);
+    assert_overlay("union", SQUARE0, SQUARE5, 1, 175);
+    assert_overlay("difference", SQUARE0, SQUARE5, 1, 75);
+    assert_overlay("difference", SQUARE5, SQUARE0, 1, 75);
+
+    // identical, including opposite winding orders
+    assert_overlay("intersection", SQUARE0, SQUARE0, 1, 100);
+    assert_overlay("union", SQUARE0, SQUARE0, 1, 100);
+    assert_overlay("difference", SQUARE0, SQUARE0, 0, 0);
+    assert_overlay("intersection", SQUARE0, SQUARECW, 1, 100);
+    assert_overlay("union", SQUARECW, SQUARE0, 1, 100);
+    assert_overlay("difference", SQUARECW, SQUARE0, 0, 0);
+
+    // sharing an edge
+    assert_overlay("intersection", SQUARE0, SQUAREX, 0, 0);
+    assert_overlay("union", SQUARE0, SQUAREX, 1, 200);
+    assert_overlay("difference", SQUARE0, SQUAREX, 1, 100);
+
+    // sharing a corner
+    assert_overlay("intersection", SQUARE0, SQUAREC, 0, 0);
+    assert_overlay("union", SQUARE0, SQUAREC, 2, 200);
+    assert_overlay("difference", SQUARE0, SQUAREC, 1, 100);
+
+    // disjoint
+    assert_overlay("intersection", SQUARE0, SQUAREF, 0, 0);
+    assert_overlay("union", SQUARE0, SQUAREF, 2, 200);
+    assert_overlay("difference", SQUARE0, SQUAREF, 1, 100);
+
+    // inside
+    assert_overlay("intersection", SQUARE0, SQUAREI, 1, 4);
+    assert_overlay("union", SQUARE0, SQUAREI, 1, 100);
+    assert_overlay("difference", SQUARE0, SQUAREI, 1, 96);
+    assert_overlay("difference", SQUAREI, SQUARE0, 0, 0);
+    struct tg_geom *geom = overlay("difference", SQUARE0, SQUAREI);
+    assert(tg_poly_num_holes(tg_geom_poly(geom)) == 1);
+
+    // holes
+    assert_overlay("intersection", HOLED, SQUAREI, 0, 0);
+    assert_overlay("union", HOLED, SQUAREI, 1, 68);
+    assert_overlay("union", HOLED, SQUARE5, 1, 64+100-16);
+    assert_overlay("intersection", HOLED, SQUARE5, 1, 25-9);
+    assert_overlay("difference", SQUARE5, HOLED, 2, 100-16);
+    assert_overlay("union", HOLED, SQUARE0, 1, 100);
+    assert_overlay("difference", SQUARE0, HOLED, 1, 36);
+
+    // multipolygons
+    assert_overlay("union",
+        "MULTIPOLYGON(((0 0,10 0,10 10,0 10,0 0)),((20 0,30 0,30 10,20 10,20 0)))",
+        "POLYGON((5 2,25 2,25 8,5 8,5 2))", 1, 200+120-60);
+    assert_overlay("intersection",
+        "MULTIPOLYGON(((0 0,10 0,10 10,0 10,0 0)),((20 0,30 0,30 10,20 10,20 0)))",
+        "POLYGON((5 2,25 2,25 8,5 8,5 2))", 2, 60);
+    assert_overlay("difference",
+        "POLYGON((5 2,25 2,25 8,5 8,5 2))",
+        "MULTIPOLYGON(((0 0,10 0,10 10,0 10,0 0)),((20 0,30 0,30 10,20 10,20 0)))",
+        1, 60);
+
+    // crossing shapes
+    assert_overlay("intersection",
+        "POLYGON((0 0,10 0,10 10,0 10,0 0))",
+        "POLYGON((5 -2,12 5,5 12,-2 5,5 -2))", 1, 100-4*4.5);
+    assert_overlay("union",
+        "POLYGON((0 0,10 0,10 10,0 10,0 0))",
+        "POLYGON((5 -2,12 5,5 12,-2 5,5 -2))", 1, 98+4*4.5);
+    assert_overlay("difference",
+        "POLYGON((0 0,10 0,10 10,0 10,0 0))",
+        "POLYGON((5 -2,12 5,5 12,-2 5,5 -2))", 4, 4*4.5);
+
+    // empty and errors
+    assert_overlay("union", SQUARE0, "POLYGON EMPTY", 1, 100);
+    assert_overlay("intersection", SQUARE0, "POLYGON EMPTY", 0, 0);
+    assert_overlay("difference", "POLYGON EMPTY", SQUARE0, 0, 0);
+    struct tg_geom *point = gc_geom(tg_parse_wkt("POINT(1 1)"));
+    struct tg_geom *square = gc_geom(tg_parse_wkt(SQUARE0));
+    assert(tg_geom_error(gc_geom(tg_geom_union(point, square))));
+    assert(tg_geom_error(gc_geom(tg_geom_intersection(square, point))));
+    assert(tg_geom_error(gc_geom(tg_geom_cascaded_union(point))));
+    assert(!tg_geom_union(0, square));
+}
+
+void overlay_identity(const char *name, enum tg_index ix, double dx,
+    double dy)
+{
+    struct tg_geom *a = gc_geom(load_geom(name, ix));
+    struct tg_poly *b = tg_poly_move_gc((struct tg_poly*)a, dx, dy);
+    double area_a = geom_area(a);
+    double area_b = geom_area((struct tg_geom*)b);
+    struct tg_geom *ab_and = gc_geom(tg_geom_intersection(a, (void*)b));
+    struct tg_geom *ab_or = gc_geom(tg_geom_union(a, (void*)b));
+    struct tg_geom *ab_not = gc_geom(tg_geom_difference(a, (void*)b));
+    struct tg_geom *ba_not = gc_geom(tg_geom_difference((void*)b, a));
+    double area_and = geom_area(ab_and);
+    double area_or = geom_area(ab_or);
+    double area_ab_not = geom_area(ab_not);
+    double area_ba_not = geom_area(ba_not);
+    double eps = (area_a + area_b) * 1e-9;
+    assert(area_and > 0 && area_and < area_a);
+    assert(fabs(area_or - (area_a + area_b - area_and)) < eps);
+    assert(fabs(area_ab_not - (area_a - area_and)) < eps);
+    assert(fabs(area_ba_not - (area_b - area_and)) < eps);
+    assert(tg_geom_intersects(ab_and, a) && tg_geom_intersects(ab_and, (void*)b));
+    // the two differences can only meet at the crossings
+    struct tg_geom *nots = gc_geom(tg_geom_intersection(ab_not, ba_not));
+    assert(geom_area(nots) < eps);
+}
+
+void test_overlay_shapes(void) {
+    enum tg_index ixs[] = { TG_NONE, TG_NATURAL, TG_YSTRIPES };
+    for (int i = 0; i < 3; i++) {
+        overlay_identity("az", ixs[i], 0.5, 0.5);
+        overlay_identity("ri", ixs[i], 0.01, -0.02);
+        overlay_identity("tx", ixs[i], -1.5, 0.25);
+        overlay_identity("bc", ixs[i], 0.7, 1.1);
+    }
+}
+
+void test_overlay_cascaded_union(void) {
+    // grid of adjacent squares merges into a single square
+    struct tg_poly *polys[100];
+    for (int y = 0; y < 10; y++) {
+        for (int x = 0; x < 10; x++) {
+            polys[y*10+x] = POLY(RR(x, y, x+1, y+1));
+        }
+    }
+    struct tg_geom *grid = gc_geom(tg_geom_new_multipolygon(
+        (const struct tg_poly*const*)polys, 100));
+    struct tg_geom *geom = gc_geom(tg_geom_cascaded_union(grid));
+    assert(tg_geom_typeof(geom) == TG_POLYGON);
+    assert(eqish(geom_area(geom), 100));
+    assert(tg_ring_num_points(tg_poly_exterior(tg_geom_poly(geom))) == 5);
+
+    // chain of overlapping circles in a collection
+    struct tg_geom *circles[50];
+    for (int i = 0; i < 50; i++) {
+        circles[i] = (struct tg_geom*)CIRCLE(P(i*1.5, 0), 1, 64);
+    }
+    struct tg_geom *col = gc_geom(tg_geom_new_geometrycollection(
+        (const struct tg_geom*const*)circles, 50));
+    geom = gc_geom(tg_geom_cascaded_union(col));
+    assert(tg_geom_typeof(geom) == TG_POLYGON);
+    double area = geom_area(geom);
+    assert(area > geom_area(circles[0]) * 30);
+    assert(area < geom_area(circles[0]) * 50);
+    for (int i = 0; i < 50; i++) {
+        assert(tg_geom_intersects_xy(geom, i*1.5, 0));
+        assert(tg_geom_intersects_xy(geom, i*1.5, 0.99));
+    }
+    assert(!tg_geom_intersects_xy(geom, 0.75, 0.99));
+
+    // single and empty
+    assert(eqish(geom_area(gc_geom(tg_geom_cascaded_union(circles[0]))),
+        geom_area(circles[0])));
+    struct tg_geom *empty = gc_geom(tg_geom_new_geometrycollection_empty());
+    assert(geom_npolys(gc_geom(tg_geom_cascaded_union(empty))) == 0);
+}
+
+void test_overlay_chaos(void) {
+    struct tg_geom *a = NULL;
+    struct tg_geom *b = NULL;
+    while (!a) a = tg_parse_wkt(HOLED);
+    while (!b) b = tg_parse_wkt(SQUARE5);
+    int must_fail = 100;
+    while (must_fail > 0) {
+        struct tg_geom *geom = tg_geom_union(a, b);
+        if (!geom) {
+            must_fail--;
+            continue;
+        }
+        tg_geom_free(geom);
+    }
+    must_fail = 100;
+    while (must_fail > 0) {
+        struct tg_geom *geom = tg_geom_cascaded_union(a);
+        if (!geom) {
+            must_fail--;
+            continue;
+        }
+        tg_geom_free(geom);
+    }
+    tg_geom_free(a);
+    tg_geom_free(b);
+}
+
+int main(int argc, char **argv) {
+    do_test(test_overlay_basic);
+    do_test(test_overlay_shapes);
+    do_test(test_overlay_cascaded_union);
+    do_chaos_test(test_overlay_chaos);
+    return 0;
+}
@@ -12,11 +12,11 @@
 | point/line  | * | * , * | * , * | * , * | * , * , * |
 | point/poly  | * | * , * | * , * | * , * | * , * , * |
 | line/point  | * | * , * | * , * | * , * | * , * , * |
-| line/line   | * | * , * | * , * | * , * |   ,   ,   |
-| line/poly   | * | * , * | * , * | * , * |   ,   ,   |
+| line/line   | * | * , * | * , * | * , * | * , * ,   |
+| line/poly   | * | * , * | * , * | * , * | * , * ,   |
 | poly/point  | * | * , * | * , * | * , * | * , * , * |
-| poly/line   | * | * , * | * , * | * , * |   ,   ,   |
-| poly/poly   | * | * , * | * , * | * , * |   ,   , * |
+| poly/line   | * | * , * | * , * | * , * | * , * ,   |
+| poly/poly   | * | * , * | * , * | * , * | * , * , * |
 •-----------------------------------------------------•
 */
 
@@ -51,8 +51,8 @@
 #define ENABLE_WITHIN
 #define ENABLE_COVERS
 #define ENABLE_COVEREDBY
-// #define ENABLE_CROSSES
-// #define ENABLE_OVERLAPS
+#define ENABLE_CROSSES
+#define ENABLE_OVERLAPS
 #define ENABLE_TOUCHES
 
 static const char *only_file = "all";
@@ -521,17 +521,161 @@ void simple_test(const char *awkt, const char *bwkt,
     tg_geom_free(b);
 }
 
-void test_relations_unsupported(void) {
-    // Telations that are unsupported, but available. 
-    // These always return false, until true supported is added.
-    assert(tg_geom_overlaps(
-        (struct tg_geom*)RING(P(1,1),P(2,1),P(2,2),P(1,2),P(1,1)), 
-        (struct tg_geom*)RING(P(1.5,1.5),P(2.5,1.5),P(2.5,2.5),P(1.5,2.5),P(1.5,1.5))
-    ) == 0);
-    assert(tg_geom_crosses(
-        (struct tg_geom*)LINE(P(1,1),P(2,2)), 
-        (struct tg_geom*)LINE(P(1,2),P(2,1))
-    ) == 0);
+static void assert_crosses_overlaps(const char *awkt, const char *bwkt, 
+    bool crosses, bool overlaps)
+{
+    struct tg_geom *a = tg_parse_wkt(awkt);
+    struct tg_geom *b = tg_parse_wkt(bwkt);
+    assert(!tg_geom_error(a) && !tg_geom_error(b));
+    if (tg_geom_crosses(a, b) != crosses || tg_geom_crosses(b, a) != crosses ||
+        tg_geom_overlaps(a, b) != overlaps || 
+        tg_geom_overlaps(b, a) != overlaps)
+    {
+        fprintf(stderr, "%s\n%s\ncrosses: %d, overlaps: %d\n", awkt, bwkt,
+            tg_geom_crosses(a, b), tg_geom_overlaps(a, b));
+        abort();
+    }
+    tg_geom_free(a);
+    tg_geom_free(b);
+}
+
+void test_relations_crosses_overlaps(void) {
+    const char *sq = "POLYGON((0 0,10 0,10 10,0 10,0 0))";
+    // line/line
+    assert_crosses_overlaps("LINESTRING(0 0,10 10)", "LINESTRING(0 10,10 0)",
+        true, false);
+    assert_crosses_overlaps("LINESTRING(0 0,10 10)", "LINESTRING(5 5,15 15)",
+        false, true);
+    assert_crosses_overlaps("LINESTRING(0 0,10 0)", "LINESTRING(10 0,10 10)",
+        false, false);
+    assert_crosses_overlaps("LINESTRING(0 0,10 0)", "LINESTRING(5 0,5 10)",
+        false, false);
+    assert_crosses_overlaps("LINESTRING(0 0,10 0)", "LINESTRING(5 -5,5 5)",
+        true, false);
+    assert_crosses_overlaps("LINESTRING(0 0,10 0)", "LINESTRING(2 0,8 0)",
+        false, false);
+    // the shared end of two lines is not on the boundary
+    assert_crosses_overlaps("MULTILINESTRING((0 0,5 0),(5 0,10 0))", 
+        "LINESTRING(5 -5,5 5)", true, false);
+    // the start of the first line is in the middle of its doubled back
+    // segment, and is only on the second line's interior
+    assert_crosses_overlaps("LINESTRING(2 4,1 4,4 4)",
+        "LINESTRING(3 6,1 2,5 3)", false, false);
+    assert_crosses_overlaps("LINESTRING(2 4,1 4,4 4)",
+        "LINESTRING(3 6,3 2)", true, false);
+    struct tg_geom *a = tg_parse_wkt("LINESTRING(2 4,1 4,4 4)");
+    struct tg_geom *b = tg_parse_wkt("LINESTRING(3 6,1 2,5 3)");
+    assert(a && b);
+    assert(tg_geom_intersects(a, b));
+    tg_geom_free(a);
+    tg_geom_free(b);
+    // line/poly
+    assert_crosses_overlaps("LINESTRING(-5 5,5 5)", sq, true, false);
+    assert_crosses_overlaps("LINESTRING(2 2,8 8)", sq, false, false);
+    assert_crosses_overlaps("LINESTRING(0 0,10 10)", sq, false, false);
+    assert_crosses_overlaps("LINESTRING(-5 0,15 0)", sq, false, false);
+    assert_crosses_overlaps("LINESTRING(-5 5,0 5)", sq, false, false);
+    assert_crosses_overlaps("LINESTRING(-5 -5,0 0,15 0)", sq, false, false);
+    assert_crosses_overlaps("LINESTRING(0 5,10 5,10 15)", sq, true, false);
+    assert_crosses_overlaps("LINESTRING(-5 5,15 5)", 
+        "POLYGON((0 0,10 0,10 10,0 10,0 0),(2 2,8 2,8 8,2 8,2 2))", 
+        true, false);
+    assert_crosses_overlaps("LINESTRING(3 5,7 5)", 
+        "POLYGON((0 0,10 0,10 10,0 10,0 0),(2 2,8 2,8 8,2 8,2 2))", 
+        false, false);
+    // point/line and point/poly
+    assert_crosses_overlaps("MULTIPOINT(5 5,20 20)", sq, true, false);
+    assert_crosses_overlaps("MULTIPOINT(5 5,6 6)", sq, false, false);
+    assert_crosses_overlaps("MULTIPOINT(0 0,20 20)", sq, false, false);
+    assert_crosses_overlaps("POINT(5 5)", sq, false, false);
+    assert_crosses_overlaps("MULTIPOINT(5 0,20 20)", "LINESTRING(0 0,10 0)", 
+        true, false);
+    assert_crosses_overlaps("MULTIPOINT(0 0,20 20)", "LINESTRING(0 0,10 0)", 
+        false, false);
+    // point/point
+    assert_crosses_overlaps("MULTIPOINT(0 0,1 1)", "MULTIPOINT(1 1,2 2)", 
+        false, true);
+    assert_crosses_overlaps("MULTIPOINT(0 0,1 1)", "MULTIPOINT(0 0)", 
+        false, false);
+    assert_crosses_overlaps("MULTIPOINT(0 0,1 1)", "MULTIPOINT(2 2,3 3)", 
+        false, false);
+    // poly/poly
+    assert_crosses_overlaps(sq, "POLYGON((5 5,15 5,15 15,5 15,5 5))", 
+        false, true);
+    assert_crosses_overlaps(sq, "POLYGON((2 2,8 2,8 8,2 8,2 2))", 
+        false, false);
+    assert_crosses_overlaps(sq, "POLYGON((10 0,20 0,20 10,10 10,10 0))", 
+        false, false);
+    assert_crosses_overlaps(sq, sq, false, false);
+    assert_crosses_overlaps(
+        "POLYGON((0 0,10 0,10 10,0 10,0 0),(2 2,8 2,8 8,2 8,2 2))", 
+        "POLYGON((3 3,7 3,7 7,3 7,3 3))", false, false);
+    assert_crosses_overlaps(
+        "POLYGON((0 0,10 0,10 10,0 10,0 0),(2 2,8 2,8 8,2 8,2 2))", 
+        "POLYGON((1 1,5 1,5 5,1 5,1 1))", false, true);
+    assert_crosses_overlaps(
+        "MULTIPOLYGON(((0 0,1 0,1 1,0 1,0 0)),((5 5,6 5,6 6,5 6,5 5)))",
+        "POLYGON((0.5 0.5,2 0.5,2 2,0.5 2,0.5 0.5))", false, true);
+    // empty and null
+    assert_crosses_overlaps("LINESTRING EMPTY", "LINESTRING(0 0,1 1)", 
+        false, false);
+    assert(!tg_geom_crosses(NULL, NULL));
+    assert(!tg_geom_overlaps(NULL, NULL));
+
+    // random polygons and lines, which must have the same results with 
+    // any index.
+    static const enum tg_index ixs[] = { TG_NONE, TG_NATURAL, TG_YSTRIPES };
+    srand(mkrandseed());
+    double start = now();
+    int ncrosses = 0, noverlaps = 0;
+    while (now()-start < 1 || ncrosses == 0 || noverlaps == 0) {
+        int npoints1 = rand_double()*200+10;
+        int npoints2 = rand_double()*200+10;
+        struct tg_point *points1 = make_rand_polygon(npoints1);
+        struct tg_point *points2 = make_rand_polygon(npoints2);
+        double dx = (rand_double()-0.5)*0.004;
+        for (int i = 0; i < npoints2; i++) {
+            points2[i].x += dx;
+        }
+        struct tg_geom *geoms[3][3];
+        for (int i = 0; i < 3; i++) {
+            geoms[i][0] = (struct tg_geom*)tg_ring_new_ix(points1, npoints1, 
+                ixs[i]);
+            geoms[i][1] = (struct tg_geom*)tg_ring_new_ix(points2, npoints2, 
+                ixs[i]);
+            geoms[i][2] = (struct tg_geom*)tg_line_new_ix(points2, 
+                npoints2/2+2, ixs[i]);
+            assert(geoms[i][0] && geoms[i][1] && geoms[i][2]);
+        }
+        for (int j = 1; j < 3; j++) {
+            bool crosses = tg_geom_crosses(geoms[0][0], geoms[0][j]);
+            bool overlaps = tg_geom_overlaps(geoms[0][0], geoms[0][j]);
+            for (int i = 0; i < 3; i++) {
+                for (int k = 0; k < 3; k++) {
+                    assert(tg_geom_crosses(geoms[i][0], geoms[k][j]) == 
+                        crosses);
+                    assert(tg_geom_crosses(geoms[k][j], geoms[i][0]) == 
+                        crosses);
+                    assert(tg_geom_overlaps(geoms[i][0], geoms[k][j]) == 
+                        overlaps);
+                    assert(tg_geom_overlaps(geoms[k][j], geoms[i][0]) == 
+                        overlaps);
+                }
+            }
+            if (crosses || overlaps) {
+                assert(tg_geom_intersects(geoms[0][0], geoms[0][j]));
+            }
+            ncrosses += crosses;
+            noverlaps += overlaps;
+        }
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 3; j++) {
+                tg_geom_free(geoms[i][j]);
+            }
+        }
+        free(points1);
+        free(points2);
+    }
 }
 
 void test_relations_various(void) {
@@ -557,6 +701,170 @@ void test_relations_various(void) {
     tg_geom_free(geom);
 }
 
+static bool equals_ref(const struct tg_geom *a, const struct tg_geom *b) {
+    return tg_geom_within(a, b) && tg_geom_contains(a, b);
+}
+
+static void assert_equals(const char *awkt, const char *bwkt, bool equals) {
+    struct tg_geom *a = tg_parse_wkt(awkt);
+    struct tg_geom *b = tg_parse_wkt(bwkt);
+    assert(!tg_geom_error(a) && !tg_geom_error(b));
+    assert(tg_geom_equals(a, b) == equals);
+    assert(tg_geom_equals(b, a) == equals);
+    assert(equals_ref(a, b) == equals);
+    if (equals) {
+        assert(tg_geom_hash(a) == tg_geom_hash(b));
+    }
+    tg_geom_free(a);
+    tg_geom_free(b);
+}
+
+// Copies the points of a ring, starting at 'start', optionally reversed. 
+// The 'extra' param adds a repeat of the first point (1) or a point near
+// the middle of the first segment (2).
+static struct tg_ring *ring_variant(const struct tg_ring *ring, int start, 
+    bool reverse, int extra, enum tg_index ix)
+{
+    int n = tg_ring_num_segments(ring);
+    const struct tg_point *points = tg_ring_points(ring);
+    struct tg_point *points2 = malloc((n+2)*sizeof(struct tg_point));
+    assert(points2);
+    int npoints2 = 0;
+    for (int i = 0; i < n; i++) {
+        int j = reverse ? (start-i+n)%n : (start+i)%n;
+        points2[npoints2++] = points[j];
+        if (extra == 1 && i == 0) {
+            points2[npoints2++] = points[j];
+        } else if (extra == 2 && i == 0) {
+            int k = reverse ? (start-1+n)%n : (start+1)%n;
+            points2[npoints2++] = P((points[j].x+points[k].x)/2, 
+                (points[j].y+points[k].y)/2);
+        }
+    }
+    points2[npoints2++] = points2[0];
+    struct tg_ring *ring2 = tg_ring_new_ix(points2, npoints2, ix);
+    assert(ring2);
+    free(points2);
+    return ring2;
+}
+
+void test_relations_equals(void) {
+    // rotated and reversed
+    assert_equals("POLYGON((0 0,10 0,10 10,0 10,0 0))", 
+        "POLYGON((10 10,0 10,0 0,10 0,10 10))", true);
+    assert_equals("POLYGON((0 0,10 0,10 10,0 10,0 0))", 
+        "POLYGON((10 0,0 0,0 10,10 10,10 0))", true);
+    // extra point on an edge
+    assert_equals("POLYGON((0 0,10 0,10 10,0 10,0 0))", 
+        "POLYGON((0 0,5 0,10 0,10 10,0 10,0 0))", true);
+    assert_equals("POLYGON((0 0,10 0,10 5,5 5,5 10,0 10,0 0))", 
+        "POLYGON((5 5,5 10,0 10,0 0,5 0,10 0,10 5,5 5))", true);
+    // same rect, different shape
+    assert_equals("POLYGON((0 0,10 0,10 10,0 10,0 0))", 
+        "POLYGON((0 0,10 0,10 5,5 5,5 10,0 10,0 0))", false);
+    struct tg_geom *a = tg_parse_wkt("POLYGON((0 0,10 0,10 10,0 10,0 0))");
+    struct tg_geom *b = tg_parse_wkt("POLYGON((0 0,10 0,10 5,5 10,0 0))");
+    assert(tg_geom_hash(a) == tg_geom_hash(b));
+    tg_geom_free(a);
+    tg_geom_free(b);
+    // holes
+    assert_equals(
+        "POLYGON((0 0,10 0,10 10,0 10,0 0),(1 1,2 1,2 2,1 2,1 1),"
+            "(5 5,6 5,6 6,5 6,5 5))", 
+        "POLYGON((0 0,10 0,10 10,0 10,0 0),(5 5,6 5,6 6,5 6,5 5),"
+            "(2 2,1 2,1 1,2 1,2 2))", true);
+    assert_equals(
+        "POLYGON((0 0,10 0,10 10,0 10,0 0),(1 1,2 1,2 2,1 2,1 1))", 
+        "POLYGON((0 0,10 0,10 10,0 10,0 0),(1 1,2 1,2 3,1 2,1 1))", false);
+    assert_equals("POLYGON((0 0,10 0,10 10,0 10,0 0))", 
+        "MULTIPOLYGON(((10 10,0 10,0 0,10 0,10 10)))", true);
+    // lines and points
+    assert_equals("LINESTRING(0 0,5 5,10 0)", "LINESTRING(10 0,5 5,0 0)", 
+        true);
+    assert_equals("LINESTRING(0 0,5 5,10 0)", "LINESTRING(0 0,10 0)", false);
+    assert_equals("MULTIPOINT(0 0,5 5)", "MULTIPOINT(5 5,0 0)", true);
+    assert_equals("POINT(-0 0)", "POINT(0 0)", true);
+    assert(tg_geom_hash(NULL) == tg_geom_hash(NULL));
+    // repeated points
+    assert_equals("LINESTRING(0 1,0 1,2 0)", "LINESTRING(0 1,0 1,2 0)", true);
+    assert_equals("LINESTRING(0 1,0 1,2 0)", "LINESTRING(0 1,2 0)", true);
+    assert_equals("LINESTRING(3 1,0 0,0 0,2 2)", "LINESTRING(2 2,0 0,3 1)",
+        true);
+    assert_equals("MULTILINESTRING((0 1,0 1,2 0))", 
+        "MULTILINESTRING((2 0,2 0,0 1))", true);
+    // turns off of the other line at a shared point
+    assert_equals("LINESTRING(0 0,1 0,1 1,2 1)", "LINESTRING(0 0,1 0,2 1)",
+        false);
+    // doubles back over itself
+    assert_equals("LINESTRING(0 0,2 0,1 0)", "LINESTRING(0 0,2 0)", true);
+
+    // random small lines, with repeated points, against each other
+    char awkt[256], bwkt[256];
+    for (int i = 0; i < 4000; i++) {
+        char *wkts[] = { awkt, bwkt };
+        for (int j = 0; j < 2; j++) {
+            int n = 2+rand()%4;
+            int len = snprintf(wkts[j], 256, "LINESTRING(");
+            for (int k = 0; k < n; k++) {
+                len += snprintf(wkts[j]+len, 256-len, "%s%d %d", 
+                    k ? "," : "", rand()%3, rand()%3);
+            }
+            snprintf(wkts[j]+len, 256-len, ")");
+        }
+        if (rand()%2) {
+            strcpy(bwkt, awkt);
+        }
+        struct tg_geom *a = tg_parse_wkt(awkt);
+        struct tg_geom *b = tg_parse_wkt(bwkt);
+        assert(a && b);
+        assert(tg_geom_equals(a, b) == equals_ref(a, b));
+        tg_geom_free(a);
+        tg_geom_free(b);
+    }
+
+    // random rings against copies
+    static const enum tg_index ixs[] = { TG_NONE, TG_NATURAL, TG_YSTRIPES };
+    srand(mkrandseed());
+    double start = now();
+    while (now()-start < 1) {
+        int npoints = rand_double()*500+10;
+        struct tg_point *points = make_rand_polygon(npoints);
+        enum tg_index ix1 = tg_index_with_spread(ixs[rand()%3], 
+            rand_double()*20);
+        enum tg_index ix2 = tg_index_with_spread(ixs[rand()%3], 
+            rand_double()*20);
+        struct tg_ring *ring1 = tg_ring_new_ix(points, npoints, ix1);
+        assert(ring1);
+        int n = tg_ring_num_segments(ring1);
+        struct tg_ring *ring2 = ring_variant(ring1, rand()%n, rand()%2, 
+            rand()%2, ix2);
+        struct tg_geom *a = (struct tg_geom*)ring1;
+        struct tg_geom *b = (struct tg_geom*)ring2;
+        assert(tg_geom_equals(a, b));
+        assert(tg_geom_equals(b, a));
+        assert(equals_ref(a, b));
+        assert(tg_geom_hash(a) == tg_geom_hash(b));
+        // the middle point may be rounded off of the edge
+        struct tg_ring *ring4 = ring_variant(ring1, rand()%n, rand()%2, 2, 
+            ix2);
+        struct tg_geom *d = (struct tg_geom*)ring4;
+        assert(tg_geom_equals(a, d) == equals_ref(a, d));
+        assert(tg_geom_equals(d, a) == equals_ref(d, a));
+        tg_ring_free(ring4);
+        // move a point
+        points[rand()%(npoints-1)+1].x += (rand_double()-0.5)*0.0005;
+        struct tg_ring *ring3 = tg_ring_new_ix(points, npoints, ix2);
+        assert(ring3);
+        struct tg_geom *c = (struct tg_geom*)ring3;
+        assert(tg_geom_equals(a, c) == equals_ref(a, c));
+        assert(tg_geom_equals(c, b) == equals_ref(c, b));
+        tg_ring_free(ring1);
+        tg_ring_free(ring2);
+        tg_ring_free(ring3);
+        free(points);
+    }
+}
+
 int main(int argc, char **argv) {
     // return 0;
     // $ tests/run.sh test_relation [only_file] [only_index]
@@ -572,7 +880,8 @@ int main(int argc, char **argv) {
     }
 
     do_test(test_relations_cases);
-    do_test(test_relations_unsupported);
+    do_test(test_relations_crosses_overlaps);
     do_test(test_relations_various);
+    do_test(test_relations_equals);
     return 0;
 }
@@ -1050,6 +1050,255 @@ void test_ring_intersects_ring() {
     }
 }
 
+// The per-segment algorithm that tg_ring_intersects_ring used prior to 
+// walking both indexes together.
+static bool ring_intersects_ring_ref(const struct tg_ring *ring,
+    const struct tg_ring *other, bool allow_on_edge)
+{
+    if (!tg_rect_intersects_rect(tg_ring_rect(ring), tg_ring_rect(other))) {
+        return false;
+    }
+    struct tg_rect r1 = tg_ring_rect(ring);
+    struct tg_rect r2 = tg_ring_rect(other);
+    if ((r2.max.x-r2.min.x)*(r2.max.y-r2.min.y) > 
+        (r1.max.x-r1.min.x)*(r1.max.y-r1.min.y))
+    {
+        const struct tg_ring *tmp = ring;
+        ring = other;
+        other = tmp;
+    }
+    for (int i = 0; i < tg_ring_num_segments(other); i++) {
+        if (tg_ring_intersects_segment(ring, tg_ring_segment_at(other, i), 
+            allow_on_edge)) 
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static struct tg_ring *make_moved_ring(struct tg_point *points, int npoints, 
+    double scale, double dx, double dy, enum tg_index ix)
+{
+    struct tg_point *points2 = malloc(npoints*sizeof(struct tg_point));
+    assert(points2);
+    struct tg_point c = points[0];
+    for (int i = 0; i < npoints; i++) {
+        points2[i].x = c.x+(points[i].x-c.x)*scale+dx;
+        points2[i].y = c.y+(points[i].y-c.y)*scale+dy;
+    }
+    struct tg_ring *ring = tg_ring_new_ix(points2, npoints, ix);
+    assert(ring);
+    free(points2);
+    return ring;
+}
+
+void test_ring_intersects_ring_random(void) {
+    static const enum tg_index ixs[] = { TG_NONE, TG_NATURAL, TG_YSTRIPES };
+    srand(mkrandseed());
+    double start = now();
+    int nhits = 0, nmisses = 0;
+    while (now()-start < 1 || nhits == 0 || nmisses == 0) {
+        int npoints1 = rand_double()*500+10;
+        int npoints2 = rand_double()*500+10;
+        struct tg_point *points1 = make_rand_polygon(npoints1);
+        struct tg_point *points2 = make_rand_polygon(npoints2);
+        enum tg_index ix1 = tg_index_with_spread(ixs[rand()%3], 
+            rand_double()*20);
+        enum tg_index ix2 = tg_index_with_spread(ixs[rand()%3], 
+            rand_double()*20);
+        struct tg_ring *ring1 = tg_ring_new_ix(points1, npoints1, ix1);
+        assert(ring1);
+        struct tg_ring *ring2 = make_moved_ring(points2, npoints2, 
+            rand_double()*1.5+0.05, (rand_double()-0.5)*0.006, 
+            (rand_double()-0.5)*0.006, ix2);
+        for (int i = 0; i < 2; i++) {
+            bool allow_on_edge = i == 0;
+            bool hit = tg_ring_intersects_ring(ring1, ring2, allow_on_edge);
+            assert(hit == ring_intersects_ring_ref(ring1, ring2, 
+                allow_on_edge));
+            assert(hit == tg_ring_intersects_ring(ring2, ring1, 
+                allow_on_edge));
+            nhits += hit;
+            nmisses += !hit;
+        }
+        // fully inside of itself and of a larger copy
+        struct tg_ring *ring3 = make_moved_ring(points1, npoints1, 1.5, 0, 0,
+            ix2);
+        assert(tg_ring_intersects_ring(ring1, ring1, true));
+        assert(tg_ring_intersects_ring(ring1, ring3, true) ==
+            ring_intersects_ring_ref(ring1, ring3, true));
+        tg_ring_free(ring3);
+        tg_ring_free(ring1);
+        tg_ring_free(ring2);
+        free(points1);
+        free(points2);
+    }
+}
+
+// The per-segment algorithm that tg_ring_contains_ring used for concave 
+// rings prior to classifying the points once.
+static bool ring_contains_ring_ref(const struct tg_ring *ring,
+    const struct tg_ring *other, bool allow_on_edge)
+{
+    if (!tg_rect_covers_rect(tg_ring_rect(ring), tg_ring_rect(other))) {
+        return false;
+    }
+    for (int i = 0; i < tg_ring_num_segments(other); i++) {
+        if (!tg_ring_contains_segment(ring, tg_ring_segment_at(other, i),
+            allow_on_edge))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void test_ring_contains_ring_random(void) {
+    static const enum tg_index ixs[] = { TG_NONE, TG_NATURAL, TG_YSTRIPES };
+    srand(mkrandseed());
+    double start = now();
+    int nhits = 0, nmisses = 0;
+    while (now()-start < 1 || nhits == 0 || nmisses == 0) {
+        int npoints1 = rand_double()*500+10;
+        struct tg_point *points1 = make_rand_polygon(npoints1);
+        enum tg_index ix1 = tg_index_with_spread(ixs[rand()%3], 
+            rand_double()*20);
+        enum tg_index ix2 = tg_index_with_spread(ixs[rand()%3], 
+            rand_double()*20);
+        struct tg_ring *ring1 = tg_ring_new_ix(points1, npoints1, ix1);
+        assert(ring1);
+        // every nth point of the outer ring, which has points on the edge
+        // and chords that may pass outside.
+        int step = rand()%4+1;
+        struct tg_point *points2 = malloc(npoints1*sizeof(struct tg_point));
+        assert(points2);
+        int npoints2 = 0;
+        for (int i = 0; i < npoints1-1; i += step) {
+            points2[npoints2++] = points1[i];
+        }
+        points2[npoints2++] = points1[0];
+        struct tg_ring *ring2 = tg_ring_new_ix(points2, npoints2, ix2);
+        assert(ring2);
+        // a smaller copy that is moved around.
+        struct tg_ring *ring3 = make_moved_ring(points1, npoints1, 
+            rand_double()*0.5+0.01, (rand_double()-0.5)*0.002, 
+            (rand_double()-0.5)*0.002, ix2);
+        for (int i = 0; i < 2; i++) {
+            bool allow_on_edge = i == 0;
+            bool hit = tg_ring_contains_ring(ring1, ring2, allow_on_edge);
+            assert(hit == ring_contains_ring_ref(ring1, ring2, 
+                allow_on_edge));
+            nhits += hit;
+            nmisses += !hit;
+            hit = tg_ring_contains_ring(ring1, ring3, allow_on_edge);
+            assert(hit == ring_contains_ring_ref(ring1, ring3, 
+                allow_on_edge));
+            nhits += hit;
+            nmisses += !hit;
+        }
+        assert(tg_ring_contains_ring(ring1, ring1, true));
+        assert(!tg_ring_contains_ring(ring1, ring1, false));
+        tg_ring_free(ring1);
+        tg_ring_free(ring2);
+        tg_ring_free(ring3);
+        free(points1);
+        free(points2);
+    }
+}
+
+static bool ring_intersects_line_ref(const struct tg_ring *ring,
+    const struct tg_line *line, bool allow_on_edge)
+{
+    for (int i = 0; i < tg_line_num_segments(line); i++) {
+        if (tg_ring_intersects_segment(ring, tg_line_segment_at(line, i),
+            allow_on_edge))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool ring_contains_line_ref(const struct tg_ring *ring,
+    const struct tg_line *line, bool allow_on_edge)
+{
+    if (!tg_rect_covers_rect(tg_ring_rect(ring), tg_line_rect(line))) {
+        return false;
+    }
+    for (int i = 0; i < tg_line_num_segments(line); i++) {
+        if (!tg_ring_contains_segment(ring, tg_line_segment_at(line, i),
+            allow_on_edge))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void test_ring_line_random(void) {
+    static const enum tg_index ixs[] = { TG_NONE, TG_NATURAL, TG_YSTRIPES };
+    srand(mkrandseed());
+    double start = now();
+    int nhits = 0, nmisses = 0;
+    while (now()-start < 1 || nhits == 0 || nmisses == 0) {
+        int npoints1 = rand_double()*500+10;
+        struct tg_point *points1 = make_rand_polygon(npoints1);
+        enum tg_index ix1 = tg_index_with_spread(ixs[rand()%3], 
+            rand_double()*20);
+        enum tg_index ix2 = tg_index_with_spread(ixs[rand()%3], 
+            rand_double()*20);
+        struct tg_ring *ring = tg_ring_new_ix(points1, npoints1, ix1);
+        assert(ring);
+        // every nth point of a run of the ring, which has points on the edge
+        // and chords that may pass outside.
+        int step = rand()%4+1;
+        int first = rand()%(npoints1-1);
+        int count = rand()%(npoints1-1)+2;
+        struct tg_point *points2 = malloc(count*sizeof(struct tg_point));
+        assert(points2);
+        int npoints2 = 0;
+        for (int i = 0; i < count; i += step) {
+            points2[npoints2++] = points1[(first+i)%(npoints1-1)];
+        }
+        if (npoints2 == 1) {
+            points2[npoints2++] = points1[(first+1)%(npoints1-1)];
+        }
+        struct tg_line *line1 = tg_line_new_ix(points2, npoints2, ix2);
+        assert(line1);
+        // part of a smaller copy that is moved around.
+        struct tg_ring *ring2 = make_moved_ring(points1, npoints1, 
+            rand_double()*0.5+0.01, (rand_double()-0.5)*0.002, 
+            (rand_double()-0.5)*0.002, ix2);
+        int npoints3 = rand()%(npoints1-1)+2;
+        struct tg_line *line2 = tg_line_new_ix(tg_ring_points(ring2), 
+            npoints3, ix2);
+        assert(line2);
+        for (int i = 0; i < 2; i++) {
+            bool allow_on_edge = i == 0;
+            const struct tg_line *lines[] = { line1, line2 };
+            for (int j = 0; j < 2; j++) {
+                bool hit = tg_ring_intersects_line(ring, lines[j], 
+                    allow_on_edge);
+                assert(hit == ring_intersects_line_ref(ring, lines[j], 
+                    allow_on_edge));
+                hit = tg_ring_contains_line(ring, lines[j], allow_on_edge,
+                    false);
+                assert(hit == ring_contains_line_ref(ring, lines[j], 
+                    allow_on_edge));
+                nhits += hit;
+                nmisses += !hit;
+            }
+        }
+        tg_ring_free(ring);
+        tg_ring_free(ring2);
+        tg_line_free(line1);
+        tg_line_free(line2);
+        free(points1);
+        free(points2);
+    }
+}
+
 struct tg_line *make_line(struct tg_point start) {
     return LINE(
         start, 
@@ -1601,7 +1850,10 @@ int main(int argc, char **argv) {
     do_test(test_ring_intersects_segment_parallel);
     do_test(test_ring_covers_segment);
     do_test(test_ring_contains_ring);
+    do_test(test_ring_contains_ring_random);
+    do_test(test_ring_line_random);
     do_test(test_ring_intersects_ring);
+    do_test(test_ring_intersects_ring_random);
     do_test(test_ring_covers_line);
     do_test(test_ring_intersects_line);
     do_test(test_ring_not_closed);
@@ -0,0 +1,196 @@
+#include <pthread.h>
+#include "tests.h"
+
+struct counter {
+    int count;
+};
+
+static bool count_iter(const struct tg_geom *geom, int index, void *udata) {
+    (void)geom; (void)index;
+    ((struct counter*)udata)->count++;
+    return true;
+}
+
+static int search_count(const struct tg_geom *geom, struct tg_rect rect) {
+    struct counter counter = { 0 };
+    tg_geom_search(geom, rect, count_iter, &counter);
+    return counter.count;
+}
+
+static struct tg_geom *square(double x, double y) {
+    struct tg_point points[] = {
+        P(x, y), P(x+1, y), P(x+1, y+1), P(x, y+1), P(x, y),
+    };
+    return (struct tg_geom*)tg_ring_new(points, 5);
+}
+
+void test_set_basic(void) {
+    struct tg_rect world = R(-180, -90, 180, 90);
+    struct tg_geom_set *set = tg_geom_set_new();
+    assert(set);
+    struct tg_geom *snap0 = tg_geom_set_snapshot(set);
+    assert(snap0);
+    assert(tg_geom_typeof(snap0) == TG_GEOMETRYCOLLECTION);
+    assert(tg_geom_num_geometries(snap0) == 0);
+
+    struct tg_geom *a = square(0, 0);
+    struct tg_geom *b = square(10, 10);
+    assert(a && b);
+    assert(!tg_geom_set_put(set, 1, a));
+    assert(!tg_geom_set_put(set, -1, a));
+    assert(tg_geom_set_put(set, 0, a));
+    assert(tg_geom_set_put(set, 1, b));
+    assert(tg_geom_set_count(set) == 2);
+
+    // not yet published
+    struct tg_geom *snap1 = tg_geom_set_snapshot(set);
+    assert(tg_geom_num_geometries(snap1) == 0);
+    tg_geom_free(snap1);
+
+    assert(tg_geom_set_publish(set));
+    snap1 = tg_geom_set_snapshot(set);
+    assert(tg_geom_num_geometries(snap1) == 2);
+    assert(search_count(snap1, world) == 2);
+    assert(search_count(snap1, R(0.5, 0.5, 0.5, 0.5)) == 1);
+    assert(tg_geom_equals(tg_geom_geometry_at(snap1, 0), a));
+
+    // replace and remove
+    assert(tg_geom_set_put(set, 0, b));
+    assert(tg_geom_set_remove(set, 1));
+    assert(!tg_geom_set_remove(set, 1));
+    assert(tg_geom_set_count(set) == 1);
+    assert(tg_geom_set_publish(set));
+    struct tg_geom *snap2 = tg_geom_set_snapshot(set);
+    assert(tg_geom_num_geometries(snap2) == 1);
+    assert(search_count(snap2, R(0.5, 0.5, 0.5, 0.5)) == 0);
+    assert(search_count(snap2, R(10.5, 10.5, 10.5, 10.5)) == 1);
+
+    // older snapshots are unchanged
+    assert(tg_geom_num_geometries(snap0) == 0);
+    assert(search_count(snap1, R(0.5, 0.5, 0.5, 0.5)) == 1);
+
+    // indexed snapshots
+    for (int i = 0; i < 1000; i++) {
+        struct tg_geom *geom = square(rand_double()*300-150,
+            rand_double()*150-75);
+        assert(geom);
+        assert(tg_geom_set_put(set, tg_geom_set_count(set), geom));
+        tg_geom_free(geom);
+    }
+    assert(tg_geom_set_publish(set));
+    struct tg_geom *snap3 = tg_geom_set_snapshot(set);
+    assert(tg_geom_multi_index_spread(snap3) > 0);
+    assert(search_count(snap3, world) == 1001);
+
+    tg_geom_free(a);
+    tg_geom_free(b);
+    tg_geom_set_free(set);
+    tg_geom_free(snap0);
+    tg_geom_free(snap1);
+    tg_geom_free(snap2);
+    tg_geom_free(snap3);
+
+    // should not fail
+    tg_geom_set_free(NULL);
+    assert(!tg_geom_set_snapshot(NULL));
+    assert(!tg_geom_set_publish(NULL));
+    assert(tg_geom_set_count(NULL) == 0);
+}
+
+struct reader_ctx {
+    struct tg_geom_set *set;
+    int done;
+    int reads;
+};
+
+static void *reader_thread(void *arg) {
+    struct reader_ctx *ctx = arg;
+    int reads = 0;
+    while (!__atomic_load_n(&ctx->done, __ATOMIC_ACQUIRE)) {
+        struct tg_geom *snap = tg_geom_set_snapshot(ctx->set);
+        assert(snap);
+        // every snapshot is internally consistent
+        int n = tg_geom_num_geometries(snap);
+        assert(search_count(snap, R(-1000, -1000, 1000, 1000)) == n);
+        tg_geom_free(snap);
+        reads++;
+    }
+    __atomic_add_fetch(&ctx->reads, reads, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+static void check_concurrent(int nreaders, double secs) {
+    struct tg_geom_set *set = tg_geom_set_new();
+    assert(set);
+    struct reader_ctx ctx = { .set = set };
+    pthread_t threads[100];
+    assert(nreaders <= 100);
+    for (int i = 0; i < nreaders; i++) {
+        assert(pthread_create(&threads[i], NULL, reader_thread, &ctx) == 0);
+    }
+    double start = now();
+    int publishes = 0;
+    while (now()-start < secs || publishes < 100) {
+        int n = tg_geom_set_count(set);
+        if (n > 200 && rand()%2) {
+            for (int i = 0; i < 20; i++) {
+                assert(tg_geom_set_remove(set, rand()%tg_geom_set_count(set)));
+            }
+        } else {
+            for (int i = 0; i < 20; i++) {
+                struct tg_geom *geom = square(rand_double()*300-150,
+                    rand_double()*150-75);
+                assert(geom);
+                int index = rand()%(tg_geom_set_count(set)+1);
+                assert(tg_geom_set_put(set, index, geom));
+                tg_geom_free(geom);
+            }
+        }
+        assert(tg_geom_set_publish(set));
+        publishes++;
+    }
+    __atomic_store_n(&ctx.done, 1, __ATOMIC_RELEASE);
+    for (int i = 0; i < nreaders; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    assert(ctx.reads > 0);
+    tg_geom_set_free(set);
+}
+
+void test_set_concurrent(void) {
+    // Readers may release snapshots, so use an allocator that is safe
+    // across threads.
+    tg_env_set_allocator(NULL, NULL, NULL);
+    check_concurrent(4, 1.0);
+    // more readers than reader slots
+    check_concurrent(100, 1.0);
+}
+
+void test_set_chaos(void) {
+    struct tg_geom_set *set;
+    while (!(set = tg_geom_set_new())) {}
+    struct tg_geom *geom;
+    while (!(geom = square(0, 0))) {}
+    for (int i = 0; i < 2000; i++) {
+        if (tg_geom_set_count(set) > 100 && rand()%3 == 0) {
+            assert(tg_geom_set_remove(set, 0));
+        } else {
+            tg_geom_set_put(set, tg_geom_set_count(set), geom);
+        }
+        int n = tg_geom_set_count(set);
+        if (tg_geom_set_publish(set)) {
+            struct tg_geom *snap = tg_geom_set_snapshot(set);
+            assert(tg_geom_num_geometries(snap) == n);
+            tg_geom_free(snap);
+        }
+    }
+    tg_geom_free(geom);
+    tg_geom_set_free(set);
+}
+
+int main(int argc, char **argv) {
+    do_test(test_set_basic);
+    do_test(test_set_concurrent);
+    do_chaos_test(test_set_chaos);
+    return 0;
+}
@@ -0,0 +1,204 @@
+#include "tests.h"
+
+// run.sh runs these tests twice, once as is and once with TG_STATS. The
+// counters are only checked when TG_STATS is defined.
+
+#ifdef TG_STATS
+
+static bool count_seg(struct tg_segment seg, int index, void *udata) {
+    (void)seg; (void)index;
+    (*(int*)udata)++;
+    return true;
+}
+
+void test_stats_pip(void) {
+    struct tg_ring *none = RING_NONE(az);
+    struct tg_ring *natural = RING_NATURAL(az);
+    struct tg_ring *ystripes = RING_YSTRIPES(az);
+    struct tg_point point = P(-112, 34);
+    struct tg_stats stats;
+
+    tg_stats_reset();
+    tg_stats_get(&stats);
+    assert(stats.index_nodes == 0 && stats.segments == 0);
+
+    assert(tg_ring_contains_point(none, point, true).hit);
+    tg_stats_get(&stats);
+    assert(stats.index_nodes == 0);
+    assert((int)stats.segments == tg_ring_num_segments(none));
+    assert(stats.raycasts > 0);
+    assert(stats.allocs == 0);
+
+    tg_stats_reset();
+    assert(tg_ring_contains_point(natural, point, true).hit);
+    tg_stats_get(&stats);
+    assert(stats.index_nodes > 0);
+    assert(stats.segments > 0);
+    assert((int)stats.segments < tg_ring_num_segments(natural));
+
+    tg_stats_reset();
+    assert(tg_ring_contains_point(ystripes, point, true).hit);
+    tg_stats_get(&stats);
+    assert(stats.index_nodes == 1);
+    assert((int)stats.segments < tg_ring_num_segments(ystripes));
+
+    // search visits fewer segments with an index
+    struct tg_rect rect = R(-112, 34, -111.9, 34.1);
+    int count_none = 0, count_natural = 0;
+    tg_stats_reset();
+    tg_ring_search(none, rect, count_seg, &count_none);
+    struct tg_stats stats_none;
+    tg_stats_get(&stats_none);
+    tg_stats_reset();
+    tg_ring_search(natural, rect, count_seg, &count_natural);
+    tg_stats_get(&stats);
+    assert(count_none == count_natural);
+    assert(stats.segments < stats_none.segments);
+    assert(stats.index_nodes > 0);
+    tg_ring_free(ystripes);
+}
+
+void test_stats_intersects(void) {
+    struct tg_line *a = LINE(P(0, 0), P(5, 5), P(10, 10));
+    struct tg_line *b = LINE(P(0, 10), P(5, 6), P(10, 0));
+    struct tg_stats stats;
+    tg_stats_reset();
+    assert(tg_line_intersects_line(a, b));
+    tg_stats_get(&stats);
+    assert(stats.segment_intersects > 0);
+
+    // allocations are counted per thread
+    tg_stats_reset();
+    struct tg_geom *geom = tg_parse_wkt("POLYGON((0 0,10 0,10 10,0 10,0 0))");
+    assert(geom);
+    tg_stats_get(&stats);
+    assert(stats.allocs > 0);
+    assert(stats.bytes > 0);
+    tg_geom_free(geom);
+
+    // should not fail
+    tg_stats_get(NULL);
+}
+
+void test_stats_tracker(void) {
+    struct tg_geom *geom = tg_parse_wkt(
+        "POLYGON((0 0,10 0,10 10,0 10,0 0),(4 4,6 4,6 6,4 6,4 4))");
+    assert(geom);
+    struct tg_pip_tracker *tracker = tg_pip_tracker_new(geom);
+    assert(tracker);
+    struct tg_stats stats;
+
+    // the nearest boundary of (2 2) is one unit away, so (2.5 2.5) is
+    // answered without touching the polygon.
+    assert(tg_pip_tracker_intersects_xy(tracker, 2, 2));
+    tg_stats_reset();
+    assert(tg_pip_tracker_intersects_xy(tracker, 2.5, 2.5));
+    tg_stats_get(&stats);
+    assert(stats.raycasts == 0 && stats.segments == 0);
+
+    // a reset always tests the next point
+    tg_pip_tracker_reset(tracker);
+    tg_stats_reset();
+    assert(tg_pip_tracker_intersects_xy(tracker, 2.5, 2.5));
+    tg_stats_get(&stats);
+    assert(stats.raycasts > 0);
+    tg_pip_tracker_free(tracker);
+    tg_geom_free(geom);
+}
+
+#else
+
+void test_stats_disabled(void) {
+    struct tg_geom *geom = tg_parse_wkt("POLYGON((0 0,10 0,10 10,0 10,0 0))");
+    assert(geom);
+    struct tg_stats stats;
+    memset(&stats, 0xFF, sizeof(stats));
+    tg_stats_reset();
+    assert(tg_geom_intersects_xy(geom, 5, 5));
+    tg_stats_get(&stats);
+    struct tg_stats zero = { 0 };
+    assert(memcmp(&stats, &zero, sizeof(stats)) == 0);
+    tg_geom_free(geom);
+}
+
+#endif
+
+struct slow_ops {
+    int count;
+    struct tg_slow_op last;
+};
+
+static void slow_op_hook(const struct tg_slow_op *op, void *udata) {
+    struct slow_ops *ops = udata;
+    ops->count++;
+    ops->last = *op;
+}
+
+void test_stats_slow_op(void) {
+    struct tg_geom *a = tg_parse_wkt("POLYGON((0 0,10 0,10 10,0 10,0 0))");
+    struct tg_geom *b = tg_parse_wkt("POINT(5 5)");
+    struct slow_ops ops = { 0 };
+    tg_env_set_slow_op_hook(0, slow_op_hook, &ops);
+
+    // one in every 64 calls is timed
+    for (int i = 0; i < 64*4; i++) {
+        assert(tg_geom_intersects(a, b));
+    }
+    assert(ops.count == 4);
+    assert(ops.last.kind == TG_OP_INTERSECTS);
+    assert(ops.last.a_type == TG_POLYGON);
+    assert(ops.last.b_type == TG_POINT);
+    assert(ops.last.a_points == 5);
+    assert(ops.last.b_points == 1);
+
+    // nested operations are only reported by the outer operation
+    ops.count = 0;
+    char hex[256];
+    for (int i = 0; i < 64; i++) {
+        assert(tg_geom_hex(b, hex, sizeof(hex)) == 42);
+    }
+    assert(ops.count == 1);
+    assert(ops.last.kind == TG_OP_WRITE_HEX);
+    assert(ops.last.b_type == 0);
+    assert(ops.last.len == 42);
+
+    ops.count = 0;
+    for (int i = 0; i < 64; i++) {
+        struct tg_geom *geom = tg_parse_hex(hex);
+        assert(geom);
+        tg_geom_free(geom);
+    }
+    assert(ops.count == 1);
+    assert(ops.last.kind == TG_OP_PARSE_HEX);
+    assert(ops.last.a_type == TG_POINT);
+    assert(ops.last.len == 42);
+
+    // nothing is over the threshold
+    ops.count = 0;
+    tg_env_set_slow_op_hook(UINT64_MAX, slow_op_hook, &ops);
+    for (int i = 0; i < 64*4; i++) {
+        assert(tg_geom_within(b, a));
+    }
+    assert(ops.count == 0);
+
+    // removed
+    tg_env_set_slow_op_hook(0, NULL, NULL);
+    for (int i = 0; i < 64*4; i++) {
+        assert(tg_geom_within(b, a));
+    }
+    assert(ops.count == 0);
+    tg_geom_free(a);
+    tg_geom_free(b);
+}
+
+int main(int argc, char **argv) {
+#ifdef TG_STATS
+    do_test(test_stats_pip);
+    do_test(test_stats_intersects);
+    do_test(test_stats_tracker);
+#else
+    do_test(test_stats_disabled);
+#endif
+    do_test(test_stats_slow_op);
+    return 0;
+}
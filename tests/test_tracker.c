@@ -0,0 +1,136 @@
+#include "tests.h"
+
+// Walks a point around the geometry and checks every tracker result against
+// tg_geom_intersects_xy().
+static void walk(struct tg_geom *geom, double step, int nsteps) {
+    struct tg_pip_tracker *tracker = tg_pip_tracker_new(geom);
+    assert(tracker);
+    struct tg_rect rect = tg_geom_rect(geom);
+    double x = rect.min.x + (rect.max.x-rect.min.x)*rand_double();
+    double y = rect.min.y + (rect.max.y-rect.min.y)*rand_double();
+    double angle = rand_double()*M_PI*2;
+    int nhits = 0;
+    for (int i = 0; i < nsteps; i++) {
+        bool hit = tg_pip_tracker_intersects_xy(tracker, x, y);
+        assert(hit == tg_geom_intersects_xy(geom, x, y));
+        nhits += hit;
+        angle += (rand_double()-0.5)*0.5;
+        x += cos(angle)*step;
+        y += sin(angle)*step;
+        if (x < rect.min.x || x > rect.max.x ||
+            y < rect.min.y || y > rect.max.y)
+        {
+            // turn back
+            angle += M_PI;
+        }
+        if (rand()%1000 == 0) {
+            tg_pip_tracker_reset(tracker);
+        }
+    }
+    tg_pip_tracker_free(tracker);
+}
+
+void test_tracker_walk(void) {
+    srand(mkrandseed());
+    static const enum tg_index ixs[] = { TG_NONE, TG_NATURAL, TG_YSTRIPES };
+    for (int i = 0; i < 3; i++) {
+        struct tg_geom *geom = load_geom("az", ixs[i]);
+        assert(geom);
+        walk(geom, 0.01, 20000);
+        tg_geom_free(geom);
+        geom = tg_parse_wkt_ix(
+            "MULTIPOLYGON(((0 0,10 0,10 10,0 10,0 0),(4 4,6 4,6 6,4 6,4 4)),"
+            "((20 0,30 0,30 10,20 10,20 0)))", ixs[i]);
+        assert(geom);
+        walk(geom, 0.05, 20000);
+        tg_geom_free(geom);
+    }
+}
+
+void test_tracker_cached(void) {
+    struct tg_geom *geom = tg_parse_wkt(
+        "POLYGON((0 0,10 0,10 10,0 10,0 0),(4 4,6 4,6 6,4 6,4 4))");
+    assert(geom);
+    struct tg_pip_tracker *tracker = tg_pip_tracker_new(geom);
+    assert(tracker);
+
+    // the nearest boundary of (2 2) is one unit away
+    assert(tg_pip_tracker_intersects_xy(tracker, 2, 2));
+    assert(tg_pip_tracker_intersects_xy(tracker, 2.5, 2.5));
+    assert(tg_pip_tracker_intersects_xy(tracker, 1.1, 2.9));
+    assert(tg_pip_tracker_intersects_xy(tracker, 3.9, 3.9));
+
+    // over the hole boundary
+    assert(!tg_pip_tracker_intersects_xy(tracker, 5, 5));
+    assert(!tg_pip_tracker_intersects_xy(tracker, 5.5, 5.5));
+    assert(tg_pip_tracker_intersects_xy(tracker, 4, 5));
+    assert(tg_pip_tracker_intersects_xy(tracker, 4, 5));
+    assert(!tg_pip_tracker_intersects_xy(tracker, 4.001, 5));
+
+    // a reset always tests the next point
+    tg_pip_tracker_reset(tracker);
+    assert(!tg_pip_tracker_intersects_xy(tracker, 5, 5));
+    assert(!tg_pip_tracker_intersects_xy(tracker, 11, 11));
+    assert(tg_pip_tracker_intersects_xy(tracker, 10, 10));
+    tg_pip_tracker_free(tracker);
+
+    // the geometry is cloned by the tracker
+    tracker = tg_pip_tracker_new(geom);
+    assert(tracker);
+    tg_geom_free(geom);
+    assert(tg_pip_tracker_intersects_xy(tracker, 1, 1));
+    tg_pip_tracker_free(tracker);
+}
+
+void test_tracker_various(void) {
+    // not a polygon, which is never cached
+    struct tg_geom *geom = tg_parse_wkt("LINESTRING(0 0,10 10)");
+    assert(geom);
+    struct tg_pip_tracker *tracker = tg_pip_tracker_new(geom);
+    assert(tracker);
+    assert(tg_pip_tracker_intersects_xy(tracker, 5, 5));
+    assert(!tg_pip_tracker_intersects_xy(tracker, 5, 5.1));
+    assert(tg_pip_tracker_intersects_xy(tracker, 5.1, 5.1));
+    tg_pip_tracker_free(tracker);
+    tg_geom_free(geom);
+
+    // empty
+    geom = tg_parse_wkt("POLYGON EMPTY");
+    assert(geom);
+    tracker = tg_pip_tracker_new(geom);
+    assert(tracker);
+    assert(!tg_pip_tracker_intersects_xy(tracker, 0, 0));
+    tg_pip_tracker_free(tracker);
+    tg_geom_free(geom);
+
+    // null
+    tracker = tg_pip_tracker_new(NULL);
+    assert(tracker);
+    assert(!tg_pip_tracker_intersects_xy(tracker, 0, 0));
+    tg_pip_tracker_free(tracker);
+    assert(!tg_pip_tracker_intersects_xy(NULL, 0, 0));
+    tg_pip_tracker_reset(NULL);
+    tg_pip_tracker_free(NULL);
+}
+
+void test_tracker_chaos(void) {
+    struct tg_geom *geom = NULL;
+    while (!geom) {
+        geom = tg_parse_wkt("POLYGON((0 0,10 0,10 10,0 10,0 0))");
+    }
+    struct tg_pip_tracker *tracker = NULL;
+    while (!tracker) {
+        tracker = tg_pip_tracker_new(geom);
+    }
+    assert(tg_pip_tracker_intersects_xy(tracker, 5, 5));
+    tg_pip_tracker_free(tracker);
+    tg_geom_free(geom);
+}
+
+int main(int argc, char **argv) {
+    do_test(test_tracker_walk);
+    do_test(test_tracker_cached);
+    do_test(test_tracker_various);
+    do_chaos_test(test_tracker_chaos);
+    return 0;
+}
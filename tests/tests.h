@@ -144,7 +144,6 @@ int tg_rect_num_segments(struct tg_rect rect);
 struct tg_segment tg_rect_segment_at(struct tg_rect rect, int index);
 bool tg_geom_covers(const struct tg_geom *a, const struct tg_geom *b);
 bool tg_geom_covers_point(const struct tg_geom *a, struct tg_point b);
-bool tg_geom_covers_xy(const struct tg_geom *a, double x, double y);
 bool tg_point_covers_point(struct tg_point a, struct tg_point b);
 bool tg_point_covers_rect(struct tg_point a, struct tg_rect b);
 bool tg_point_covers_line(struct tg_point a, const struct tg_line *b);
@@ -196,8 +195,6 @@ bool tg_rect_intersects_rect(struct tg_rect a, struct tg_rect b);
 bool tg_rect_intersects_line(struct tg_rect a, const struct tg_line *b);
 bool tg_rect_intersects_poly(struct tg_rect a, const struct tg_poly *b);
 bool tg_segment_intersects_segment(struct tg_segment a, struct tg_segment b);
-bool tg_geom_crosses(const struct tg_geom *a, const struct tg_geom *b);
-bool tg_geom_overlaps(const struct tg_geom *a, const struct tg_geom *b);
 bool tg_geom_intersects_point(const struct tg_geom *a, struct tg_point b);
 void tg_ring_ring_search(const struct tg_ring *a, const struct tg_ring *b, 
     bool (*iter)(struct tg_segment seg_a, int index_a, struct tg_segment seg_b, 
@@ -51,6 +51,7 @@ enum flags {
 };
 
 // Optionally use non-atomic reference counting when TG_NOATOMICS is defined.
+// This also disables the batch threads.
 #ifdef TG_NOATOMICS
 
 typedef int rc_t;
@@ -65,6 +66,44 @@ static bool rc_release(rc_t *rc) {
     return *rc == 1;
 }
 
+typedef int aint_t;
+#define aptr(T) T*
+static inline int aint_load(aint_t *a) {
+    return *a;
+}
+static inline int aint_fetch_add(aint_t *a, int n) {
+    int prev = *a;
+    *a += n;
+    return prev;
+}
+
+typedef uint64_t au64_t;
+#define aptr_load(ptr) (*(ptr))
+#define aptr_store(ptr, val) (*(ptr) = (val))
+static inline uint64_t au64_load(au64_t *a) {
+    return *a;
+}
+static inline void au64_store(au64_t *a, uint64_t val) {
+    *a = val;
+}
+static inline uint64_t au64_fetch_add(au64_t *a, uint64_t n) {
+    uint64_t prev = *a;
+    *a += n;
+    return prev;
+}
+static inline uint64_t au64_fetch_sub(au64_t *a, uint64_t n) {
+    uint64_t prev = *a;
+    *a -= n;
+    return prev;
+}
+static inline bool au64_cas(au64_t *a, uint64_t expected, uint64_t desired) {
+    if (*a != expected) {
+        return false;
+    }
+    *a = desired;
+    return true;
+}
+
 #else
 
 #include <stdatomic.h>
@@ -89,6 +128,38 @@ static bool rc_release(rc_t *rc) {
     return false;
 }
 
+// Atomic integers and pointers that are shared between threads, such as the
+// next item of each batch range and the lazy ystripes of a ring.
+typedef atomic_int aint_t;
+#define aptr(T) _Atomic(T*)
+static inline int aint_load(aint_t *a) {
+    return atomic_load_explicit(a, __ATOMIC_RELAXED);
+}
+static inline int aint_fetch_add(aint_t *a, int n) {
+    return atomic_fetch_add_explicit(a, n, __ATOMIC_RELAXED);
+}
+
+// Sequentially consistent integers and pointers, such as the epochs and
+// reader slots of a geometry set.
+typedef _Atomic(uint64_t) au64_t;
+#define aptr_load(ptr) atomic_load(ptr)
+#define aptr_store(ptr, val) atomic_store(ptr, val)
+static inline uint64_t au64_load(au64_t *a) {
+    return atomic_load(a);
+}
+static inline void au64_store(au64_t *a, uint64_t val) {
+    atomic_store(a, val);
+}
+static inline uint64_t au64_fetch_add(au64_t *a, uint64_t n) {
+    return atomic_fetch_add(a, n);
+}
+static inline uint64_t au64_fetch_sub(au64_t *a, uint64_t n) {
+    return atomic_fetch_sub(a, n);
+}
+static inline bool au64_cas(au64_t *a, uint64_t expected, uint64_t desired) {
+    return atomic_compare_exchange_strong(a, &expected, desired);
+}
+
 #endif
 
 struct head { 
@@ -127,12 +198,13 @@ struct tg_ring {
     bool closed;
     bool clockwise;
     bool convex;
+    bool lazy;     // ystripes are built on first use
     double area;
     int npoints;
     int nsegs;
     struct tg_rect rect;
     struct index *index;
-    struct ystripes *ystripes;
+    aptr(struct ystripes) ystripes;
     struct tg_point points[]; 
 };
 
@@ -290,7 +362,6 @@ bool tg_point_covers_rect(struct tg_point a, struct tg_rect b);
 bool tg_point_covers_line(struct tg_point a, const struct tg_line *b);
 bool tg_point_covers_poly(struct tg_point a, const struct tg_poly *b);
 bool tg_geom_covers_point(const struct tg_geom *a, struct tg_point b);
-bool tg_geom_covers_xy(const struct tg_geom *a, double x, double y);
 bool tg_segment_covers_segment(struct tg_segment a, struct tg_segment b);
 bool tg_segment_covers_point(struct tg_segment a, struct tg_point b);
 bool tg_segment_covers_rect(struct tg_segment a, struct tg_rect b);
@@ -499,6 +570,67 @@ static void (*_free)(void*) = NULL;
 static enum tg_index default_index = TG_NATURAL;
 static int default_index_spread = 16;
 
+// Optionally disable thread-local overrides when TG_NOTHREADLOCAL is defined,
+// for targets that do not support thread-local storage.
+#if defined(TG_NOTHREADLOCAL)
+#define tg_thread_local
+#elif defined(_MSC_VER)
+#define tg_thread_local __declspec(thread)
+#else
+#define tg_thread_local _Thread_local
+#endif
+
+// Thread-local variables that override the globals for the calling thread.
+static tg_thread_local void *(*_tl_malloc)(size_t) = NULL;
+static tg_thread_local void *(*_tl_realloc)(void*, size_t) = NULL;
+static tg_thread_local void (*_tl_free)(void*) = NULL;
+static tg_thread_local enum tg_index tl_default_index = TG_DEFAULT;
+static tg_thread_local int tl_default_index_spread = 0;
+
+// Thread-local counters, which are only maintained when compiled with 
+// TG_STATS. Otherwise stats_add compiles to nothing.
+#ifdef TG_STATS
+static tg_thread_local struct tg_stats tl_stats = { 0 };
+#define stats_add(field, n) (tl_stats.field += (n))
+#else
+#define stats_add(field, n) ((void)0)
+#endif
+
+// Slow operation hook. Only one in every SLOW_OP_SAMPLE top-level calls on
+// each thread is timed, and nested calls are never timed. Without a hook the
+// cost is one load and branch per call.
+#ifndef SLOW_OP_SAMPLE
+#define SLOW_OP_SAMPLE 64
+#endif
+
+static void (*slow_op_hook)(const struct tg_slow_op *op, void *udata) = NULL;
+static void *slow_op_udata = NULL;
+static uint64_t slow_op_threshold = 0;
+static tg_thread_local int tl_slow_op_depth = 0;
+static tg_thread_local unsigned tl_slow_op_calls = 0;
+
+static uint64_t slow_op_enter(void);
+static void slow_op_leave(uint64_t start, enum tg_op_kind kind, 
+    const struct tg_geom *a, const struct tg_geom *b, size_t len);
+
+// Returns zero when there is no hook, one when the call is not sampled, or
+// the start time.
+static inline uint64_t slow_op_begin(void) {
+    return slow_op_hook ? slow_op_enter() : 0;
+}
+
+static inline void slow_op_end(uint64_t start, enum tg_op_kind kind,
+    const struct tg_geom *a, const struct tg_geom *b, size_t len)
+{
+    if (start) {
+        slow_op_leave(start, kind, a, b, len);
+    }
+}
+
+// Internal tg_index flag for deferring the TG_YSTRIPES structure until the
+// first point-in-polygon operation. Set using tg_options.lazy.
+#define IX_LAZY (1<<16)
+
 /// Allow for configuring a custom allocator.
 ///
 /// This overrides the built-in malloc, realloc, and free functions for all
@@ -516,16 +648,68 @@ void tg_env_set_allocator(
     _free = free;
 }
 
+/// Allow for configuring a custom allocator for the calling thread only.
+///
+/// This overrides the allocator set by tg_env_set_allocator(), or the 
+/// built-in malloc, realloc, and free functions, for all TG operations on 
+/// the calling thread. Passing NULL functions removes the override.
+/// @warning Geometries are freed using the allocator that is active on the
+/// freeing thread, so it must be able to release memory from the allocator 
+/// that created them. The same goes for TG_YSTRIPES that are deferred with
+/// the tg_options lazy option, which are allocated by the first thread that
+/// needs them.
+/// @see tg_env_set_allocator()
+/// @see GlobalFuncs
+void tg_env_set_thread_allocator(
+    void *(*malloc)(size_t), 
+    void *(*realloc)(void*, size_t),
+    void (*free)(void*)) 
+{
+    _tl_malloc = malloc;
+    _tl_realloc = realloc;
+    _tl_free = free;
+}
+
 void *tg_malloc(size_t nbytes) {
-    return (_malloc?_malloc:malloc)(nbytes);
+    stats_add(allocs, 1);
+    stats_add(bytes, nbytes);
+    return (_tl_malloc?_tl_malloc:_malloc?_malloc:malloc)(nbytes);
 }
 
 void *tg_realloc(void *ptr, size_t nbytes) {
-    return (_realloc?_realloc:realloc)(ptr, nbytes);
+    stats_add(allocs, 1);
+    stats_add(bytes, nbytes);
+    return (_tl_realloc?_tl_realloc:_realloc?_realloc:realloc)(ptr, nbytes);
 }
 
 void tg_free(void *ptr) {
-    (_free?_free:free)(ptr);
+    (_tl_free?_tl_free:_free?_free:free)(ptr);
+}
+
+/// Get the counters for the calling thread.
+///
+/// Counters accumulate until tg_stats_reset() is called, so resetting before
+/// an operation and reading afterwards gives the work done by that one call.
+/// All counters are zero unless TG is compiled with TG_STATS.
+/// @param stats Output counters
+/// @see tg_stats_reset()
+/// @see StatsFuncs
+void tg_stats_get(struct tg_stats *stats) {
+    if (!stats) return;
+#ifdef TG_STATS
+    *stats = tl_stats;
+#else
+    memset(stats, 0, sizeof(struct tg_stats));
+#endif
+}
+
+/// Reset the counters for the calling thread to zero.
+/// @see tg_stats_get()
+/// @see StatsFuncs
+void tg_stats_reset(void) {
+#ifdef TG_STATS
+    memset(&tl_stats, 0, sizeof(struct tg_stats));
+#endif
 }
 
 /// Set the geometry indexing default.
@@ -551,11 +735,36 @@ void tg_env_set_index(enum tg_index ix) {
     }
 }
 
+/// Set the geometry indexing default for the calling thread only.
+///
+/// This overrides tg_env_set_index() for all yet-to-be created geometries on
+/// the calling thread. It may be called at any time. 
+/// Passing TG_DEFAULT removes the override.
+/// @see [tg_index](.#tg_index)
+/// @see tg_env_set_index()
+/// @see GlobalFuncs
+void tg_env_set_thread_index(enum tg_index ix) {
+    switch (ix) {
+    case TG_DEFAULT:
+    case TG_NONE: 
+    case TG_NATURAL: 
+    case TG_YSTRIPES:
+        tl_default_index = ix;
+        break;
+    default:
+        // no change
+        break;
+    }
+}
+
 /// Get the current geometry indexing default.
 /// @see [tg_index](.#tg_index)
 /// @see tg_env_set_index()
 /// @see GlobalFuncs
 enum tg_index tg_env_get_default_index(void) {
+    if (tl_default_index != TG_DEFAULT) {
+        return tl_default_index;
+    }
     return default_index;
 }
 
@@ -580,7 +789,24 @@ void tg_env_set_index_spread(int spread) {
         default_index_spread = spread;
     }
 }
+
+/// Set the default index spread for the calling thread only.
+///
+/// This overrides tg_env_set_index_spread() for all yet-to-be created 
+/// geometries on the calling thread. It may be called at any time. 
+/// Passing zero removes the override.
+/// @see tg_env_set_index_spread()
+/// @see GlobalFuncs
+void tg_env_set_thread_index_spread(int spread) {
+    if (spread == 0 || (spread >= 2 && spread <= 4096)) {
+        tl_default_index_spread = spread;
+    }
+}
+
 int tg_env_get_index_spread(void) {
+    if (tl_default_index_spread != 0) {
+        return tl_default_index_spread;
+    }
     return default_index_spread;
 }
 
@@ -608,6 +834,19 @@ enum tg_index tg_index_extract_spread(enum tg_index ix, int *spread) {
     return ix & 0xF;
 }
 
+// Returns the index option of a per-call options, or TG_DEFAULT when there
+// are no options.
+static enum tg_index opts_index(const struct tg_options *opts) {
+    if (!opts) {
+        return TG_DEFAULT;
+    }
+    enum tg_index ix = tg_index_with_spread(opts->index, opts->spread);
+    if (opts->lazy) {
+        ix |= IX_LAZY;
+    }
+    return ix;
+}
+
 ////////////////////
 // point
 ////////////////////
@@ -744,6 +983,7 @@ enum tg_raycast_result {
 static enum tg_raycast_result raycast(struct tg_segment seg, 
     struct tg_point p)
 {
+    stats_add(raycasts, 1);
     struct tg_rect r = tg_segment_rect(seg);
     if (p.y < r.min.y || p.y > r.max.y) {
         return TG_OUT;
@@ -937,6 +1177,7 @@ struct tg_segment tg_rect_segment_at(struct tg_rect r, int index) {
 bool tg_segment_intersects_segment(struct tg_segment seg_a, 
     struct tg_segment seg_b)
 {
+    stats_add(segment_intersects, 1);
     struct tg_point a = seg_a.a;
     struct tg_point b = seg_a.b;
     struct tg_point c = seg_b.a;
@@ -1239,7 +1480,7 @@ struct ystripes {
     struct ystripe stripes[];
 };
 
-static bool process_ystripes(struct tg_ring *ring) {
+static struct ystripes *ystripes_new(const struct tg_ring *ring) {
     double score = tg_ring_polsby_popper_score(ring);
     int nstripes = ring->nsegs * score;
     nstripes = fmax0(nstripes, 32);
@@ -1248,7 +1489,7 @@ static bool process_ystripes(struct tg_ring *ring) {
     // ycounts is used to log the number of segments in each stripe.
     int *ycounts = tg_malloc(nstripes*sizeof(int));
     if (!ycounts) {
-        return false;
+        return NULL;
     }
     memset(ycounts, 0, nstripes*sizeof(int));
 
@@ -1279,7 +1520,7 @@ static bool process_ystripes(struct tg_ring *ring) {
     struct ystripes *ystripes = tg_malloc(tsize);
     if (!ystripes) {
         tg_free(ycounts);
-        return false;
+        return NULL;
     }
     ystripes->memsz = tsize;
     ystripes->nstripes = nstripes;
@@ -1304,9 +1545,67 @@ static bool process_ystripes(struct tg_ring *ring) {
             stripe->indexes[stripe->count++] = i;
         }
     }
-    ring->ystripes = ystripes;
+    return ystripes;
+}
+
+// Lazy ystripes may be built by any thread that is reading the ring, so the
+// pointer is loaded and published atomically. The first to publish wins.
+#ifdef TG_NOATOMICS
+static struct ystripes *ystripes_load(aptr(struct ystripes) const *ptr) {
+    return *ptr;
+}
+static void ystripes_store(aptr(struct ystripes) *ptr, struct ystripes *val) {
+    *ptr = val;
+}
+static bool ystripes_publish(aptr(struct ystripes) *ptr, struct ystripes *val) {
+    if (*ptr) return false;
+    *ptr = val;
     return true;
 }
+#else
+static struct ystripes *ystripes_load(aptr(struct ystripes) const *ptr) {
+    return atomic_load_explicit((aptr(struct ystripes)*)ptr, __ATOMIC_ACQUIRE);
+}
+static void ystripes_store(aptr(struct ystripes) *ptr, struct ystripes *val) {
+    atomic_store_explicit(ptr, val, __ATOMIC_RELEASE);
+}
+static bool ystripes_publish(aptr(struct ystripes) *ptr, struct ystripes *val) {
+    struct ystripes *expected = NULL;
+    return atomic_compare_exchange_strong_explicit(ptr, &expected, val, 
+        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+#endif
+
+static bool process_ystripes(struct tg_ring *ring) {
+    struct ystripes *ystripes = ystripes_new(ring);
+    ystripes_store(&ring->ystripes, ystripes);
+    return ystripes != NULL;
+}
+
+__attr_noinline
+static struct ystripes *ring_lazy_ystripes(const struct tg_ring *ring) {
+    struct tg_ring *mut = (struct tg_ring*)ring;
+    struct ystripes *ystripes = ystripes_load(&ring->ystripes);
+    if (!ystripes) {
+        ystripes = ystripes_new(ring);
+        if (ystripes && !ystripes_publish(&mut->ystripes, ystripes)) {
+            // another thread beat us to it
+            tg_free(ystripes);
+            ystripes = ystripes_load(&ring->ystripes);
+        }
+    }
+    return ystripes;
+}
+
+// ring_ystripes returns the ystripes of the ring, which are built on first
+// use for rings created with the lazy option. Returns NULL if the ring does
+// not have ystripes, or if the system is out of memory.
+static struct ystripes *ring_ystripes(const struct tg_ring *ring) {
+    if (ring->lazy) {
+        return ring_lazy_ystripes(ring);
+    }
+    return ystripes_load(&ring->ystripes);
+}
 
 static struct tg_segment ring_segment_at(const struct tg_ring *ring, int index);
 
@@ -1715,6 +2014,7 @@ static struct tg_ring *series_new(const struct tg_point *points, int npoints,
     int nsegs = num_segments(points, npoints, closed);    
     size_t size = calc_series_size(npoints);
 
+    bool lazy = (ix & IX_LAZY) == IX_LAZY;
     int ixspread;
     ix = tg_index_extract_spread(ix, &ixspread);
     bool ystripes = false;
@@ -1778,7 +2078,10 @@ static struct tg_ring *series_new(const struct tg_point *points, int npoints,
         ring->head.base = BASE_LINE;
         ring->head.type = TG_LINESTRING;
     }
-    if (ystripes) {
+    if (ystripes && lazy) {
+        // Defer the ystripes until the first point-in-polygon operation.
+        ring->lazy = true;
+    } else if (ystripes) {
         // Process ystripes for closed series only. e.g. rings, not lines.
         if (!process_ystripes(ring)) {
             tg_ring_free(ring);
@@ -1798,7 +2101,9 @@ static struct tg_ring *series_move(const struct tg_ring *ring, bool closed,
         points[i] = tg_point_move(ring->points[i], delta_x, delta_y);
     }
     enum tg_index ix = 0;
-    if (ring->ystripes) {
+    if (ring->lazy) {
+        ix = TG_YSTRIPES | IX_LAZY;
+    } else if (ystripes_load(&ring->ystripes)) {
         ix = TG_YSTRIPES;
     } else if (ring->index) {
         ix = TG_NATURAL;
@@ -1842,12 +2147,27 @@ struct tg_ring *tg_ring_new_ix(const struct tg_point *points, int npoints,
     return series_new(points, npoints, true, ix);
 }
 
+/// Creates a ring from a series of points using the provided options.
+/// @param points Array of points
+/// @param npoints Number of points in array
+/// @param opts Options, or NULL for defaults
+/// @return A newly allocated ring
+/// @return NULL if out of memory
+/// @see tg_ring_new_ix()
+/// @see RingFuncs
+struct tg_ring *tg_ring_new_opts(const struct tg_point *points, int npoints,
+    const struct tg_options *opts)
+{
+    return series_new(points, npoints, true, opts_index(opts));
+}
+
 /// Releases the memory associated with a ring.
 /// @param ring Input ring
 /// @see RingFuncs
 void tg_ring_free(struct tg_ring *ring) {
     if (!ring || ring->head.noheap || !rc_release(&ring->head.rc)) return;
-    if (ring->ystripes) tg_free(ring->ystripes);
+    struct ystripes *ystripes = ystripes_load(&ring->ystripes);
+    if (ystripes) tg_free(ystripes);
     tg_free(ring);
 }
 
@@ -1884,8 +2204,9 @@ struct tg_ring *tg_ring_clone(const struct tg_ring *ring) {
 size_t tg_ring_memsize(const struct tg_ring *ring) {
     if (!ring) return 0;
     size_t size = ring_alloc_size(ring);
-    if (ring->ystripes) {
-        size += ring->ystripes->memsz;
+    struct ystripes *ystripes = ystripes_load(&ring->ystripes);
+    if (ystripes) {
+        size += ystripes->memsz;
     }
     return size;
 }
@@ -1978,6 +2299,7 @@ static bool index_search(const struct tg_ring *ring, struct tg_rect *rect,
         int i = start;
         int e = i+ixspread;
         if (e > nsegs) e = nsegs;
+        stats_add(segments, e-i);
         for (; i < e; i++) {
             int j = i;
             struct tg_segment *seg = (struct tg_segment *)(&ring->points[j]);
@@ -1994,6 +2316,7 @@ static bool index_search(const struct tg_ring *ring, struct tg_rect *rect,
         int i = start;
         int e = i+ixspread;
         if (e > level->nrects) e = level->nrects;
+        stats_add(index_nodes, e-i);
         for (; i < e; i++) {
             if (ixrect_intersects_ixrect(&level->rects[i], &ixrect)) {
                 if (!index_search(ring, rect, lvl+1, i*ixspread, iter, 
@@ -2018,6 +2341,7 @@ void tg_ring_search(const struct tg_ring *ring, struct tg_rect rect,
     if (ring->index) {
         index_search(ring, &rect, 0, 0, iter, udata);
     } else {
+        stats_add(segments, ring->nsegs);
         for (int i = 0; i < ring->nsegs; i++) {
             struct tg_segment *seg = (struct tg_segment *)(&ring->points[i]);
             if (segment_rect_intersects_rect(seg, &rect)) {
@@ -2051,6 +2375,31 @@ static bool ring_ring_iter(struct tg_segment seg, int index, void *udata) {
     return true;
 }
 
+// The number of leaf segments that are compared to a segment rect at once.
+#define SEG_BLOCK 16
+
+// Writes the index of each segment of the ring in the range [start,end) that
+// has a rect intersecting the rect, and returns the count. The range is no
+// larger than SEG_BLOCK. There are no branches in the loop, so the compiler 
+// can compare the whole block together.
+static int segs_block_filter(const struct tg_ring *ring, int start, int end,
+    struct tg_rect rect, int hits[])
+{
+    const struct tg_point *points = ring->points;
+    int nhits = 0;
+    for (int j = start; j < end; j++) {
+        struct tg_point p = points[j];
+        struct tg_point q = points[j+1];
+        int miss = (p.x < rect.min.x) & (q.x < rect.min.x);
+        miss |= (p.x > rect.max.x) & (q.x > rect.max.x);
+        miss |= (p.y < rect.min.y) & (q.y < rect.min.y);
+        miss |= (p.y > rect.max.y) & (q.y > rect.max.y);
+        hits[nhits] = j;
+        nhits += !miss;
+    }
+    return nhits;
+}
+
 static bool ring_ring_ix(const struct tg_ring *a, int alvl, int aidx, 
     int aspread, const struct tg_ring *b, int blvl, int bidx, int bspread,
     bool (*iter)(struct tg_segment aseg, int aidx, struct tg_segment bseg, 
@@ -2067,15 +2416,26 @@ static bool ring_ring_ix(const struct tg_ring *a, int alvl, int aidx,
     int bs = bidx;
     int be = bs + bspread;
     if (be > bnrects) be = bnrects;
+    if (!aleaf || !bleaf) {
+        stats_add(index_nodes, (ae-as)*(be-bs));
+    }
     if (aleaf && bleaf) {
         // both are leaves
         for (int i = as; i < ae; i++) {
             struct tg_segment seg_a = ring_segment_at(a, i);
-            for (int j = bs; j < be; j++) {
-                struct tg_segment seg_b = ring_segment_at(b, j);
-                if (tg_segment_intersects_segment(seg_a, seg_b)) {
-                    if (!iter(seg_a, i, seg_b, j, udata)) {
-                        return false;
+            struct tg_rect arect;
+            segment_fill_rect(&seg_a, &arect);
+            for (int j0 = bs; j0 < be; j0 += SEG_BLOCK) {
+                int j1 = j0+SEG_BLOCK < be ? j0+SEG_BLOCK : be;
+                int hits[SEG_BLOCK];
+                int nhits = segs_block_filter(b, j0, j1, arect, hits);
+                for (int k = 0; k < nhits; k++) {
+                    int j = hits[k];
+                    struct tg_segment seg_b = ring_segment_at(b, j);
+                    if (tg_segment_intersects_segment(seg_a, seg_b)) {
+                        if (!iter(seg_a, i, seg_b, j, udata)) {
+                            return false;
+                        }
                     }
                 }
             }
@@ -2174,11 +2534,19 @@ void tg_ring_ring_search(const struct tg_ring *a, const struct tg_ring *b,
         // no indexes are available
         for (int i = 0; i < a->nsegs; i++) {
             struct tg_segment seg_a = ring_segment_at(a, i);
-            for (int j = 0; j < b->nsegs; j++) {
-                struct tg_segment seg_b = ring_segment_at(b, j);
-                if (tg_segment_intersects_segment(seg_a, seg_b)) {
-                    if (!iter(seg_a, i, seg_b, j, udata)) {
-                        return;
+            struct tg_rect arect;
+            segment_fill_rect(&seg_a, &arect);
+            for (int j0 = 0; j0 < b->nsegs; j0 += SEG_BLOCK) {
+                int j1 = j0+SEG_BLOCK < b->nsegs ? j0+SEG_BLOCK : b->nsegs;
+                int hits[SEG_BLOCK];
+                int nhits = segs_block_filter(b, j0, j1, arect, hits);
+                for (int k = 0; k < nhits; k++) {
+                    int j = hits[k];
+                    struct tg_segment seg_b = ring_segment_at(b, j);
+                    if (tg_segment_intersects_segment(seg_a, seg_b)) {
+                        if (!iter(seg_a, i, seg_b, j, udata)) {
+                            return;
+                        }
                     }
                 }
             }
@@ -2260,15 +2628,17 @@ struct ring_result {
 };
 
 static struct ring_result ystripes_pip(const struct tg_ring *ring, 
-    struct tg_point point, bool allow_on_edge)
+    const struct ystripes *ystripes, struct tg_point point, 
+    bool allow_on_edge)
 {
     bool in = false;
     int idx = -1;
-    struct ystripes *ystripes = ring->ystripes;
     double height = ring->rect.max.y-ring->rect.min.y;
     int y = (point.y - ring->rect.min.y) / height * (double)ystripes->nstripes;
     y = fclamp0(y, 0, ystripes->nstripes-1);
-    struct ystripe *ystripe = &ystripes->stripes[y];
+    const struct ystripe *ystripe = &ystripes->stripes[y];
+    stats_add(index_nodes, 1);
+    stats_add(segments, ystripe->count);
     for (int i = 0; i < ystripe->count; i++) {
         int j = ystripe->indexes[i];
         pip_eval_seg(ring, j, point, allow_on_edge, &in, &idx); 
@@ -2282,6 +2652,7 @@ static struct ring_result standard_pip(const struct tg_ring *ring,
     bool in = false;
     int idx = -1;
     int i = 0;
+    stats_add(segments, ring->nsegs);
     while (i < ring->nsegs) {
         for16(i, ring->nsegs, {
             double ymin = fmin0(ring->points[i].y, ring->points[i+1].y);
@@ -2320,6 +2691,7 @@ static void index_pip_counter(const struct tg_ring *ring, struct tg_point point,
         int i = start;
         int e = i+ixspread;
         if (e > ring->nsegs) e = ring->nsegs;
+        stats_add(segments, e-i);
         for16(i, e, {
             pip_eval_seg(ring, i, point, allow_on_edge, in, idx);
         });
@@ -2331,6 +2703,7 @@ static void index_pip_counter(const struct tg_ring *ring, struct tg_point point,
         int i = start;
         int e = i+ixspread;
         if (e > level->nrects) e = level->nrects;
+        stats_add(index_nodes, e-i);
         for16(i, e, {
             if (branch_maybe_in(ixpoint, level->rects[i])) {
                 index_pip_counter(ring, point, allow_on_edge, lvl+1, 
@@ -2355,8 +2728,9 @@ struct ring_result tg_ring_contains_point(const struct tg_ring *ring,
     if (!tg_rect_covers_point(ring->rect, point)) {
         return (struct ring_result){ .hit = false, .idx = -1 };
     }
-    if (ring->ystripes) {
-        return ystripes_pip(ring, point, allow_on_edge);
+    const struct ystripes *ystripes = ring_ystripes(ring);
+    if (ystripes) {
+        return ystripes_pip(ring, ystripes, point, allow_on_edge);
     }
     if (ring->index) {
         return index_pip(ring, point, allow_on_edge);
@@ -2660,6 +3034,238 @@ bool tg_ring_empty(const struct tg_ring *ring) {
     return (ring->closed && ring->npoints < 3) || ring->npoints < 2;
 }
 
+// How a segment of the inner ring is tested against the crossing segments of
+// the outer ring. These are the same tests that tg_ring_contains_segment()
+// performs after both segment points are known to be inside.
+enum contseg_mode {
+    CONTSEG_SKIP, // fully contained, no need to test crossings
+    CONTSEG_1,    // both points on the ring edge
+    CONTSEG_2,    // only point B on the ring edge
+    CONTSEG_3,    // not allowed on edge
+    CONTSEG_4,    // only point A on the ring edge
+    CONTSEG_5,    // no points on the ring edge
+};
+
+static bool (*const contseg_iters[])(struct tg_segment, int, void*) = {
+    [CONTSEG_1] = contsegiter1,
+    [CONTSEG_2] = contsegiter2,
+    [CONTSEG_3] = contsegiter3,
+    [CONTSEG_4] = contsegiter4,
+    [CONTSEG_5] = contsegiter5,
+};
+
+// Returns the mode for a segment with both points inside of the ring, or -1
+// if the segment passes over the outside of the ring.
+static int contseg_mode(const struct tg_ring *ring, struct tg_segment seg,
+    struct ring_result res_a, struct ring_result res_b, bool allow_on_edge)
+{
+    if (pteq(seg.b, seg.a)) {
+        return CONTSEG_SKIP;
+    }
+    if (!allow_on_edge) {
+        return CONTSEG_3;
+    }
+    if (res_a.idx != -1 && res_b.idx != -1) {
+        if (res_b.idx == res_a.idx) {
+            return CONTSEG_SKIP;
+        }
+        struct tg_segment r_seg_a = ring_segment_at(ring, res_a.idx);
+        struct tg_segment r_seg_b = ring_segment_at(ring, res_b.idx);
+        if (pteq(r_seg_a.a, seg.a) || pteq(r_seg_a.b, seg.a) ||
+            pteq(r_seg_b.a, seg.a) || pteq(r_seg_b.b, seg.a) ||
+            pteq(r_seg_a.a, seg.b) || pteq(r_seg_a.b, seg.b) ||
+            pteq(r_seg_b.a, seg.b) || pteq(r_seg_b.b, seg.b))
+        {
+            return CONTSEG_SKIP;
+        }
+        if (res_b.idx < res_a.idx) {
+            struct tg_segment tmp = r_seg_a;
+            r_seg_a = r_seg_b;
+            r_seg_b = tmp;
+        }
+        struct tg_point pts[] = {
+            r_seg_a.a, r_seg_a.b, r_seg_b.a, r_seg_b.b, r_seg_a.a
+        };
+        double cwc = 0.0;
+        for (int i = 0; i < 4; i++) {
+            cwc += (pts[i+1].x - pts[i].x) * (pts[i+1].y + pts[i].y);
+        }
+        if ((cwc > 0) != ring->clockwise) {
+            return -1;
+        }
+        return CONTSEG_1;
+    }
+    if (res_a.idx != -1) {
+        return CONTSEG_4;
+    }
+    if (res_b.idx != -1) {
+        return CONTSEG_2;
+    }
+    return CONTSEG_5;
+}
+
+// Tests a segment of the inner ring against a crossing segment of the outer
+// ring. Returns true if the inner segment passes over the outside.
+static bool contseg_crosses(const uint8_t *modes, struct tg_segment seg, 
+    int idx, struct tg_segment seg2, int idx2)
+{
+    if (!modes || modes[idx] == CONTSEG_SKIP) {
+        return false;
+    }
+    struct contsegiterctx ctx = { .seg = seg };
+    contseg_iters[modes[idx]](seg2, idx2, &ctx);
+    return ctx.intersects;
+}
+
+struct contring_ctx {
+    const uint8_t *modes;   // segments of the first ring, or NULL
+    const uint8_t *modes2;  // segments of the second ring, or NULL
+    bool intersects;
+};
+
+static bool contring_iter(struct tg_segment seg, int idx, 
+    struct tg_segment seg2, int idx2, void *udata)
+{
+    struct contring_ctx *ctx = udata;
+    if (contseg_crosses(ctx->modes, seg, idx, seg2, idx2) ||
+        contseg_crosses(ctx->modes2, seg2, idx2, seg, idx))
+    {
+        ctx->intersects = true;
+        return false;
+    }
+    return true;
+}
+
+// Classifies each point of ring 'b' against the concave ring 'a' and fills
+// in the mode of each segment of 'b'. Returns false if 'b' is not contained.
+// The 'search' param is set when some segments need to be tested against
+// the crossing segments of 'a'.
+static bool ring_contseg_modes(const struct tg_ring *a, 
+    const struct tg_ring *b, bool allow_on_edge, uint8_t *modes,
+    bool *search)
+{
+    *search = false;
+    struct ring_result res_a = tg_ring_contains_point(a, b->points[0], 
+        allow_on_edge);
+    if (!res_a.hit) {
+        return false;
+    }
+    for (int i = 0; i < b->nsegs; i++) {
+        struct tg_segment seg = ring_segment_at(b, i);
+        struct ring_result res_b = res_a;
+        if (!pteq(seg.b, seg.a)) {
+            res_b = tg_ring_contains_point(a, seg.b, allow_on_edge);
+            if (!res_b.hit) {
+                return false;
+            }
+        }
+        int mode = contseg_mode(a, seg, res_a, res_b, allow_on_edge);
+        if (mode == -1) {
+            return false;
+        }
+        modes[i] = mode;
+        *search = *search || mode != CONTSEG_SKIP;
+        res_a = res_b;
+    }
+    return true;
+}
+
+// Tests that the concave ring 'a' contains ring 'b'. This is the same as 
+// testing each segment with tg_ring_contains_segment(), except that each 
+// point of 'b' is classified once and the crossing segments are found using
+// one search over both rings. Returns -1 if out of memory.
+static int ring_contains_ring_concave(const struct tg_ring *a, 
+    const struct tg_ring *b, bool allow_on_edge)
+{
+    uint8_t modes0[256];
+    uint8_t *modes = modes0;
+    if (b->nsegs > (int)sizeof(modes0)) {
+        modes = tg_malloc(b->nsegs);
+        if (!modes) {
+            return -1;
+        }
+    }
+    bool search;
+    int ok = ring_contseg_modes(a, b, allow_on_edge, modes, &search);
+    if (ok && search) {
+        struct contring_ctx ctx = { .modes = modes };
+        tg_ring_ring_search(b, a, contring_iter, &ctx);
+        ok = !ctx.intersects;
+    }
+    if (modes != modes0) {
+        tg_free(modes);
+    }
+    return ok;
+}
+
+// Tests that rings 'a' and 'b' contain each other. This is the same as 
+// tg_ring_contains_ring() in both directions, except that the crossing 
+// segments of the two rings are only searched once. Returns -1 if out of 
+// memory.
+static int ring_equals_ring_joint(const struct tg_ring *a, 
+    const struct tg_ring *b)
+{
+    if (tg_ring_empty(a) || tg_ring_empty(b)) {
+        return 0;
+    }
+    if (!tg_rect_covers_rect(a->rect, b->rect) || 
+        !tg_rect_covers_rect(b->rect, a->rect))
+    {
+        return 0;
+    }
+    // A convex ring contains the other ring when it contains all of its
+    // points, so those segments never need to be searched.
+    const struct tg_ring *rings[2][2] = { { a, b }, { b, a } };
+    for (int i = 0; i < 2; i++) {
+        if (rings[i][0]->convex) {
+            const struct tg_ring *r = rings[i][1];
+            for (int j = 0; j < r->npoints; j++) {
+                if (!tg_ring_contains_point(rings[i][0], r->points[j], 
+                    true).hit)
+                {
+                    return 0;
+                }
+            }
+        }
+    }
+    if (a->convex && b->convex) {
+        return 1;
+    }
+    uint8_t modes0[256];
+    uint8_t *modes = modes0;
+    int nsegs = (a->convex ? 0 : b->nsegs) + (b->convex ? 0 : a->nsegs);
+    if (nsegs > (int)sizeof(modes0)) {
+        modes = tg_malloc(nsegs);
+        if (!modes) {
+            return -1;
+        }
+    }
+    // modes_b are the segments of 'b' inside of 'a', and modes_a are the 
+    // segments of 'a' inside of 'b'.
+    uint8_t *modes_b = a->convex ? NULL : modes;
+    uint8_t *modes_a = b->convex ? NULL : modes + (a->convex ? 0 : b->nsegs);
+    bool search_b = false, search_a = false;
+    int ok = 1;
+    if (modes_b && !ring_contseg_modes(a, b, true, modes_b, &search_b)) {
+        ok = 0;
+    } else if (modes_a && !ring_contseg_modes(b, a, true, modes_a, 
+        &search_a))
+    {
+        ok = 0;
+    } else if (search_b || search_a) {
+        struct contring_ctx ctx = { 
+            .modes = search_b ? modes_b : NULL,
+            .modes2 = search_a ? modes_a : NULL,
+        };
+        tg_ring_ring_search(b, a, contring_iter, &ctx);
+        ok = !ctx.intersects;
+    }
+    if (modes != modes0) {
+        tg_free(modes);
+    }
+    return ok;
+}
+
 bool tg_ring_contains_ring(const struct tg_ring *a, const struct tg_ring *b,
     bool allow_on_edge)
 {
@@ -2684,6 +3290,11 @@ bool tg_ring_contains_ring(const struct tg_ring *a, const struct tg_ring *b,
     } else {
         // outer ring is concave so let's make sure that all inner segments are
         // fully contained inside of the outer ring.
+        int ok = ring_contains_ring_concave(a, b, allow_on_edge);
+        if (ok != -1) {
+            return ok;
+        }
+        // out of memory, test one segment at a time.
         for (int i = 0; i < b->nsegs; i++) {
             struct tg_segment seg = ring_segment_at(b, i);
             if (!tg_ring_contains_segment(a, seg, allow_on_edge)) {
@@ -2706,6 +3317,29 @@ static double rect_area(struct tg_rect rect) {
     return (rect.max.x - rect.min.x) * (rect.max.y - rect.min.y);
 }
 
+struct ring_ring_ix_ctx {
+    const struct tg_ring *ring;
+    bool allow_on_edge;
+    bool hit;
+    int last;
+};
+
+static bool ring_ring_ix_iter(struct tg_segment aseg, int aidx, 
+    struct tg_segment bseg, int bidx, void *udata)
+{
+    (void)aseg; (void)aidx;
+    struct ring_ring_ix_ctx *ctx = udata;
+    if (bidx == ctx->last) {
+        return true;
+    }
+    ctx->last = bidx;
+    if (tg_ring_intersects_segment(ctx->ring, bseg, ctx->allow_on_edge)) {
+        ctx->hit = true;
+        return false;
+    }
+    return true;
+}
+
 bool tg_ring_intersects_ring(const struct tg_ring *ring,
     const struct tg_ring *other, bool allow_on_edge)
 {
@@ -2724,14 +3358,22 @@ bool tg_ring_intersects_ring(const struct tg_ring *ring,
         ring = other;
         other = tmp;
     }
-    for (int i = 0; i < other->nsegs; i++) {
-        if (tg_ring_intersects_segment(ring, ring_segment_at(other, i), 
-            allow_on_edge)) 
-        {
-            return true;
-        }
+    // Quick check that the first inner point is inside of the outer ring.
+    if (tg_ring_contains_point(ring, other->points[0], allow_on_edge).hit) {
+        return true;
     }
-    return false;
+    // Walk both indexes together and only test the inner segments that touch
+    // a segment of the outer ring. Any inner segment that does not touch is
+    // on the same side as its neighbors, and an inside neighbor that does
+    // touch would have been found by their shared point. When none touch,
+    // then the inner ring is fully outside, like its first point.
+    struct ring_ring_ix_ctx ctx = { 
+        .ring = ring, 
+        .allow_on_edge = allow_on_edge,
+        .last = -1,
+    };
+    tg_ring_ring_search(ring, other, ring_ring_ix_iter, &ctx);
+    return ctx.hit;
 }
 
 bool tg_ring_contains_line(const struct tg_ring *a, const struct tg_line *b, 
@@ -2749,19 +3391,6 @@ bool tg_ring_contains_line(const struct tg_ring *a, const struct tg_line *b,
         return false;
     }
 
-    // if (a->convex && !respect_boundaries) {
-    //     // outer ring is convex so test that all inner points are inside of
-    //     // the outer ring
-    //     int npoints = tg_line_num_points(b);
-    //     const struct tg_point *points = tg_line_points(b);
-    //     for (int i = 0; i < npoints; i++) {
-    //         if (!tg_ring_contains_point(a, points[i], allow_on_edge).hit) {
-    //             // point is on the outside the outer ring
-    //             return false;
-    //         }
-    //     }
-    // } else 
-    
     if (!allow_on_edge && respect_boundaries) {
         // outer ring is concave so let's make sure that all inner segments are
         // fully contained inside of the outer ring.
@@ -2775,9 +3404,26 @@ bool tg_ring_contains_line(const struct tg_ring *a, const struct tg_line *b,
                 return false;
             }
         }
+    } else if (a->convex) {
+        // outer ring is convex so test that all line points are inside of
+        // the outer ring
+        int npoints = tg_line_num_points(b);
+        const struct tg_point *points = tg_line_points(b);
+        for (int i = 0; i < npoints; i++) {
+            if (!tg_ring_contains_point(a, points[i], allow_on_edge).hit) {
+                return false;
+            }
+        }
     } else {
         // outer ring is concave so let's make sure that all inner segments are
-        // fully contained inside of the outer ring.
+        // fully contained inside of the outer ring, using one search over 
+        // the ring and line.
+        int ok = ring_contains_ring_concave(a, (struct tg_ring*)b, 
+            allow_on_edge);
+        if (ok != -1) {
+            return ok;
+        }
+        // out of memory, test one segment at a time.
         int nsegs = tg_line_num_segments(b);
         for (int i = 0; i < nsegs; i++) {
             struct tg_segment seg = line_segment_at(b, i);
@@ -2802,17 +3448,23 @@ bool tg_ring_intersects_line(const struct tg_ring *ring,
     if (!tg_rect_intersects_rect(tg_ring_rect(ring), tg_line_rect(line))) {
         return false;
     }
-    // check if any points are inside ring
-    // TODO: use line index if available.
-    int nsegs = tg_line_num_segments(line);
-    for (int i = 0; i < nsegs; i++) {
-        if (tg_ring_intersects_segment(ring, tg_line_segment_at(line, i), 
-            allow_on_edge))
-        {
-            return true;
-        }
+    // Quick check that the first line point is inside of the ring.
+    if (tg_ring_contains_point(ring, tg_line_points(line)[0], 
+        allow_on_edge).hit)
+    {
+        return true;
     }
-    return false;
+    // Walk the ring and line indexes together and only test the line
+    // segments that touch a segment of the ring, like 
+    // tg_ring_intersects_ring(). The first line segment that enters the ring
+    // must start on or cross over the ring boundary.
+    struct ring_ring_ix_ctx ctx = { 
+        .ring = ring, 
+        .allow_on_edge = allow_on_edge,
+        .last = -1,
+    };
+    tg_ring_ring_search(ring, (struct tg_ring*)line, ring_ring_ix_iter, &ctx);
+    return ctx.hit;
 }
 
 /// Tests whether a rectangle intersects a line.
@@ -2883,10 +3535,25 @@ struct tg_line *tg_line_new_ix(const struct tg_point *points, int npoints,
     return (struct tg_line*)series_new(points, npoints, false, ix);
 }
 
-/// Releases the memory associated with a line.
-/// @param line Input line
+/// Creates a line from a series of points using the provided options.
+/// @param points Array of points
+/// @param npoints Number of points in array
+/// @param opts Options, or NULL for defaults
+/// @return A newly allocated line
+/// @return NULL if out of memory
+/// @see tg_ring_new_opts()
 /// @see LineFuncs
-void tg_line_free(struct tg_line *line) {
+struct tg_line *tg_line_new_opts(const struct tg_point *points, int npoints,
+    const struct tg_options *opts)
+{
+    return (struct tg_line*)series_new(points, npoints, false, 
+        opts_index(opts));
+}
+
+/// Releases the memory associated with a line.
+/// @param line Input line
+/// @see LineFuncs
+void tg_line_free(struct tg_line *line) {
     struct tg_ring *ring = (struct tg_ring *)line;
     tg_ring_free(ring);
 }
@@ -3026,6 +3693,81 @@ bool tg_line_intersects_rect(const struct tg_line *line, struct tg_rect rect) {
     return tg_rect_intersects_line(rect, line);
 }
 
+struct line_covers_segment_iter_ctx {
+    struct tg_segment seg;  // segment that is being covered
+    struct tg_point start;  // seg is covered from seg.a up to here
+    struct tg_point next;   // furthest point reached from start
+    double reach;           // position of next along seg
+    int last;               // index of the line segment that covered seg.b
+    bool covered;
+};
+
+// Returns the position of a point that is on the segment, increasing from
+// seg.a to seg.b.
+static double segment_position(struct tg_segment seg, struct tg_point point) {
+    double dx = seg.b.x-seg.a.x;
+    double dy = seg.b.y-seg.a.y;
+    return fabs(dx) >= fabs(dy) ? (point.x-seg.a.x)*dx : (point.y-seg.a.y)*dy;
+}
+
+static bool line_covers_segment_iter(struct tg_segment seg, int index, 
+    void *udata)
+{
+    struct line_covers_segment_iter_ctx *ctx = udata;
+    if (pteq(seg.a, seg.b) || !tg_segment_covers_point(seg, ctx->start) ||
+        !collinear(seg.a.x, seg.a.y, seg.b.x, seg.b.y, 
+            ctx->seg.a.x, ctx->seg.a.y) ||
+        !collinear(seg.a.x, seg.a.y, seg.b.x, seg.b.y, 
+            ctx->seg.b.x, ctx->seg.b.y))
+    {
+        return true;
+    }
+    if (tg_segment_covers_point(seg, ctx->seg.b)) {
+        ctx->last = index;
+        ctx->covered = true;
+        return false;
+    }
+    double pos = segment_position(ctx->seg, seg.a);
+    if (pos > ctx->reach) {
+        ctx->reach = pos;
+        ctx->next = seg.a;
+    }
+    pos = segment_position(ctx->seg, seg.b);
+    if (pos > ctx->reach) {
+        ctx->reach = pos;
+        ctx->next = seg.b;
+    }
+    return true;
+}
+
+// Tests whether the segments of a line cover a segment. The segment may
+// span multiple collinear segments of the line, which are followed from 
+// seg.a to seg.b.
+static bool line_covers_segment(const struct tg_line *line, 
+    struct line_covers_segment_iter_ctx *ctx)
+{
+    struct tg_segment seg = ctx->seg;
+    if (pteq(seg.a, seg.b)) {
+        // repeated point
+        return tg_line_covers_point(line, seg.a);
+    }
+    struct tg_rect rect = tg_segment_rect(seg);
+    ctx->start = seg.a;
+    while (1) {
+        double pos = segment_position(seg, ctx->start);
+        ctx->reach = pos;
+        ctx->covered = false;
+        tg_line_search(line, rect, line_covers_segment_iter, ctx);
+        if (ctx->covered) {
+            return true;
+        }
+        if (ctx->reach <= pos) {
+            return false;
+        }
+        ctx->start = ctx->next;
+    }
+}
+
 /// Tests whether a line contains another line
 /// @see LineFuncs
 bool tg_line_covers_line(const struct tg_line *a, const struct tg_line *b) {
@@ -3034,38 +3776,35 @@ bool tg_line_covers_line(const struct tg_line *a, const struct tg_line *b) {
     if (!tg_rect_covers_rect(tg_line_rect(a), tg_line_rect(b))) {
         return false;
     }
-    // locate the first "other" segment that contains the first "line" segment.
+    // Each segment of 'b' must be covered by the segments of 'a'. This does
+    // not depend on the order or direction of the segments, or on repeated
+    // points in either line.
+    struct line_covers_segment_iter_ctx ctx = { 0 };
     int ansegs = tg_line_num_segments(a);
-    int j = -1;
-    for (int k = 0; k < ansegs; k++) {
-        if (tg_segment_covers_segment(tg_line_segment_at(a, k),
-            tg_line_segment_at(b, 0)))
+    int bnsegs = tg_line_num_segments(b);
+    for (int i = 0; i < bnsegs; i++) {
+        struct tg_segment seg = tg_line_segment_at(b, i);
+        // Lines usually follow each other, so first try the segment that
+        // covered the previous one and its neighbors.
+        int j = ctx.last;
+        if (tg_segment_covers_segment(tg_line_segment_at(a, j), seg)) {
+            continue;
+        }
+        if (j+1 < ansegs && 
+            tg_segment_covers_segment(tg_line_segment_at(a, j+1), seg))
         {
-            j = k;
-            break;
+            ctx.last = j+1;
+            continue;
         }
-    }
-    if (j == -1) {
-        return false;
-    }
-    int bnsegs = tg_line_num_segments(b);
-    for (int i = 1; i < bnsegs && j < ansegs; i++) {
-        struct tg_segment aseg = tg_line_segment_at(a, j);
-        struct tg_segment bseg = tg_line_segment_at(b, i);
-        if (tg_segment_covers_segment(aseg, bseg)) {
+        if (j > 0 && 
+            tg_segment_covers_segment(tg_line_segment_at(a, j-1), seg))
+        {
+            ctx.last = j-1;
             continue;
         }
-        if (pteq(bseg.a, aseg.a)) {
-            // reverse it
-            if (j == 0) {
-                return false;
-            }
-            j--;
-            i--;
-        } else if (pteq(bseg.a, aseg.b)) {
-            // forward it
-            j++;
-            i--;
+        ctx.seg = seg;
+        if (!line_covers_segment(a, &ctx)) {
+            return false;
         }
     }
     return true;
@@ -3578,22 +4317,11 @@ bool tg_poly_intersects_line(const struct tg_poly *poly,
     return true;
 }
 
-/// Tests whether a polygon fully contains another polygon.
-/// @see PolyFuncs
-bool tg_poly_covers_poly(const struct tg_poly *a, const struct tg_poly *b) {
-    if (a && a->head.base == BASE_RING && 
-        b && b->head.base == BASE_RING)
-    {
-        // downcast fast path
-        return tg_ring_contains_ring((struct tg_ring*)a, (struct tg_ring*)b,
-            true);
-    }
-    // standard path
-    if (tg_poly_empty(a) || tg_poly_empty(b)) {
-        return false;
-    }
-
-    const struct tg_ring *a_exterior = tg_poly_exterior(a);
+// Tests that the holes of poly 'a' do not take away from poly 'b', where
+// the exterior of 'a' is already known to contain the exterior of 'b'.
+static bool poly_holes_cover_poly(const struct tg_poly *a, 
+    const struct tg_poly *b)
+{
     const struct tg_ring *b_exterior = tg_poly_exterior(b);
     int a_nholes = tg_poly_num_holes(a);
     int b_nholes = tg_poly_num_holes(b);
@@ -3605,11 +4333,6 @@ bool tg_poly_covers_poly(const struct tg_poly *a, const struct tg_poly *b) {
     if (b->head.base == BASE_POLY) {
         b_holes = b->holes;
     }
-    
-    // 1) other exterior must be fully contained inside of the poly exterior.
-    if (!tg_ring_contains_ring(a_exterior, b_exterior, true)) {
-        return false;
-    }
     // 2) ring cannot intersect poly holes
     bool covers = true;
     for (int i = 0; i < a_nholes; i++) {
@@ -3632,6 +4355,50 @@ bool tg_poly_covers_poly(const struct tg_poly *a, const struct tg_poly *b) {
     return covers;
 }
 
+/// Tests whether a polygon fully contains another polygon.
+/// @see PolyFuncs
+bool tg_poly_covers_poly(const struct tg_poly *a, const struct tg_poly *b) {
+    if (a && a->head.base == BASE_RING && 
+        b && b->head.base == BASE_RING)
+    {
+        // downcast fast path
+        return tg_ring_contains_ring((struct tg_ring*)a, (struct tg_ring*)b,
+            true);
+    }
+    // standard path
+    if (tg_poly_empty(a) || tg_poly_empty(b)) {
+        return false;
+    }
+    // 1) other exterior must be fully contained inside of the poly exterior.
+    if (!tg_ring_contains_ring(tg_poly_exterior(a), tg_poly_exterior(b), 
+        true))
+    {
+        return false;
+    }
+    return poly_holes_cover_poly(a, b);
+}
+
+static bool ring_equals_ring(const struct tg_ring *a, const struct tg_ring *b) {
+    int eq = ring_equals_ring_joint(a, b);
+    if (eq == -1) {
+        // out of memory, test each direction.
+        return tg_ring_contains_ring(a, b, true) && 
+            tg_ring_contains_ring(b, a, true);
+    }
+    return eq;
+}
+
+// Tests whether two polygons cover each other. This is the same as 
+// tg_poly_covers_poly() in both directions, except that the exteriors are
+// compared in one pass.
+static bool poly_equals_poly(const struct tg_poly *a, const struct tg_poly *b) {
+    if (tg_poly_empty(a) || tg_poly_empty(b)) {
+        return false;
+    }
+    return ring_equals_ring(tg_poly_exterior(a), tg_poly_exterior(b)) &&
+        poly_holes_cover_poly(a, b) && poly_holes_cover_poly(b, a);
+}
+
 bool tg_poly_contains_poly(const struct tg_poly *a, const struct tg_poly *b) {
     return tg_poly_covers_poly(a, b);
 }
@@ -4867,6 +5634,42 @@ size_t tg_geom_memsize(const struct tg_geom *geom) {
     return 0;
 }
 
+static uint64_t hash_double(uint64_t h, double x) {
+    x += 0.0; // -0.0 and 0.0 are the same
+    uint64_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    h ^= bits;
+    h ^= h >> 33;
+    h *= UINT64_C(0xff51afd7ed558ccd);
+    h ^= h >> 33;
+    h *= UINT64_C(0xc4ceb9fe1a85ec53);
+    h ^= h >> 33;
+    return h;
+}
+
+/// Returns a hash of the geometry.
+///
+/// Geometries that are equal, according to tg_geom_equals(), always have
+/// the same hash, no matter their type, the order of their points, or the 
+/// starting point and winding order of their rings. Different geometries
+/// may also share a hash, so this is only useful for grouping possible 
+/// duplicates before comparing them with tg_geom_equals().
+/// @param geom Input geometry
+/// @return The hash, which is computed from the bounding rectangle.
+/// @see tg_geom_equals()
+/// @see GeometryAccessors
+uint64_t tg_geom_hash(const struct tg_geom *geom) {
+    uint64_t h = 0;
+    if (!tg_geom_is_empty(geom)) {
+        struct tg_rect rect = tg_geom_rect(geom);
+        h = hash_double(h, rect.min.x);
+        h = hash_double(h, rect.min.y);
+        h = hash_double(h, rect.max.x);
+        h = hash_double(h, rect.max.y);
+    }
+    return h;
+}
+
 /// Returns the underlying line for the provided geometry.
 /// @param geom Input geometry
 /// @return For a TG_LINESTRING geometry, returns the line.
@@ -5186,6 +5989,165 @@ static bool line_intersects_geom(struct tg_line *line,
     return false;
 }
 
+// MultiPoints with fewer points than this are tested one point at a time.
+#define POLY_POINTS_MIN 16
+
+// Cells with this many points or fewer are tested one point at a time.
+#define POLY_POINTS_CELL 8
+
+// Cells are not split any deeper than this, which stops on duplicate points.
+#define POLY_POINTS_DEPTH 40
+
+struct poly_points_ctx {
+    const struct tg_poly *poly;
+    struct tg_rect rect; // polygon rect
+    bool all;            // every point must hit, otherwise any
+};
+
+static bool boundary_found_iter(struct tg_segment seg, int index, 
+    void *udata)
+{
+    (void)seg; (void)index;
+    *(bool*)udata = true;
+    return false;
+}
+
+// poly_boundary_in_rect returns true when the boundary of the polygon may
+// pass through the rect.
+static bool poly_boundary_in_rect(const struct tg_poly *poly, 
+    struct tg_rect rect)
+{
+    bool found = false;
+    tg_ring_search(tg_poly_exterior(poly), rect, boundary_found_iter, &found);
+    int nholes = tg_poly_num_holes(poly);
+    for (int i = 0; i < nholes && !found; i++) {
+        tg_ring_search(tg_poly_hole_at(poly, i), rect, boundary_found_iter, 
+            &found);
+    }
+    return found;
+}
+
+// poly_points_each tests the points one at a time. Returns true when the
+// answer for the whole MultiPoint is known, which is a point that is not 
+// covered when 'all' is set and a covered point otherwise.
+static bool poly_points_each(struct poly_points_ctx *ctx, 
+    const struct tg_point *points, int npoints)
+{
+    for (int i = 0; i < npoints; i++) {
+        if (tg_poly_covers_point(ctx->poly, points[i]) != ctx->all) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// poly_points_cell tests the points that are in the cell. A cell that is not
+// crossed by the polygon boundary is decided by a single point-in-polygon
+// test, otherwise it's split in half along its longest side and the points 
+// are partitioned in place. Returns the same as poly_points_each.
+static bool poly_points_cell(struct poly_points_ctx *ctx, 
+    struct tg_point *points, int npoints, struct tg_rect cell, int depth)
+{
+    if (npoints == 0) {
+        return false;
+    }
+    if (!tg_rect_intersects_rect(cell, ctx->rect)) {
+        // all points are outside of the polygon
+        return ctx->all;
+    }
+    if (npoints <= POLY_POINTS_CELL || depth == POLY_POINTS_DEPTH) {
+        return poly_points_each(ctx, points, npoints);
+    }
+    if (!poly_boundary_in_rect(ctx->poly, cell)) {
+        // every point is on the same side of the boundary as the first
+        return tg_poly_covers_point(ctx->poly, points[0]) != ctx->all;
+    }
+    struct tg_rect cell2 = cell;
+    int i = 0, j = npoints;
+    if (cell.max.x-cell.min.x >= cell.max.y-cell.min.y) {
+        double mid = (cell.min.x+cell.max.x)/2;
+        cell.max.x = mid;
+        cell2.min.x = mid;
+        while (i < j) {
+            if (points[i].x <= mid) {
+                i++;
+            } else {
+                struct tg_point swap = points[i];
+                points[i] = points[--j];
+                points[j] = swap;
+            }
+        }
+    } else {
+        double mid = (cell.min.y+cell.max.y)/2;
+        cell.max.y = mid;
+        cell2.min.y = mid;
+        while (i < j) {
+            if (points[i].y <= mid) {
+                i++;
+            } else {
+                struct tg_point swap = points[i];
+                points[i] = points[--j];
+                points[j] = swap;
+            }
+        }
+    }
+    return poly_points_cell(ctx, points, i, cell, depth+1) ||
+        poly_points_cell(ctx, points+i, npoints-i, cell2, depth+1);
+}
+
+// poly_covers_multipoint tests a polygon against the points of a MultiPoint 
+// as one batch. With 'all' every point must be covered by the polygon,
+// otherwise at least one point. The points are split into cells over the
+// MultiPoint rect, so that points that are far from the polygon boundary 
+// share a single point-in-polygon test. Returns -1 when the MultiPoint is 
+// small, has empty children, or the system is out of memory, and the caller
+// tests the points one at a time instead.
+static int poly_covers_multipoint(const struct tg_poly *poly, 
+    const struct tg_geom *geom, bool all)
+{
+    int npoints = geom->multi->ngeoms;
+    if (npoints < POLY_POINTS_MIN) {
+        return -1;
+    }
+    struct tg_point *points = tg_malloc(npoints*sizeof(struct tg_point));
+    if (!points) {
+        return -1;
+    }
+    for (int i = 0; i < npoints; i++) {
+        const struct tg_geom *child = geom->multi->geoms[i];
+        if (child->head.base == BASE_POINT) {
+            points[i] = ((struct boxed_point*)child)->point;
+        } else if (child->head.base == BASE_GEOM && 
+            child->head.type == TG_POINT && 
+            (child->head.flags&IS_EMPTY) != IS_EMPTY)
+        {
+            points[i] = child->point;
+        } else {
+            tg_free(points);
+            return -1;
+        }
+    }
+    struct poly_points_ctx ctx = {
+        .poly = poly,
+        .rect = tg_poly_rect(poly),
+        .all = all,
+    };
+    struct tg_rect mrect = geom->multi->rect;
+    int hit;
+    if (all ? !tg_rect_covers_rect(ctx.rect, mrect) : 
+        !tg_rect_intersects_rect(ctx.rect, mrect))
+    {
+        hit = 0;
+    } else if (poly_points_each(&ctx, points, POLY_POINTS_CELL)) {
+        // answered by the first few points
+        hit = !all;
+    } else {
+        hit = poly_points_cell(&ctx, points, npoints, mrect, 0) != all;
+    }
+    tg_free(points);
+    return hit;
+}
+
 static bool poly_intersects_geom(struct tg_poly *poly, 
     const struct tg_geom *geom);
 
@@ -5193,6 +6155,12 @@ static bool poly_intersects_base_geom(struct tg_poly *poly,
     const struct tg_geom *geom)
 {
     if ((geom->head.flags&IS_EMPTY) != IS_EMPTY) {
+        if (geom->head.type == TG_MULTIPOINT && geom->multi) {
+            int hit = poly_covers_multipoint(poly, geom, false);
+            if (hit != -1) {
+                return hit;
+            }
+        }
         switch (geom->head.type) {
         case TG_POINT: 
             return tg_poly_intersects_point(poly, geom->point); 
@@ -5257,6 +6225,17 @@ static bool base_geom_intersects_geom(const struct tg_geom *geom,
     const struct tg_geom *other)
 {
     if ((geom->head.flags&IS_EMPTY) != IS_EMPTY) {
+        if (geom->head.type == TG_MULTIPOINT && geom->multi && other &&
+            (other->head.flags&IS_EMPTY) != IS_EMPTY)
+        {
+            const struct tg_poly *poly = tg_geom_poly(other);
+            if (poly) {
+                int hit = poly_covers_multipoint(poly, geom, false);
+                if (hit != -1) {
+                    return hit;
+                }
+            }
+        }
         switch (geom->head.type) {
         case TG_POINT: 
             return point_intersects_geom(geom->point, other);
@@ -5276,9 +6255,8 @@ static bool base_geom_intersects_geom(const struct tg_geom *geom,
     return false;
 }
 
-/// Tests whether two geometries intersect.
-/// @see GeometryPredicates
-bool tg_geom_intersects(const struct tg_geom *geom, 
+__attr_noinline
+static bool geom_intersects(const struct tg_geom *geom, 
     const struct tg_geom *other)
 {
     if (geom) {
@@ -5299,6 +6277,17 @@ bool tg_geom_intersects(const struct tg_geom *geom,
     return false;
 }
 
+/// Tests whether two geometries intersect.
+/// @see GeometryPredicates
+bool tg_geom_intersects(const struct tg_geom *geom, 
+    const struct tg_geom *other)
+{
+    uint64_t start = slow_op_begin();
+    bool hit = geom_intersects(geom, other);
+    slow_op_end(start, TG_OP_INTERSECTS, geom, other, 0);
+    return hit;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 /////  Covers
@@ -5414,6 +6403,12 @@ static bool poly_covers_base_geom(struct tg_poly *poly,
     const struct tg_geom *geom)
 {
     if ((geom->head.flags&IS_EMPTY) != IS_EMPTY) {
+        if (geom->head.type == TG_MULTIPOINT && geom->multi) {
+            int hit = poly_covers_multipoint(poly, geom, true);
+            if (hit != -1) {
+                return hit;
+            }
+        }
         switch (geom->head.type) {
         case TG_POINT: 
             return tg_poly_covers_point(poly, geom->point); 
@@ -5564,9 +6559,10 @@ static bool base_geom_covers_geom(const struct tg_geom *geom,
     return false;
 }
 
-/// Tests whether a geometry 'a' fully contains geometry 'b'.
-/// @see GeometryPredicates
-bool tg_geom_covers(const struct tg_geom *geom, const struct tg_geom *other) {
+__attr_noinline
+static bool geom_covers(const struct tg_geom *geom, 
+    const struct tg_geom *other)
+{
     if (geom) {
         switch (geom->head.base) {
         case BASE_GEOM:
@@ -5585,6 +6581,15 @@ bool tg_geom_covers(const struct tg_geom *geom, const struct tg_geom *other) {
     return false;
 }
 
+/// Tests whether a geometry 'a' fully contains geometry 'b'.
+/// @see GeometryPredicates
+bool tg_geom_covers(const struct tg_geom *geom, const struct tg_geom *other) {
+    uint64_t start = slow_op_begin();
+    bool hit = geom_covers(geom, other);
+    slow_op_end(start, TG_OP_COVERS, geom, other, 0);
+    return hit;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////
 /////  Contains
@@ -5815,14 +6820,10 @@ static bool point_contains_geom(struct tg_point point,
     return false;
 }
 
-/// Tests whether 'a' contains 'b', and 'b' is not touching the boundary of 'a'.
-/// @note Works the same as `tg_geom_within(b, a)`
-/// @warning This predicate returns **false** when geometry 'b' is *on* or
-/// *touching* the boundary of geometry 'a'. Such as when a point is on the
-/// edge of a polygon.  
-/// For full coverage, consider using @ref tg_geom_covers.
-/// @see GeometryPredicates
-bool tg_geom_contains(const struct tg_geom *geom, const struct tg_geom *other) {
+__attr_noinline
+static bool geom_contains(const struct tg_geom *geom, 
+    const struct tg_geom *other)
+{
     if (geom) {
         switch (geom->head.base) {
         case BASE_GEOM:
@@ -5841,6 +6842,20 @@ bool tg_geom_contains(const struct tg_geom *geom, const struct tg_geom *other) {
     return false;
 }
 
+/// Tests whether 'a' contains 'b', and 'b' is not touching the boundary of 'a'.
+/// @note Works the same as `tg_geom_within(b, a)`
+/// @warning This predicate returns **false** when geometry 'b' is *on* or
+/// *touching* the boundary of geometry 'a'. Such as when a point is on the
+/// edge of a polygon.  
+/// For full coverage, consider using @ref tg_geom_covers.
+/// @see GeometryPredicates
+bool tg_geom_contains(const struct tg_geom *geom, const struct tg_geom *other) {
+    uint64_t start = slow_op_begin();
+    bool hit = geom_contains(geom, other);
+    slow_op_end(start, TG_OP_CONTAINS, geom, other, 0);
+    return hit;
+}
+
 bool tg_poly_contains_geom(struct tg_poly *a, const struct tg_geom *b) {
     return poly_contains_geom(a, b);
 }
@@ -6051,11 +7066,10 @@ static bool base_geom_touches_geom(const struct tg_geom *geom,
     return false;
 }
 
-/// Tests whether a geometry 'a' touches 'b'. 
-/// They have at least one point in common, but their interiors do not
-/// intersect.
-/// @see GeometryPredicates
-bool tg_geom_touches(const struct tg_geom *geom, const struct tg_geom *other) {
+__attr_noinline
+static bool geom_touches(const struct tg_geom *geom, 
+    const struct tg_geom *other)
+{
     if (geom) {
         switch (geom->head.base) {
         case BASE_GEOM:
@@ -6074,6 +7088,17 @@ bool tg_geom_touches(const struct tg_geom *geom, const struct tg_geom *other) {
     return false;
 }
 
+/// Tests whether a geometry 'a' touches 'b'. 
+/// They have at least one point in common, but their interiors do not
+/// intersect.
+/// @see GeometryPredicates
+bool tg_geom_touches(const struct tg_geom *geom, const struct tg_geom *other) {
+    uint64_t start = slow_op_begin();
+    bool hit = geom_touches(geom, other);
+    slow_op_end(start, TG_OP_TOUCHES, geom, other, 0);
+    return hit;
+}
+
 bool tg_poly_touches_geom(struct tg_poly *a, const struct tg_geom *b) {
     return poly_touches_geom(a, b);
 }
@@ -6096,7 +7121,10 @@ bool tg_geom_covers_point(const struct tg_geom *a, struct tg_point b) {
     return tg_geom_covers(a, (struct tg_geom*)&bpoint);
 }
 
-/// Tests whether a geometry fully contains a point using xy coordinates.
+/// Tests whether a geometry covers a point using xy coordinates.
+///
+/// Points on the boundary of the geometry, such as on the exterior ring or
+/// the holes of a polygon, are covered.
 /// @see GeometryPredicates
 bool tg_geom_covers_xy(const struct tg_geom *a, double x, double y) {
     return tg_geom_covers_point(a, (struct tg_point){ .x = x, .y = y });
@@ -6115,7 +7143,10 @@ bool tg_geom_intersects_point(const struct tg_geom *a, struct tg_point b) {
 /// Tests whether a geometry intersects a point using xy coordinates.
 /// @see GeometryPredicates
 bool tg_geom_intersects_xy(const struct tg_geom *a, double x, double y) {
-    return tg_geom_intersects_point(a, (struct tg_point){ .x = x, .y = y });
+    uint64_t start = slow_op_begin();
+    bool hit = tg_geom_intersects_point(a, (struct tg_point){ .x = x, .y = y });
+    slow_op_end(start, TG_OP_INTERSECTS_XY, a, NULL, 0);
+    return hit;
 }
 
 /// Get the extra coordinates for a geometry.
@@ -6257,31 +7288,189 @@ struct tg_rect tg_ring_index_level_rect(const struct tg_ring *ring,
     return index_level_rect(index, levelidx, rectidx);
 }
 
-/// Get the string representation of a geometry type. 
-/// e.g. "Point", "Polygon", "LineString".
-/// @param type Input geometry type
-/// @return A string representing the type
-/// @note The returned string does not need to be freed.
-/// @see tg_geom_typeof()
-/// @see GeometryAccessors
-const char *tg_geom_type_string(enum tg_geom_type type) {
-    switch (type) {
-    case TG_POINT: return "Point";
-    case TG_LINESTRING: return "LineString";
-    case TG_POLYGON: return "Polygon";
-    case TG_MULTIPOINT: return "MultiPoint";
-    case TG_MULTILINESTRING: return "MultiLineString";
-    case TG_MULTIPOLYGON: return "MultiPolygon";
-    case TG_GEOMETRYCOLLECTION: return "GeometryCollection";
-    default: return "Unknown";
+static double rect_overlap_area(struct tg_rect a, struct tg_rect b) {
+    double w = fmin0(a.max.x, b.max.x)-fmax0(a.min.x, b.min.x);
+    double h = fmin0(a.max.y, b.max.y)-fmax0(a.min.y, b.min.y);
+    return w > 0 && h > 0 ? w*h : 0;
+}
+
+// Returns the rect of a child of an index rectangle at level, which is 
+// either a rectangle in the next level or a leaf segment.
+static struct tg_rect index_child_rect(const struct tg_ring *ring, 
+    int levelidx, int childidx)
+{
+    if (levelidx == ring->index->nlevels-1) {
+        return tg_segment_rect(ring_segment_at(ring, childidx));
     }
+    struct tg_rect rect;
+    ixrect_to_tg_rect(&ring->index->levels[levelidx+1].rects[childidx], &rect);
+    return rect;
 }
 
-/////////////////////////////////////////////
-// Formats -- GeoJSON, WKT, WKB, HEX
-/////////////////////////////////////////////
+// Returns the probability that a random point in the ring's rect needs the
+// children of rect to be tested during point-in-polygon. These are points
+// that are vertically within rect and not to its right.
+static double pip_descend_prob(struct tg_rect ringrect, struct tg_rect rect) {
+    double w = ringrect.max.x-ringrect.min.x;
+    double h = ringrect.max.y-ringrect.min.y;
+    double px = w > 0 ? (rect.max.x-ringrect.min.x)/w : 1;
+    double py = h > 0 ? (rect.max.y-rect.min.y)/h : 1;
+    return fclamp0(px, 0, 1)*fclamp0(py, 0, 1);
+}
 
-// maximum depth for all recursive input formats such as wkt, wkb, and json.
+/// Returns index quality diagnostics for a ring.
+///
+/// The pip_cost is the estimated number of rectangle and segment tests for
+/// a point-in-polygon operation of a random point within the ring's 
+/// rectangle. It's useful for comparing the index kinds and spreads of the
+/// same ring, or for finding rings that deserve a different index.
+/// @param ring Input ring
+/// @param stats Output diagnostics
+/// @return False if ring or stats is NULL
+/// @note Lazy TG_YSTRIPES that have not been built yet are reported as 
+/// absent.
+/// @see tg_ring_index_level_stats()
+/// @see RingFuncs
+bool tg_ring_index_stats(const struct tg_ring *ring, 
+    struct tg_index_stats *stats)
+{
+    if (!ring || !stats) return false;
+    memset(stats, 0, sizeof(struct tg_index_stats));
+    struct index *ix = ring->index;
+    if (ix) {
+        stats->nlevels = ix->nlevels;
+        stats->spread = ix->spread;
+        stats->nleaves = ix->levels[ix->nlevels-1].nrects;
+        stats->leaf_segments = stats->nleaves > 0 ? 
+            (double)ring->nsegs/stats->nleaves : 0;
+    }
+    const struct ystripes *ystripes = ystripes_load(&ring->ystripes);
+    if (ystripes) {
+        int64_t total = 0;
+        stats->nstripes = ystripes->nstripes;
+        for (int i = 0; i < ystripes->nstripes; i++) {
+            int count = ystripes->stripes[i].count;
+            total += count;
+            if (count > stats->stripe_max) {
+                stats->stripe_max = count;
+            }
+            if (count == 0) {
+                stats->stripe_empty++;
+            }
+        }
+        stats->stripe_avg = ystripes->nstripes > 0 ? 
+            (double)total/ystripes->nstripes : 0;
+        // one stripe lookup and its segments
+        stats->pip_cost = 1+stats->stripe_avg;
+    } else if (ix) {
+        // the root rectangles plus the children of each rectangle weighted
+        // by the chance that they are tested
+        double cost = ix->levels[0].nrects;
+        for (int i = 0; i < ix->nlevels; i++) {
+            const struct level *level = &ix->levels[i];
+            int nchildren = i == ix->nlevels-1 ? ring->nsegs : 
+                ix->levels[i+1].nrects;
+            for (int j = 0; j < level->nrects; j++) {
+                struct tg_rect rect;
+                ixrect_to_tg_rect(&level->rects[j], &rect);
+                int s = j*ix->spread;
+                int e = s+ix->spread;
+                if (e > nchildren) e = nchildren;
+                cost += pip_descend_prob(ring->rect, rect)*(e-s);
+            }
+        }
+        stats->pip_cost = cost;
+    } else {
+        stats->pip_cost = ring->nsegs;
+    }
+    return true;
+}
+
+/// Returns index quality diagnostics for one level of a ring index.
+///
+/// The overlap is the total area shared by pairs of rectangles with the 
+/// same parent, divided by the level area. The dead space is the level area
+/// that is not covered by the rectangles of the next level, or of the 
+/// segments for the last level, divided by the level area. Lower is better
+/// for both.
+/// @param ring Input ring
+/// @param levelidx The index of level
+/// @param stats Output diagnostics
+/// @return False if ring has no indexing, stats is NULL, or levelidx is out
+/// of bounds.
+/// @see tg_ring_index_stats()
+/// @see tg_ring_index_num_levels()
+/// @see RingFuncs
+bool tg_ring_index_level_stats(const struct tg_ring *ring, int levelidx,
+    struct tg_index_level_stats *stats)
+{
+    struct index *ix = ring ? ring->index : NULL;
+    if (!ix || !stats || levelidx < 0 || levelidx >= ix->nlevels) {
+        return false;
+    }
+    memset(stats, 0, sizeof(struct tg_index_level_stats));
+    const struct level *level = &ix->levels[levelidx];
+    int nchildren = levelidx == ix->nlevels-1 ? ring->nsegs : 
+        ix->levels[levelidx+1].nrects;
+    double overlap = 0;
+    double dead = 0;
+    stats->nrects = level->nrects;
+    for (int i = 0; i < level->nrects; i++) {
+        struct tg_rect rect;
+        ixrect_to_tg_rect(&level->rects[i], &rect);
+        double area = rect_area(rect);
+        stats->area += area;
+        // siblings share the same parent
+        int e = (i/ix->spread+1)*ix->spread;
+        if (e > level->nrects) e = level->nrects;
+        for (int j = i+1; j < e; j++) {
+            struct tg_rect other;
+            ixrect_to_tg_rect(&level->rects[j], &other);
+            overlap += rect_overlap_area(rect, other);
+        }
+        // covered by children, ignoring the overlap between children
+        double covered = 0;
+        int cs = i*ix->spread;
+        int ce = cs+ix->spread;
+        if (ce > nchildren) ce = nchildren;
+        for (int j = cs; j < ce; j++) {
+            covered += rect_overlap_area(rect, 
+                index_child_rect(ring, levelidx, j));
+        }
+        dead += fmax0(area-covered, 0);
+    }
+    if (stats->area > 0) {
+        stats->overlap = overlap/stats->area;
+        stats->dead_space = dead/stats->area;
+    }
+    return true;
+}
+
+/// Get the string representation of a geometry type. 
+/// e.g. "Point", "Polygon", "LineString".
+/// @param type Input geometry type
+/// @return A string representing the type
+/// @note The returned string does not need to be freed.
+/// @see tg_geom_typeof()
+/// @see GeometryAccessors
+const char *tg_geom_type_string(enum tg_geom_type type) {
+    switch (type) {
+    case TG_POINT: return "Point";
+    case TG_LINESTRING: return "LineString";
+    case TG_POLYGON: return "Polygon";
+    case TG_MULTIPOINT: return "MultiPoint";
+    case TG_MULTILINESTRING: return "MultiLineString";
+    case TG_MULTIPOLYGON: return "MultiPolygon";
+    case TG_GEOMETRYCOLLECTION: return "GeometryCollection";
+    default: return "Unknown";
+    }
+}
+
+/////////////////////////////////////////////
+// Formats -- GeoJSON, WKT, WKB, HEX
+/////////////////////////////////////////////
+
+// maximum depth for all recursive input formats such as wkt, wkb, and json.
 #define MAXDEPTH 1024
 
 #ifndef JSON_MAXDEPTH
@@ -8250,6 +9439,7 @@ struct tg_geom *tg_parse_geojson_ix(const char *geojson, enum tg_index ix) {
 struct tg_geom *tg_parse_geojsonn_ix(const char *geojson, size_t len, 
     enum tg_index ix)
 {
+    uint64_t start = slow_op_begin();
     struct tg_geom *geom = NULL;
     struct json_valid is = json_validn_ex(geojson, len, 0);
     if (!is.valid) {
@@ -8258,12 +9448,12 @@ struct tg_geom *tg_parse_geojsonn_ix(const char *geojson, size_t len,
         struct json json = json_parsen(geojson, len);
         geom = parse_geojson(json, false, ix);
     }
-    if (!geom) return NULL;
-    if ((geom->head.flags&IS_ERROR) == IS_ERROR) {
+    if (geom && (geom->head.flags&IS_ERROR) == IS_ERROR) {
         struct tg_geom *gerr = make_parse_error("ParseError: %s", geom->error);
         tg_geom_free(geom);
-        return gerr;
+        geom = gerr;
     }
+    slow_op_end(start, TG_OP_PARSE_GEOJSON, geom, NULL, len);
     return geom;
 }
 
@@ -10856,9 +12046,11 @@ static void write_geom_geojson(const struct tg_geom *geom, struct writer *wr) {
 /// @see GeometryWriting
 size_t tg_geom_geojson(const struct tg_geom *geom, char *dst, size_t n) {
     if (!geom) return 0;
+    uint64_t start = slow_op_begin();
     struct writer wr = { .dst = (uint8_t*)dst, .n = n };
     write_geom_geojson(geom, &wr);
     write_nullterm(&wr);
+    slow_op_end(start, TG_OP_WRITE_GEOJSON, geom, NULL, wr.count);
     return wr.count;
 }
 
@@ -11751,13 +12943,14 @@ struct tg_geom *tg_parse_wkt_ix(const char *wkt, enum tg_index ix) {
 struct tg_geom *tg_parse_wktn_ix(const char *wkt, size_t len, 
     enum tg_index ix)
 {
+    uint64_t start = slow_op_begin();
     struct tg_geom *geom = parse_wkt(wkt, len, ix);
-    if (!geom) return NULL;
-    if ((geom->head.flags&IS_ERROR) == IS_ERROR) {
+    if (geom && (geom->head.flags&IS_ERROR) == IS_ERROR) {
         struct tg_geom *gerr = make_parse_error("ParseError: %s", geom->error);
         tg_geom_free(geom);
-        return gerr;
+        geom = gerr;
     }
+    slow_op_end(start, TG_OP_PARSE_WKT, geom, NULL, len);
     return geom;
 }
 
@@ -12231,9 +13424,11 @@ static void write_geom_wkt(const struct tg_geom *geom, struct writer *wr) {
 /// @see GeometryWriting
 size_t tg_geom_wkt(const struct tg_geom *geom, char *dst, size_t n) {
     if (!geom) return 0;
+    uint64_t start = slow_op_begin();
     struct writer wr = { .dst = (uint8_t*)dst, .n = n };
     write_geom_wkt(geom, &wr);
     write_nullterm(&wr);
+    slow_op_end(start, TG_OP_WRITE_WKT, geom, NULL, wr.count);
     return wr.count;
 }
 
@@ -12904,14 +14099,15 @@ struct tg_geom *tg_parse_wkb(const uint8_t *wkb, size_t len) {
 struct tg_geom *tg_parse_wkb_ix(const uint8_t *wkb, size_t len, 
     enum tg_index ix)
 {
+    uint64_t start = slow_op_begin();
     struct tg_geom *geom = NULL;
     parse_wkb(wkb, len, 0, 0, ix, &geom);
-    if (!geom) return NULL;
-    if ((geom->head.flags&IS_ERROR) == IS_ERROR) {
+    if (geom && (geom->head.flags&IS_ERROR) == IS_ERROR) {
         struct tg_geom *gerr = make_parse_error("ParseError: %s", geom->error);
         tg_geom_free(geom);
-        return gerr;
+        geom = gerr;
     }
+    slow_op_end(start, TG_OP_PARSE_WKB, geom, NULL, len);
     return geom;
 }
 
@@ -13388,8 +14584,10 @@ static void write_geom_wkb(const struct tg_geom *geom, struct writer *wr) {
 /// @see GeometryWriting
 size_t tg_geom_wkb(const struct tg_geom *geom, uint8_t *dst, size_t n) {
     if (!geom) return 0;
+    uint64_t start = slow_op_begin();
     struct writer wr = { .dst = dst, .n = n };
     write_geom_wkb(geom, &wr);
+    slow_op_end(start, TG_OP_WRITE_WKB, geom, NULL, wr.count);
     return wr.count;
 }
 
@@ -13424,9 +14622,11 @@ size_t tg_geom_hex(const struct tg_geom *geom, char *dst, size_t n) {
     // This is done by scanning the wkb in reverse, overwriting the data
     // along the way.
     static const uint8_t hexchars[] = "0123456789ABCDEF";
+    uint64_t start = slow_op_begin();
     size_t count = tg_geom_wkb(geom, (uint8_t*)dst, n);
     if (count == 0) {
         if (n > 0) dst[0] = '\0';
+        slow_op_end(start, TG_OP_WRITE_HEX, geom, NULL, 0);
         return 0;
     }
     size_t i = count - 1;
@@ -13443,6 +14643,7 @@ size_t tg_geom_hex(const struct tg_geom *geom, char *dst, size_t n) {
     }
     if (count*2 < n) dst[count*2] = '\0';
     else if (n > 0) dst[n-1] = '\0';
+    slow_op_end(start, TG_OP_WRITE_HEX, geom, NULL, count*2);
     return count*2;
 }
 
@@ -13506,13 +14707,14 @@ invalid:
 struct tg_geom *tg_parse_hexn_ix(const char *hex, size_t len, 
     enum tg_index ix)
 {
+    uint64_t start = slow_op_begin();
     struct tg_geom *geom = parse_hex(hex, len, ix);
-    if (!geom) return NULL;
-    if ((geom->head.flags&IS_ERROR) == IS_ERROR) {
+    if (geom && (geom->head.flags&IS_ERROR) == IS_ERROR) {
         struct tg_geom *gerr = make_parse_error("ParseError: %s", geom->error);
         tg_geom_free(geom);
-        return gerr;
+        geom = gerr;
     }
+    slow_op_end(start, TG_OP_PARSE_HEX, geom, NULL, len);
     return geom;
 }
 
@@ -13654,6 +14856,169 @@ double tg_point_distance_point(struct tg_point a, struct tg_point b) {
     return sqrt((a.x-b.x) * (a.x-b.x) + (a.y-b.y) * (a.y-b.y));
 }
 
+struct sdist_ctx {
+    struct tg_point point;
+    struct ixpoint ixpoint;
+    bool ray;      // count the crossings of the ray from the point
+    double dist;   // distance to the nearest segment so far
+};
+
+static double ixrect_distance_point(struct ixrect *ixrect, 
+    struct tg_point point)
+{
+    struct tg_rect rect;
+    ixrect_to_tg_rect(ixrect, &rect);
+    return tg_point_distance_rect(point, rect);
+}
+
+static void sdist_leaf(const struct tg_ring *ring, struct sdist_ctx *ctx, 
+    bool allow_on_edge, int start, int end, bool *in, int *idx)
+{
+    stats_add(segments, end-start);
+    for (int i = start; i < end; i++) {
+        if (ctx->ray) {
+            pip_eval_seg(ring, i, ctx->point, allow_on_edge, in, idx);
+        }
+        struct tg_segment seg = { ring->points[i], ring->points[i+1] };
+        double dist = tg_point_distance_segment(ctx->point, seg);
+        if (dist < ctx->dist) {
+            ctx->dist = dist;
+        }
+    }
+}
+
+// Visits the branches that are nearer than the nearest segment so far, and
+// the branches that the ray passes through, which are the same branches as
+// index_pip_counter(). The nearest branch goes first to shrink the distance
+// early.
+static void sdist_counter(const struct tg_ring *ring, struct sdist_ctx *ctx,
+    bool allow_on_edge, int lvl, int start, bool *in, int *idx)
+{
+    struct index *ix = ring->index;
+    int ixspread = ix->spread;
+    if (lvl == ix->nlevels) {
+        int e = start+ixspread;
+        if (e > ring->nsegs) e = ring->nsegs;
+        sdist_leaf(ring, ctx, allow_on_edge, start, e, in, idx);
+        return;
+    }
+    struct level *level = &ix->levels[lvl];
+    int e = start+ixspread;
+    if (e > level->nrects) e = level->nrects;
+    stats_add(index_nodes, e-start);
+    int nearest = start;
+    double nearest_dist = INFINITY;
+    for (int i = start; i < e; i++) {
+        double dist = ixrect_distance_point(&level->rects[i], ctx->point);
+        if (dist < nearest_dist) {
+            nearest = i;
+            nearest_dist = dist;
+        }
+    }
+    if (nearest_dist < ctx->dist || 
+        (ctx->ray && branch_maybe_in(ctx->ixpoint, level->rects[nearest])))
+    {
+        sdist_counter(ring, ctx, allow_on_edge, lvl+1, nearest*ixspread, 
+            in, idx);
+    }
+    for (int i = start; i < e; i++) {
+        if (i == nearest) {
+            continue;
+        }
+        if ((ctx->ray && branch_maybe_in(ctx->ixpoint, level->rects[i])) ||
+            ixrect_distance_point(&level->rects[i], ctx->point) < ctx->dist)
+        {
+            sdist_counter(ring, ctx, allow_on_edge, lvl+1, i*ixspread, 
+                in, idx);
+        }
+    }
+}
+
+// Shrinks the distance to the nearest segment of the ring and, when 
+// wanted, returns the result of tg_ring_contains_point().
+static bool ring_sdist(const struct tg_ring *ring, struct sdist_ctx *ctx, 
+    bool allow_on_edge, bool want_pip)
+{
+    ctx->ray = want_pip && tg_rect_covers_point(ring->rect, ctx->point);
+    if (!ctx->ray && tg_point_distance_rect(ctx->point, ring->rect) >= 
+        ctx->dist)
+    {
+        return false;
+    }
+    bool in = false;
+    int idx = -1;
+    if (ring->index) {
+        sdist_counter(ring, ctx, allow_on_edge, 0, 0, &in, &idx);
+    } else {
+        sdist_leaf(ring, ctx, allow_on_edge, 0, ring->nsegs, &in, &idx);
+    }
+    return ctx->ray && in;
+}
+
+// Finds the distance from the point to the nearest boundary of a Polygon or
+// MultiPolygon, and whether the point is covered, in one pass over each 
+// ring. Returns false if the geometry has no polygons.
+static bool geom_sdist(const struct tg_geom *geom, struct tg_point point,
+    bool *covers, double *dist)
+{
+    int npolys = tg_geom_num_polys(geom);
+    const struct tg_poly *single = tg_geom_poly(geom);
+    if (single) {
+        npolys = 1;
+    }
+    struct sdist_ctx ctx = { .point = point, .dist = INFINITY };
+    tg_point_to_ixpoint(&point, &ctx.ixpoint);
+    *covers = false;
+    for (int i = 0; i < npolys; i++) {
+        const struct tg_poly *poly = single ? single : 
+            tg_geom_poly_at(geom, i);
+        if (tg_poly_empty(poly)) {
+            continue;
+        }
+        // A point that is already covered by another polygon does not need
+        // the parity of this one.
+        bool in = ring_sdist(tg_poly_exterior(poly), &ctx, true, !*covers);
+        int nholes = tg_poly_num_holes(poly);
+        for (int j = 0; j < nholes; j++) {
+            if (ring_sdist(tg_poly_hole_at(poly, j), &ctx, false, in)) {
+                in = false;
+            }
+        }
+        *covers = *covers || in;
+    }
+    *dist = ctx.dist;
+    return ctx.dist != INFINITY;
+}
+
+/// Returns the signed distance from a point to the boundary of a Polygon or
+/// MultiPolygon, including the boundaries of holes.
+///
+/// The distance is negative when the point is inside of the geometry, 
+/// positive when outside, and zero when on the boundary. Inside is the same
+/// as tg_geom_covers_xy(). The distance and the inside test are found 
+/// together, in one pass over the natural index of each ring.
+/// @param geom Input geometry
+/// @param x X coordinate
+/// @param y Y coordinate
+/// @return The signed distance, in the units of the coordinates
+/// @return INFINITY if the geometry has no polygons, or is empty
+/// @see GeometryPredicates
+double tg_geom_signed_distance(const struct tg_geom *geom, double x, double y)
+{
+    uint64_t start = slow_op_begin();
+    bool covers;
+    double dist;
+    if (!geom_sdist(geom, (struct tg_point){ .x = x, .y = y }, &covers, 
+        &dist))
+    {
+        dist = INFINITY;
+    } else if (covers) {
+        dist = -dist;
+    }
+    slow_op_end(start, TG_OP_SIGNED_DISTANCE, geom, NULL, 0);
+    return dist;
+}
+
 enum nqentry_kind {
     NQUEUE_KIND_SEGMENT,
     NQUEUE_KIND_RECT
@@ -13805,6 +15170,7 @@ bool tg_ring_nearest_segment(const struct tg_ring *ring,
             int more = 0;
             struct tg_rect rect;
             ixrect_to_tg_rect(&ix->levels[0].rects[i], &rect);
+            stats_add(index_nodes, 1);
             double dist = rect_dist(rect, &more, udata);
             struct nqentry entry = {
                 .kind = NQUEUE_KIND_RECT,
@@ -13823,6 +15189,7 @@ bool tg_ring_nearest_segment(const struct tg_ring *ring,
                 ring->points[i+1]
             };
             int more = 0;
+            stats_add(segments, 1);
             double dist = seg_dist(seg, &more, udata);
             struct nqentry entry = {
                 .kind = NQUEUE_KIND_SEGMENT,
@@ -13844,6 +15211,7 @@ bool tg_ring_nearest_segment(const struct tg_ring *ring,
             if (ientry->more) {
                 // Reinsert the segment
                 struct nqentry entry = *ientry;
+                stats_add(segments, 1);
                 entry.dist = seg_dist(seg, &entry.more, udata);
                 nqueue_push(&queue, &entry);
             } else {
@@ -13860,6 +15228,7 @@ bool tg_ring_nearest_segment(const struct tg_ring *ring,
             ixrect_to_tg_rect(&ix->levels[ientry->rect_level]
                 .rects[ientry->rect_index], &rect);
             struct nqentry entry = *ientry;
+            stats_add(index_nodes, 1);
             entry.dist = rect_dist(rect, &entry.more, udata);
             nqueue_push(&queue, &entry);
             continue;
@@ -13879,6 +15248,7 @@ bool tg_ring_nearest_segment(const struct tg_ring *ring,
                     ring->points[i+1]
                 };
                 int more = 0;
+                stats_add(segments, 1);
                 double dist = seg_dist(seg, &more, udata);
                 struct nqentry entry = {
                     .more = more,
@@ -13898,6 +15268,7 @@ bool tg_ring_nearest_segment(const struct tg_ring *ring,
                 int more = 0;
                 struct tg_rect rect;
                 ixrect_to_tg_rect(&level->rects[i], &rect);
+                stats_add(index_nodes, 1);
                 double dist = rect_dist(rect, &more, udata);
                 struct nqentry entry = {
                     .more = more,
@@ -13933,17 +15304,205 @@ bool tg_line_nearest_segment(const struct tg_line *line,
 //  Spatial predicates
 ////////////////////////////////////////////////////////////////////////////////
 
+static bool points_same(const struct tg_point *a, const struct tg_point *b,
+    int n)
+{
+    if (memcmp(a, b, n*sizeof(struct tg_point)) == 0) {
+        return true;
+    }
+    for (int i = 0; i < n; i++) {
+        if (!pteq(a[i], b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool line_same_points(const struct tg_line *a, const struct tg_line *b)
+{
+    int n = tg_line_num_points(a);
+    if (n != tg_line_num_points(b)) {
+        return false;
+    }
+    const struct tg_point *pa = tg_line_points(a);
+    const struct tg_point *pb = tg_line_points(b);
+    if (points_same(pa, pb, n)) {
+        return true;
+    }
+    // reversed
+    for (int i = 0; i < n; i++) {
+        if (!pteq(pa[i], pb[n-1-i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Tests that two rings have the same points, starting at any point and in 
+// either direction.
+static bool ring_same_points(const struct tg_ring *a, const struct tg_ring *b)
+{
+    int n = a->nsegs;
+    if (n != b->nsegs) {
+        return false;
+    }
+    if (a->npoints == b->npoints && points_same(a->points, b->points, 
+        a->npoints))
+    {
+        return true;
+    }
+    const struct tg_point *pa = a->points;
+    const struct tg_point *pb = b->points;
+    for (int k = 0; k < n; k++) {
+        if (!pteq(pa[0], pb[k])) {
+            continue;
+        }
+        bool fwd = true, rev = true;
+        for (int i = 1; i < n && (fwd || rev); i++) {
+            fwd = fwd && pteq(pa[i], pb[(k+i)%n]);
+            rev = rev && pteq(pa[i], pb[(k-i+n)%n]);
+        }
+        if (fwd || rev) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool poly_same_points(const struct tg_poly *a, const struct tg_poly *b)
+{
+    int nholes = tg_poly_num_holes(a);
+    if (nholes != tg_poly_num_holes(b) || 
+        !ring_same_points(tg_poly_exterior(a), tg_poly_exterior(b)))
+    {
+        return false;
+    }
+    for (int i = 0; i < nholes; i++) {
+        if (!ring_same_points(tg_poly_hole_at(a, i), tg_poly_hole_at(b, i))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Tests that two geometries have the same type and the same coordinates,
+// allowing for lines and rings that are reversed, and rings that start at a
+// different point.
+static bool geom_same_points(const struct tg_geom *a, const struct tg_geom *b)
+{
+    enum tg_geom_type type = tg_geom_typeof(a);
+    if (type != tg_geom_typeof(b)) {
+        return false;
+    }
+    switch (type) {
+    case TG_POINT:
+        return pteq(tg_geom_point(a), tg_geom_point(b));
+    case TG_LINESTRING:
+        return line_same_points(tg_geom_line(a), tg_geom_line(b));
+    case TG_POLYGON:
+        return poly_same_points(tg_geom_poly(a), tg_geom_poly(b));
+    case TG_MULTIPOINT: {
+        int n = tg_geom_num_points(a);
+        if (n != tg_geom_num_points(b)) {
+            return false;
+        }
+        for (int i = 0; i < n; i++) {
+            if (!pteq(tg_geom_point_at(a, i), tg_geom_point_at(b, i))) {
+                return false;
+            }
+        }
+        return true;
+    }
+    case TG_MULTILINESTRING: {
+        int n = tg_geom_num_lines(a);
+        if (n != tg_geom_num_lines(b)) {
+            return false;
+        }
+        for (int i = 0; i < n; i++) {
+            if (!line_same_points(tg_geom_line_at(a, i), 
+                tg_geom_line_at(b, i)))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+    case TG_MULTIPOLYGON: {
+        int n = tg_geom_num_polys(a);
+        if (n != tg_geom_num_polys(b)) {
+            return false;
+        }
+        for (int i = 0; i < n; i++) {
+            if (!poly_same_points(tg_geom_poly_at(a, i), 
+                tg_geom_poly_at(b, i)))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+    case TG_GEOMETRYCOLLECTION: {
+        int n = tg_geom_num_geometries(a);
+        if (n != tg_geom_num_geometries(b)) {
+            return false;
+        }
+        for (int i = 0; i < n; i++) {
+            const struct tg_geom *ga = tg_geom_geometry_at(a, i);
+            const struct tg_geom *gb = tg_geom_geometry_at(b, i);
+            if (tg_geom_is_empty(ga) || tg_geom_is_empty(gb) || 
+                !geom_same_points(ga, gb))
+            {
+                return false;
+            }
+        }
+        return true;
+    }}
+    return false;
+}
+
+__attr_noinline
+static bool geom_equals(const struct tg_geom *a, const struct tg_geom *b) {
+    if (!a || !b) {
+        return false;
+    }
+    if (!tg_geom_is_empty(a) && !tg_geom_is_empty(b)) {
+        // Equal geometries cover each other, so they must have the same 
+        // bounding rectangle.
+        struct tg_rect ra = tg_geom_rect(a);
+        struct tg_rect rb = tg_geom_rect(b);
+        if (!pteq(ra.min, rb.min) || !pteq(ra.max, rb.max)) {
+            return false;
+        }
+        if (geom_same_points(a, b)) {
+            return true;
+        }
+        const struct tg_poly *pa = tg_geom_poly(a);
+        const struct tg_poly *pb = tg_geom_poly(b);
+        if (pa && pb) {
+            return poly_equals_poly(pa, pb);
+        }
+    }
+    return geom_contains(b, a) && geom_contains(a, b);
+}
+
 /// Tests whether two geometries are topologically equal.
+/// @see tg_geom_hash()
 /// @see GeometryPredicates
 bool tg_geom_equals(const struct tg_geom *a, const struct tg_geom *b) {
-    return tg_geom_within(a, b) && tg_geom_contains(a, b);
+    uint64_t start = slow_op_begin();
+    bool eq = geom_equals(a, b);
+    slow_op_end(start, TG_OP_EQUALS, a, b, 0);
+    return eq;
 }
 
 /// Tests whether 'a' is fully contained inside of 'b'.
 /// @note Works the same as `tg_geom_covers(b, a)`
 /// @see GeometryPredicates
 bool tg_geom_coveredby(const struct tg_geom *a, const struct tg_geom *b) {
-    return tg_geom_covers(b, a);
+    uint64_t start = slow_op_begin();
+    bool hit = geom_covers(b, a);
+    slow_op_end(start, TG_OP_COVEREDBY, a, b, 0);
+    return hit;
 }
 
 /// Tests whether 'a' and 'b' have no point in common, and are fully
@@ -13951,7 +15510,10 @@ bool tg_geom_coveredby(const struct tg_geom *a, const struct tg_geom *b) {
 /// @note Works the same as `!tg_geom_intersects(a, b)`
 /// @see GeometryPredicates
 bool tg_geom_disjoint(const struct tg_geom *a, const struct tg_geom *b) {
-    return !tg_geom_intersects(a, b);
+    uint64_t start = slow_op_begin();
+    bool hit = geom_intersects(a, b);
+    slow_op_end(start, TG_OP_DISJOINT, a, b, 0);
+    return !hit;
 }
 
 /// Tests whether 'a' is contained inside of 'b' and not touching the boundary
@@ -13963,47 +15525,616 @@ bool tg_geom_disjoint(const struct tg_geom *a, const struct tg_geom *b) {
 /// For full coverage, consider using @ref tg_geom_coveredby.
 /// @see GeometryPredicates
 bool tg_geom_within(const struct tg_geom *a, const struct tg_geom *b) {
-    return tg_geom_contains(b, a);
+    uint64_t start = slow_op_begin();
+    bool hit = geom_contains(b, a);
+    slow_op_end(start, TG_OP_WITHIN, a, b, 0);
+    return hit;
 }
 
-bool tg_geom_crosses(const struct tg_geom *a, const struct tg_geom *b) {
-    (void)a; (void)b;
-    // unsupported
-    return false;
-}
+// The boundary points of the lines in a geometry. A line end is only on the
+// boundary when it's shared by an odd number of line ends (mod-2 rule), so 
+// closed lines have no boundary.
+struct lbounds {
+    struct tg_point *points; // sorted
+    int count;
+    int cap;
+    bool oom;
+    struct tg_point spare[2];
+};
 
-bool tg_geom_overlaps(const struct tg_geom *a, const struct tg_geom *b) {
-    (void)a; (void)b;
-    // unsupported
-    return false;
+static int lbounds_compare(const void *a, const void *b) {
+    const struct tg_point *pa = a;
+    const struct tg_point *pb = b;
+    if (pa->x < pb->x) return -1;
+    if (pa->x > pb->x) return 1;
+    if (pa->y < pb->y) return -1;
+    if (pa->y > pb->y) return 1;
+    return 0;
 }
 
-int tg_geom_de9im_dims(const struct tg_geom *geom) {
-    int dims = -1;
-    if (geom) {
-        switch (geom->head.base) {
-        case BASE_POINT: return 0;
-        case BASE_LINE:  return 1;
-        case BASE_RING:  return 2;
-        case BASE_POLY:  return 2;
-        case BASE_GEOM:
-            switch (geom->head.type) {
-            case TG_POINT:           return 0;
-            case TG_LINESTRING:      return 1;
-            case TG_POLYGON:         return 2;
-            case TG_MULTIPOINT:      return 0;
-            case TG_MULTILINESTRING: return 1;
-            case TG_MULTIPOLYGON:    return 2;
-            case TG_GEOMETRYCOLLECTION: {
-                int ngeoms = tg_geom_num_geometries(geom);
-                for (int i = 0; i < ngeoms; i++) {
-                    const struct tg_geom *child = tg_geom_geometry_at(geom, i);
-                    int child_dims = tg_geom_de9im_dims(child);
-                    if (child_dims > dims) {
-                        dims = child_dims;
-                    }
-                }
-            }}
+static void lbounds_push(struct lbounds *bounds, struct tg_point point) {
+    if (bounds->count == bounds->cap) {
+        int cap = bounds->cap*2;
+        struct tg_point *points = tg_malloc(cap*sizeof(struct tg_point));
+        if (!points) {
+            bounds->oom = true;
+            return;
+        }
+        memcpy(points, bounds->points, bounds->count*sizeof(struct tg_point));
+        if (bounds->points != bounds->spare) {
+            tg_free(bounds->points);
+        }
+        bounds->points = points;
+        bounds->cap = cap;
+    }
+    bounds->points[bounds->count++] = point;
+}
+
+static void lbounds_push_line(struct lbounds *bounds, 
+    const struct tg_line *line)
+{
+    int npoints = tg_line_num_points(line);
+    if (npoints > 0) {
+        lbounds_push(bounds, tg_line_point_at(line, 0));
+        lbounds_push(bounds, tg_line_point_at(line, npoints-1));
+    }
+}
+
+static void lbounds_push_geom(struct lbounds *bounds, 
+    const struct tg_geom *geom)
+{
+    switch (tg_geom_typeof(geom)) {
+    case TG_LINESTRING:
+        lbounds_push_line(bounds, tg_geom_line(geom));
+        break;
+    case TG_MULTILINESTRING:
+        for (int i = 0; i < tg_geom_num_lines(geom); i++) {
+            lbounds_push_line(bounds, tg_geom_line_at(geom, i));
+        }
+        break;
+    case TG_GEOMETRYCOLLECTION:
+        for (int i = 0; i < tg_geom_num_geometries(geom); i++) {
+            lbounds_push_geom(bounds, tg_geom_geometry_at(geom, i));
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static void lbounds_init(struct lbounds *bounds, const struct tg_geom *geom) {
+    memset(bounds, 0, sizeof(struct lbounds));
+    bounds->points = bounds->spare;
+    bounds->cap = 2;
+    lbounds_push_geom(bounds, geom);
+    if (bounds->oom || bounds->count == 0) {
+        return;
+    }
+    qsort(bounds->points, bounds->count, sizeof(struct tg_point), 
+        lbounds_compare);
+    // keep the points that are repeated an odd number of times.
+    int count = 0;
+    for (int i = 0; i < bounds->count; ) {
+        int j = i+1;
+        while (j < bounds->count && pteq(bounds->points[j], bounds->points[i])){
+            j++;
+        }
+        if ((j-i)%2 == 1) {
+            bounds->points[count++] = bounds->points[i];
+        }
+        i = j;
+    }
+    bounds->count = count;
+}
+
+static bool lbounds_has(const struct lbounds *bounds, struct tg_point point) {
+    return bounds->count > 0 && bsearch(&point, bounds->points, 
+        bounds->count, sizeof(struct tg_point), lbounds_compare);
+}
+
+// Tests whether a boundary point is on both segments. The segments must 
+// cross at a single point that is not on the end of either.
+static bool lbounds_on_segments(const struct lbounds *bounds, 
+    struct tg_segment a, struct tg_segment b)
+{
+    // The crossing point is within the x range of both segments. A boundary
+    // point may be on another segment of its own line, such as where a line
+    // doubles back over one of its ends.
+    double minx = fmax0(fmin0(a.a.x, a.b.x), fmin0(b.a.x, b.b.x));
+    double maxx = fmin0(fmax0(a.a.x, a.b.x), fmax0(b.a.x, b.b.x));
+    int lo = 0;
+    int hi = bounds->count;
+    while (lo < hi) {
+        int mid = (lo+hi)/2;
+        if (bounds->points[mid].x < minx) {
+            lo = mid+1;
+        } else {
+            hi = mid;
+        }
+    }
+    for (int i = lo; i < bounds->count && bounds->points[i].x <= maxx; i++) {
+        if (tg_segment_covers_point(a, bounds->points[i]) &&
+            tg_segment_covers_point(b, bounds->points[i]))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void lbounds_free(struct lbounds *bounds) {
+    if (bounds->points != bounds->spare) {
+        tg_free(bounds->points);
+    }
+}
+
+// A point on a line segment, by its segment index and its distance along 
+// that segment from 0.0 to 1.0.
+struct seg_contact {
+    int idx;
+    double t;
+};
+
+static int seg_contact_compare(const void *a, const void *b) {
+    const struct seg_contact *ca = a;
+    const struct seg_contact *cb = b;
+    if (ca->idx != cb->idx) return ca->idx < cb->idx ? -1 : 1;
+    return ca->t < cb->t ? -1 : ca->t > cb->t;
+}
+
+struct enters_ctx {
+    bool enters;
+    bool oom;
+    struct seg_contact *contacts;
+    int ncontacts;
+    int cap;
+    struct seg_contact spare[32];
+};
+
+static void enters_push(struct enters_ctx *ctx, int idx, double t) {
+    if (ctx->ncontacts == ctx->cap) {
+        int cap = ctx->cap*2;
+        struct seg_contact *contacts = tg_malloc(cap*sizeof(*contacts));
+        if (!contacts) {
+            ctx->oom = true;
+            return;
+        }
+        memcpy(contacts, ctx->contacts, ctx->ncontacts*sizeof(*contacts));
+        if (ctx->contacts != ctx->spare) {
+            tg_free(ctx->contacts);
+        }
+        ctx->contacts = contacts;
+        ctx->cap = cap;
+    }
+    ctx->contacts[ctx->ncontacts++] = (struct seg_contact){ idx, t };
+}
+
+static double segment_point_t(struct tg_segment seg, struct tg_point point) {
+    double dx = seg.b.x - seg.a.x;
+    double dy = seg.b.y - seg.a.y;
+    double len2 = dx*dx + dy*dy;
+    if (len2 == 0) {
+        return 0;
+    }
+    double t = ((point.x-seg.a.x)*dx + (point.y-seg.a.y)*dy) / len2;
+    return fclamp0(t, 0, 1);
+}
+
+static bool enters_iter(struct tg_segment seg, int idx, 
+    struct tg_segment rseg, int ridx, void *udata)
+{
+    (void)ridx;
+    struct enters_ctx *ctx = udata;
+    bool ra = tg_segment_covers_point(seg, rseg.a);
+    bool rb = tg_segment_covers_point(seg, rseg.b);
+    if (!ra && !rb && !tg_segment_covers_point(rseg, seg.a) && 
+        !tg_segment_covers_point(rseg, seg.b))
+    {
+        // The segments cross at a single point that is not on the end of 
+        // either, so the line passes from one side of the boundary to the
+        // other.
+        ctx->enters = true;
+        return false;
+    }
+    // The segment touches the boundary. Record where it touches so that the
+    // parts of the segment between can be tested later.
+    enters_push(ctx, idx, 0);
+    enters_push(ctx, idx, 1);
+    if (ra) {
+        enters_push(ctx, idx, segment_point_t(seg, rseg.a));
+    }
+    if (rb) {
+        enters_push(ctx, idx, segment_point_t(seg, rseg.b));
+    }
+    return !ctx->oom;
+}
+
+// Tests whether any part of a line is strictly inside of a polygon, not 
+// counting the polygon boundary. 
+static bool line_enters_poly(const struct tg_line *line, 
+    const struct tg_poly *poly, bool *oom)
+{
+    struct tg_rect rect = tg_poly_rect(poly);
+    if (!tg_rect_intersects_rect(tg_line_rect(line), rect)) {
+        return false;
+    }
+    int npoints = tg_line_num_points(line);
+    const struct tg_point *points = tg_line_points(line);
+    for (int i = 0; i < npoints; i++) {
+        if (tg_rect_covers_point(rect, points[i]) && 
+            tg_poly_contains_point(poly, points[i]))
+        {
+            return true;
+        }
+    }
+    // No points are inside, but the segments may still pass through the
+    // polygon interior.
+    struct enters_ctx ctx = { 0 };
+    ctx.contacts = ctx.spare;
+    ctx.cap = sizeof(ctx.spare)/sizeof(ctx.spare[0]);
+    int nholes = tg_poly_num_holes(poly);
+    for (int i = -1; i < nholes && !ctx.enters && !ctx.oom; i++) {
+        const struct tg_ring *ring = i == -1 ? tg_poly_exterior(poly) : 
+            tg_poly_hole_at(poly, i);
+        tg_line_line_search(line, (struct tg_line*)ring, enters_iter, &ctx);
+    }
+    if (!ctx.enters && !ctx.oom && ctx.ncontacts > 0) {
+        // Test the middle of each part of the segment that is between two
+        // boundary contacts.
+        qsort(ctx.contacts, ctx.ncontacts, sizeof(struct seg_contact), 
+            seg_contact_compare);
+        for (int i = 1; i < ctx.ncontacts; i++) {
+            struct seg_contact c0 = ctx.contacts[i-1];
+            struct seg_contact c1 = ctx.contacts[i];
+            if (c0.idx != c1.idx || !(c0.t < c1.t)) {
+                continue;
+            }
+            struct tg_segment seg = tg_line_segment_at(line, c0.idx);
+            double t = (c0.t + c1.t) / 2;
+            struct tg_point mid = {
+                seg.a.x + (seg.b.x - seg.a.x) * t,
+                seg.a.y + (seg.b.y - seg.a.y) * t,
+            };
+            if (tg_poly_contains_point(poly, mid)) {
+                ctx.enters = true;
+                break;
+            }
+        }
+    }
+    if (ctx.contacts != ctx.spare) {
+        tg_free(ctx.contacts);
+    }
+    if (ctx.oom) {
+        *oom = true;
+        return false;
+    }
+    return ctx.enters;
+}
+
+// Tests whether the interiors of two polygons intersect. 
+static bool poly_interiors_intersect(const struct tg_poly *a, 
+    const struct tg_poly *b, bool *oom)
+{
+    if (!tg_rect_intersects_rect(tg_poly_rect(a), tg_poly_rect(b))) {
+        return false;
+    }
+    // When no part of the boundary of 'a' is inside of 'b', then the
+    // interior of 'b' is either fully inside of 'a' or fully outside.
+    int nholes = tg_poly_num_holes(a);
+    for (int i = -1; i < nholes; i++) {
+        const struct tg_ring *ring = i == -1 ? tg_poly_exterior(a) : 
+            tg_poly_hole_at(a, i);
+        if (line_enters_poly((struct tg_line*)ring, b, oom)) {
+            return true;
+        }
+    }
+    return tg_poly_covers_poly(a, b) || tg_poly_covers_poly(b, a);
+}
+
+struct interiors_ctx {
+    struct lbounds abounds;  // line boundary of geometry 'a'
+    struct lbounds bbounds;  // line boundary of geometry 'b'
+    bool full;               // keep looking for overlaps after an interior
+    bool interior;           // the interiors intersect
+    bool overlap;            // two lines share a part that has a length
+    bool oom;
+    const struct tg_geom *b;
+    const struct tg_geom *apart;
+};
+
+static bool interiors_done(struct interiors_ctx *ctx) {
+    return ctx->oom || ctx->overlap || (ctx->interior && !ctx->full);
+}
+
+static bool lines_interiors_iter(struct tg_segment a, int aidx, 
+    struct tg_segment b, int bidx, void *udata)
+{
+    (void)aidx; (void)bidx;
+    struct interiors_ctx *ctx = udata;
+    // Find where the segments touch. Two different points means that the
+    // segments share a part.
+    struct tg_point pts[4];
+    int n = 0;
+    if (tg_segment_covers_point(b, a.a)) pts[n++] = a.a;
+    if (tg_segment_covers_point(b, a.b)) pts[n++] = a.b;
+    if (tg_segment_covers_point(a, b.a)) pts[n++] = b.a;
+    if (tg_segment_covers_point(a, b.b)) pts[n++] = b.b;
+    for (int i = 1; i < n; i++) {
+        if (!pteq(pts[i], pts[0])) {
+            ctx->interior = true;
+            ctx->overlap = true;
+            return false;
+        }
+    }
+    if (n == 0) {
+        // Crossing at a point that is not the end of either segment, but it
+        // may still be the end of either line.
+        if (!lbounds_on_segments(&ctx->abounds, a, b) &&
+            !lbounds_on_segments(&ctx->bbounds, a, b))
+        {
+            ctx->interior = true;
+        }
+    } else if (!lbounds_has(&ctx->abounds, pts[0]) && 
+        !lbounds_has(&ctx->bbounds, pts[0]))
+    {
+        // Touching at a point that is not a line end.
+        ctx->interior = true;
+    }
+    return !interiors_done(ctx);
+}
+
+static bool line_interior_covers_point(const struct tg_line *line, 
+    const struct lbounds *bounds, struct tg_point point)
+{
+    return tg_line_covers_point(line, point) && !lbounds_has(bounds, point);
+}
+
+// Tests the interiors of a point, line, or polygon from 'a' and one from 'b'.
+static void parts_interiors(struct interiors_ctx *ctx, 
+    const struct tg_geom *a, const struct tg_geom *b)
+{
+    enum tg_geom_type atype = tg_geom_typeof(a);
+    enum tg_geom_type btype = tg_geom_typeof(b);
+    switch (atype) {
+    case TG_POINT: {
+        struct tg_point point = tg_geom_point(a);
+        switch (btype) {
+        case TG_POINT:
+            ctx->interior = pteq(point, tg_geom_point(b));
+            break;
+        case TG_LINESTRING:
+            ctx->interior = line_interior_covers_point(tg_geom_line(b), 
+                &ctx->bbounds, point);
+            break;
+        default:
+            ctx->interior = tg_poly_contains_point(tg_geom_poly(b), point);
+            break;
+        }
+        break;
+    }
+    case TG_LINESTRING: {
+        const struct tg_line *line = tg_geom_line(a);
+        switch (btype) {
+        case TG_POINT:
+            ctx->interior = line_interior_covers_point(line, &ctx->abounds, 
+                tg_geom_point(b));
+            break;
+        case TG_LINESTRING:
+            tg_line_line_search(line, tg_geom_line(b), lines_interiors_iter, 
+                ctx);
+            break;
+        default:
+            ctx->interior = line_enters_poly(line, tg_geom_poly(b), 
+                &ctx->oom);
+            break;
+        }
+        break;
+    }
+    default: {
+        const struct tg_poly *poly = tg_geom_poly(a);
+        switch (btype) {
+        case TG_POINT:
+            ctx->interior = tg_poly_contains_point(poly, tg_geom_point(b));
+            break;
+        case TG_LINESTRING:
+            ctx->interior = line_enters_poly(tg_geom_line(b), poly, 
+                &ctx->oom);
+            break;
+        default:
+            ctx->interior = poly_interiors_intersect(poly, tg_geom_poly(b), 
+                &ctx->oom);
+            break;
+        }
+        break;
+    }}
+}
+
+// Calls iter for each point, line, and polygon of a geometry that 
+// intersects the rect, using the index of each collection, if available.
+struct parts_search_ctx {
+    struct tg_rect rect;
+    bool (*iter)(const struct tg_geom *part, void *udata);
+    void *udata;
+    bool stop;
+};
+
+static void parts_search0(const struct tg_geom *geom, 
+    struct parts_search_ctx *ctx);
+
+static bool parts_search_iter(const struct tg_geom *child, int index, 
+    void *udata)
+{
+    (void)index;
+    struct parts_search_ctx *ctx = udata;
+    parts_search0(child, ctx);
+    return !ctx->stop;
+}
+
+static void parts_search0(const struct tg_geom *geom, 
+    struct parts_search_ctx *ctx)
+{
+    if (tg_geom_is_empty(geom)) {
+        return;
+    }
+    switch (tg_geom_typeof(geom)) {
+    case TG_POINT:
+    case TG_LINESTRING:
+    case TG_POLYGON:
+        if (tg_rect_intersects_rect(tg_geom_rect(geom), ctx->rect)) {
+            if (!ctx->iter(geom, ctx->udata)) {
+                ctx->stop = true;
+            }
+        }
+        break;
+    default:
+        tg_geom_search(geom, ctx->rect, parts_search_iter, ctx);
+        break;
+    }
+}
+
+static void parts_search(const struct tg_geom *geom, struct tg_rect rect,
+    bool (*iter)(const struct tg_geom *part, void *udata), void *udata)
+{
+    struct parts_search_ctx ctx = { 
+        .rect = rect, 
+        .iter = iter, 
+        .udata = udata,
+    };
+    parts_search0(geom, &ctx);
+}
+
+static bool interiors_biter(const struct tg_geom *bpart, void *udata) {
+    struct interiors_ctx *ctx = udata;
+    bool interior = ctx->interior;
+    parts_interiors(ctx, ctx->apart, bpart);
+    ctx->interior = ctx->interior || interior;
+    return !interiors_done(ctx);
+}
+
+static bool interiors_aiter(const struct tg_geom *apart, void *udata) {
+    struct interiors_ctx *ctx = udata;
+    ctx->apart = apart;
+    parts_search(ctx->b, tg_geom_rect(apart), interiors_biter, ctx);
+    return !interiors_done(ctx);
+}
+
+// Tests whether the interiors of two geometries intersect. When 'full' is
+// true the search continues until lines are found that share a part, which
+// is returned in 'overlap'.
+static bool geom_interiors_intersect(const struct tg_geom *a, 
+    const struct tg_geom *b, bool full, bool *overlap)
+{
+    struct interiors_ctx ctx = { .full = full, .b = b };
+    lbounds_init(&ctx.abounds, a);
+    lbounds_init(&ctx.bbounds, b);
+    ctx.oom = ctx.abounds.oom || ctx.bbounds.oom;
+    if (!ctx.oom) {
+        parts_search(a, tg_geom_rect(b), interiors_aiter, &ctx);
+    }
+    lbounds_free(&ctx.abounds);
+    lbounds_free(&ctx.bbounds);
+    *overlap = ctx.overlap && !ctx.oom;
+    return ctx.interior && !ctx.oom;
+}
+
+static bool geom_crosses(const struct tg_geom *a, const struct tg_geom *b) {
+    if (!a || !b || tg_geom_is_empty(a) || tg_geom_is_empty(b) ||
+        !tg_rect_intersects_rect(tg_geom_rect(a), tg_geom_rect(b)))
+    {
+        return false;
+    }
+    int adims = tg_geom_de9im_dims(a);
+    int bdims = tg_geom_de9im_dims(b);
+    bool overlap;
+    if (adims == bdims) {
+        // Only lines can cross lines, and only at points.
+        return adims == 1 && geom_interiors_intersect(a, b, true, &overlap) &&
+            !overlap;
+    }
+    if (adims > bdims) {
+        const struct tg_geom *tmp = a;
+        a = b;
+        b = tmp;
+    }
+    // The interior of the lower dimension geometry 'a' must be partly inside
+    // of 'b' and partly outside.
+    return geom_interiors_intersect(a, b, false, &overlap) && 
+        !geom_covers(b, a);
+}
+
+static bool geom_overlaps(const struct tg_geom *a, const struct tg_geom *b) {
+    if (!a || !b || tg_geom_is_empty(a) || tg_geom_is_empty(b) ||
+        !tg_rect_intersects_rect(tg_geom_rect(a), tg_geom_rect(b)))
+    {
+        return false;
+    }
+    int dims = tg_geom_de9im_dims(a);
+    if (dims != tg_geom_de9im_dims(b) || geom_covers(a, b) || 
+        geom_covers(b, a))
+    {
+        return false;
+    }
+    // Lines must share a part that has a length, while points and polygons
+    // only need their interiors to intersect.
+    bool overlap;
+    bool interior = geom_interiors_intersect(a, b, dims == 1, &overlap);
+    return dims == 1 ? overlap : interior;
+}
+
+/// Tests whether 'a' and 'b' cross. 
+///
+/// A point or line crosses a line or polygon of a higher dimension when its
+/// interior is partly inside of the other geometry and partly outside. Two
+/// lines cross when their interiors intersect at points only.
+/// @note Works the same as `tg_geom_crosses(b, a)`
+/// @see GeometryPredicates
+bool tg_geom_crosses(const struct tg_geom *a, const struct tg_geom *b) {
+    uint64_t start = slow_op_begin();
+    bool hit = geom_crosses(a, b);
+    slow_op_end(start, TG_OP_CROSSES, a, b, 0);
+    return hit;
+}
+
+/// Tests whether 'a' and 'b' overlap. 
+///
+/// Two geometries of the same dimension overlap when their interiors 
+/// intersect, and neither covers the other. For lines the intersection must
+/// also be a line.
+/// @note Works the same as `tg_geom_overlaps(b, a)`
+/// @see GeometryPredicates
+bool tg_geom_overlaps(const struct tg_geom *a, const struct tg_geom *b) {
+    uint64_t start = slow_op_begin();
+    bool hit = geom_overlaps(a, b);
+    slow_op_end(start, TG_OP_OVERLAPS, a, b, 0);
+    return hit;
+}
+
+int tg_geom_de9im_dims(const struct tg_geom *geom) {
+    int dims = -1;
+    if (geom) {
+        switch (geom->head.base) {
+        case BASE_POINT: return 0;
+        case BASE_LINE:  return 1;
+        case BASE_RING:  return 2;
+        case BASE_POLY:  return 2;
+        case BASE_GEOM:
+            switch (geom->head.type) {
+            case TG_POINT:           return 0;
+            case TG_LINESTRING:      return 1;
+            case TG_POLYGON:         return 2;
+            case TG_MULTIPOINT:      return 0;
+            case TG_MULTILINESTRING: return 1;
+            case TG_MULTIPOLYGON:    return 2;
+            case TG_GEOMETRYCOLLECTION: {
+                int ngeoms = tg_geom_num_geometries(geom);
+                for (int i = 0; i < ngeoms; i++) {
+                    const struct tg_geom *child = tg_geom_geometry_at(geom, i);
+                    int child_dims = tg_geom_de9im_dims(child);
+                    if (child_dims > dims) {
+                        dims = child_dims;
+                    }
+                }
+            }}
         }
     }
     return dims;
@@ -14029,13 +16160,25 @@ struct tg_ring *tg_ring_copy(const struct tg_ring *ring) {
     rc_init(&ring2->head.rc);
     rc_retain(&ring2->head.rc);
     ring2->head.noheap = 0;
-    if (ring->ystripes) {
-        ring2->ystripes = tg_malloc(ring->ystripes->memsz);
-        if (!ring2->ystripes) {
+    if (ring->index) {
+        // The index shares the same allocation as the ring, so its pointers
+        // must be relocated to the new allocation.
+        ring2->index = (void*)((char*)ring2+((char*)ring->index-(char*)ring));
+        for (int i = 0; i < ring2->index->nlevels; i++) {
+            ring2->index->levels[i].rects = (void*)((char*)ring2->index+
+                ((char*)ring->index->levels[i].rects-(char*)ring->index));
+        }
+    }
+    struct ystripes *ystripes = ystripes_load(&ring->ystripes);
+    ystripes_store(&ring2->ystripes, NULL);
+    if (ystripes) {
+        struct ystripes *ystripes2 = tg_malloc(ystripes->memsz);
+        if (!ystripes2) {
             tg_free(ring2);
             return NULL;
         }
-        memcpy(ring2->ystripes, ring->ystripes, ring->ystripes->memsz);
+        memcpy(ystripes2, ystripes, ystripes->memsz);
+        ystripes_store(&ring2->ystripes, ystripes2);
     }
     return ring2;
 }
@@ -14237,9 +16380,12 @@ struct tg_geom *tg_geom_copy(const struct tg_geom *geom) {
 /// Tests whether a geometry intersects a rect.
 /// @see GeometryPredicates
 bool tg_geom_intersects_rect(const struct tg_geom *a, struct tg_rect b) {
+    uint64_t start = slow_op_begin();
     struct tg_ring *ring = stack_ring();
     rect_to_ring(b, ring);
-    return tg_geom_intersects(a, (struct tg_geom*)ring);
+    bool hit = geom_intersects(a, (struct tg_geom*)ring);
+    slow_op_end(start, TG_OP_INTERSECTS_RECT, a, NULL, 0);
+    return hit;
 }
 
 static bool multi_index_search(const struct multi *multi, struct tg_rect rect,
@@ -14255,6 +16401,7 @@ static bool multi_index_search(const struct multi *multi, struct tg_rect rect,
         if (e > multi->ngeoms) {
             e = multi->ngeoms;
         }
+        stats_add(index_nodes, e-s);
         for (int i = s; i < e; i++) {
             int index = multi->ixgeoms[i];
             const struct tg_geom *child = multi->geoms[index];
@@ -14272,6 +16419,7 @@ static bool multi_index_search(const struct multi *multi, struct tg_rect rect,
         if (e > level->nrects) {
             e = level->nrects;
         }
+        stats_add(index_nodes, e-s);
         for (int i = s; i < e; i++) {
             struct tg_rect brect;
             ixrect_to_tg_rect(&level->rects[i], &brect);
@@ -14392,6 +16540,21 @@ geobin:
     return tg_parse_geobin_ix((uint8_t*)src, len, ix);
 }
 
+/// Parse data using the provided options.
+/// @param data Data
+/// @param len Length of data
+/// @param opts Options, or NULL for defaults
+/// @returns A geometry or an error. Use tg_geom_error() after parsing to check
+/// for errors.
+/// @see tg_parse_ix()
+/// @see tg_ring_new_opts()
+/// @see GeometryParsing
+struct tg_geom *tg_parse_opts(const void *data, size_t len, 
+    const struct tg_options *opts)
+{
+    return tg_parse_ix(data, len, opts_index(opts));
+}
+
 /// Utility for returning an error message wrapped in a geometry.
 /// This operation does not return a real geometry, only an error message,
 /// which may be useful for generating custom errors from operations 
@@ -14555,14 +16718,15 @@ invalid:
 struct tg_geom *tg_parse_geobin_ix(const uint8_t *geobin, size_t len,
     enum tg_index ix)
 {
+    uint64_t start = slow_op_begin();
     struct tg_geom *geom = NULL;
     parse_geobin(geobin, len, 0, 0, ix, &geom);
-    if (!geom) return NULL;
-    if ((geom->head.flags&IS_ERROR) == IS_ERROR) {
+    if (geom && (geom->head.flags&IS_ERROR) == IS_ERROR) {
         struct tg_geom *gerr = make_parse_error("ParseError: %s", geom->error);
         tg_geom_free(geom);
-        return gerr;
+        geom = gerr;
     }
+    slow_op_end(start, TG_OP_PARSE_GEOBIN, geom, NULL, len);
     return geom;
 }
 
@@ -14700,8 +16864,10 @@ static void write_geom_geobin(const struct tg_geom *geom, struct writer *wr) {
 /// @see GeometryWriting
 size_t tg_geom_geobin(const struct tg_geom *geom, uint8_t *dst, size_t n) {
     if (!geom) return 0;
+    uint64_t start = slow_op_begin();
     struct writer wr = { .dst = dst, .n = n };
     write_geom_geobin(geom, &wr);
+    slow_op_end(start, TG_OP_WRITE_GEOBIN, geom, NULL, wr.count);
     return wr.count;
 }
 
@@ -14892,3 +17058,2423 @@ struct tg_point tg_geobin_point(const uint8_t *geobin, size_t len) {
     }
     return point;
 }
+
+////////////////////////////////////////////////////////////////////////////////
+//  Overlay operations
+////////////////////////////////////////////////////////////////////////////////
+
+// The overlay operations (intersection, union, difference) work by noding the
+// rings of both operands against each other, using the tg_ring_ring_search
+// dual-index traversal to find the crossings. The noded edges are classified
+// as being inside, outside, or shared with the boundary of the other operand.
+// The edges that belong to the result are then linked back together into
+// rings and assembled into new indexed polygons.
+//
+// All rings are walked with the polygon interior on the left side, meaning
+// that exteriors are walked counter-clockwise and holes are walked clockwise.
+
+enum ovop {
+    OV_INTERSECTION,
+    OV_UNION,
+    OV_DIFFERENCE,
+};
+
+enum ovloc {
+    OV_OUT,
+    OV_IN,
+    OV_ON,
+};
+
+enum ovkind {
+    OV_KIND_OUT,      // edge is outside of the other operand
+    OV_KIND_IN,       // edge is inside of the other operand
+    OV_KIND_SAME,     // edge is shared, interiors on the same side
+    OV_KIND_OPPOSITE, // edge is shared, interiors on opposite sides
+    OV_KIND_SKIP,     // edge is shared and is represented by the other operand
+};
+
+struct ovring {
+    const struct tg_ring *ring;
+    int operand;  // 0 for 'a', 1 for 'b'
+    bool reverse; // walk backwards to keep the interior on the left
+};
+
+// ovsplit is a point where a ring segment needs to be split into two edges.
+struct ovsplit {
+    int ring;
+    int seg;
+    double t;  // position along the segment, 0.0 to 1.0
+    struct tg_point point;
+};
+
+struct ovedge {
+    struct tg_point a;
+    struct tg_point b;
+    int operand;
+    enum ovkind kind;
+};
+
+def_vec(struct ovrvec, struct ovring,   ovrvec_append, 8)
+def_vec(struct ovsvec, struct ovsplit,  ovsvec_append, 16)
+def_vec(struct ovevec, struct ovedge,   ovevec_append, 64)
+def_vec(struct ovpvec, struct tg_point, ovpvec_append, 16)
+
+struct ovoperand {
+    const struct tg_geom *geom;
+    int npolys;
+    int *rstart; // first ring of each polygon, has npolys+1 entries
+};
+
+struct overlay {
+    struct ovoperand ops[2];
+    struct ovrvec rings;
+    struct ovsvec splits;
+    struct ovevec edges;
+    bool oom;
+};
+
+static bool ov_polygonal(const struct tg_geom *geom) {
+    enum tg_geom_type type = tg_geom_typeof(geom);
+    return type == TG_POLYGON || type == TG_MULTIPOLYGON;
+}
+
+static int ov_num_polys(const struct tg_geom *geom) {
+    const struct multi *multi = geom_multi(geom);
+    if (multi) return multi->ngeoms;
+    return tg_geom_poly(geom) ? 1 : 0;
+}
+
+static const struct tg_poly *ov_poly_at(const struct tg_geom *geom, int index){
+    const struct multi *multi = geom_multi(geom);
+    if (multi) return tg_geom_poly(multi->geoms[index]);
+    return tg_geom_poly(geom);
+}
+
+// ov_search iterates over the polygons in geom that intersect rect, using the
+// multi index when available.
+static void ov_search(const struct tg_geom *geom, struct tg_rect rect,
+    bool (*iter)(const struct tg_geom *geom, int index, void *udata),
+    void *udata)
+{
+    if (geom_multi(geom)) {
+        tg_geom_search(geom, rect, iter, udata);
+    } else if (tg_rect_intersects_rect(tg_geom_rect(geom), rect)) {
+        iter(geom, 0, udata);
+    }
+}
+
+static double ov_orient(struct tg_point a, struct tg_point b, 
+    struct tg_point c)
+{
+    return (b.x-a.x)*(c.y-a.y) - (b.y-a.y)*(c.x-a.x);
+}
+
+static int ov_point_compare(struct tg_point a, struct tg_point b) {
+    return a.x < b.x ? -1 : a.x > b.x ? 1 : a.y < b.y ? -1 : a.y > b.y;
+}
+
+static enum ovloc ov_poly_locate(const struct tg_poly *poly, 
+    struct tg_point point)
+{
+    if (tg_poly_empty(poly)) return OV_OUT;
+    struct ring_result res = tg_ring_contains_point(tg_poly_exterior(poly),
+        point, true);
+    if (res.idx != -1) return OV_ON;
+    if (!res.hit) return OV_OUT;
+    int nholes = tg_poly_num_holes(poly);
+    for (int i = 0; i < nholes; i++) {
+        res = tg_ring_contains_point(tg_poly_hole_at(poly, i), point, true);
+        if (res.idx != -1) return OV_ON;
+        if (res.hit) return OV_OUT;
+    }
+    return OV_IN;
+}
+
+struct ovlocate_ctx {
+    struct tg_point point;
+    enum ovloc loc;
+};
+
+static bool ov_locate_iter(const struct tg_geom *child, int index, 
+    void *udata)
+{
+    (void)index;
+    struct ovlocate_ctx *ctx = udata;
+    ctx->loc = ov_poly_locate(tg_geom_poly(child), ctx->point);
+    return ctx->loc == OV_OUT;
+}
+
+// ov_locate returns the location of a point relative to a polygonal geometry.
+static enum ovloc ov_locate(const struct tg_geom *geom, struct tg_point point){
+    struct ovlocate_ctx ctx = { .point = point, .loc = OV_OUT };
+    ov_search(geom, (struct tg_rect){ point, point }, ov_locate_iter, &ctx);
+    return ctx.loc;
+}
+
+static bool ov_add_ring(struct overlay *ov, int operand, 
+    const struct tg_ring *ring, bool hole)
+{
+    if (tg_ring_empty(ring) || ring->area == 0) {
+        return true;
+    }
+    struct ovring ovring = {
+        .ring = ring,
+        .operand = operand,
+        .reverse = ring->clockwise != hole,
+    };
+    return ovrvec_append(&ov->rings, ovring);
+}
+
+static bool ov_add_operand(struct overlay *ov, int operand, 
+    const struct tg_geom *geom)
+{
+    struct ovoperand *op = &ov->ops[operand];
+    op->geom = geom;
+    op->npolys = ov_num_polys(geom);
+    op->rstart = tg_malloc(sizeof(int)*(op->npolys+1));
+    if (!op->rstart) {
+        return false;
+    }
+    for (int i = 0; i < op->npolys; i++) {
+        op->rstart[i] = ov->rings.len;
+        const struct tg_poly *poly = ov_poly_at(geom, i);
+        if (tg_poly_empty(poly)) {
+            continue;
+        }
+        if (!ov_add_ring(ov, operand, tg_poly_exterior(poly), false)) {
+            return false;
+        }
+        int nholes = tg_poly_num_holes(poly);
+        for (int j = 0; j < nholes; j++) {
+            if (!ov_add_ring(ov, operand, tg_poly_hole_at(poly, j), true)) {
+                return false;
+            }
+        }
+    }
+    op->rstart[op->npolys] = ov->rings.len;
+    return true;
+}
+
+static void ov_split(struct overlay *ov, int ring, int seg, 
+    struct tg_segment s, struct tg_point point)
+{
+    if (ov->oom || pteq(point, s.a) || pteq(point, s.b)) {
+        return;
+    }
+    double dx = s.b.x - s.a.x;
+    double dy = s.b.y - s.a.y;
+    double t = ((point.x-s.a.x)*dx + (point.y-s.a.y)*dy) / (dx*dx + dy*dy);
+    if (!(t > 0 && t < 1)) {
+        return;
+    }
+    struct ovsplit split = { .ring = ring, .seg = seg, .t = t, .point = point };
+    if (!ovsvec_append(&ov->splits, split)) {
+        ov->oom = true;
+    }
+}
+
+struct ovnode_ctx {
+    struct overlay *ov;
+    int bpoly;
+    int aring;
+    int bring;
+};
+
+static bool ov_node_iter(struct tg_segment a, int aidx, struct tg_segment b, 
+    int bidx, void *udata)
+{
+    struct ovnode_ctx *ctx = udata;
+    struct overlay *ov = ctx->ov;
+    double d1 = ov_orient(b.a, b.b, a.a);
+    double d2 = ov_orient(b.a, b.b, a.b);
+    double d3 = ov_orient(a.a, a.b, b.a);
+    double d4 = ov_orient(a.a, a.b, b.b);
+    if (d1 == 0 || d2 == 0 || d3 == 0 || d4 == 0) {
+        // Touching or collinear segments. Split each segment where a vertex 
+        // of the other segment lands on it.
+        struct tg_rect arect = tg_segment_rect(a);
+        struct tg_rect brect = tg_segment_rect(b);
+        if (d1 == 0 && tg_rect_covers_point(brect, a.a)) {
+            ov_split(ov, ctx->bring, bidx, b, a.a);
+        }
+        if (d2 == 0 && tg_rect_covers_point(brect, a.b)) {
+            ov_split(ov, ctx->bring, bidx, b, a.b);
+        }
+        if (d3 == 0 && tg_rect_covers_point(arect, b.a)) {
+            ov_split(ov, ctx->aring, aidx, a, b.a);
+        }
+        if (d4 == 0 && tg_rect_covers_point(arect, b.b)) {
+            ov_split(ov, ctx->aring, aidx, a, b.b);
+        }
+    } else if ((d1 < 0) != (d2 < 0) && (d3 < 0) != (d4 < 0)) {
+        // Proper crossing. Both segments are split at the same computed 
+        // point, which is kept inside of the common bounds of the segments.
+        double t = d1 / (d1 - d2);
+        struct tg_point point = {
+            a.a.x + (a.b.x - a.a.x) * t,
+            a.a.y + (a.b.y - a.a.y) * t,
+        };
+        point.x = fclamp0(point.x, 
+            fmax0(fmin0(a.a.x, a.b.x), fmin0(b.a.x, b.b.x)),
+            fmin0(fmax0(a.a.x, a.b.x), fmax0(b.a.x, b.b.x)));
+        point.y = fclamp0(point.y, 
+            fmax0(fmin0(a.a.y, a.b.y), fmin0(b.a.y, b.b.y)),
+            fmin0(fmax0(a.a.y, a.b.y), fmax0(b.a.y, b.b.y)));
+        ov_split(ov, ctx->aring, aidx, a, point);
+        ov_split(ov, ctx->bring, bidx, b, point);
+    }
+    return !ov->oom;
+}
+
+static bool ov_node_poly_iter(const struct tg_geom *child, int index, 
+    void *udata)
+{
+    (void)child;
+    struct ovnode_ctx *ctx = udata;
+    struct overlay *ov = ctx->ov;
+    const struct ovoperand *opa = &ov->ops[0];
+    const struct ovoperand *opb = &ov->ops[1];
+    for (int i = opa->rstart[index]; i < opa->rstart[index+1]; i++) {
+        for (int j = opb->rstart[ctx->bpoly]; j < opb->rstart[ctx->bpoly+1];
+            j++)
+        {
+            ctx->aring = i;
+            ctx->bring = j;
+            tg_ring_ring_search(ov->rings.data[i].ring, 
+                ov->rings.data[j].ring, ov_node_iter, ctx);
+            if (ov->oom) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// ov_node finds all of the places where the rings of 'a' and 'b' cross or
+// touch. The polygons of 'a' are found using the multi index, if available,
+// and the ring segments using the dual-index traversal.
+static bool ov_node(struct overlay *ov) {
+    struct ovnode_ctx ctx = { .ov = ov };
+    const struct ovoperand *opb = &ov->ops[1];
+    for (int i = 0; i < opb->npolys; i++) {
+        const struct tg_poly *poly = ov_poly_at(opb->geom, i);
+        if (tg_poly_empty(poly)) {
+            continue;
+        }
+        ctx.bpoly = i;
+        ov_search(ov->ops[0].geom, tg_poly_rect(poly), ov_node_poly_iter, 
+            &ctx);
+        if (ov->oom) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int ov_split_compare(const void *a, const void *b) {
+    const struct ovsplit *sa = a;
+    const struct ovsplit *sb = b;
+    if (sa->ring != sb->ring) return sa->ring < sb->ring ? -1 : 1;
+    if (sa->seg != sb->seg) return sa->seg < sb->seg ? -1 : 1;
+    return sa->t < sb->t ? -1 : sa->t > sb->t;
+}
+
+static bool ov_add_edge(struct overlay *ov, const struct ovring *ring,
+    struct tg_point a, struct tg_point b)
+{
+    if (pteq(a, b)) {
+        return true;
+    }
+    struct ovedge edge = {
+        .a = ring->reverse ? b : a,
+        .b = ring->reverse ? a : b,
+        .operand = ring->operand,
+    };
+    return ovevec_append(&ov->edges, edge);
+}
+
+// ov_build_edges breaks every ring segment at its split points.
+static bool ov_build_edges(struct overlay *ov) {
+    struct ovsplit *splits = ov->splits.data;
+    size_t nsplits = ov->splits.len;
+    if (nsplits > 1) {
+        qsort(splits, nsplits, sizeof(struct ovsplit), ov_split_compare);
+    }
+    size_t k = 0;
+    for (size_t r = 0; r < ov->rings.len; r++) {
+        const struct ovring *ring = &ov->rings.data[r];
+        const struct tg_point *points = ring->ring->points;
+        for (int i = 0; i < ring->ring->nsegs; i++) {
+            struct tg_point prev = points[i];
+            while (k < nsplits && splits[k].ring == (int)r && 
+                splits[k].seg == i)
+            {
+                if (!ov_add_edge(ov, ring, prev, splits[k].point)) {
+                    return false;
+                }
+                prev = splits[k].point;
+                k++;
+            }
+            if (!ov_add_edge(ov, ring, prev, points[i+1])) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static void ov_edge_key(const struct ovedge *edge, struct tg_point *lo, 
+    struct tg_point *hi)
+{
+    bool swap = ov_point_compare(edge->a, edge->b) > 0;
+    *lo = swap ? edge->b : edge->a;
+    *hi = swap ? edge->a : edge->b;
+}
+
+static int ov_edge_compare(const void *a, const void *b) {
+    const struct ovedge *ea = a;
+    const struct ovedge *eb = b;
+    struct tg_point alo, ahi, blo, bhi;
+    ov_edge_key(ea, &alo, &ahi);
+    ov_edge_key(eb, &blo, &bhi);
+    int cmp = ov_point_compare(alo, blo);
+    if (cmp == 0) cmp = ov_point_compare(ahi, bhi);
+    if (cmp == 0) cmp = ea->operand < eb->operand ? -1 : 
+        ea->operand > eb->operand;
+    return cmp;
+}
+
+static enum ovkind ov_classify_edge(const struct overlay *ov, 
+    const struct ovedge *edge)
+{
+    const struct tg_geom *other = ov->ops[!edge->operand].geom;
+    struct tg_point mid = {
+        (edge->a.x + edge->b.x) / 2,
+        (edge->a.y + edge->b.y) / 2,
+    };
+    switch (ov_locate(other, mid)) {
+    case OV_IN:
+        return OV_KIND_IN;
+    case OV_OUT:
+        return OV_KIND_OUT;
+    case OV_ON:
+        break;
+    }
+    // The edge lies on the boundary of the other operand, but was not matched
+    // to one of its edges. Probe the left side of the edge to see which way
+    // the other interior faces.
+    if (edge->operand == 1) {
+        return OV_KIND_SKIP;
+    }
+    double dx = edge->b.x - edge->a.x;
+    double dy = edge->b.y - edge->a.y;
+    double eps = 1e-7;
+    struct tg_point left = { mid.x - dy*eps, mid.y + dx*eps };
+    return ov_locate(other, left) == OV_IN ? OV_KIND_SAME : OV_KIND_OPPOSITE;
+}
+
+// ov_classify_edges sets the kind of every edge. Edges that are shared by 
+// both operands are matched up by sorting, everything else is located 
+// against the other operand using its midpoint.
+static void ov_classify_edges(struct overlay *ov) {
+    struct ovedge *edges = ov->edges.data;
+    size_t nedges = ov->edges.len;
+    if (nedges > 1) {
+        qsort(edges, nedges, sizeof(struct ovedge), ov_edge_compare);
+    }
+    size_t i = 0;
+    while (i < nedges) {
+        struct tg_point lo, hi;
+        ov_edge_key(&edges[i], &lo, &hi);
+        size_t j = i+1;
+        while (j < nedges) {
+            struct tg_point lo2, hi2;
+            ov_edge_key(&edges[j], &lo2, &hi2);
+            if (!pteq(lo, lo2) || !pteq(hi, hi2)) break;
+            j++;
+        }
+        if (edges[i].operand == 0 && edges[j-1].operand == 1) {
+            // shared edge
+            struct tg_point ba = edges[j-1].a;
+            for (size_t k = i; k < j; k++) {
+                if (edges[k].operand == 0) {
+                    edges[k].kind = pteq(edges[k].a, ba) ? OV_KIND_SAME : 
+                        OV_KIND_OPPOSITE;
+                } else {
+                    edges[k].kind = OV_KIND_SKIP;
+                }
+            }
+        } else {
+            for (size_t k = i; k < j; k++) {
+                edges[k].kind = ov_classify_edge(ov, &edges[k]);
+            }
+        }
+        i = j;
+    }
+}
+
+static bool ov_keep_edge(enum ovop op, struct ovedge *edge) {
+    bool a = edge->operand == 0;
+    switch (op) {
+    case OV_INTERSECTION:
+        return edge->kind == OV_KIND_IN || (a && edge->kind == OV_KIND_SAME);
+    case OV_UNION:
+        return edge->kind == OV_KIND_OUT || (a && edge->kind == OV_KIND_SAME);
+    case OV_DIFFERENCE:
+        if (a) {
+            return edge->kind == OV_KIND_OUT || edge->kind == OV_KIND_OPPOSITE;
+        }
+        if (edge->kind == OV_KIND_IN) {
+            // holes punched into 'a' by 'b' are walked backwards
+            struct tg_point tmp = edge->a;
+            edge->a = edge->b;
+            edge->b = tmp;
+            return true;
+        }
+        return false;
+    }
+    return false;
+}
+
+static int ov_edge_start_compare(const void *a, const void *b) {
+    const struct ovedge *ea = a;
+    const struct ovedge *eb = b;
+    return ov_point_compare(ea->a, eb->a);
+}
+
+// ov_next_edge returns the edge that follows the provided edge in its ring.
+// When more than one edge leaves the same vertex, the one that forms the
+// tightest turn is chosen, which splits rings that touch at a single vertex.
+static int ov_next_edge(const struct ovedge *edges, int nedges, int e) {
+    struct tg_point node = edges[e].b;
+    int lo = 0;
+    int hi = nedges;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (ov_point_compare(edges[mid].a, node) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    double back = atan2(edges[e].a.y - node.y, edges[e].a.x - node.x);
+    int best = -1;
+    double best_sweep = 0;
+    for (int i = lo; i < nedges && pteq(edges[i].a, node); i++) {
+        double out = atan2(edges[i].b.y - node.y, edges[i].b.x - node.x);
+        double sweep = back - out;
+        if (sweep <= 0) sweep += 2 * M_PI;
+        if (best == -1 || sweep < best_sweep) {
+            best = i;
+            best_sweep = sweep;
+        }
+    }
+    return best;
+}
+
+// ov_ring_new creates an indexed ring from the open points series, dropping
+// any vertices that sit in the middle of a straight run.
+static struct tg_ring *ov_ring_new(struct tg_point *points, int npoints,
+    bool *oom)
+{
+    int n = 0;
+    for (int i = 0; i < npoints; i++) {
+        struct tg_point prev = n > 0 ? points[n-1] : points[npoints-1];
+        struct tg_point point = points[i];
+        struct tg_point next = points[(i+1)%npoints];
+        if (ov_orient(prev, point, next) == 0 &&
+            (point.x-prev.x)*(next.x-point.x) + 
+            (point.y-prev.y)*(next.y-point.y) > 0)
+        {
+            continue;
+        }
+        points[n++] = point;
+    }
+    if (n < 3) {
+        return NULL;
+    }
+    points[n++] = points[0];
+    struct tg_ring *ring = tg_ring_new_ix(points, n, TG_DEFAULT);
+    if (!ring) {
+        *oom = true;
+    } else if (ring->area == 0) {
+        tg_ring_free(ring);
+        ring = NULL;
+    }
+    return ring;
+}
+
+// ov_link_rings links the kept edges into closed rings, which are sorted into
+// shells (counter-clockwise) and holes (clockwise).
+static bool ov_link_rings(struct ovedge *edges, int nedges, 
+    struct rvec *shells, struct rvec *holes)
+{
+    bool ok = false;
+    struct ovpvec points = { 0 };
+    int *next = tg_malloc(sizeof(int)*(nedges+1));
+    bool *visited = tg_malloc(sizeof(bool)*(nedges+1));
+    if (!next || !visited) {
+        goto done;
+    }
+    if (nedges > 1) {
+        qsort(edges, nedges, sizeof(struct ovedge), ov_edge_start_compare);
+    }
+    for (int i = 0; i < nedges; i++) {
+        next[i] = ov_next_edge(edges, nedges, i);
+        visited[i] = false;
+    }
+    for (int i = 0; i < nedges; i++) {
+        if (visited[i]) {
+            continue;
+        }
+        points.len = 0;
+        bool closed = false;
+        int e = i;
+        while (1) {
+            visited[e] = true;
+            if (!ovpvec_append(&points, edges[e].a)) {
+                goto done;
+            }
+            e = next[e];
+            if (e == i) {
+                closed = true;
+                break;
+            }
+            if (e == -1 || visited[e]) {
+                break;
+            }
+        }
+        if (!closed) {
+            continue;
+        }
+        // make room for the closing point
+        if (!ovpvec_append(&points, points.data[0])) {
+            goto done;
+        }
+        bool oom = false;
+        struct tg_ring *ring = ov_ring_new(points.data, points.len-1, &oom);
+        if (oom) {
+            goto done;
+        }
+        if (ring) {
+            if (!rvec_append(ring->clockwise ? holes : shells, ring)) {
+                tg_ring_free(ring);
+                goto done;
+            }
+        }
+    }
+    ok = true;
+done:
+    if (points.data) tg_free(points.data);
+    if (next) tg_free(next);
+    if (visited) tg_free(visited);
+    return ok;
+}
+
+static bool ov_ring_inside_ring(const struct tg_ring *shell, 
+    const struct tg_ring *hole)
+{
+    if (!tg_rect_covers_rect(shell->rect, hole->rect)) {
+        return false;
+    }
+    for (int i = 0; i < hole->npoints; i++) {
+        struct ring_result res = tg_ring_contains_point(shell, 
+            hole->points[i], true);
+        if (res.idx == -1) {
+            return res.hit;
+        }
+    }
+    return true;
+}
+
+static int ov_ring_area_compare(const void *a, const void *b) {
+    double area_a = (*(struct tg_ring**)a)->area;
+    double area_b = (*(struct tg_ring**)b)->area;
+    return area_a < area_b ? -1 : area_a > area_b;
+}
+
+struct ovhole {
+    int shell;
+    struct tg_ring *ring;
+};
+
+static int ov_hole_compare(const void *a, const void *b) {
+    const struct ovhole *ha = a;
+    const struct ovhole *hb = b;
+    return ha->shell < hb->shell ? -1 : ha->shell > hb->shell;
+}
+
+static struct tg_geom *ov_polys_to_geom(struct tg_poly **polys, int npolys) {
+    if (npolys == 0) {
+        return tg_geom_new_polygon_empty();
+    } else if (npolys == 1) {
+        return tg_geom_new_polygon(polys[0]);
+    } else {
+        return tg_geom_new_multipolygon((const struct tg_poly*const*)polys,
+            npolys);
+    }
+}
+
+// ov_assemble assigns each hole to the smallest shell that contains it, and
+// returns the final polygonal geometry.
+static struct tg_geom *ov_assemble(struct rvec *shells, struct rvec *holes) {
+    struct tg_geom *geom = NULL;
+    struct pvec polys = { 0 };
+    struct ovhole *ovholes = NULL;
+    const struct tg_ring **poly_holes = NULL;
+    if (shells->len > 1) {
+        qsort(shells->data, shells->len, sizeof(struct tg_ring*), 
+            ov_ring_area_compare);
+    }
+    size_t nholes = 0;
+    if (holes->len > 0) {
+        ovholes = tg_malloc(sizeof(struct ovhole)*holes->len);
+        poly_holes = tg_malloc(sizeof(struct tg_ring*)*holes->len);
+        if (!ovholes || !poly_holes) {
+            goto done;
+        }
+        for (size_t i = 0; i < holes->len; i++) {
+            for (size_t j = 0; j < shells->len; j++) {
+                if (ov_ring_inside_ring(shells->data[j], holes->data[i])) {
+                    ovholes[nholes].shell = j;
+                    ovholes[nholes].ring = holes->data[i];
+                    nholes++;
+                    break;
+                }
+            }
+        }
+        if (nholes > 1) {
+            qsort(ovholes, nholes, sizeof(struct ovhole), ov_hole_compare);
+        }
+    }
+    size_t k = 0;
+    for (size_t i = 0; i < shells->len; i++) {
+        int n = 0;
+        while (k < nholes && ovholes[k].shell == (int)i) {
+            poly_holes[n++] = ovholes[k].ring;
+            k++;
+        }
+        struct tg_poly *poly = tg_poly_new(shells->data[i], poly_holes, n);
+        if (!poly) {
+            goto done;
+        }
+        if (!pvec_append(&polys, poly)) {
+            tg_poly_free(poly);
+            goto done;
+        }
+    }
+    geom = ov_polys_to_geom(polys.data, polys.len);
+done:
+    for (size_t i = 0; i < polys.len; i++) {
+        tg_poly_free(polys.data[i]);
+    }
+    if (polys.data) tg_free(polys.data);
+    if (ovholes) tg_free(ovholes);
+    if (poly_holes) tg_free(poly_holes);
+    return geom;
+}
+
+// ov_combine returns all the polygons of 'a' and 'b' in a single geometry,
+// for when the two do not interact.
+static struct tg_geom *ov_combine(const struct tg_geom *a, 
+    const struct tg_geom *b)
+{
+    const struct tg_geom *geoms[] = { a, b };
+    int npolys = ov_num_polys(a) + ov_num_polys(b);
+    struct tg_poly **polys = tg_malloc(sizeof(struct tg_poly*)*(npolys+1));
+    if (!polys) {
+        return NULL;
+    }
+    int n = 0;
+    for (int i = 0; i < 2; i++) {
+        int count = ov_num_polys(geoms[i]);
+        for (int j = 0; j < count; j++) {
+            const struct tg_poly *poly = ov_poly_at(geoms[i], j);
+            if (!tg_poly_empty(poly)) {
+                polys[n++] = (struct tg_poly*)poly;
+            }
+        }
+    }
+    struct tg_geom *geom = ov_polys_to_geom(polys, n);
+    tg_free(polys);
+    return geom;
+}
+
+static struct tg_geom *geom_overlay(const struct tg_geom *a, 
+    const struct tg_geom *b, enum ovop op)
+{
+    if (tg_geom_error(a)) return tg_geom_clone(a);
+    if (tg_geom_error(b)) return tg_geom_clone(b);
+    if ((a && !ov_polygonal(a)) || (b && !ov_polygonal(b))) {
+        return tg_geom_new_error(
+            "overlay requires Polygon or MultiPolygon geometries");
+    }
+    bool aempty = tg_geom_is_empty(a);
+    bool bempty = tg_geom_is_empty(b);
+    if (aempty || bempty || 
+        !tg_rect_intersects_rect(tg_geom_rect(a), tg_geom_rect(b)))
+    {
+        // The geometries do not interact.
+        switch (op) {
+        case OV_INTERSECTION:
+            return tg_geom_new_polygon_empty();
+        case OV_UNION:
+            return ov_combine(aempty ? NULL : a, bempty ? NULL : b);
+        case OV_DIFFERENCE:
+            return ov_combine(aempty ? NULL : a, NULL);
+        }
+    }
+    struct tg_geom *geom = NULL;
+    struct overlay ov = { 0 };
+    struct rvec shells = { 0 };
+    struct rvec holes = { 0 };
+    if (!ov_add_operand(&ov, 0, a) || !ov_add_operand(&ov, 1, b) ||
+        !ov_node(&ov) || !ov_build_edges(&ov))
+    {
+        goto done;
+    }
+    ov_classify_edges(&ov);
+    int nedges = 0;
+    for (size_t i = 0; i < ov.edges.len; i++) {
+        if (ov_keep_edge(op, &ov.edges.data[i])) {
+            ov.edges.data[nedges++] = ov.edges.data[i];
+        }
+    }
+    if (!ov_link_rings(ov.edges.data, nedges, &shells, &holes)) {
+        goto done;
+    }
+    geom = ov_assemble(&shells, &holes);
+done:
+    for (size_t i = 0; i < shells.len; i++) {
+        tg_ring_free(shells.data[i]);
+    }
+    for (size_t i = 0; i < holes.len; i++) {
+        tg_ring_free(holes.data[i]);
+    }
+    if (shells.data) tg_free(shells.data);
+    if (holes.data) tg_free(holes.data);
+    if (ov.ops[0].rstart) tg_free(ov.ops[0].rstart);
+    if (ov.ops[1].rstart) tg_free(ov.ops[1].rstart);
+    if (ov.rings.data) tg_free(ov.rings.data);
+    if (ov.splits.data) tg_free(ov.splits.data);
+    if (ov.edges.data) tg_free(ov.edges.data);
+    return geom;
+}
+
+/// Returns the intersection of two polygonal geometries.
+/// @param a Input geometry, a Polygon or MultiPolygon
+/// @param b Input geometry, a Polygon or MultiPolygon
+/// @return A newly allocated Polygon or MultiPolygon geometry. An empty 
+/// intersection is returned as an empty Polygon.
+/// @return NULL if system is out of memory.
+/// @return An error geometry when either input is not polygonal. Use 
+/// tg_geom_error() to check for errors.
+/// @note The caller is responsible for freeing with tg_geom_free().
+/// @note The rings of the result are indexed using the default index.
+/// @note Z and M coordinates are not carried over to the result.
+/// @see GeometryOverlay
+struct tg_geom *tg_geom_intersection(const struct tg_geom *a,
+    const struct tg_geom *b)
+{
+    return geom_overlay(a, b, OV_INTERSECTION);
+}
+
+/// Returns the union of two polygonal geometries.
+/// @param a Input geometry, a Polygon or MultiPolygon
+/// @param b Input geometry, a Polygon or MultiPolygon
+/// @return A newly allocated Polygon or MultiPolygon geometry.
+/// @return NULL if system is out of memory.
+/// @return An error geometry when either input is not polygonal. Use 
+/// tg_geom_error() to check for errors.
+/// @note The caller is responsible for freeing with tg_geom_free().
+/// @note The rings of the result are indexed using the default index.
+/// @note Z and M coordinates are not carried over to the result.
+/// @see tg_geom_cascaded_union()
+/// @see GeometryOverlay
+struct tg_geom *tg_geom_union(const struct tg_geom *a, 
+    const struct tg_geom *b)
+{
+    return geom_overlay(a, b, OV_UNION);
+}
+
+/// Returns the part of geometry 'a' that does not intersect geometry 'b'.
+/// @param a Input geometry, a Polygon or MultiPolygon
+/// @param b Input geometry, a Polygon or MultiPolygon
+/// @return A newly allocated Polygon or MultiPolygon geometry. An empty 
+/// difference is returned as an empty Polygon.
+/// @return NULL if system is out of memory.
+/// @return An error geometry when either input is not polygonal. Use 
+/// tg_geom_error() to check for errors.
+/// @note The caller is responsible for freeing with tg_geom_free().
+/// @note The rings of the result are indexed using the default index.
+/// @note Z and M coordinates are not carried over to the result.
+/// @see GeometryOverlay
+struct tg_geom *tg_geom_difference(const struct tg_geom *a, 
+    const struct tg_geom *b)
+{
+    return geom_overlay(a, b, OV_DIFFERENCE);
+}
+
+static bool ov_polygonal_deep(const struct tg_geom *geom) {
+    if (tg_geom_typeof(geom) == TG_GEOMETRYCOLLECTION) {
+        int ngeoms = tg_geom_num_geometries(geom);
+        for (int i = 0; i < ngeoms; i++) {
+            if (!ov_polygonal_deep(tg_geom_geometry_at(geom, i))) {
+                return false;
+            }
+        }
+        return true;
+    }
+    return ov_polygonal(geom) || tg_geom_is_empty(geom);
+}
+
+static bool ov_gather_polys(const struct tg_geom *geom, struct pvec *polys) {
+    if (tg_geom_typeof(geom) == TG_GEOMETRYCOLLECTION) {
+        int ngeoms = tg_geom_num_geometries(geom);
+        for (int i = 0; i < ngeoms; i++) {
+            if (!ov_gather_polys(tg_geom_geometry_at(geom, i), polys)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    if (!ov_polygonal(geom)) {
+        return true;
+    }
+    int npolys = ov_num_polys(geom);
+    for (int i = 0; i < npolys; i++) {
+        const struct tg_poly *poly = ov_poly_at(geom, i);
+        if (!tg_poly_empty(poly)) {
+            if (!pvec_append(polys, (struct tg_poly*)poly)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// ov_order_polys puts the polygons into hilbert order so that neighbors are
+// merged first. A MultiPolygon with a multi index is already in that order.
+static bool ov_order_polys(const struct tg_geom *geom, struct pvec *polys) {
+    const struct multi *multi = geom_multi(geom);
+    if (multi && multi->index && tg_geom_typeof(geom) == TG_MULTIPOLYGON &&
+        polys->len == (size_t)multi->ngeoms)
+    {
+        for (int i = 0; i < multi->ngeoms; i++) {
+            polys->data[i] = (struct tg_poly*)multi->geoms[multi->ixgeoms[i]];
+        }
+        return true;
+    }
+    struct tg_rect rect = tg_geom_rect(geom);
+    if (polys->len < 3 || !(rect.max.x > rect.min.x) || 
+        !(rect.max.y > rect.min.y))
+    {
+        return true;
+    }
+    struct hildex *hildexes = tg_malloc(sizeof(struct hildex)*polys->len);
+    struct tg_poly **sorted = tg_malloc(sizeof(struct tg_poly*)*polys->len);
+    if (!hildexes || !sorted) {
+        if (hildexes) tg_free(hildexes);
+        if (sorted) tg_free(sorted);
+        return false;
+    }
+    for (size_t i = 0; i < polys->len; i++) {
+        struct tg_point center = tg_rect_center(tg_poly_rect(polys->data[i]));
+        hildexes[i].index = i;
+        hildexes[i].hilbert = tg_point_hilbert(center, rect);
+    }
+    qsort(hildexes, polys->len, sizeof(struct hildex), hilsort);
+    for (size_t i = 0; i < polys->len; i++) {
+        sorted[i] = polys->data[hildexes[i].index];
+    }
+    memcpy(polys->data, sorted, sizeof(struct tg_poly*)*polys->len);
+    tg_free(hildexes);
+    tg_free(sorted);
+    return true;
+}
+
+/// Returns the union of all polygons in a collection.
+/// 
+/// This is a cascaded union. The polygons are put into the order of the 
+/// collection's multi index (or hilbert order when there is no index), and
+/// neighbors are merged pairwise, level by level, until one geometry remains.
+/// This keeps the intermediate geometries small and mostly disjoint from each 
+/// other, which is much faster than merging one polygon at a time.
+/// @param geom Input geometry, a Polygon, MultiPolygon, or GeometryCollection
+/// of polygonal geometries.
+/// @return A newly allocated Polygon or MultiPolygon geometry.
+/// @return NULL if system is out of memory.
+/// @return An error geometry when the input is not polygonal. Use 
+/// tg_geom_error() to check for errors.
+/// @note The caller is responsible for freeing with tg_geom_free().
+/// @note The rings of the result are indexed using the default index.
+/// @see tg_geom_union()
+/// @see GeometryOverlay
+struct tg_geom *tg_geom_cascaded_union(const struct tg_geom *geom) {
+    if (tg_geom_error(geom)) return tg_geom_clone(geom);
+    if (geom && !ov_polygonal_deep(geom)) {
+        return tg_geom_new_error(
+            "overlay requires Polygon or MultiPolygon geometries");
+    }
+    struct tg_geom *result = NULL;
+    struct pvec polys = { 0 };
+    struct tg_geom **geoms = NULL;
+    int ngeoms = 0;
+    if (!ov_gather_polys(geom, &polys) || !ov_order_polys(geom, &polys)) {
+        goto done;
+    }
+    if (polys.len == 0) {
+        result = tg_geom_new_polygon_empty();
+        goto done;
+    }
+    geoms = tg_malloc(sizeof(struct tg_geom*)*polys.len);
+    if (!geoms) {
+        goto done;
+    }
+    for (size_t i = 0; i < polys.len; i++) {
+        geoms[ngeoms] = tg_geom_new_polygon(polys.data[i]);
+        if (!geoms[ngeoms]) {
+            goto done;
+        }
+        ngeoms++;
+    }
+    while (ngeoms > 1) {
+        int n = 0;
+        for (int i = 0; i < ngeoms; i += 2) {
+            if (i+1 == ngeoms) {
+                geoms[n++] = geoms[i];
+                continue;
+            }
+            struct tg_geom *merged = tg_geom_union(geoms[i], geoms[i+1]);
+            if (!merged) {
+                // free the remaining geometries
+                for (int j = 0; j < n; j++) {
+                    tg_geom_free(geoms[j]);
+                }
+                for (int j = i; j < ngeoms; j++) {
+                    tg_geom_free(geoms[j]);
+                }
+                ngeoms = 0;
+                goto done;
+            }
+            tg_geom_free(geoms[i]);
+            tg_geom_free(geoms[i+1]);
+            geoms[n++] = merged;
+        }
+        ngeoms = n;
+    }
+    result = geoms[0];
+    ngeoms = 0;
+done:
+    for (int i = 0; i < ngeoms; i++) {
+        tg_geom_free(geoms[i]);
+    }
+    if (geoms) tg_free(geoms);
+    if (polys.data) tg_free(polys.data);
+    return result;
+}
+
+////////////////////
+// Batch predicates
+////////////////////
+
+// Batch operations split the input into one contiguous range per thread. Each
+// thread claims small chunks from its own range and, once that is exhausted,
+// steals chunks from the ranges of the other threads. This keeps the threads
+// busy when the work is skewed, such as when most of the points are clustered
+// around the complex parts of a polygon.
+//
+// The threads are kept in a small pool that is started on first use and
+// lives for the duration of the program. The calling thread always takes
+// part in the work. Providing TG_NOTHREADS to the compiler will disable the
+// pool and all batches run on the calling thread.
+//
+// Only one batch uses the pool at a time. A batch that starts while the pool
+// is busy, such as one started by another thread or one started from inside
+// the work of another batch, runs on its calling thread instead of waiting.
+// A child process made with fork() starts its own pool on its first batch.
+
+#if !defined(TG_NOTHREADS) && !defined(TG_NOATOMICS) && !defined(_WIN32) && \
+    !defined(__EMSCRIPTEN__)
+#define TG_THREADS
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#define BATCH_MAXTHREADS 64  // maximum number of threads for a batch
+#define BATCH_CHUNK      64  // number of items claimed at a time
+#define BATCH_MINPOINTS  4096 // fewer points are processed on calling thread
+#define BATCH_MINGEOMS   256  // fewer geoms are processed on calling thread
+
+static int batch_threads = 0;
+
+/// Set the number of threads used by the batch predicates.
+///
+/// Default is zero, which uses one thread per online processor, up to 64.
+/// Use 1 to process all batches on the calling thread.
+/// @see tg_batch_covers_xy()
+/// @see tg_batch_intersects()
+/// @see tg_join()
+/// @see GlobalFuncs
+void tg_env_set_batch_threads(int nthreads) {
+    if (nthreads >= 0) {
+        batch_threads = nthreads > BATCH_MAXTHREADS ? 
+            BATCH_MAXTHREADS : nthreads;
+    }
+}
+
+struct batch_range {
+    aint_t next;  // next unclaimed item
+    int end;
+    char pad[56]; // keep each range on its own cache line
+};
+
+struct batch {
+    void (*work)(struct batch *batch, int start, int end);
+    const struct tg_geom *geom;
+    const struct tg_locator *locator;
+    bool (*pred)(const struct tg_geom *a, const struct tg_geom *b);
+    const struct tg_geom *const *ageoms;
+    const struct tg_geom *const *bgeoms;
+    const void *items;
+    bool *results;
+    int *indexes;
+    int nranges;
+    void *(*malloc)(size_t);        // allocator of the calling thread
+    void *(*realloc)(void*, size_t);
+    void (*free)(void*);
+    struct batch_range ranges[BATCH_MAXTHREADS];
+};
+
+#ifdef TG_THREADS
+
+static bool batch_claim(struct batch_range *range, int *start, int *end) {
+    if (aint_load(&range->next) >= range->end) {
+        return false;
+    }
+    *start = aint_fetch_add(&range->next, BATCH_CHUNK);
+    if (*start >= range->end) {
+        return false;
+    }
+    *end = *start+BATCH_CHUNK < range->end ? *start+BATCH_CHUNK : range->end;
+    return true;
+}
+
+static void batch_run(struct batch *batch, int id) {
+    int start, end;
+    for (int i = 0; i < batch->nranges; i++) {
+        // Start with own range, then steal from the others.
+        struct batch_range *range = &batch->ranges[(id+i)%batch->nranges];
+        while (batch_claim(range, &start, &end)) {
+            batch->work(batch, start, end);
+        }
+    }
+}
+
+static struct {
+    pthread_mutex_t lock;  // held by the calling thread for the whole batch
+    pthread_mutex_t mu;    // protects the fields below
+    pthread_cond_t cond;   // signals workers of a new batch
+    pthread_cond_t done;   // signals caller that workers are done
+    int nworkers;          // number of started workers
+    int nactive;           // number of workers still on the current batch
+    uint64_t gen;          // batch generation
+    struct batch *batch;   // current batch
+    uint64_t starts[BATCH_MAXTHREADS]; // generation when each worker started
+    bool atfork;           // pool_atfork_child is registered
+} pool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .mu = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER,
+};
+
+static void *pool_worker(void *arg) {
+    int id = (int)(intptr_t)arg;
+    pthread_mutex_lock(&pool.mu);
+    uint64_t gen = pool.starts[id];
+    while (1) {
+        while (pool.gen == gen) {
+            pthread_cond_wait(&pool.cond, &pool.mu);
+        }
+        gen = pool.gen;
+        struct batch *batch = pool.batch;
+        pthread_mutex_unlock(&pool.mu);
+        if (id < batch->nranges) {
+            tg_env_set_thread_allocator(batch->malloc, batch->realloc, 
+                batch->free);
+            batch_run(batch, id);
+        }
+        pthread_mutex_lock(&pool.mu);
+        pool.nactive--;
+        if (pool.nactive == 0) {
+            pthread_cond_signal(&pool.done);
+        }
+    }
+    return NULL;
+}
+
+// Only the thread that calls fork() exists in the child process, so the
+// child starts with an empty pool. Any batch that was running in the parent
+// is abandoned, along with the locks that its threads may have been holding.
+static void pool_atfork_child(void) {
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_mutex_init(&pool.mu, NULL);
+    pthread_cond_init(&pool.cond, NULL);
+    pthread_cond_init(&pool.done, NULL);
+    pool.nworkers = 0;
+    pool.nactive = 0;
+    pool.batch = NULL;
+}
+
+// Start workers until there are at least nthreads-1 of them. Returns the
+// number of threads available to a batch, including the calling thread.
+// Must be called while holding pool.lock.
+static int pool_grow(int nthreads) {
+    if (!pool.atfork) {
+        if (pthread_atfork(NULL, NULL, pool_atfork_child) != 0) {
+            return 1;
+        }
+        pool.atfork = true;
+    }
+    while (pool.nworkers < nthreads-1) {
+        pthread_t th;
+        // Worker ids start at 1. The calling thread is 0.
+        void *arg = (void*)(intptr_t)(pool.nworkers+1);
+        // Workers are only started between batches, so the worker must wait
+        // for the generation after the current one.
+        pool.starts[pool.nworkers+1] = pool.gen;
+        if (pthread_create(&th, NULL, pool_worker, arg) != 0) {
+            break;
+        }
+        pthread_detach(th);
+        pool.nworkers++;
+    }
+    return nthreads < pool.nworkers+1 ? nthreads : pool.nworkers+1;
+}
+
+static int batch_nthreads(void) {
+    int nthreads = batch_threads;
+    if (nthreads == 0) {
+        long nprocs = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = nprocs < 1 ? 1 : nprocs > BATCH_MAXTHREADS ? 
+            BATCH_MAXTHREADS : (int)nprocs;
+    }
+    return nthreads;
+}
+
+#endif
+
+static void batch_exec(struct batch *batch, int n, int min) {
+    if (n <= 0) {
+        return;
+    }
+#ifdef TG_THREADS
+    int nthreads = n < min ? 1 : batch_nthreads();
+    if (nthreads > 1) {
+        if (pthread_mutex_trylock(&pool.lock) != 0) {
+            // The pool is busy with another batch, which may be the one that
+            // is calling this batch.
+            batch->work(batch, 0, n);
+            return;
+        }
+        nthreads = pool_grow(nthreads);
+        if (nthreads == 1) {
+            pthread_mutex_unlock(&pool.lock);
+        }
+    }
+    if (nthreads == 1) {
+        batch->work(batch, 0, n);
+        return;
+    }
+    batch->nranges = nthreads;
+    for (int i = 0; i < nthreads; i++) {
+        atomic_init(&batch->ranges[i].next, (int)((int64_t)n*i/nthreads));
+        batch->ranges[i].end = (int)((int64_t)n*(i+1)/nthreads);
+    }
+    batch->malloc = _tl_malloc;
+    batch->realloc = _tl_realloc;
+    batch->free = _tl_free;
+    pthread_mutex_lock(&pool.mu);
+    pool.batch = batch;
+    pool.nactive = pool.nworkers;
+    pool.gen++;
+    pthread_cond_broadcast(&pool.cond);
+    pthread_mutex_unlock(&pool.mu);
+    batch_run(batch, 0);
+    pthread_mutex_lock(&pool.mu);
+    while (pool.nactive > 0) {
+        pthread_cond_wait(&pool.done, &pool.mu);
+    }
+    pool.batch = NULL;
+    pthread_mutex_unlock(&pool.mu);
+    pthread_mutex_unlock(&pool.lock);
+#else
+    (void)min;
+    batch->work(batch, 0, n);
+#endif
+}
+
+static void batch_covers_xy(struct batch *batch, int start, int end) {
+    const struct tg_point *points = batch->items;
+    for (int i = start; i < end; i++) {
+        batch->results[i] = tg_geom_covers_xy(batch->geom, points[i].x, 
+            points[i].y);
+    }
+}
+
+static void batch_intersects(struct batch *batch, int start, int end) {
+    const struct tg_geom *const *geoms = batch->items;
+    for (int i = start; i < end; i++) {
+        batch->results[i] = tg_geom_intersects(batch->geom, geoms[i]);
+    }
+}
+
+/// Tests whether a geometry covers each point in an array.
+///
+/// This is the same as calling tg_geom_covers_xy() for each point, except
+/// that large arrays are spread over multiple threads.
+/// @param geom Input geometry
+/// @param points Array of points
+/// @param npoints Number of points in array
+/// @param results Array of at least npoints, receives the result for each
+/// point.
+/// @note The input geometry is only read and may be shared by other threads
+/// at the same time.
+/// @see tg_env_set_batch_threads()
+/// @see GeometryBatch
+void tg_batch_covers_xy(const struct tg_geom *geom, 
+    const struct tg_point *points, int npoints, bool *results)
+{
+    if (!points || !results) {
+        return;
+    }
+    struct batch batch = {
+        .work = batch_covers_xy,
+        .geom = geom,
+        .items = points,
+        .results = results,
+    };
+    batch_exec(&batch, npoints, BATCH_MINPOINTS);
+}
+
+/// Tests whether a geometry intersects each geometry in an array.
+///
+/// This is the same as calling tg_geom_intersects() for each geometry, except
+/// that large arrays are spread over multiple threads.
+/// @param geom Input geometry
+/// @param geoms Array of geometries
+/// @param ngeoms Number of geometries in array
+/// @param results Array of at least ngeoms, receives the result for each
+/// geometry.
+/// @see tg_env_set_batch_threads()
+/// @see GeometryBatch
+void tg_batch_intersects(const struct tg_geom *geom, 
+    const struct tg_geom *const geoms[], int ngeoms, bool *results)
+{
+    if (!geoms || !results) {
+        return;
+    }
+    struct batch batch = {
+        .work = batch_intersects,
+        .geom = geom,
+        .items = geoms,
+        .results = results,
+    };
+    batch_exec(&batch, ngeoms, BATCH_MINGEOMS);
+}
+
+// Spatial joins walk the indexes of both collections together and collect
+// the pairs of children whose rects intersect. The pairs are refined by the
+// predicate on the batch threads, a block at a time, and the results are 
+// passed to the caller on the calling thread.
+
+#define JOIN_MAXPAIRS 65536 // pairs in a block
+
+struct join_pair {
+    int a;
+    int b;
+};
+
+struct join_side {
+    const struct tg_geom *const *geoms;
+    int ngeoms;
+    const struct index *index; // NULL if not indexed
+    const int *ixgeoms;        // NULL if not indexed
+};
+
+struct join_ctx {
+    struct join_side a;
+    struct join_side b;
+    bool (*pred)(const struct tg_geom *a, const struct tg_geom *b);
+    bool (*iter)(int aindex, int bindex, void *udata);
+    void *udata;
+    struct join_pair *pairs;
+    bool *results;
+    int npairs;
+    int cap;
+    bool stop;  // stopped by the caller
+    bool oom;
+};
+
+static void join_side_init(struct join_side *side, 
+    const struct tg_geom *const *geom)
+{
+    const struct multi *multi = geom_multi(*geom);
+    if (multi) {
+        side->geoms = (const struct tg_geom *const *)multi->geoms;
+        side->ngeoms = multi->ngeoms;
+        side->index = multi->index;
+        side->ixgeoms = multi->ixgeoms;
+    } else {
+        // a geometry that is not a collection is the only child
+        side->geoms = geom;
+        side->ngeoms = *geom ? 1 : 0;
+        side->index = NULL;
+        side->ixgeoms = NULL;
+    }
+}
+
+static int join_nlevels(const struct join_side *side) {
+    return side->index ? side->index->nlevels : 0;
+}
+
+// Returns the number of nodes at a level. The level after the last level of
+// the index is the children.
+static int join_count(const struct join_side *side, int lvl) {
+    return lvl == join_nlevels(side) ? side->ngeoms : 
+        side->index->levels[lvl].nrects;
+}
+
+static int join_child(const struct join_side *side, int i) {
+    return side->ixgeoms ? side->ixgeoms[i] : i;
+}
+
+static struct tg_rect join_rect(const struct join_side *side, int lvl, int i) {
+    struct tg_rect rect;
+    if (lvl == join_nlevels(side)) {
+        rect = tg_geom_rect(side->geoms[join_child(side, i)]);
+    } else {
+        ixrect_to_tg_rect(&side->index->levels[lvl].rects[i], &rect);
+    }
+    return rect;
+}
+
+static void batch_join(struct batch *batch, int start, int end) {
+    const struct join_pair *pairs = batch->items;
+    for (int i = start; i < end; i++) {
+        batch->results[i] = batch->pred(batch->ageoms[pairs[i].a], 
+            batch->bgeoms[pairs[i].b]);
+    }
+}
+
+// Refines the pairs in the block and passes the results to the caller.
+static bool join_flush(struct join_ctx *ctx) {
+    if (ctx->pred) {
+        struct batch batch = {
+            .work = batch_join,
+            .pred = ctx->pred,
+            .ageoms = ctx->a.geoms,
+            .bgeoms = ctx->b.geoms,
+            .items = ctx->pairs,
+            .results = ctx->results,
+        };
+        batch_exec(&batch, ctx->npairs, BATCH_MINGEOMS);
+    }
+    for (int i = 0; i < ctx->npairs; i++) {
+        if ((!ctx->pred || ctx->results[i]) && 
+            !ctx->iter(ctx->pairs[i].a, ctx->pairs[i].b, ctx->udata))
+        {
+            ctx->stop = true;
+            return false;
+        }
+    }
+    ctx->npairs = 0;
+    return true;
+}
+
+static bool join_push(struct join_ctx *ctx, int a, int b) {
+    if (ctx->npairs == ctx->cap) {
+        if (ctx->cap == JOIN_MAXPAIRS) {
+            if (!join_flush(ctx)) {
+                return false;
+            }
+        } else {
+            int cap = ctx->cap == 0 ? 256 : ctx->cap*2;
+            struct join_pair *pairs = tg_realloc(ctx->pairs, 
+                cap*sizeof(struct join_pair));
+            if (!pairs) {
+                ctx->oom = true;
+                return false;
+            }
+            ctx->pairs = pairs;
+            bool *results = tg_realloc(ctx->results, cap*sizeof(bool));
+            if (!results) {
+                ctx->oom = true;
+                return false;
+            }
+            ctx->results = results;
+            ctx->cap = cap;
+        }
+    }
+    ctx->pairs[ctx->npairs].a = a;
+    ctx->pairs[ctx->npairs].b = b;
+    ctx->npairs++;
+    return true;
+}
+
+static bool join_nodes(struct join_ctx *ctx, int la, int i, int lb, int j);
+
+// Joins each node of range A with each node of range B.
+static bool join_ranges(struct join_ctx *ctx, int la, int as, int ae, int lb, 
+    int bs, int be)
+{
+    // the rects of B are loaded once for every node of A
+    struct tg_rect brects[64];
+    for (int b0 = bs; b0 < be; b0 += 64) {
+        int b1 = b0+64 < be ? b0+64 : be;
+        for (int j = b0; j < b1; j++) {
+            brects[j-b0] = join_rect(&ctx->b, lb, j);
+        }
+        stats_add(index_nodes, (ae-as)+(b1-b0));
+        for (int i = as; i < ae; i++) {
+            struct tg_rect arect = join_rect(&ctx->a, la, i);
+            for (int j = b0; j < b1; j++) {
+                if (tg_rect_intersects_rect(arect, brects[j-b0]) && 
+                    !join_nodes(ctx, la, i, lb, j))
+                {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// Joins two nodes whose rects intersect. Both nodes are split into their
+// children until both are children of the collections.
+static bool join_nodes(struct join_ctx *ctx, int la, int i, int lb, int j) {
+    bool aleaf = la == join_nlevels(&ctx->a);
+    bool bleaf = lb == join_nlevels(&ctx->b);
+    if (aleaf && bleaf) {
+        return join_push(ctx, join_child(&ctx->a, i), join_child(&ctx->b, j));
+    }
+    int as = i, ae = i+1, bs = j, be = j+1;
+    if (!aleaf) {
+        int spread = ctx->a.index->spread;
+        la++;
+        as = i*spread;
+        ae = as+spread < join_count(&ctx->a, la) ? as+spread : 
+            join_count(&ctx->a, la);
+    }
+    if (!bleaf) {
+        int spread = ctx->b.index->spread;
+        lb++;
+        bs = j*spread;
+        be = bs+spread < join_count(&ctx->b, lb) ? bs+spread : 
+            join_count(&ctx->b, lb);
+    }
+    return join_ranges(ctx, la, as, ae, lb, bs, be);
+}
+
+/// Finds every pair of children of two collections that satisfy a predicate.
+///
+/// The collections, such as GeoJSON FeatureCollections or the snapshots of
+/// geometry sets, are joined by walking both of their indexes together. 
+/// The pairs of children whose rects intersect are then tested with the 
+/// predicate, spreading the work over multiple threads. A geometry that is
+/// not a collection is joined as a collection of one.
+/// @param a Input collection
+/// @param b Input collection
+/// @param pred Predicate, such as tg_geom_intersects() or tg_geom_covers(),
+/// that is called with a child of 'a' and a child of 'b'. It must only be 
+/// true for geometries that intersect. Use NULL to report every pair whose
+/// rects intersect.
+/// @param iter Callback that receives the index of the child in 'a' and in
+/// 'b' for each pair, in no particular order. Caller must return true to 
+/// continue to the next pair, or return false to stop.
+/// @param udata User-defined data
+/// @return True if operation succeeded, false if out of memory.
+/// @note The predicate may be called by many threads at once. The callback
+/// is only called by the calling thread.
+/// @note When out of memory, some pairs may have already been passed to the
+/// callback.
+/// @see tg_env_set_batch_threads()
+/// @see GeometryBatch
+bool tg_join(const struct tg_geom *a, const struct tg_geom *b, 
+    bool (*pred)(const struct tg_geom *a, const struct tg_geom *b),
+    bool (*iter)(int aindex, int bindex, void *udata), void *udata)
+{
+    if (!a || !b || !iter || 
+        !tg_rect_intersects_rect(tg_geom_rect(a), tg_geom_rect(b)))
+    {
+        return true;
+    }
+    struct join_ctx ctx = { .pred = pred, .iter = iter, .udata = udata };
+    join_side_init(&ctx.a, &a);
+    join_side_init(&ctx.b, &b);
+    if (join_ranges(&ctx, 0, 0, join_count(&ctx.a, 0), 0, 0, 
+        join_count(&ctx.b, 0)))
+    {
+        join_flush(&ctx);
+    }
+    tg_free(ctx.results);
+    tg_free(ctx.pairs);
+    return !ctx.oom;
+}
+
+////////////////////
+// Geometry sets
+////////////////////
+
+// A geometry set is written by one thread and read by many. Each published
+// snapshot is an immutable GeometryCollection, so its packed index is shared
+// by all readers and is searched with tg_geom_search(). The member
+// geometries are shared between snapshots by reference.
+//
+// Readers never block. A reader briefly occupies a slot with the epoch at
+// which it started, loads the current snapshot, and takes its own reference.
+// The writer retires a replaced snapshot with the epoch at which it was
+// replaced, and only releases it once no reader slot holds that epoch or
+// an older one. When all slots are taken, a reader counts itself in the
+// overflow counter instead, and the writer releases nothing while that
+// counter is not zero.
+
+#define SET_NSLOTS 64
+
+struct set_slot {
+    au64_t epoch;    // epoch of the reader using this slot, or zero if idle
+    char pad[56];    // keep each slot on its own cache line
+};
+
+struct set_retired {
+    struct tg_geom *snapshot;
+    uint64_t epoch;
+};
+
+/// A geometry set is a collection of geometries that is updated by one writer
+/// thread and searched by any number of reader threads.
+///
+/// **Creating**
+///
+/// To create a new set use the tg_geom_set_new() function.
+///
+/// ```
+/// struct tg_geom_set *set = tg_geom_set_new();
+/// ```
+///
+/// **Reading**
+///
+/// Readers use tg_geom_set_snapshot() to get an immutable 
+/// GeometryCollection of the last published state, which is a tg_geom that
+/// works with any tg_geom_&ast;() function.
+///
+/// @see GeometrySet
+struct tg_geom_set {
+    aptr(struct tg_geom) snapshot; // current snapshot
+    au64_t epoch;                  // current epoch
+    au64_t overflow;               // number of readers without a slot
+    struct set_slot slots[SET_NSLOTS];
+    // The fields below are only used by the writer.
+    struct tg_geom **geoms;
+    int ngeoms;
+    int cap;
+    struct set_retired *retired;
+    int nretired;
+    int rcap;
+};
+
+/// Creates an empty geometry set.
+/// @return A newly allocated geometry set
+/// @return NULL if out of memory
+/// @note The caller is responsible for freeing with tg_geom_set_free().
+/// @see GeometrySet
+struct tg_geom_set *tg_geom_set_new(void) {
+    struct tg_geom_set *set = tg_malloc(sizeof(struct tg_geom_set));
+    if (!set) {
+        return NULL;
+    }
+    memset(set, 0, sizeof(struct tg_geom_set));
+    struct tg_geom *snapshot = tg_geom_new_geometrycollection(NULL, 0);
+    if (!snapshot) {
+        tg_free(set);
+        return NULL;
+    }
+    au64_store(&set->epoch, 1);
+    aptr_store(&set->snapshot, snapshot);
+    return set;
+}
+
+/// Releases the memory associated with a geometry set.
+/// @param set Input geometry set
+/// @note Snapshots that were returned by tg_geom_set_snapshot() stay valid
+/// until they are freed.
+/// @warning There must be no readers using the set.
+/// @see GeometrySet
+void tg_geom_set_free(struct tg_geom_set *set) {
+    if (!set) {
+        return;
+    }
+    for (int i = 0; i < set->ngeoms; i++) {
+        tg_geom_free(set->geoms[i]);
+    }
+    for (int i = 0; i < set->nretired; i++) {
+        tg_geom_free(set->retired[i].snapshot);
+    }
+    tg_geom_free(aptr_load(&set->snapshot));
+    if (set->geoms) tg_free(set->geoms);
+    if (set->retired) tg_free(set->retired);
+    tg_free(set);
+}
+
+/// Returns the current snapshot of a geometry set.
+///
+/// The snapshot is a GeometryCollection that contains the geometries of the
+/// set at the time of the last tg_geom_set_publish(), and it does not change
+/// when the set is updated. Use tg_geom_search() to query it.
+///
+/// This function may be called from any number of threads at the same time,
+/// and it never blocks on the writer or on other readers. With more than 64
+/// readers at the same time, the writer may hold on to replaced snapshots
+/// until a later tg_geom_set_publish().
+/// @param set Input geometry set
+/// @return The current snapshot
+/// @note The caller is responsible for freeing with tg_geom_free().
+/// @see GeometrySet
+struct tg_geom *tg_geom_set_snapshot(struct tg_geom_set *set) {
+    if (!set) {
+        return NULL;
+    }
+    // Occupy an idle slot, starting with one that depends on the thread.
+    int local;
+    size_t start = ((uintptr_t)&local >> 12) % SET_NSLOTS;
+    struct set_slot *slot = NULL;
+    for (size_t i = 0; i < SET_NSLOTS; i++) {
+        struct set_slot *next = &set->slots[(start+i) % SET_NSLOTS];
+        uint64_t epoch = au64_load(&set->epoch);
+        if (au64_load(&next->epoch) == 0 && 
+            au64_cas(&next->epoch, 0, epoch))
+        {
+            slot = next;
+            break;
+        }
+    }
+    if (!slot) {
+        // All slots are taken. Hold off the writer with the overflow counter.
+        au64_fetch_add(&set->overflow, 1);
+    }
+    struct tg_geom *snapshot = tg_geom_clone(aptr_load(&set->snapshot));
+    if (slot) {
+        au64_store(&slot->epoch, 0);
+    } else {
+        au64_fetch_sub(&set->overflow, 1);
+    }
+    return snapshot;
+}
+
+/// Returns the number of geometries in a geometry set, including changes 
+/// that are not yet published.
+/// @param set Input geometry set
+/// @note Only for the writer thread.
+/// @see GeometrySet
+int tg_geom_set_count(const struct tg_geom_set *set) {
+    return set ? set->ngeoms : 0;
+}
+
+/// Puts a geometry into a geometry set.
+/// @param set Input geometry set
+/// @param index Index of the geometry to replace, or tg_geom_set_count() to
+/// add the geometry to the end of the set.
+/// @param geom Input geometry, caller retains ownership.
+/// @return True if the geometry was put into the set
+/// @return False if out of memory or the index is out of range
+/// @note Only for the writer thread. Changes are visible to readers after
+/// calling tg_geom_set_publish().
+/// @see GeometrySet
+bool tg_geom_set_put(struct tg_geom_set *set, int index, 
+    const struct tg_geom *geom)
+{
+    if (!set || !geom || index < 0 || index > set->ngeoms) {
+        return false;
+    }
+    if (index == set->ngeoms && set->ngeoms == set->cap) {
+        int cap = set->cap == 0 ? 16 : set->cap*2;
+        struct tg_geom **geoms = tg_realloc(set->geoms, 
+            cap*sizeof(struct tg_geom*));
+        if (!geoms) {
+            return false;
+        }
+        set->geoms = geoms;
+        set->cap = cap;
+    }
+    struct tg_geom *clone = tg_geom_clone(geom);
+    if (index == set->ngeoms) {
+        set->ngeoms++;
+    } else {
+        tg_geom_free(set->geoms[index]);
+    }
+    set->geoms[index] = clone;
+    return true;
+}
+
+/// Removes a geometry from a geometry set.
+///
+/// The last geometry in the set is moved into the index of the removed
+/// geometry.
+/// @param set Input geometry set
+/// @param index Index of the geometry to remove
+/// @return True if the geometry was removed
+/// @return False if the index is out of range
+/// @note Only for the writer thread. Changes are visible to readers after
+/// calling tg_geom_set_publish().
+/// @see GeometrySet
+bool tg_geom_set_remove(struct tg_geom_set *set, int index) {
+    if (!set || index < 0 || index >= set->ngeoms) {
+        return false;
+    }
+    tg_geom_free(set->geoms[index]);
+    set->geoms[index] = set->geoms[set->ngeoms-1];
+    set->ngeoms--;
+    return true;
+}
+
+// Release the retired snapshots that no reader may still be loading.
+static void set_reclaim(struct tg_geom_set *set) {
+    if (au64_load(&set->overflow) != 0) {
+        // A reader without a slot may be loading any of them.
+        return;
+    }
+    uint64_t oldest = UINT64_MAX;
+    for (int i = 0; i < SET_NSLOTS; i++) {
+        uint64_t epoch = au64_load(&set->slots[i].epoch);
+        if (epoch != 0 && epoch < oldest) {
+            oldest = epoch;
+        }
+    }
+    int n = 0;
+    for (int i = 0; i < set->nretired; i++) {
+        if (set->retired[i].epoch < oldest) {
+            tg_geom_free(set->retired[i].snapshot);
+        } else {
+            set->retired[n++] = set->retired[i];
+        }
+    }
+    set->nretired = n;
+}
+
+/// Publishes the changes of a geometry set to readers.
+///
+/// A new snapshot is created and atomically replaces the current one. 
+/// Readers that are holding an older snapshot are not affected.
+/// @param set Input geometry set
+/// @return True if the changes were published
+/// @return False if out of memory, in which case the current snapshot is 
+/// unchanged.
+/// @note Only for the writer thread.
+/// @see GeometrySet
+bool tg_geom_set_publish(struct tg_geom_set *set) {
+    if (!set) {
+        return false;
+    }
+    set_reclaim(set);
+    if (set->nretired == set->rcap) {
+        int rcap = set->rcap == 0 ? 4 : set->rcap*2;
+        struct set_retired *retired = tg_realloc(set->retired, 
+            rcap*sizeof(struct set_retired));
+        if (!retired) {
+            return false;
+        }
+        set->retired = retired;
+        set->rcap = rcap;
+    }
+    struct tg_geom *snapshot = tg_geom_new_geometrycollection(
+        (const struct tg_geom *const*)set->geoms, set->ngeoms);
+    if (!snapshot) {
+        return false;
+    }
+    // Only the writer stores the snapshot and epoch.
+    struct tg_geom *prev = aptr_load(&set->snapshot);
+    aptr_store(&set->snapshot, snapshot);
+    uint64_t epoch = au64_fetch_add(&set->epoch, 1);
+    set->retired[set->nretired++] = (struct set_retired){ prev, epoch };
+    set_reclaim(set);
+    return true;
+}
+
+////////////////////
+// Point-in-polygon trackers
+////////////////////
+
+// A tracker keeps the last query point, its result, and the distance from
+// that point to the nearest polygon boundary. Any point that is closer to
+// the last point than that distance cannot be on the other side of the 
+// boundary, so it has the same result.
+
+/// A point-in-polygon tracker tests a moving point against the same geometry.
+///
+/// **Creating**
+///
+/// To create a new tracker use the tg_pip_tracker_new() function.
+///
+/// ```
+/// struct tg_pip_tracker *tracker = tg_pip_tracker_new(geom);
+/// ```
+///
+/// A tracker is not thread-safe. Use one tracker for each moving point.
+///
+/// @see PipTracker
+struct tg_pip_tracker {
+    struct tg_geom *geom;   // cloned from the caller's geometry
+    struct tg_point point;  // last point that was tested
+    double safe;            // safe radius around the point, zero if none
+    bool hit;               // result of the last point
+};
+
+/// Creates a point-in-polygon tracker for a geometry.
+///
+/// A tracker is for testing a series of points that move a little at a 
+/// time, such as the positions of a vehicle, against the same geometry.
+/// @param geom Input geometry, which is cloned by the tracker
+/// @return A newly allocated tracker
+/// @return NULL if out of memory
+/// @note The caller is responsible for freeing with tg_pip_tracker_free().
+/// @see PipTracker
+struct tg_pip_tracker *tg_pip_tracker_new(const struct tg_geom *geom) {
+    struct tg_pip_tracker *tracker = tg_malloc(sizeof(struct tg_pip_tracker));
+    if (!tracker) {
+        return NULL;
+    }
+    memset(tracker, 0, sizeof(struct tg_pip_tracker));
+    tracker->geom = tg_geom_clone(geom);
+    if (geom && !tracker->geom) {
+        tg_free(tracker);
+        return NULL;
+    }
+    return tracker;
+}
+
+/// Releases the memory associated with a tracker.
+/// @param tracker Input tracker
+/// @see PipTracker
+void tg_pip_tracker_free(struct tg_pip_tracker *tracker) {
+    if (!tracker) {
+        return;
+    }
+    tg_geom_free(tracker->geom);
+    tg_free(tracker);
+}
+
+/// Clears the last point of a tracker, so that the next point is tested 
+/// against the geometry.
+/// @param tracker Input tracker
+/// @see PipTracker
+void tg_pip_tracker_reset(struct tg_pip_tracker *tracker) {
+    if (!tracker) {
+        return;
+    }
+    tracker->safe = 0;
+}
+
+/// Tests whether the geometry of a tracker intersects a point, which is the
+/// same as tg_geom_intersects_xy().
+///
+/// A point that is within the safe radius of the last tested point returns
+/// the last result without touching the geometry. Otherwise the point is 
+/// tested and, for a Polygon or MultiPolygon, the safe radius becomes the 
+/// distance from the point to the nearest polygon boundary.
+/// @param tracker Input tracker
+/// @param x X coordinate
+/// @param y Y coordinate
+/// @return True if the geometry intersects the point
+/// @note A tracker must not be used by more than one thread at a time.
+/// @see PipTracker
+bool tg_pip_tracker_intersects_xy(struct tg_pip_tracker *tracker, double x, 
+    double y)
+{
+    if (!tracker) {
+        return false;
+    }
+    if (tracker->safe > 0) {
+        double dx = x - tracker->point.x;
+        double dy = y - tracker->point.y;
+        if (dx*dx + dy*dy < tracker->safe*tracker->safe) {
+            return tracker->hit;
+        }
+    }
+    struct tg_point point = { x, y };
+    tracker->point = point;
+    double dist;
+    if (!geom_sdist(tracker->geom, point, &tracker->hit, &dist)) {
+        tracker->hit = tg_geom_intersects_xy(tracker->geom, x, y);
+        dist = 0;
+    }
+    // Shrink the radius a little so that the rounding of the distance does
+    // not allow a point that is on the boundary.
+    tracker->safe = dist*(1-1e-9);
+    return tracker->hit;
+}
+
+////////////////////
+// Locators
+////////////////////
+
+// A locator flattens the polygons of every feature into one array of 
+// entries, in hilbert order, and covers the bounds of all entries with a 
+// uniform grid. Each grid cell has the list of entries whose rects 
+// intersect the cell. The lists of all cells are packed into one array,
+// with cells[i] to cells[i+1] being the range of cell i.
+
+#define LOCATOR_MAXCELLS (1<<22) // maximum number of grid cells
+
+struct loc_entry {
+    struct tg_rect rect;
+    const struct tg_poly *poly;
+    int feature;               // index of the feature in the collection
+};
+
+/// A locator finds the features of a collection that contain a point.
+///
+/// **Creating**
+///
+/// To create a new locator use the tg_locator_new() function.
+///
+/// ```
+/// struct tg_locator *locator = tg_locator_new(geom);
+/// ```
+///
+/// A locator is immutable and may be searched by many threads at once.
+///
+/// @see Locator
+struct tg_locator {
+    struct tg_geom *geom;      // cloned from the caller's collection
+    struct loc_entry *entries; // polygons in hilbert order
+    int nentries;
+    struct tg_rect rect;       // bounds of all entries
+    int cols, rows;            // grid size
+    double sx, sy;             // grid cells per unit
+    int *cells;                // start of each cell in items, cols*rows+1
+    int *items;                // entry indexes of every cell
+};
+
+static int loc_col(const struct tg_locator *locator, double x) {
+    int col = (x - locator->rect.min.x) * locator->sx;
+    return col < 0 ? 0 : col >= locator->cols ? locator->cols-1 : col;
+}
+
+static int loc_row(const struct tg_locator *locator, double y) {
+    int row = (y - locator->rect.min.y) * locator->sy;
+    return row < 0 ? 0 : row >= locator->rows ? locator->rows-1 : row;
+}
+
+// Fills in the entries of the locator, which are not in order yet. Returns
+// false if out of memory.
+static bool loc_fill_entries(struct tg_locator *locator) {
+    // a geometry that is not a collection is the only feature
+    const struct multi *multi = geom_multi(locator->geom);
+    const struct tg_geom *const *features = multi ? 
+        (const struct tg_geom *const *)multi->geoms : 
+        (const struct tg_geom *const *)&locator->geom;
+    int nfeatures = multi ? multi->ngeoms : locator->geom ? 1 : 0;
+    int nentries = 0;
+    for (int i = 0; i < nfeatures; i++) {
+        const struct tg_geom *child = features[i];
+        nentries += tg_geom_poly(child) ? 1 : tg_geom_num_polys(child);
+    }
+    locator->entries = tg_malloc((nentries+1)*sizeof(struct loc_entry));
+    if (!locator->entries) {
+        return false;
+    }
+    for (int i = 0; i < nfeatures; i++) {
+        const struct tg_geom *child = features[i];
+        const struct tg_poly *single = tg_geom_poly(child);
+        int npolys = single ? 1 : tg_geom_num_polys(child);
+        for (int j = 0; j < npolys; j++) {
+            const struct tg_poly *poly = single ? single : 
+                tg_geom_poly_at(child, j);
+            if (tg_poly_empty(poly)) {
+                continue;
+            }
+            struct loc_entry *entry = &locator->entries[locator->nentries];
+            entry->rect = tg_poly_rect(poly);
+            entry->poly = poly;
+            entry->feature = i;
+            if (locator->nentries == 0) {
+                locator->rect = entry->rect;
+            } else {
+                locator->rect = tg_rect_expand(locator->rect, entry->rect);
+            }
+            locator->nentries++;
+        }
+    }
+    return true;
+}
+
+// Puts the entries into hilbert order. Returns false if out of memory.
+static bool loc_order_entries(struct tg_locator *locator) {
+    int n = locator->nentries;
+    struct hildex *hildexes = tg_malloc(n*sizeof(struct hildex));
+    struct loc_entry *entries = tg_malloc(n*sizeof(struct loc_entry));
+    if (!hildexes || !entries) {
+        tg_free(hildexes);
+        tg_free(entries);
+        return false;
+    }
+    struct tg_rect rect = locator->rect;
+    double w = rect.max.x - rect.min.x;
+    double h = rect.max.y - rect.min.y;
+    for (int i = 0; i < n; i++) {
+        struct tg_point center = tg_rect_center(locator->entries[i].rect);
+        uint32_t ix = w > 0 ? (center.x-rect.min.x)/w*0xFFFF : 0;
+        uint32_t iy = h > 0 ? (center.y-rect.min.y)/h*0xFFFF : 0;
+        hildexes[i].hilbert = hilbert_xy_to_index(ix, iy);
+        hildexes[i].index = i;
+    }
+    qsort(hildexes, n, sizeof(struct hildex), hilsort);
+    for (int i = 0; i < n; i++) {
+        entries[i] = locator->entries[hildexes[i].index];
+    }
+    tg_free(hildexes);
+    tg_free(locator->entries);
+    locator->entries = entries;
+    return true;
+}
+
+// Builds the grid with about one cell for each entry. Returns false if out
+// of memory.
+static bool loc_fill_grid(struct tg_locator *locator) {
+    int n = locator->nentries;
+    struct tg_rect rect = locator->rect;
+    double w = rect.max.x - rect.min.x;
+    double h = rect.max.y - rect.min.y;
+    double ncells = n < LOCATOR_MAXCELLS ? n : LOCATOR_MAXCELLS;
+    double cols = 1, rows = 1;
+    if (w > 0 && h > 0) {
+        cols = ceil(sqrt(ncells*w/h));
+        rows = ceil(ncells/cols);
+    } else if (w > 0) {
+        cols = ncells;
+    } else if (h > 0) {
+        rows = ncells;
+    }
+    locator->cols = cols < 1 ? 1 : cols > LOCATOR_MAXCELLS ? 
+        LOCATOR_MAXCELLS : cols;
+    locator->rows = rows < 1 ? 1 : rows > LOCATOR_MAXCELLS/locator->cols ? 
+        LOCATOR_MAXCELLS/locator->cols : rows;
+    locator->sx = w > 0 ? locator->cols / w : 0;
+    locator->sy = h > 0 ? locator->rows / h : 0;
+    int total = locator->cols*locator->rows;
+    locator->cells = tg_malloc((total+1)*sizeof(int));
+    if (!locator->cells) {
+        return false;
+    }
+    memset(locator->cells, 0, (total+1)*sizeof(int));
+    // count the entries of each cell, then turn the counts into the cell
+    // starts.
+    size_t nitems = 0;
+    for (int i = 0; i < n; i++) {
+        struct tg_rect erect = locator->entries[i].rect;
+        int c0 = loc_col(locator, erect.min.x);
+        int c1 = loc_col(locator, erect.max.x);
+        int r0 = loc_row(locator, erect.min.y);
+        int r1 = loc_row(locator, erect.max.y);
+        for (int r = r0; r <= r1; r++) {
+            for (int c = c0; c <= c1; c++) {
+                locator->cells[r*locator->cols+c+1]++;
+            }
+        }
+        nitems += (size_t)(c1-c0+1)*(r1-r0+1);
+        if (nitems > INT_MAX) {
+            return false;
+        }
+    }
+    for (int i = 0; i < total; i++) {
+        locator->cells[i+1] += locator->cells[i];
+    }
+    locator->items = tg_malloc((nitems+1)*sizeof(int));
+    int *next = tg_malloc((total+1)*sizeof(int));
+    if (!locator->items || !next) {
+        tg_free(next);
+        return false;
+    }
+    memcpy(next, locator->cells, (total+1)*sizeof(int));
+    for (int i = 0; i < n; i++) {
+        struct tg_rect erect = locator->entries[i].rect;
+        int c0 = loc_col(locator, erect.min.x);
+        int c1 = loc_col(locator, erect.max.x);
+        int r0 = loc_row(locator, erect.min.y);
+        int r1 = loc_row(locator, erect.max.y);
+        for (int r = r0; r <= r1; r++) {
+            for (int c = c0; c <= c1; c++) {
+                locator->items[next[r*locator->cols+c]++] = i;
+            }
+        }
+    }
+    tg_free(next);
+    return true;
+}
+
+/// Creates a locator for finding the features that contain a point.
+///
+/// The input is a collection, such as a GeoJSON FeatureCollection, a 
+/// GeometryCollection, or a MultiPolygon. Only the Polygon and MultiPolygon
+/// features are located, and each one is found by its index in the 
+/// collection. The polygons of a MultiPolygon input are each a feature, and
+/// a single Polygon input is feature zero. Point-in-polygon tests use the 
+/// index of each polygon, so a collection that is created with TG_YSTRIPES
+/// is usually the fastest.
+/// @param geom Input collection, which is cloned by the locator
+/// @return A newly allocated locator
+/// @return NULL if out of memory
+/// @note The caller is responsible for freeing with tg_locator_free().
+/// @see Locator
+struct tg_locator *tg_locator_new(const struct tg_geom *geom) {
+    struct tg_locator *locator = tg_malloc(sizeof(struct tg_locator));
+    if (!locator) {
+        return NULL;
+    }
+    memset(locator, 0, sizeof(struct tg_locator));
+    locator->geom = tg_geom_clone(geom);
+    if ((geom && !locator->geom) || !loc_fill_entries(locator) || 
+        !loc_order_entries(locator) || !loc_fill_grid(locator))
+    {
+        tg_locator_free(locator);
+        return NULL;
+    }
+    return locator;
+}
+
+/// Releases the memory associated with a locator.
+/// @param locator Input locator
+/// @see Locator
+void tg_locator_free(struct tg_locator *locator) {
+    if (!locator) {
+        return;
+    }
+    tg_free(locator->items);
+    tg_free(locator->cells);
+    tg_free(locator->entries);
+    tg_geom_free(locator->geom);
+    tg_free(locator);
+}
+
+/// Finds the features that contain a point.
+///
+/// A point on the boundary of a feature is contained by it, which is the 
+/// same as tg_geom_covers_xy().
+/// @param locator Input locator
+/// @param x X coordinate
+/// @param y Y coordinate
+/// @param indexes Array that receives the index of each feature that 
+/// contains the point, in no particular order. May be NULL when max is zero.
+/// @param max Maximum number of indexes to find. Use 1 to stop at the first
+/// feature.
+/// @return The number of indexes in the array.
+/// @note A locator can be used by many threads at once.
+/// @see Locator
+int tg_locator_find_xy(const struct tg_locator *locator, double x, double y,
+    int *indexes, int max)
+{
+    if (!locator || locator->nentries == 0 || max <= 0 || !indexes) {
+        return 0;
+    }
+    struct tg_rect rect = locator->rect;
+    if (x < rect.min.x || x > rect.max.x || y < rect.min.y || y > rect.max.y) {
+        return 0;
+    }
+    int cell = loc_row(locator, y)*locator->cols + loc_col(locator, x);
+    int s = locator->cells[cell];
+    int e = locator->cells[cell+1];
+    stats_add(index_nodes, e-s);
+    int count = 0;
+    for (int i = s; i < e; i++) {
+        const struct loc_entry *entry = &locator->entries[locator->items[i]];
+        if (x < entry->rect.min.x || x > entry->rect.max.x || 
+            y < entry->rect.min.y || y > entry->rect.max.y)
+        {
+            continue;
+        }
+        bool found = false;
+        for (int j = 0; j < count && !found; j++) {
+            // another part of the same feature
+            found = indexes[j] == entry->feature;
+        }
+        if (found || !tg_poly_covers_xy(entry->poly, x, y)) {
+            continue;
+        }
+        indexes[count++] = entry->feature;
+        if (count == max) {
+            break;
+        }
+    }
+    return count;
+}
+
+static void batch_locate(struct batch *batch, int start, int end) {
+    const struct tg_point *points = batch->items;
+    for (int i = start; i < end; i++) {
+        int index;
+        if (tg_locator_find_xy(batch->locator, points[i].x, points[i].y, 
+            &index, 1) == 0)
+        {
+            index = -1;
+        }
+        batch->indexes[i] = index;
+    }
+}
+
+/// Finds a feature that contains each point in an array.
+///
+/// This is the same as calling tg_locator_find_xy() with a max of one for
+/// each point, except that large arrays are spread over multiple threads.
+/// @param locator Input locator
+/// @param points Array of points
+/// @param npoints Number of points in array
+/// @param indexes Array of at least npoints, receives the index of a 
+/// feature that contains each point, or -1 if there is none.
+/// @see tg_env_set_batch_threads()
+/// @see Locator
+void tg_locator_find_points(const struct tg_locator *locator, 
+    const struct tg_point *points, int npoints, int *indexes)
+{
+    if (!points || !indexes) {
+        return;
+    }
+    struct batch batch = {
+        .work = batch_locate,
+        .locator = locator,
+        .items = points,
+        .indexes = indexes,
+    };
+    batch_exec(&batch, npoints, BATCH_MINPOINTS);
+}
+
+////////////////////
+// Slow operations
+////////////////////
+
+#include <time.h>
+
+static int slow_op_ring_points(const struct tg_ring *ring) {
+    return ring ? ring->npoints : 0;
+}
+
+static int slow_op_poly_points(const struct tg_poly *poly) {
+    if (!poly) return 0;
+    int n = slow_op_ring_points(tg_poly_exterior(poly));
+    int nholes = tg_poly_num_holes(poly);
+    for (int i = 0; i < nholes; i++) {
+        n += slow_op_ring_points(tg_poly_hole_at(poly, i));
+    }
+    return n;
+}
+
+// Returns the total number of vertices in a geometry.
+static int slow_op_points(const struct tg_geom *geom) {
+    if (!geom) return 0;
+    switch (geom->head.base) {
+    case BASE_POINT:
+        return 1;
+    case BASE_LINE:
+    case BASE_RING:
+        return slow_op_ring_points((struct tg_ring*)geom);
+    case BASE_POLY:
+        return slow_op_poly_points((struct tg_poly*)geom);
+    case BASE_GEOM:
+        if ((geom->head.flags&IS_ERROR) == IS_ERROR) {
+            return 0;
+        }
+        switch (geom->head.type) {
+        case TG_POINT:
+            return 1;
+        case TG_LINESTRING:
+            return slow_op_ring_points((struct tg_ring*)geom->line);
+        case TG_POLYGON:
+            return slow_op_poly_points(geom->poly);
+        default:
+            if (geom->multi) {
+                int n = 0;
+                for (int i = 0; i < geom->multi->ngeoms; i++) {
+                    n += slow_op_points(geom->multi->geoms[i]);
+                }
+                return n;
+            }
+        }
+    }
+    return 0;
+}
+
+static uint64_t slow_op_now(void) {
+#if defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec*1000000000 + (uint64_t)ts.tv_nsec;
+#elif defined(TIME_UTC)
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (uint64_t)ts.tv_sec*1000000000 + (uint64_t)ts.tv_nsec;
+#else
+    return (uint64_t)((double)clock()/CLOCKS_PER_SEC*1e9);
+#endif
+}
+
+static uint64_t slow_op_enter(void) {
+    if (tl_slow_op_depth++ > 0) {
+        // nested inside of another operation
+        return 1;
+    }
+    if (++tl_slow_op_calls < SLOW_OP_SAMPLE) {
+        return 1;
+    }
+    tl_slow_op_calls = 0;
+    uint64_t now = slow_op_now();
+    return now > 1 ? now : 2;
+}
+
+static void slow_op_leave(uint64_t start, enum tg_op_kind kind, 
+    const struct tg_geom *a, const struct tg_geom *b, size_t len)
+{
+    tl_slow_op_depth--;
+    if (start == 1) {
+        return;
+    }
+    uint64_t elapsed = slow_op_now()-start;
+    void (*hook)(const struct tg_slow_op *op, void *udata) = slow_op_hook;
+    if (!hook || elapsed < slow_op_threshold) {
+        return;
+    }
+    struct tg_slow_op op = {
+        .kind = kind,
+        .a_type = tg_geom_typeof(a),
+        .b_type = tg_geom_typeof(b),
+        .a_points = slow_op_points(a),
+        .b_points = slow_op_points(b),
+        .len = len,
+        .elapsed_ns = elapsed,
+    };
+    hook(&op, slow_op_udata);
+}
+
+/// Set a hook that is called for predicates, parsing, and writing that take 
+/// longer than a threshold.
+///
+/// Only one in every 64 top-level calls on each thread is timed, so the hook
+/// sees a sample of the slow operations rather than every one of them. 
+/// Operations that are called internally by another operation are never 
+/// timed or reported on their own. The hook is called on the thread that 
+/// performed the operation, after the operation completes.
+///
+/// @param threshold_ns Minimum duration, in nanoseconds, of a reported 
+/// operation. Use zero to report every sampled operation.
+/// @param hook The function to call, or NULL to remove the hook.
+/// @param udata User data that is passed to the hook.
+/// @note The sample rate can be changed by providing SLOW_OP_SAMPLE to the
+/// compiler.
+/// @see tg_slow_op
+/// @see GlobalFuncs
+void tg_env_set_slow_op_hook(uint64_t threshold_ns, 
+    void (*hook)(const struct tg_slow_op *op, void *udata), void *udata)
+{
+    slow_op_threshold = threshold_ns;
+    slow_op_udata = udata;
+    slow_op_hook = hook;
+}
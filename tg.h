@@ -39,6 +39,9 @@ struct tg_line;  ///< Find the description in the tg.c file.
 struct tg_ring;  ///< Find the description in the tg.c file.
 struct tg_poly;  ///< Find the description in the tg.c file.
 struct tg_geom;  ///< Find the description in the tg.c file.
+struct tg_geom_set;  ///< Find the description in the tg.c file.
+struct tg_pip_tracker;  ///< Find the description in the tg.c file.
+struct tg_locator;  ///< Find the description in the tg.c file.
 
 /// Geometry types.
 ///
@@ -72,6 +75,98 @@ enum tg_index {
     TG_YSTRIPES, ///< indexing using segment striping, rings only
 };
 
+/// Per-call options for creating geometries.
+///
+/// Zero-initialized fields fall back to the thread or global defaults.
+/// @see tg_ring_new_opts()
+/// @see tg_line_new_opts()
+/// @see tg_parse_opts()
+struct tg_options {
+    enum tg_index index; ///< indexing option, e.g. TG_NATURAL, TG_YSTRIPES
+    int spread;          ///< index spread, 2 to 4096, or zero for default
+    bool lazy;           ///< defer building TG_YSTRIPES until first use
+};
+
+/// Traversal and allocation counters for the calling thread.
+///
+/// The counters are only updated when TG is compiled with TG_STATS defined.
+/// @see tg_stats_get()
+/// @see tg_stats_reset()
+struct tg_stats {
+    uint64_t index_nodes;    ///< index rectangles and collection entries visited
+    uint64_t segments;       ///< leaf segments evaluated
+    uint64_t segment_intersects; ///< tg_segment_intersects_segment() calls
+    uint64_t raycasts;       ///< point-in-polygon segment raycasts
+    uint64_t allocs;         ///< calls to malloc and realloc
+    uint64_t bytes;          ///< bytes requested from malloc and realloc
+};
+
+/// Operation kinds that are reported to the slow operation hook.
+/// @see tg_env_set_slow_op_hook()
+enum tg_op_kind {
+    TG_OP_EQUALS,          ///< tg_geom_equals()
+    TG_OP_INTERSECTS,      ///< tg_geom_intersects()
+    TG_OP_DISJOINT,        ///< tg_geom_disjoint()
+    TG_OP_CONTAINS,        ///< tg_geom_contains()
+    TG_OP_WITHIN,          ///< tg_geom_within()
+    TG_OP_COVERS,          ///< tg_geom_covers()
+    TG_OP_COVEREDBY,       ///< tg_geom_coveredby()
+    TG_OP_TOUCHES,         ///< tg_geom_touches()
+    TG_OP_CROSSES,         ///< tg_geom_crosses()
+    TG_OP_OVERLAPS,        ///< tg_geom_overlaps()
+    TG_OP_INTERSECTS_RECT, ///< tg_geom_intersects_rect()
+    TG_OP_INTERSECTS_XY,   ///< tg_geom_intersects_xy()
+    TG_OP_SIGNED_DISTANCE, ///< tg_geom_signed_distance()
+    TG_OP_PARSE_GEOJSON,   ///< tg_parse_geojson() and variants
+    TG_OP_PARSE_WKT,       ///< tg_parse_wkt() and variants
+    TG_OP_PARSE_WKB,       ///< tg_parse_wkb() and variants
+    TG_OP_PARSE_HEX,       ///< tg_parse_hex() and variants
+    TG_OP_PARSE_GEOBIN,    ///< tg_parse_geobin() and variants
+    TG_OP_WRITE_GEOJSON,   ///< tg_geom_geojson()
+    TG_OP_WRITE_WKT,       ///< tg_geom_wkt()
+    TG_OP_WRITE_WKB,       ///< tg_geom_wkb()
+    TG_OP_WRITE_HEX,       ///< tg_geom_hex()
+    TG_OP_WRITE_GEOBIN,    ///< tg_geom_geobin()
+};
+
+/// Details of a slow operation.
+///
+/// For predicates 'a' and 'b' are the two inputs. For parsing 'a' is the 
+/// resulting geometry and for writing 'a' is the input geometry.
+/// @see tg_env_set_slow_op_hook()
+struct tg_slow_op {
+    enum tg_op_kind kind;    ///< operation kind
+    enum tg_geom_type a_type;///< type of geometry 'a', or zero if none
+    enum tg_geom_type b_type;///< type of geometry 'b', or zero if none
+    int a_points;            ///< number of vertices in geometry 'a'
+    int b_points;            ///< number of vertices in geometry 'b'
+    size_t len;              ///< number of bytes parsed or written
+    uint64_t elapsed_ns;     ///< duration of the operation
+};
+
+/// Index quality diagnostics for a ring.
+/// @see tg_ring_index_stats()
+struct tg_index_stats {
+    int nlevels;          ///< number of index levels, zero if none
+    int spread;           ///< index spread
+    int nleaves;          ///< number of rectangles in the last level
+    double leaf_segments; ///< average number of segments per leaf rectangle
+    int nstripes;         ///< number of ystripes, zero if none
+    int stripe_max;       ///< most segments in one ystripe
+    double stripe_avg;    ///< average segments per ystripe
+    int stripe_empty;     ///< number of ystripes without segments
+    double pip_cost;      ///< estimated tests per point-in-polygon operation
+};
+
+/// Index quality diagnostics for one level of a ring index.
+/// @see tg_ring_index_level_stats()
+struct tg_index_level_stats {
+    int nrects;           ///< number of rectangles
+    double area;          ///< total area of the rectangles
+    double overlap;       ///< ratio of area overlapped by sibling rectangles
+    double dead_space;    ///< ratio of area not covered by child rectangles
+};
+
 /// @defgroup GeometryConstructors Geometry constructors
 /// Functions for creating and freeing geometries. 
 /// @{
@@ -119,6 +214,7 @@ double tg_geom_m(const struct tg_geom *geom);
 const double *tg_geom_extra_coords(const struct tg_geom *geom);
 int tg_geom_num_extra_coords(const struct tg_geom *geom);
 size_t tg_geom_memsize(const struct tg_geom *geom);
+uint64_t tg_geom_hash(const struct tg_geom *geom);
 void tg_geom_search(const struct tg_geom *geom, struct tg_rect rect,
     bool (*iter)(const struct tg_geom *geom, int index, void *udata),
     void *udata);
@@ -136,8 +232,67 @@ bool tg_geom_within(const struct tg_geom *a, const struct tg_geom *b);
 bool tg_geom_covers(const struct tg_geom *a, const struct tg_geom *b);
 bool tg_geom_coveredby(const struct tg_geom *a, const struct tg_geom *b);
 bool tg_geom_touches(const struct tg_geom *a, const struct tg_geom *b);
+bool tg_geom_crosses(const struct tg_geom *a, const struct tg_geom *b);
+bool tg_geom_overlaps(const struct tg_geom *a, const struct tg_geom *b);
 bool tg_geom_intersects_rect(const struct tg_geom *a, struct tg_rect b);
 bool tg_geom_intersects_xy(const struct tg_geom *a, double x, double y);
+bool tg_geom_covers_xy(const struct tg_geom *a, double x, double y);
+double tg_geom_signed_distance(const struct tg_geom *geom, double x, double y);
+/// @}
+
+/// @defgroup GeometryOverlay Geometry overlay
+/// Functions for creating new polygonal geometries from the intersection,
+/// union, or difference of Polygon and MultiPolygon geometries.
+/// @{
+struct tg_geom *tg_geom_intersection(const struct tg_geom *a, const struct tg_geom *b);
+struct tg_geom *tg_geom_union(const struct tg_geom *a, const struct tg_geom *b);
+struct tg_geom *tg_geom_difference(const struct tg_geom *a, const struct tg_geom *b);
+struct tg_geom *tg_geom_cascaded_union(const struct tg_geom *geom);
+/// @}
+
+/// @defgroup GeometryBatch Geometry batch predicates
+/// Functions for testing one geometry against many points or geometries, or
+/// two collections against each other, spreading the work over multiple 
+/// threads.
+/// @{
+void tg_batch_covers_xy(const struct tg_geom *geom, const struct tg_point *points, int npoints, bool *results);
+void tg_batch_intersects(const struct tg_geom *geom, const struct tg_geom *const geoms[], int ngeoms, bool *results);
+bool tg_join(const struct tg_geom *a, const struct tg_geom *b, bool (*pred)(const struct tg_geom *a, const struct tg_geom *b), bool (*iter)(int aindex, int bindex, void *udata), void *udata);
+/// @}
+
+/// @defgroup GeometrySet Geometry sets
+/// Functions for a collection of geometries that is updated by one writer
+/// thread while any number of reader threads search immutable snapshots of
+/// it without locking.
+/// @{
+struct tg_geom_set *tg_geom_set_new(void);
+void tg_geom_set_free(struct tg_geom_set *set);
+struct tg_geom *tg_geom_set_snapshot(struct tg_geom_set *set);
+int tg_geom_set_count(const struct tg_geom_set *set);
+bool tg_geom_set_put(struct tg_geom_set *set, int index, const struct tg_geom *geom);
+bool tg_geom_set_remove(struct tg_geom_set *set, int index);
+bool tg_geom_set_publish(struct tg_geom_set *set);
+/// @}
+
+/// @defgroup PipTracker Point-in-polygon trackers
+/// Functions for testing a moving point against the same geometry, where a
+/// position that is near the last one is answered without touching the 
+/// geometry.
+/// @{
+struct tg_pip_tracker *tg_pip_tracker_new(const struct tg_geom *geom);
+void tg_pip_tracker_free(struct tg_pip_tracker *tracker);
+void tg_pip_tracker_reset(struct tg_pip_tracker *tracker);
+bool tg_pip_tracker_intersects_xy(struct tg_pip_tracker *tracker, double x, double y);
+/// @}
+
+/// @defgroup Locator Locators
+/// Functions for finding which features of a large collection contain a 
+/// point, such as for reverse geocoding.
+/// @{
+struct tg_locator *tg_locator_new(const struct tg_geom *geom);
+void tg_locator_free(struct tg_locator *locator);
+int tg_locator_find_xy(const struct tg_locator *locator, double x, double y, int *indexes, int max);
+void tg_locator_find_points(const struct tg_locator *locator, const struct tg_point *points, int npoints, int *indexes);
 /// @}
 
 /// @defgroup GeometryParsing Geometry parsing
@@ -162,6 +317,7 @@ struct tg_geom *tg_parse_geobin(const uint8_t *geobin, size_t len);
 struct tg_geom *tg_parse_geobin_ix(const uint8_t *geobin, size_t len,enum tg_index ix);
 struct tg_geom *tg_parse(const void *data, size_t len);
 struct tg_geom *tg_parse_ix(const void *data, size_t len, enum tg_index ix);
+struct tg_geom *tg_parse_opts(const void *data, size_t len, const struct tg_options *opts);
 const char *tg_geom_error(const struct tg_geom *geom);
 int tg_geobin_fullrect(const uint8_t *geobin, size_t len, double min[4], double max[4]);
 struct tg_rect tg_geobin_rect(const uint8_t *geobin, size_t len);
@@ -249,6 +405,7 @@ bool tg_rect_intersects_point(struct tg_rect a, struct tg_point b);
 /// @{
 struct tg_ring *tg_ring_new(const struct tg_point *points, int npoints);
 struct tg_ring *tg_ring_new_ix(const struct tg_point *points, int npoints, enum tg_index ix);
+struct tg_ring *tg_ring_new_opts(const struct tg_point *points, int npoints, const struct tg_options *opts);
 void tg_ring_free(struct tg_ring *ring);
 struct tg_ring *tg_ring_clone(const struct tg_ring *ring);
 struct tg_ring *tg_ring_copy(const struct tg_ring *ring);
@@ -265,6 +422,8 @@ int tg_ring_index_spread(const struct tg_ring *ring);
 int tg_ring_index_num_levels(const struct tg_ring *ring);
 int tg_ring_index_level_num_rects(const struct tg_ring *ring, int levelidx);
 struct tg_rect tg_ring_index_level_rect(const struct tg_ring *ring, int levelidx, int rectidx);
+bool tg_ring_index_stats(const struct tg_ring *ring, struct tg_index_stats *stats);
+bool tg_ring_index_level_stats(const struct tg_ring *ring, int levelidx, struct tg_index_level_stats *stats);
 bool tg_ring_nearest_segment(const struct tg_ring *ring, 
     double (*rect_dist)(struct tg_rect rect, int *more, void *udata),
     double (*seg_dist)(struct tg_segment seg, int *more, void *udata),
@@ -295,6 +454,7 @@ double tg_ring_perimeter(const struct tg_ring *ring);
 /// @{
 struct tg_line *tg_line_new(const struct tg_point *points, int npoints);
 struct tg_line *tg_line_new_ix(const struct tg_point *points, int npoints, enum tg_index ix);
+struct tg_line *tg_line_new_opts(const struct tg_point *points, int npoints, const struct tg_options *opts);
 void tg_line_free(struct tg_line *line);
 struct tg_line *tg_line_clone(const struct tg_line *line);
 struct tg_line *tg_line_copy(const struct tg_line *line);
@@ -348,11 +508,26 @@ bool tg_poly_clockwise(const struct tg_poly *poly);
 /// @defgroup GlobalFuncs Global environment
 /// Functions for optionally setting the behavior of the TG environment.
 /// These, if desired, should be called only once at program start up and prior
-/// to calling any other tg_*() functions.
+/// to calling any other tg_*() functions. The tg_env_set_thread_*() variants
+/// only affect the calling thread and may be called at any time.
 /// @{
 void tg_env_set_allocator(void *(*malloc)(size_t), void *(*realloc)(void*, size_t), void (*free)(void*));
 void tg_env_set_index(enum tg_index ix);
 void tg_env_set_index_spread(int spread);
+void tg_env_set_thread_allocator(void *(*malloc)(size_t), void *(*realloc)(void*, size_t), void (*free)(void*));
+void tg_env_set_thread_index(enum tg_index ix);
+void tg_env_set_thread_index_spread(int spread);
+void tg_env_set_batch_threads(int nthreads);
+void tg_env_set_slow_op_hook(uint64_t threshold_ns, void (*hook)(const struct tg_slow_op *op, void *udata), void *udata);
+/// @}
+
+/// @defgroup StatsFuncs Instrumentation
+/// Functions for reading the thread-local counters that are maintained when 
+/// TG is compiled with TG_STATS defined, such as `-DTG_STATS`. Without it, 
+/// the counters are always zero and there is no cost on any operation.
+/// @{
+void tg_stats_get(struct tg_stats *stats);
+void tg_stats_reset(void);
 /// @}
 
 